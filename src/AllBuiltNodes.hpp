@@ -15,6 +15,16 @@ struct NodeInputFileData
 
 static_assert(sizeof(NodeInputFileData) == 12, "struct layout");
 
+// Contents and timestamp of an output file of a node built with early cutoff.
+// A zero timestamp means the output couldn't be hashed.
+#pragma pack(push, 4)
+struct NodeOutputDigest
+{
+    uint64_t m_Timestamp;
+    HashDigest m_ContentDigest;
+};
+#pragma pack(pop)
+
 struct BuiltNode
 {
     uint32_t m_WasBuiltSuccessfully;
@@ -26,11 +36,14 @@ struct BuiltNode
     FrozenArray<NodeInputFileData> m_ImplicitInputFiles;
 
     FrozenArray<uint32_t> m_DagsWeHaveSeenThisNodeInPreviously;
+
+    // Parallel to the leading entries of m_OutputFiles; empty unless the node uses early cutoff.
+    FrozenArray<NodeOutputDigest> m_OutputDigests;
 };
 
 struct AllBuiltNodes
 {
-    static const uint32_t MagicNumber = 0xefa24bc1 ^ kTundraHashMagic;
+    static const uint32_t MagicNumber = 0xefa24bc2 ^ kTundraHashMagic;
 
     uint32_t m_MagicNumber;
 
@@ -39,6 +39,16 @@ inline uint64_t AtomicAdd(uint64_t *ptr, uint64_t value)
 #endif // TUNDRA_WIN32_MINGW
 }
 
+inline bool AtomicCompareAndSwap(uint32_t *ptr, uint32_t expected, uint32_t desired)
+{
+    return uint32_t(InterlockedCompareExchange((volatile LONG *)ptr, (LONG)desired, (LONG)expected)) == expected;
+}
+
+inline void AtomicFullBarrier()
+{
+    MemoryBarrier();
+}
+
 #elif defined(__GNUC__)
 inline uint32_t AtomicIncrement(uint32_t *value)
 {
@@ -54,6 +64,14 @@ inline uint64_t AtomicAdd(uint64_t *ptr, uint64_t value)
     return __sync_add_and_fetch(ptr, value);
 #endif
 }
+inline bool AtomicCompareAndSwap(uint32_t *ptr, uint32_t expected, uint32_t desired)
+{
+    return __sync_bool_compare_and_swap(ptr, expected, desired);
+}
+inline void AtomicFullBarrier()
+{
+    __sync_synchronize();
+}
 #endif // __GNUC__
 
 
@@ -86,3 +86,21 @@ struct FrozenFileAndHash
     FrozenString m_Filename;
     uint32_t m_FilenameHash;
 };
+
+namespace Frozen
+{
+// Header of a frozen file written block compressed. The data is cut into
+// blocks of m_BlockSize bytes, the last possibly shorter, each compressed on
+// its own with LZ4 so any one can be read without the others. The header is
+// followed by the file offsets of the blocks and of the end of the last one,
+// as uint64_t; a block that didn't shrink is stored as is.
+struct CompressedFileHeader
+{
+    static const uint32_t MagicNumber = 0x3a51c7d4 ^ kTundraHashMagic;
+
+    uint32_t m_MagicNumber;
+    uint32_t m_BlockSize;
+    uint64_t m_DataSize;
+};
+static_assert(sizeof(CompressedFileHeader) == 16, "struct layout");
+}
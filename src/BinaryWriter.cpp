@@ -1,6 +1,9 @@
 #include "BinaryWriter.hpp"
+#include "BinaryData.hpp"
+#include "Lz4.hpp"
 
 #include <cstdio>
+#include <algorithm>
 
 
 
@@ -71,6 +74,96 @@ void BinarySegmentWritePointer(BinarySegment *seg, BinaryLocator locator)
     BinarySegmentWriteUint32(seg, 0x7eeeeeee);
 }
 
+void BinarySegmentWriteAt(BinarySegment *seg, size_t offset, const void *data, size_t len)
+{
+    CHECK(offset + len <= seg->m_Bytes.m_Size);
+    memcpy(seg->m_Bytes.m_Storage + offset, data, len);
+}
+
+void BinarySegmentWritePointerAt(BinarySegment *seg, size_t offset, BinaryLocator locator)
+{
+    CHECK(offset + sizeof(int32_t) <= seg->m_Bytes.m_Size);
+
+    BinaryFixup *fixup = BufferAlloc(&seg->m_Fixups, seg->m_Heap, 1);
+    fixup->m_PointerOffset = offset;
+    fixup->m_Target = locator;
+}
+
+const void *BinarySegmentDataAt(BinarySegment *seg, size_t offset)
+{
+    CHECK(offset < seg->m_Bytes.m_Size);
+    return seg->m_Bytes.m_Storage + offset;
+}
+
+void BinarySegmentPermuteRecords(BinarySegment *seg, size_t offset, size_t record_size, size_t count, const int32_t *new_index, MemAllocHeap *heap)
+{
+    const size_t total = record_size * count;
+    CHECK(offset + total <= seg->m_Bytes.m_Size);
+
+    uint8_t *records = seg->m_Bytes.m_Storage + offset;
+    uint8_t *copy = (uint8_t *)HeapAllocate(heap, total);
+    memcpy(copy, records, total);
+
+    for (size_t i = 0; i < count; ++i)
+        memcpy(records + size_t(new_index[i]) * record_size, copy + i * record_size, record_size);
+
+    HeapFree(heap, copy);
+
+    // Pointers stored in the records move with them.
+    for (BinaryFixup &fixup : seg->m_Fixups)
+    {
+        if (fixup.m_PointerOffset < offset || fixup.m_PointerOffset >= offset + total)
+            continue;
+
+        const size_t rel = fixup.m_PointerOffset - offset;
+        fixup.m_PointerOffset = offset + size_t(new_index[rel / record_size]) * record_size + rel % record_size;
+    }
+}
+
+void BinarySegmentMove(BinarySegment *dst, BinarySegment *src)
+{
+    const size_t base = dst->m_Bytes.m_Size;
+
+    BufferAppend(&dst->m_Bytes, dst->m_Heap, src->m_Bytes.m_Storage, src->m_Bytes.m_Size);
+
+    for (const BinaryFixup &fixup : src->m_Fixups)
+    {
+        BinaryFixup *moved = BufferAlloc(&dst->m_Fixups, dst->m_Heap, 1);
+        moved->m_PointerOffset = base + fixup.m_PointerOffset;
+        moved->m_Target = fixup.m_Target;
+
+        if (fixup.m_Target.m_SegIndex == src->m_Index)
+        {
+            moved->m_Target.m_SegIndex = dst->m_Index;
+            moved->m_Target.m_Offset += base;
+        }
+    }
+
+    BufferClear(&src->m_Bytes);
+    BufferClear(&src->m_Fixups);
+}
+
+void BinarySegmentTransferRecords(BinarySegment *dst, BinarySegment *src, size_t record_size, const size_t *dst_offsets)
+{
+    const size_t count = src->m_Bytes.m_Size / record_size;
+    CHECK(count * record_size == src->m_Bytes.m_Size);
+
+    for (size_t i = 0; i < count; ++i)
+        BinarySegmentWriteAt(dst, dst_offsets[i], src->m_Bytes.m_Storage + i * record_size, record_size);
+
+    for (const BinaryFixup &fixup : src->m_Fixups)
+    {
+        CHECK(fixup.m_Target.m_SegIndex != src->m_Index);
+
+        BinaryFixup *moved = BufferAlloc(&dst->m_Fixups, dst->m_Heap, 1);
+        moved->m_PointerOffset = dst_offsets[fixup.m_PointerOffset / record_size] + fixup.m_PointerOffset % record_size;
+        moved->m_Target = fixup.m_Target;
+    }
+
+    BufferClear(&src->m_Bytes);
+    BufferClear(&src->m_Fixups);
+}
+
 static void BinarySegmentFixupPointers(BinarySegment *self, BinarySegment **segs)
 {
     int64_t my_seg_base = self->m_GlobalOffset;
@@ -106,6 +199,7 @@ void BinaryWriterInit(BinaryWriter *w, MemAllocHeap *heap)
 {
     w->m_Heap = heap;
     BufferInit(&w->m_Segments);
+    w->m_CompressThreshold = 0;
 }
 
 void BinaryWriterDestroy(BinaryWriter *self)
@@ -148,6 +242,74 @@ static bool BinaryWriterFinalize(BinaryWriter *w)
     return true;
 }
 
+static const uint32_t kCompressedBlockSize = 256 * 1024;
+
+// Write the segments as one run of data, cut into blocks and compressed.
+static bool BinaryWriterWriteCompressed(BinaryWriter *self, FILE *f, size_t data_size)
+{
+    const size_t block_count = (data_size + kCompressedBlockSize - 1) / kCompressedBlockSize;
+
+    Frozen::CompressedFileHeader header;
+    header.m_MagicNumber = Frozen::CompressedFileHeader::MagicNumber;
+    header.m_BlockSize = kCompressedBlockSize;
+    header.m_DataSize = data_size;
+
+    uint64_t *offsets = HeapAllocateArrayZeroed<uint64_t>(self->m_Heap, block_count + 1);
+    uint8_t *block = HeapAllocateArray<uint8_t>(self->m_Heap, kCompressedBlockSize);
+    uint8_t *packed = HeapAllocateArray<uint8_t>(self->m_Heap, kCompressedBlockSize);
+
+    // The offsets are filled in once the blocks are written.
+    bool success = 1 == fwrite(&header, sizeof header, 1, f) && block_count + 1 == fwrite(offsets, sizeof(uint64_t), block_count + 1, f);
+
+    uint64_t offset = sizeof header + sizeof(uint64_t) * (block_count + 1);
+    size_t block_index = 0;
+    size_t block_fill = 0;
+
+    auto write_block = [&]() {
+        // Blocks that don't shrink are stored as is.
+        size_t size = Lz4Compress(block, block_fill, packed, block_fill - 1);
+        const uint8_t *data = packed;
+        if (0 == size)
+        {
+            size = block_fill;
+            data = block;
+        }
+
+        offsets[block_index++] = offset;
+        offset += size;
+        block_fill = 0;
+        return size == fwrite(data, 1, size, f);
+    };
+
+    for (size_t i = 0; success && i < self->m_Segments.m_Size; ++i)
+    {
+        const Buffer<uint8_t> &bytes = self->m_Segments[i]->m_Bytes;
+        for (size_t pos = 0; success && pos < bytes.m_Size;)
+        {
+            const size_t count = std::min(bytes.m_Size - pos, kCompressedBlockSize - block_fill);
+            memcpy(block + block_fill, bytes.m_Storage + pos, count);
+            block_fill += count;
+            pos += count;
+
+            if (kCompressedBlockSize == block_fill)
+                success = write_block();
+        }
+    }
+
+    if (success && block_fill > 0)
+        success = write_block();
+
+    offsets[block_count] = offset;
+
+    if (success)
+        success = 0 == fseek(f, sizeof header, SEEK_SET) && block_count + 1 == fwrite(offsets, sizeof(uint64_t), block_count + 1, f);
+
+    HeapFree(self->m_Heap, packed);
+    HeapFree(self->m_Heap, block);
+    HeapFree(self->m_Heap, offsets);
+    return success;
+}
+
 bool BinaryWriterFlush(BinaryWriter *self, const char *out_fn)
 {
     if (!BinaryWriterFinalize(self))
@@ -162,13 +324,25 @@ bool BinaryWriterFlush(BinaryWriter *self, const char *out_fn)
     const size_t seg_count = self->m_Segments.m_Size;
     BinarySegment **segs = self->m_Segments.m_Storage;
 
-    // Align all segments to 16 bytes
-    for (size_t i = 0; success && i < seg_count; ++i)
+    size_t data_size = 0;
+    for (size_t i = 0; i < seg_count; ++i)
+        data_size += BinarySegmentSize(segs[i]);
+
+    if (self->m_CompressThreshold && data_size >= self->m_CompressThreshold)
     {
-        success = BinarySegmentWrite(segs[i], f);
+        success = BinaryWriterWriteCompressed(self, f, data_size);
     }
+    else
+    {
+        for (size_t i = 0; success && i < seg_count; ++i)
+        {
+            success = BinarySegmentWrite(segs[i], f);
+        }
+    }
+
+    if (0 != fclose(f))
+        success = false;
 
-    fclose(f);
     return success;
 }
 
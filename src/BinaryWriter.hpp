@@ -21,6 +21,8 @@ struct BinaryWriter
 {
   MemAllocHeap*          m_Heap;
   Buffer<BinarySegment*> m_Segments;
+  // Output of at least this many bytes is written block compressed; zero never compresses.
+  size_t                 m_CompressThreshold;
 };
 
 size_t BinarySegmentSize(BinarySegment* seg);
@@ -73,6 +75,28 @@ inline void BinarySegmentWriteNullPointer(BinarySegment* seg)
 
 BinaryLocator BinarySegmentPosition(BinarySegment *seg);
 
+// Overwrite bytes, or place a pointer, in data that has already been written.
+void BinarySegmentWriteAt(BinarySegment* seg, size_t offset, const void* data, size_t len);
+void BinarySegmentWritePointerAt(BinarySegment* seg, size_t offset, BinaryLocator locator);
+
+// Read back data that has already been written. Only valid until the next write.
+const void* BinarySegmentDataAt(BinarySegment* seg, size_t offset);
+
+// Reorder count fixed size records starting at offset, moving record i to slot
+// new_index[i]. Pointers stored inside the records move with them; pointers
+// from elsewhere into the records are not adjusted.
+void BinarySegmentPermuteRecords(BinarySegment* seg, size_t offset, size_t record_size, size_t count, const int32_t* new_index, MemAllocHeap* heap);
+
+// Append the contents of src to dst, leaving src empty. Pointers stored in src,
+// including those into src itself, are moved along; pointers from elsewhere
+// into src are not adjusted.
+void BinarySegmentMove(BinarySegment* dst, BinarySegment* src);
+
+// Copy the fixed size records that make up src to dst, record i going to
+// dst_offsets[i], leaving src empty. Pointers stored in the records move with
+// them; src must not point into itself.
+void BinarySegmentTransferRecords(BinarySegment* dst, BinarySegment* src, size_t record_size, const size_t* dst_offsets);
+
 void BinaryWriterInit(BinaryWriter* w, MemAllocHeap* heap);
 void BinaryWriterDestroy(BinaryWriter* w);
 
@@ -54,8 +54,14 @@ static RuntimeNode *GetRuntimeNodeForDagNodeIndex(BuildQueue *queue, int32_t src
     return runtime_node;
 }
 
+static int32_t GetDagNodeIndex(BuildQueue *queue, const RuntimeNode *runtime_node)
+{
+    return int32_t(runtime_node->m_DagNode - queue->m_Config.m_DagNodes);
+}
+
 static void WakeWaiters(BuildQueue *queue, int count)
 {
+    ++queue->m_WorkAvailableGeneration;
     if (count > 1)
         CondBroadcast(&queue->m_WorkAvailable);
     else
@@ -88,7 +94,7 @@ static void Enqueue(BuildQueue *queue, RuntimeNode *runtime_node)
 
 static bool AllDependenciesAreFinished(BuildQueue *queue, RuntimeNode *runtime_node)
 {
-    for (int32_t dep_index : runtime_node->m_DagNode->m_Dependencies)
+    for (int32_t dep_index : DagNodeDependencies(queue->m_Config.m_Dag, GetDagNodeIndex(queue, runtime_node)))
     {
         RuntimeNode *runtime_node = GetRuntimeNodeForDagNodeIndex(queue, dep_index);
         if (!runtime_node->m_Finished)
@@ -99,7 +105,7 @@ static bool AllDependenciesAreFinished(BuildQueue *queue, RuntimeNode *runtime_n
 
 static bool AllDependenciesAreSuccesful(BuildQueue *queue, RuntimeNode *runtime_node)
 {
-    for (int32_t dep_index : runtime_node->m_DagNode->m_Dependencies)
+    for (int32_t dep_index : DagNodeDependencies(queue->m_Config.m_Dag, GetDagNodeIndex(queue, runtime_node)))
     {
         RuntimeNode *runtime_node = GetRuntimeNodeForDagNodeIndex(queue, dep_index);
         CHECK(runtime_node->m_Finished);
@@ -114,7 +120,7 @@ static void EnqueueDependeesWhoMightNowHaveBecomeReadyToRun(BuildQueue *queue, R
 {
     int enqueue_count = 0;
 
-    for (int32_t link : node->m_DagNode->m_BackLinks)
+    for (int32_t link : DagNodeBackLinks(queue->m_Config.m_Dag, GetDagNodeIndex(queue, node)))
     {
         if (RuntimeNode *waiter = GetRuntimeNodeForDagNodeIndex(queue, link))
         {
@@ -273,6 +279,24 @@ void BuildLoop(ThreadState *thread_state)
             continue;
         }
 
+        //nothing is queued, but another thread may be digesting a large file that we can help hash. Don't hold the lock while hashing.
+        //any wakeup sent while the lock was dropped would be lost by the CondWait below, so check the queue again if there was one.
+        uint32_t wake_generation = queue->m_WorkAvailableGeneration;
+        MutexUnlock(mutex);
+        bool helped = FileSignHelpWithDigests();
+        MutexLock(mutex);
+        if (helped)
+        {
+            if (waitingForWork)
+            {
+                ProfilerEnd(thread_state->m_ProfilerThreadId);
+                waitingForWork = false;
+            }
+            continue;
+        }
+        if (wake_generation != queue->m_WorkAvailableGeneration)
+            continue;
+
         //ok, there is nothing to do at this very moment, let's go to sleep.
         if (!waitingForWork)
         {
@@ -8,6 +8,7 @@
 #include "RuntimeNode.hpp"
 #include "BuildLoop.hpp"
 #include "Driver.hpp"
+#include "FileSign.hpp"
 #include <stdarg.h>
 #include <algorithm>
 
@@ -43,10 +44,18 @@ static void ThreadStateDestroy(ThreadState *self)
 static void WakeupAllBuildThreadsSoTheyCanExit(BuildQueue *queue)
 {
     //build threads are either waiting on m_WorkAvailable signal, or on m_MaxJobsChangedConditionalVariable. Let's send 'm both.
+    ++queue->m_WorkAvailableGeneration;
     CondBroadcast(&queue->m_WorkAvailable);
     CondBroadcast(&queue->m_MaxJobsChangedConditionalVariable);
 }
 
+static void WakeupBuildThreadsToHelpWithDigests(void *user_data)
+{
+    // Called without m_Lock held; a missed wakeup only means the digesting thread does more of the work itself.
+    BuildQueue *queue = static_cast<BuildQueue *>(user_data);
+    CondBroadcast(&queue->m_WorkAvailable);
+}
+
 static ThreadRoutineReturnType TUNDRA_STDCALL BuildThreadRoutine(void *param)
 {
     ThreadState *thread_state = static_cast<ThreadState *>(param);
@@ -80,6 +89,7 @@ void BuildQueueInit(BuildQueue *queue, const BuildQueueConfig *config)
     queue->m_Queue = HeapAllocateArray<int32_t>(heap, capacity);
     queue->m_QueueReadIndex = 0;
     queue->m_QueueWriteIndex = 0;
+    queue->m_WorkAvailableGeneration = 0;
     queue->m_QueueCapacity = capacity;
     queue->m_Config = *config;
     queue->m_FinalBuildResult = BuildResult::kOk;
@@ -100,6 +110,8 @@ void BuildQueueInit(BuildQueue *queue, const BuildQueueConfig *config)
     SignalBlockThread(true);
     SignalHandlerSetCondition(&queue->m_BuildFinishedConditionalVariable);
 
+    FileSignInitHelpers(WakeupBuildThreadsToHelpWithDigests, queue);
+
     // Create build threads.
     for (int i = 0, thread_count = queue->m_Config.m_DriverOptions->m_ThreadCount; i < thread_count; ++i)
     {
@@ -135,6 +147,8 @@ void BuildQueueDestroy(BuildQueue *queue)
         ThreadStateDestroy(&queue->m_ThreadState[i]);
     }
 
+    FileSignDestroyHelpers();
+
     {
         ProfilerScope profile_scope("SharedResourceDestroy", 0);
         // Destroy any shared resources that were created
@@ -229,22 +243,32 @@ BuildResult::Enum BuildQueueBuild(BuildQueue *queue)
     int32_t *build_queue = queue->m_Queue;
     RuntimeNode *runtime_nodes = queue->m_Config.m_RuntimeNodes;
 
+    const Frozen::Dag *dag = queue->m_Config.m_Dag;
+    const Frozen::DagNode *dag_nodes = queue->m_Config.m_DagNodes;
+
     int amountQueued = 0;
     for (int i = 0; i < queue->m_Config.m_TotalRuntimeNodeCount; ++i)
     {
         RuntimeNode *runtime_node = runtime_nodes + i;
 
         //to start up, let's enqueue all nodes that have 0 dependencies.
-        if (runtime_node->m_DagNode->m_Dependencies.GetCount() == 0)
+        if (DagNodeDependencies(dag, int32_t(runtime_node->m_DagNode - dag_nodes)).GetCount() == 0)
         {
             RuntimeNodeFlagQueued(runtime_node);
             build_queue[amountQueued++] = i;
         }
     }
 
+    // Start the nodes the longest chains wait on first.
+    const int32_t *priorities = dag->m_NodePriorities;
+    std::stable_sort(build_queue, build_queue + amountQueued, [=](int32_t a, int32_t b) {
+        return priorities[runtime_nodes[a].m_DagNode - dag_nodes] > priorities[runtime_nodes[b].m_DagNode - dag_nodes];
+    });
+
     queue->m_QueueWriteIndex = amountQueued;
     queue->m_QueueReadIndex = 0;
 
+    ++queue->m_WorkAvailableGeneration;
     CondBroadcast(&queue->m_WorkAvailable);
 
     auto ShouldContinue = [=]() {
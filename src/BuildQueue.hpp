@@ -33,6 +33,7 @@ struct BuildQueueConfig
     const DriverOptions* m_DriverOptions;
     uint32_t m_Flags;
     MemAllocHeap *m_Heap;
+    const Frozen::Dag *m_Dag;
     const Frozen::DagNode *m_DagNodes;
     RuntimeNode *m_RuntimeNodes;
     int m_TotalRuntimeNodeCount;
@@ -78,6 +79,7 @@ struct BuildQueue
 {
     Mutex m_Lock;
     ConditionVariable m_WorkAvailable;
+    uint32_t m_WorkAvailableGeneration; // bumped under m_Lock by every wakeup sent on m_WorkAvailable
     ConditionVariable m_MaxJobsChangedConditionalVariable;
     ConditionVariable m_BuildFinishedConditionalVariable;
     Mutex m_BuildFinishedMutex;
@@ -0,0 +1,63 @@
+#include "CacheRetention.hpp"
+
+#include <algorithm>
+
+
+
+void CacheRetentionInit(CacheRetention *self, uint64_t now, int32_t days_to_keep, uint32_t max_records)
+{
+    self->m_DaysToKeep = days_to_keep;
+    self->m_MaxRecords = max_records;
+    self->m_CutoffTime = 0;
+
+    const uint64_t keep_seconds = uint64_t(days_to_keep) * 24 * 60 * 60;
+    if (days_to_keep > 0 && now > keep_seconds)
+        self->m_CutoffTime = now - keep_seconds;
+
+    self->m_BudgetActive = false;
+    self->m_BudgetTime = 0;
+    self->m_BudgetTies = 0;
+    self->m_Evicted = 0;
+}
+
+void CacheRetentionApplyBudget(CacheRetention *self, uint64_t *access_times, uint32_t count)
+{
+    const uint64_t cutoff = self->m_CutoffTime;
+    uint64_t *live_end = std::partition(access_times, access_times + count, [cutoff](uint64_t t) { return t >= cutoff; });
+    const uint32_t live_count = uint32_t(live_end - access_times);
+    const uint32_t max_records = self->m_MaxRecords;
+
+    self->m_BudgetActive = false;
+
+    if (0 == max_records || live_count <= max_records)
+        return;
+
+    // Everything at or after the pivot is among the max_records most recently used.
+    uint64_t *pivot = access_times + (live_count - max_records);
+    std::nth_element(access_times, pivot, live_end);
+
+    const uint64_t budget_time = *pivot;
+    const uint32_t newer_count = uint32_t(std::count_if(pivot, live_end, [budget_time](uint64_t t) { return t > budget_time; }));
+
+    self->m_BudgetActive = true;
+    self->m_BudgetTime = budget_time;
+    self->m_BudgetTies = max_records - newer_count;
+}
+
+bool CacheRetentionKeep(CacheRetention *self, uint64_t access_time)
+{
+    if (access_time >= self->m_CutoffTime)
+    {
+        if (!self->m_BudgetActive || access_time > self->m_BudgetTime)
+            return true;
+
+        if (access_time == self->m_BudgetTime && self->m_BudgetTies > 0)
+        {
+            --self->m_BudgetTies;
+            return true;
+        }
+    }
+
+    ++self->m_Evicted;
+    return false;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Decides which records a cache keeps when it is saved. Records not used for
+// m_DaysToKeep days are dropped, then the least recently used ones until the
+// record count fits m_MaxRecords.
+struct CacheRetention
+{
+    // Zero or less keeps records regardless of age.
+    int32_t m_DaysToKeep;
+    // Zero means no limit.
+    uint32_t m_MaxRecords;
+
+    uint64_t m_CutoffTime;
+    bool m_BudgetActive;
+    uint64_t m_BudgetTime;
+    // Number of records used exactly at m_BudgetTime that still fit the budget.
+    uint32_t m_BudgetTies;
+    uint32_t m_Evicted;
+};
+
+void CacheRetentionInit(CacheRetention *self, uint64_t now, int32_t days_to_keep, uint32_t max_records);
+
+// Work out the least recently used records to evict, given the access times of
+// every record that may be saved. The array is reordered.
+void CacheRetentionApplyBudget(CacheRetention *self, uint64_t *access_times, uint32_t count);
+
+// Call once per record, in any order. Returns false for records that should be dropped.
+bool CacheRetentionKeep(CacheRetention *self, uint64_t access_time);
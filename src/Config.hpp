@@ -12,6 +12,12 @@
 #define USE_SHA1_HASH NO
 #define USE_FAST_HASH YES
 
+// Use vector instructions for the fast hash when the CPU supports them.
+#define USE_SIMD_HASH YES
+
+// Use vector instructions to find the structural characters of JSON documents.
+#define USE_SIMD_JSON YES
+
 #if defined(_DEBUG)
 #define CHECKED_BUILD YES
 #else
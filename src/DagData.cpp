@@ -0,0 +1,30 @@
+#include "DagData.hpp"
+#include "HashTable.hpp"
+
+#include <string.h>
+
+int32_t DagFindPath(const Frozen::Dag *dag, const char *path, uint32_t path_hash)
+{
+    if (0 == dag->m_PathLookup.GetCount())
+        return -1;
+
+    const uint32_t mask = uint32_t(dag->m_PathLookup.GetCount()) - 1;
+
+    for (uint32_t slot = path_hash & mask;; slot = (slot + 1) & mask)
+    {
+        const int32_t index = dag->m_PathLookup[slot];
+        if (-1 == index)
+            return -1;
+
+        const Frozen::DagPath &entry = dag->m_Paths[index];
+        if (entry.m_PathHash != path_hash)
+            continue;
+
+#if ENABLED(TUNDRA_CASE_INSENSITIVE_FILESYSTEM)
+        if (0 == FastCompareNoCase(entry.m_Path, path))
+#else
+        if (0 == strcmp(entry.m_Path, path))
+#endif
+            return index;
+    }
+}
@@ -32,6 +32,19 @@ struct KeywordData
     int8_t m_Padding;
 };
 
+// Node of the keyword trie of a generic scanner. Nodes are laid out breadth
+// first, so the children of a node are contiguous starting at m_FirstChild.
+struct KeywordTrieNode
+{
+    int32_t m_FirstChild;
+    // Index into m_Keywords of the keyword ending at this node, or -1.
+    int16_t m_KeywordIndex;
+    // Children have distinct non-NUL characters, so there are at most 255.
+    uint8_t m_ChildCount;
+    char m_Char;
+};
+static_assert(sizeof(KeywordTrieNode) == 8, "struct size");
+
 struct GenericScannerData : ScannerData
 {
     enum
@@ -43,6 +56,8 @@ struct GenericScannerData : ScannerData
 
     uint32_t m_Flags;
     FrozenArray<KeywordData> m_Keywords;
+    // Trie over m_Keywords, rooted at node 0.
+    FrozenArray<KeywordTrieNode> m_KeywordTrie;
 };
 
 struct NamedNodeData
@@ -69,6 +84,25 @@ struct DagGlobSignature
 };
 static_assert(sizeof(HashDigest) + sizeof(FrozenString) + sizeof(FrozenString) + sizeof(uint32_t) == sizeof(DagGlobSignature), "struct layout");
 
+// A file named by a node. Every file is also an entry in Dag::m_Paths, so
+// two files are the same path if and only if their path indices are equal.
+struct DagFile : FrozenFileAndHash
+{
+    int32_t m_PathIndex;
+};
+static_assert(sizeof(DagFile) == 12, "struct layout");
+
+// A path named by the nodes, or a directory holding one. Each path is stored
+// once, and all files with that path point to the same string.
+struct DagPath
+{
+    FrozenString m_Path;
+    uint32_t m_PathHash;
+    // Index of the directory holding this path, or -1.
+    int32_t m_Directory;
+};
+static_assert(sizeof(DagPath) == 12, "struct layout");
+
 struct EnvVarData
 {
     FrozenString m_Name;
@@ -95,18 +129,20 @@ struct DagNode
 
         kFlagIsWriteTextFileAction = 1 << 4,
         kFlagAllowUnwrittenOutputFiles = 1 << 5,
-        kFlagBanContentDigestForInputs = 1 << 6
+        kFlagBanContentDigestForInputs = 1 << 6,
+
+        // Hash the outputs after running. Outputs that come out byte-identical to the previous build
+        // get their old timestamps back, so dependents don't rebuild.
+        kFlagEarlyCutoff = 1 << 7
     };
 
     FrozenString m_Action;
     FrozenString m_Annotation;
-    FrozenArray<int32_t> m_Dependencies;
-    FrozenArray<int32_t> m_BackLinks;
-    FrozenArray<FrozenFileAndHash> m_InputFiles;
-    FrozenArray<FrozenFileAndHash> m_OutputFiles;
-    FrozenArray<FrozenFileAndHash> m_OutputDirectories;
-    FrozenArray<FrozenFileAndHash> m_AuxOutputFiles;
-    FrozenArray<FrozenFileAndHash> m_FrontendResponseFiles;
+    FrozenArray<DagFile> m_InputFiles;
+    FrozenArray<DagFile> m_OutputFiles;
+    FrozenArray<DagFile> m_OutputDirectories;
+    FrozenArray<DagFile> m_AuxOutputFiles;
+    FrozenArray<DagFile> m_FrontendResponseFiles;
     FrozenArray<FrozenString> m_AllowedOutputSubstrings;
     FrozenArray<EnvVarData> m_EnvVars;
     FrozenPtr<ScannerData> m_Scanner;
@@ -127,7 +163,7 @@ struct SharedResourceData
 
 struct Dag
 {
-    static const uint32_t MagicNumber = 0xaBD9224f ^ kTundraHashMagic;
+    static const uint32_t MagicNumber = 0x2f9a4c18 ^ kTundraHashMagic;
 
     uint32_t m_MagicNumber;
 
@@ -136,6 +172,31 @@ struct Dag
     int32_t m_NodeCount;
     FrozenPtr<HashDigest> m_NodeGuids;
     FrozenPtr<DagNode> m_DagNodes;
+    // Digest of everything the frontend said about each node, to tell which
+    // nodes changed when the DAG is next recompiled.
+    FrozenPtr<HashDigest> m_NodeContentDigests;
+    // Number of incremental recompiles since the DAG was last written in full.
+    int32_t m_IncrementalCompileCount;
+    // Size of the DAG when it was last written in full. Most of what incremental
+    // recompiles added since is taken up by records nothing refers to any more.
+    uint32_t m_CompactSize;
+
+    // Adjacency of the nodes, kept apart from the node records so graph traversals
+    // touch only these. The dependencies of node i are m_Dependencies[m_DependencyOffsets[i]]
+    // up to m_Dependencies[m_DependencyOffsets[i + 1]]; m_NodeCount + 1 offsets. Likewise
+    // for the nodes that depend on node i, in m_BackLinks.
+    FrozenPtr<int32_t> m_DependencyOffsets;
+    FrozenArray<int32_t> m_Dependencies;
+    FrozenPtr<int32_t> m_BackLinkOffsets;
+    FrozenArray<int32_t> m_BackLinks;
+    // Number of nodes on the longest chain of backlinks from each node. Ready nodes
+    // with higher priorities are started first, as more of the build waits on them.
+    FrozenPtr<int32_t> m_NodePriorities;
+
+    // Every path the nodes name, and the directories holding them.
+    FrozenArray<DagPath> m_Paths;
+    // Open addressed index of m_Paths by path hash; a power of two in size, with -1 in unused slots.
+    FrozenArray<int32_t> m_PathLookup;
 
     FrozenArray<NamedNodeData> m_NamedNodes;
     FrozenArray<int32_t> m_DefaultNodes;
@@ -150,6 +211,21 @@ struct Dag
 
     int32_t m_DaysToKeepUnreferencedNodesAround;
 
+    // Non-zero to also key scan cache records by file content digest.
+    int32_t m_ScanCacheContentDigests;
+
+    // Digest and scan cache records unused for this many days are dropped on save; zero or less keeps them regardless of age.
+    int32_t m_CacheDaysToKeep;
+    // When non-zero, the least recently used records beyond these counts are evicted on save.
+    int32_t m_DigestCacheMaxRecords;
+    int32_t m_ScanCacheMaxRecords;
+
+    // Non-zero to fold size, inode and change time into timestamp signatures.
+    int32_t m_ExtendedTimestampSignatures;
+
+    // The DAG, build state and caches are written block compressed when at least this many KB; zero or less never compresses.
+    int32_t m_CompressFilesAboveKb;
+
     FrozenString m_StateFileName;
     FrozenString m_StateFileNameTmp;
     FrozenString m_ScanCacheFileName;
@@ -159,6 +235,46 @@ struct Dag
     FrozenString m_BuildTitle;
     FrozenString m_StructuredLogFileName;
 
+    // Extended attribute holding digests recorded by an external tool, or null.
+    FrozenString m_ContentDigestXattr;
+
+    // Machine-wide digest store shared between checkouts, or null.
+    FrozenString m_SharedDigestStoreFileName;
+
     uint32_t m_MagicNumberEnd;
 };
 }
+
+// Index of the given path, formatted as the DAG formats paths, in m_Paths; -1 if no node names it.
+int32_t DagFindPath(const Frozen::Dag *dag, const char *path, uint32_t path_hash);
+
+// Size from which frozen files are written block compressed, or zero.
+inline size_t DagCompressThreshold(const Frozen::Dag *dag)
+{
+    return dag->m_CompressFilesAboveKb > 0 ? size_t(dag->m_CompressFilesAboveKb) * 1024 : 0;
+}
+
+// A run of node indices in one of the adjacency arrays of a DAG.
+struct DagNodeIndices
+{
+    const int32_t *m_Begin;
+    const int32_t *m_End;
+
+    const int32_t *begin() const { return m_Begin; }
+    const int32_t *end() const { return m_End; }
+    int32_t GetCount() const { return int32_t(m_End - m_Begin); }
+};
+
+inline DagNodeIndices DagNodeDependencies(const Frozen::Dag *dag, int32_t node_index)
+{
+    const int32_t *offsets = dag->m_DependencyOffsets;
+    const int32_t *indices = dag->m_Dependencies.GetArray();
+    return DagNodeIndices{indices + offsets[node_index], indices + offsets[node_index + 1]};
+}
+
+inline DagNodeIndices DagNodeBackLinks(const Frozen::Dag *dag, int32_t node_index)
+{
+    const int32_t *offsets = dag->m_BackLinkOffsets;
+    const int32_t *indices = dag->m_BackLinks.GetArray();
+    return DagNodeIndices{indices + offsets[node_index], indices + offsets[node_index + 1]};
+}
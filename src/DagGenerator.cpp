@@ -1,4 +1,5 @@
 #include "DagGenerator.hpp"
+#include "DagInput.hpp"
 #include "Hash.hpp"
 #include "PathUtil.hpp"
 #include "Exec.hpp"
@@ -11,7 +12,12 @@
 #include "HashTable.hpp"
 #include "FileSign.hpp"
 #include "BuildQueue.hpp"
+#include "MemoryMappedFile.hpp"
+#include "Mutex.hpp"
+#include "ConditionVar.hpp"
+#include "Thread.hpp"
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdarg.h>
@@ -86,41 +92,6 @@ static int64_t FindIntValue(const JsonObjectValue *obj, const char *key, int64_t
     return (int64_t) static_cast<const JsonNumberValue *>(node)->m_Number;
 }
 
-static bool WriteFileArray(
-    BinarySegment *seg,
-    BinarySegment *ptr_seg,
-    BinarySegment *str_seg,
-    const JsonArrayValue *files)
-{
-    if (!files || 0 == files->m_Count)
-    {
-        BinarySegmentWriteInt32(seg, 0);
-        BinarySegmentWriteNullPointer(seg);
-        return true;
-    }
-
-    BinarySegmentWriteInt32(seg, (int)files->m_Count);
-    BinarySegmentWritePointer(seg, BinarySegmentPosition(ptr_seg));
-
-    for (size_t i = 0, count = files->m_Count; i < count; ++i)
-    {
-        const JsonStringValue *path = files->m_Values[i]->AsString();
-        if (!path)
-            return false;
-
-        PathBuffer pathbuf;
-        PathInit(&pathbuf, path->m_String);
-
-        char cleaned_path[kMaxPathLength];
-        PathFormat(cleaned_path, &pathbuf);
-
-        WriteStringPtr(ptr_seg, str_seg, cleaned_path);
-        BinarySegmentWriteUint32(ptr_seg, Djb2HashPath(cleaned_path));
-    }
-
-    return true;
-}
-
 static bool EmptyArray(const JsonArrayValue *a)
 {
     return nullptr == a || a->m_Count == 0;
@@ -161,322 +132,1407 @@ static bool GetNodeFlagBool(const JsonObjectValue *node, const char *name, bool
     {
         if (const JsonBooleanValue *flag = val->AsBoolean())
         {
-            return flag->m_Boolean;
+            return flag->m_Boolean;
+        }
+    }
+    return defaultValue;
+}
+
+static uint32_t GetNodeFlag(const JsonObjectValue *node, const char *name, uint32_t value, bool defaultValue = false)
+{
+    return GetNodeFlagBool(node, name, defaultValue) ? value : 0;
+}
+
+static DagInputArray<const char *> FileSignaturesFromJson(const JsonObjectValue *json, MemAllocLinear *alloc)
+{
+    DagInputArray<const char *> result = {nullptr, 0};
+
+    if (const JsonArrayValue *file_sigs = FindArrayValue(json, "FileSignatures"))
+    {
+        size_t count = file_sigs->m_Count;
+        const char **paths = LinearAllocateArray<const char *>(alloc, count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (const JsonObjectValue *sig = file_sigs->m_Values[i]->AsObject())
+            {
+                paths[i] = FindStringValue(sig, "File");
+
+                if (!paths[i])
+                {
+                    Croak("bad FileSignatures data: could not get 'File' member for object at index %zu\n", i);
+                }
+            }
+            else
+            {
+                Croak("bad FileSignatures data: array entry at index %zu was not an Object\n", i);
+            }
+        }
+
+        result.m_Items = paths;
+        result.m_Count = count;
+    }
+
+    return result;
+}
+
+static DagInputArray<DagInputGlob> GlobSignaturesFromJson(const JsonObjectValue *json, MemAllocLinear *alloc)
+{
+    DagInputArray<DagInputGlob> result = {nullptr, 0};
+
+    if (const JsonArrayValue *glob_sigs = FindArrayValue(json, "GlobSignatures"))
+    {
+        DagInputGlob *globs = LinearAllocateArray<DagInputGlob>(alloc, glob_sigs->m_Count);
+        for (size_t i = 0, count = glob_sigs->m_Count; i < count; ++i)
+        {
+            if (const JsonObjectValue *sig = glob_sigs->m_Values[i]->AsObject())
+            {
+                DagInputGlob *glob = &globs[result.m_Count++];
+                glob->m_Path = FindStringValue(sig, "Path");
+                if (!glob->m_Path)
+                {
+                    Croak("bad GlobSignatures data\n");
+                }
+
+                glob->m_Filter = FindStringValue(sig, "Filter");
+                glob->m_Recurse = FindIntValue(sig, "Recurse", 0) == 1;
+            }
+        }
+
+        result.m_Items = globs;
+    }
+
+    return result;
+}
+
+static void EmitFileSignatures(const DagInputArray<const char *> &paths, BinarySegment *main_seg, BinarySegment *aux_seg, BinarySegment *str_seg)
+{
+    if (paths.m_Items)
+    {
+        BinarySegmentWriteInt32(main_seg, (int)paths.m_Count);
+        BinarySegmentWritePointer(main_seg, BinarySegmentPosition(aux_seg));
+        for (size_t i = 0; i < paths.m_Count; ++i)
+        {
+            const char *path = paths.m_Items[i];
+            int64_t timestamp = GetFileInfo(path).m_Timestamp;
+            WriteStringPtr(aux_seg, str_seg, path);
+            char padding[4] = {0, 0, 0, 0};
+            BinarySegmentWrite(aux_seg, padding, 4);
+            BinarySegmentWriteUint64(aux_seg, uint64_t(timestamp));
+        }
+    }
+    else
+    {
+        BinarySegmentWriteInt32(main_seg, 0);
+        BinarySegmentWriteNullPointer(main_seg);
+    }
+};
+
+static void EmitGlobSignatures(const DagInputArray<DagInputGlob> &globs, BinarySegment *main_seg, BinarySegment *aux_seg, BinarySegment *str_seg, MemAllocHeap *heap, MemAllocLinear *scratch)
+{
+    if (globs.m_Items)
+    {
+        BinarySegmentWriteInt32(main_seg, (int)globs.m_Count);
+        BinarySegmentWritePointer(main_seg, BinarySegmentPosition(aux_seg));
+        for (size_t i = 0; i < globs.m_Count; ++i)
+        {
+            const DagInputGlob &glob = globs.m_Items[i];
+
+            HashDigest digest = CalculateGlobSignatureFor(glob.m_Path, glob.m_Filter, glob.m_Recurse, heap, scratch);
+
+            WriteStringPtr(aux_seg, str_seg, glob.m_Path);
+            WriteStringPtr(aux_seg, str_seg, glob.m_Filter);
+            BinarySegmentWrite(aux_seg, (char *)&digest, sizeof digest);
+            BinarySegmentWriteInt32(aux_seg, glob.m_Recurse ? 1 : 0);
+        }
+    }
+    else
+    {
+        BinarySegmentWriteInt32(main_seg, 0);
+        BinarySegmentWriteNullPointer(main_seg);
+    }
+}
+
+// Node data that can only be written once every node has been seen.
+struct PendingNode
+{
+    size_t m_FirstDep;
+    int32_t m_DepCount;
+    int32_t m_ScannerIndex;
+    // The writer that wrote the record, and where in its node data segment; -1
+    // if the record from the previous DAG is reused.
+    int32_t m_Writer;
+    size_t m_Record;
+    // Offset of the annotation in the writer's string segment, or -1.
+    int64_t m_Annotation;
+    HashDigest m_ContentDigest;
+};
+
+// The DAG written by the last compile. Nodes that are unchanged since, at the
+// same input index, reuse its records rather than being written again.
+struct PreviousDag
+{
+    MemoryMappedFile m_File;
+    const Frozen::Dag *m_Dag;
+    // Sorted position of the node at each input index.
+    int32_t *m_Positions;
+};
+
+// Incremental recompiles in a row before the DAG is written in full again, to
+// bound the space taken by records and strings no longer referred to.
+static const int32_t kMaxIncrementalCompiles = 8;
+
+// Share of the DAG, in percent, that may be left unreferenced before it is written in full.
+static const uint32_t kMaxUnreferencedPercent = 25;
+
+// Whether patching the DAG again would leave too much of it unreferenced. Each
+// recompile copies the whole DAG and leaves the tables it replaces behind, so
+// assume the next one adds about as much as the previous ones did on average.
+static bool PreviousDagNeedsCompacting(const Frozen::Dag *dag, size_t size)
+{
+    if (dag->m_IncrementalCompileCount >= kMaxIncrementalCompiles)
+        return true;
+    if (0 == dag->m_IncrementalCompileCount || size <= dag->m_CompactSize)
+        return false;
+
+    const uint64_t unreferenced = size - dag->m_CompactSize;
+    const uint64_t growth = unreferenced / dag->m_IncrementalCompileCount;
+    return 100 * (unreferenced + growth) > kMaxUnreferencedPercent * (size + growth);
+}
+
+static void PreviousDagDestroy(PreviousDag *self, MemAllocHeap *heap)
+{
+    HeapFree(heap, self->m_Positions);
+    MmapFileDestroy(&self->m_File);
+}
+
+static bool PreviousDagLoad(PreviousDag *self, const char *dag_fn, MemAllocHeap *heap)
+{
+    MmapFileInit(&self->m_File);
+    self->m_Positions = nullptr;
+
+    MmapFileMapFrozen(&self->m_File, dag_fn);
+    if (!MmapFileValid(&self->m_File))
+        return false;
+
+    const Frozen::Dag *dag = (const Frozen::Dag *)self->m_File.m_Address;
+    self->m_Dag = dag;
+
+    if (self->m_File.m_Size < sizeof(Frozen::Dag) || Frozen::Dag::MagicNumber != dag->m_MagicNumber || PreviousDagNeedsCompacting(dag, self->m_File.m_Size))
+    {
+        PreviousDagDestroy(self, heap);
+        return false;
+    }
+
+    self->m_Positions = HeapAllocateArray<int32_t>(heap, dag->m_NodeCount);
+    for (int32_t i = 0; i < dag->m_NodeCount; ++i)
+        self->m_Positions[i] = -1;
+
+    for (int32_t i = 0; i < dag->m_NodeCount; ++i)
+    {
+        const uint32_t original_index = dag->m_DagNodes[i].m_OriginalIndex;
+        if (original_index >= uint32_t(dag->m_NodeCount) || -1 != self->m_Positions[original_index])
+        {
+            PreviousDagDestroy(self, heap);
+            return false;
+        }
+        self->m_Positions[original_index] = i;
+    }
+
+    return true;
+}
+
+struct PathTableEntry
+{
+    BinaryLocator m_String;
+    uint32_t m_Hash;
+    int32_t m_Directory;
+    const char *m_Key;
+};
+
+// The paths named by the nodes, shared by all writers. Each path, and each
+// directory holding one, is stored once and given an index. Entries are found
+// through an open addressed index kept just as Frozen::Dag::m_PathLookup is.
+struct PathTable
+{
+    MemAllocHeap *m_Heap;
+    Mutex m_Lock;
+    BinarySegment *m_StrSeg;
+    Buffer<PathTableEntry> m_Entries;
+    int32_t *m_Lookup;
+    uint32_t m_LookupSize;
+    // Storage for the keys of entries added in this compile.
+    Buffer<char *> m_KeyChunks;
+    char *m_KeyChunk;
+    size_t m_KeyChunkUsed;
+};
+
+static const size_t kPathKeyChunkSize = MB(1);
+
+static void PathTableInsert(PathTable *self, const PathTableEntry &entry)
+{
+    // Keep the index at most half full.
+    if (2 * (self->m_Entries.m_Size + 1) > self->m_LookupSize)
+    {
+        const uint32_t size = self->m_LookupSize ? 2 * self->m_LookupSize : 1024;
+        HeapFree(self->m_Heap, self->m_Lookup);
+        self->m_Lookup = HeapAllocateArray<int32_t>(self->m_Heap, size);
+        self->m_LookupSize = size;
+        memset(self->m_Lookup, 0xff, sizeof(int32_t) * size);
+
+        for (size_t i = 0, count = self->m_Entries.m_Size; i < count; ++i)
+        {
+            uint32_t slot = self->m_Entries[i].m_Hash & (size - 1);
+            while (-1 != self->m_Lookup[slot])
+                slot = (slot + 1) & (size - 1);
+            self->m_Lookup[slot] = int32_t(i);
+        }
+    }
+
+    const uint32_t mask = self->m_LookupSize - 1;
+    uint32_t slot = entry.m_Hash & mask;
+    while (-1 != self->m_Lookup[slot])
+        slot = (slot + 1) & mask;
+
+    self->m_Lookup[slot] = int32_t(self->m_Entries.m_Size);
+    BufferAppendOne(&self->m_Entries, self->m_Heap, entry);
+}
+
+static const PathTableEntry *PathTableFind(const PathTable *self, const char *path, uint32_t hash, int32_t *index_out)
+{
+    if (0 == self->m_LookupSize)
+        return nullptr;
+
+    const uint32_t mask = self->m_LookupSize - 1;
+    for (uint32_t slot = hash & mask;; slot = (slot + 1) & mask)
+    {
+        const int32_t index = self->m_Lookup[slot];
+        if (-1 == index)
+            return nullptr;
+
+        const PathTableEntry &entry = self->m_Entries[index];
+#if ENABLED(TUNDRA_CASE_INSENSITIVE_FILESYSTEM)
+        if (entry.m_Hash == hash && 0 == FastCompareNoCase(entry.m_Key, path))
+#else
+        if (entry.m_Hash == hash && 0 == strcmp(entry.m_Key, path))
+#endif
+        {
+            *index_out = index;
+            return &entry;
+        }
+    }
+}
+
+// When patching the previous DAG, its paths keep their indices, which its reused records refer to.
+static void PathTableInit(PathTable *self, BinaryWriter *writer, BinarySegment *previous_seg, const PreviousDag *previous, MemAllocHeap *heap)
+{
+    self->m_Heap = heap;
+    MutexInit(&self->m_Lock);
+    self->m_StrSeg = BinaryWriterAddSegment(writer);
+    BufferInit(&self->m_Entries);
+    self->m_Lookup = nullptr;
+    self->m_LookupSize = 0;
+    BufferInit(&self->m_KeyChunks);
+    self->m_KeyChunk = nullptr;
+    self->m_KeyChunkUsed = kPathKeyChunkSize;
+
+    if (!previous)
+        return;
+
+    // The previous DAG is copied to the start of previous_seg. Its strings
+    // stay mapped for as long as the table is looked up in.
+    const char *base = (const char *)previous->m_File.m_Address;
+    const BinaryLocator copy = BinarySegmentPosition(previous_seg);
+
+    for (const Frozen::DagPath &path : previous->m_Dag->m_Paths)
+    {
+        PathTableEntry entry;
+        entry.m_String.m_SegIndex = copy.m_SegIndex;
+        entry.m_String.m_Offset = copy.m_Offset + size_t(path.m_Path.Get() - base);
+        entry.m_Hash = path.m_PathHash;
+        entry.m_Directory = path.m_Directory;
+        entry.m_Key = path.m_Path;
+        PathTableInsert(self, entry);
+    }
+}
+
+static void PathTableDestroy(PathTable *self)
+{
+    for (char *chunk : self->m_KeyChunks)
+        HeapFree(self->m_Heap, chunk);
+
+    BufferDestroy(&self->m_KeyChunks, self->m_Heap);
+    HeapFree(self->m_Heap, self->m_Lookup);
+    BufferDestroy(&self->m_Entries, self->m_Heap);
+    MutexDestroy(&self->m_Lock);
+}
+
+static const char *PathTableCopyKey(PathTable *self, const char *path)
+{
+    const size_t size = strlen(path) + 1;
+
+    if (self->m_KeyChunkUsed + size > kPathKeyChunkSize)
+    {
+        self->m_KeyChunk = (char *)HeapAllocate(self->m_Heap, kPathKeyChunkSize);
+        self->m_KeyChunkUsed = 0;
+        BufferAppendOne(&self->m_KeyChunks, self->m_Heap, self->m_KeyChunk);
+    }
+
+    char *copy = self->m_KeyChunk + self->m_KeyChunkUsed;
+    self->m_KeyChunkUsed += size;
+    memcpy(copy, path, size);
+    return copy;
+}
+
+// Format the directory holding a path, stripping the last segment off it; false if there is none.
+static bool PathFormatDirectory(char (&dir)[kMaxPathLength], PathBuffer *path)
+{
+    if (!PathStripLast(path) || 0 == path->m_SegCount)
+        return false;
+
+    PathFormat(dir, path);
+    return true;
+}
+
+// Index of a cleaned path, adding it and the directories holding it as needed. Call with m_Lock held.
+static int32_t PathTableIntern(PathTable *self, const char *path, uint32_t hash)
+{
+    int32_t index;
+    if (PathTableFind(self, path, hash, &index))
+        return index;
+
+    PathTableEntry entry;
+    entry.m_Directory = -1;
+
+    PathBuffer buffer;
+    PathInit(&buffer, path);
+    char dir[kMaxPathLength];
+    if (PathFormatDirectory(dir, &buffer))
+        entry.m_Directory = PathTableIntern(self, dir, Djb2HashPath(dir));
+
+    entry.m_String = BinarySegmentPosition(self->m_StrSeg);
+    entry.m_Hash = hash;
+    entry.m_Key = PathTableCopyKey(self, path);
+    BinarySegmentWriteStringData(self->m_StrSeg, path);
+
+    PathTableInsert(self, entry);
+    return int32_t(self->m_Entries.m_Size - 1);
+}
+
+// Write the table and its index, as Frozen::Dag::m_Paths and m_PathLookup.
+static void PathTableEmit(PathTable *self, BinarySegment *main_seg, BinarySegment *aux_seg)
+{
+    BinarySegmentAlign(aux_seg, 4);
+    BinarySegmentWriteInt32(main_seg, int32_t(self->m_Entries.m_Size));
+    BinarySegmentWritePointer(main_seg, BinarySegmentPosition(aux_seg));
+    for (const PathTableEntry &entry : self->m_Entries)
+    {
+        BinarySegmentWritePointer(aux_seg, entry.m_String);
+        BinarySegmentWriteUint32(aux_seg, entry.m_Hash);
+        BinarySegmentWriteInt32(aux_seg, entry.m_Directory);
+    }
+
+    BinarySegmentWriteInt32(main_seg, int32_t(self->m_LookupSize));
+    BinarySegmentWritePointer(main_seg, BinarySegmentPosition(aux_seg));
+    BinarySegmentWrite(aux_seg, self->m_Lookup, sizeof(int32_t) * self->m_LookupSize);
+}
+
+static void WriteFileArray(
+    BinarySegment *seg,
+    BinarySegment *ptr_seg,
+    PathTable *paths,
+    const DagInputArray<const char *> &files,
+    MemAllocLinear *scratch)
+{
+    const size_t count = files.m_Count;
+
+    if (0 == count)
+    {
+        BinarySegmentWriteInt32(seg, 0);
+        BinarySegmentWriteNullPointer(seg);
+        return;
+    }
+
+    // Clean the paths first, to hold the lock only for the lookups.
+    const char **cleaned = LinearAllocateArray<const char *>(scratch, count);
+    uint32_t *hashes = LinearAllocateArray<uint32_t>(scratch, count);
+    int32_t *indices = LinearAllocateArray<int32_t>(scratch, count);
+    BinaryLocator *strings = LinearAllocateArray<BinaryLocator>(scratch, count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        PathBuffer pathbuf;
+        PathInit(&pathbuf, files.m_Items[i]);
+
+        char cleaned_path[kMaxPathLength];
+        PathFormat(cleaned_path, &pathbuf);
+
+        cleaned[i] = StrDup(scratch, cleaned_path);
+        hashes[i] = Djb2HashPath(cleaned_path);
+    }
+
+    MutexLock(&paths->m_Lock);
+    for (size_t i = 0; i < count; ++i)
+    {
+        indices[i] = PathTableIntern(paths, cleaned[i], hashes[i]);
+        strings[i] = paths->m_Entries[indices[i]].m_String;
+    }
+    MutexUnlock(&paths->m_Lock);
+
+    BinarySegmentWriteInt32(seg, (int)count);
+    BinarySegmentWritePointer(seg, BinarySegmentPosition(ptr_seg));
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        BinarySegmentWritePointer(ptr_seg, strings[i]);
+        BinarySegmentWriteUint32(ptr_seg, hashes[i]);
+        BinarySegmentWriteInt32(ptr_seg, indices[i]);
+    }
+}
+
+struct NodeCompiler;
+struct BinaryDagInput;
+
+// Writes node records, and everything they point to, into segments of its own
+// so that several writers can run at once.
+struct NodeWriter
+{
+    NodeCompiler *m_Compiler;
+    int32_t m_Index;
+    BinarySegment *m_NodeDataSeg;
+    BinarySegment *m_ArraySeg;
+    BinarySegment *m_StrSeg;
+    BinarySegment *m_WriteTextFilePayloadsSeg;
+    MemAllocHeap *m_Heap;
+    const PreviousDag *m_Previous;
+    PathTable *m_Paths;
+    HashTable<CommonStringRecord, kFlagCaseSensitive> m_SharedStrings;
+    // Heap chunks holding the keys of m_SharedStrings; the node trees don't outlive their batch.
+    Buffer<char *> m_KeyChunks;
+    char *m_KeyChunk;
+    size_t m_KeyChunkUsed;
+    MemAllocLinear m_Scratch;
+};
+
+// A run of consecutive input nodes, parsed on the reading thread and written by one writer.
+struct NodeBatch
+{
+    enum State
+    {
+        kFree,
+        kQueued,
+        kWriting,
+        kDone
+    };
+
+    State m_State;
+    int32_t m_FirstIndex;
+    MemAllocLinear m_Alloc;
+    Buffer<const JsonValue *> m_Nodes;
+    // Set instead of m_Nodes for binary input, which needs no parsing up front.
+    const BinaryDagInput *m_Binary;
+    int32_t m_BinaryCount;
+    // Number of records written rather than reused from the previous DAG.
+    int32_t m_WrittenCount;
+    // Set if a node doesn't match the previous DAG's node at the same input index.
+    bool m_Diverged;
+    // Results. Dependencies are indexed from the start of m_Deps.
+    Buffer<TempNodeGuid> m_Guids;
+    Buffer<PendingNode> m_Pending;
+    Buffer<int32_t> m_Deps;
+    // Input index of the node that couldn't be written, or -1.
+    int32_t m_FailedIndex;
+};
+
+static const size_t kKeyChunkSize = 64 * 1024;
+
+// Keep a copy of a string that stays put for as long as the writer lives.
+static const char *NodeWriterCopyKey(NodeWriter *w, const char *text)
+{
+    const size_t size = strlen(text) + 1;
+
+    if (size > kKeyChunkSize)
+    {
+        char *block = (char *)HeapAllocate(w->m_Heap, size);
+        BufferAppendOne(&w->m_KeyChunks, w->m_Heap, block);
+        memcpy(block, text, size);
+        return block;
+    }
+
+    if (w->m_KeyChunkUsed + size > kKeyChunkSize)
+    {
+        w->m_KeyChunk = (char *)HeapAllocate(w->m_Heap, kKeyChunkSize);
+        w->m_KeyChunkUsed = 0;
+        BufferAppendOne(&w->m_KeyChunks, w->m_Heap, w->m_KeyChunk);
+    }
+
+    char *copy = w->m_KeyChunk + w->m_KeyChunkUsed;
+    w->m_KeyChunkUsed += size;
+    memcpy(copy, text, size);
+    return copy;
+}
+
+// Like WriteCommonStringPtr, but copies new keys out of the node's JSON memory.
+static void WriteNodeCommonStringPtr(NodeWriter *w, BinarySegment *seg, const char *text)
+{
+    const uint32_t hash = Djb2Hash(text);
+
+    if (const CommonStringRecord *r = HashTableLookup(&w->m_SharedStrings, hash, text))
+    {
+        BinarySegmentWritePointer(seg, r->m_Pointer);
+        return;
+    }
+
+    CommonStringRecord r;
+    r.m_Pointer = BinarySegmentPosition(w->m_StrSeg);
+    HashTableInsert(&w->m_SharedStrings, hash, NodeWriterCopyKey(w, text), r);
+    BinarySegmentWriteStringData(w->m_StrSeg, text);
+    BinarySegmentWritePointer(seg, r.m_Pointer);
+}
+
+static bool ComputeNodeGuid(const DagInputNode &node, HashDigest *digest_out)
+{
+    HashState h;
+    HashInit(&h);
+
+    for (size_t fi = 0, fi_count = node.m_Outputs.m_Count; fi < fi_count; ++fi)
+        HashAddString(&h, node.m_Outputs.m_Items[fi]);
+
+    if (node.m_Outputs.m_Count > 0)
+    {
+        HashAddString(&h, "salt for outputs");
+    }
+    else
+    {
+        // For nodes with no outputs, preserve the legacy behaviour
+
+        const char *action = node.m_Action;
+        const char *annotation = node.m_Annotation;
+
+        if (action && action[0])
+            HashAddString(&h, action);
+
+        for (size_t fi = 0, fi_count = node.m_Inputs.m_Count; fi < fi_count; ++fi)
+            HashAddString(&h, node.m_Inputs.m_Items[fi]);
+
+        if (annotation)
+            HashAddString(&h, annotation);
+
+        if ((!action || action[0] == '\0') && !node.m_Inputs.m_Items && !annotation)
+        {
+            return false;
+        }
+
+        HashAddString(&h, "salt for legacy");
+    }
+
+    HashFinalize(&h, digest_out);
+    return true;
+}
+
+static void HashOptionalString(HashState *h, const char *text)
+{
+    HashAddInteger(h, text ? 1 : 0);
+    if (text)
+        HashAddString(h, text);
+    HashAddSeparator(h);
+}
+
+static void HashStringArray(HashState *h, const DagInputArray<const char *> &strings)
+{
+    HashAddInteger(h, strings.m_Items ? strings.m_Count + 1 : 0);
+    for (size_t i = 0; i < strings.m_Count; ++i)
+        HashOptionalString(h, strings.m_Items[i]);
+}
+
+static void HashIntArray(HashState *h, const DagInputArray<int32_t> &values)
+{
+    HashAddInteger(h, values.m_Count);
+    for (size_t i = 0; i < values.m_Count; ++i)
+        HashAddInteger(h, uint64_t(int64_t(values.m_Items[i])));
+}
+
+// Everything that goes into a node's record, with dependencies as input indices.
+static void ComputeNodeContentDigest(const DagInputNode &node, HashDigest *digest_out)
+{
+    HashState h;
+    HashInit(&h);
+
+    HashOptionalString(&h, node.m_Action);
+    HashOptionalString(&h, node.m_Annotation);
+    HashOptionalString(&h, node.m_WriteTextFilePayload);
+    HashAddInteger(&h, uint64_t(int64_t(node.m_ScannerIndex)));
+    HashAddInteger(&h, node.m_Flags);
+    HashIntArray(&h, node.m_Deps);
+    HashStringArray(&h, node.m_Inputs);
+    HashStringArray(&h, node.m_Outputs);
+    HashStringArray(&h, node.m_OutputDirectories);
+    HashStringArray(&h, node.m_AuxOutputs);
+    HashStringArray(&h, node.m_FrontendResponseFiles);
+    HashStringArray(&h, node.m_AllowedOutputSubstrings);
+
+    HashAddInteger(&h, node.m_Env.m_Count);
+    for (size_t i = 0; i < node.m_Env.m_Count; ++i)
+    {
+        HashOptionalString(&h, node.m_Env.m_Items[i].m_Key);
+        HashOptionalString(&h, node.m_Env.m_Items[i].m_Value);
+    }
+
+    HashIntArray(&h, node.m_SharedResources);
+    HashStringArray(&h, node.m_FileSignatures);
+
+    HashAddInteger(&h, node.m_GlobSignatures.m_Items ? node.m_GlobSignatures.m_Count + 1 : 0);
+    for (size_t i = 0; i < node.m_GlobSignatures.m_Count; ++i)
+    {
+        HashOptionalString(&h, node.m_GlobSignatures.m_Items[i].m_Path);
+        HashOptionalString(&h, node.m_GlobSignatures.m_Items[i].m_Filter);
+        HashAddInteger(&h, node.m_GlobSignatures.m_Items[i].m_Recurse ? 1 : 0);
+    }
+
+    HashFinalize(&h, digest_out);
+}
+
+static bool StringArrayFromJson(const JsonObjectValue *json, const char *key, DagInputArray<const char *> *out, MemAllocLinear *alloc)
+{
+    out->m_Items = nullptr;
+    out->m_Count = 0;
+
+    const JsonArrayValue *array = FindArrayValue(json, key);
+    if (!array)
+        return true;
+
+    const char **items = LinearAllocateArray<const char *>(alloc, array->m_Count);
+    for (size_t i = 0, count = array->m_Count; i < count; ++i)
+    {
+        const JsonStringValue *str = array->m_Values[i]->AsString();
+        if (!str)
+            return false;
+        items[i] = str->m_String;
+    }
+
+    out->m_Items = items;
+    out->m_Count = array->m_Count;
+    return true;
+}
+
+static bool IntArrayFromJson(const JsonObjectValue *json, const char *key, DagInputArray<int32_t> *out, MemAllocLinear *alloc)
+{
+    out->m_Items = nullptr;
+    out->m_Count = 0;
+
+    const JsonArrayValue *array = FindArrayValue(json, key);
+    if (!array)
+        return true;
+
+    int32_t *items = LinearAllocateArray<int32_t>(alloc, array->m_Count);
+    for (size_t i = 0, count = array->m_Count; i < count; ++i)
+    {
+        const JsonNumberValue *number = array->m_Values[i]->AsNumber();
+        if (!number)
+            return false;
+        items[i] = int32_t(number->m_Number);
+    }
+
+    out->m_Items = items;
+    out->m_Count = array->m_Count;
+    return true;
+}
+
+static bool NodeFromJson(const JsonObjectValue *json, DagInputNode *node, MemAllocLinear *alloc)
+{
+    node->m_Action = FindStringValue(json, "Action");
+    node->m_Annotation = FindStringValue(json, "Annotation");
+    node->m_WriteTextFilePayload = FindStringValue(json, "WriteTextFilePayload");
+    node->m_ScannerIndex = (int32_t)FindIntValue(json, "ScannerIndex", -1);
+
+    uint32_t flags = 0;
+
+    flags |= GetNodeFlag(json, "OverwriteOutputs", Frozen::DagNode::kFlagOverwriteOutputs, true);
+    flags |= GetNodeFlag(json, "PreciousOutputs", Frozen::DagNode::kFlagPreciousOutputs);
+    flags |= GetNodeFlag(json, "AllowUnexpectedOutput", Frozen::DagNode::kFlagAllowUnexpectedOutput, false);
+    flags |= GetNodeFlag(json, "AllowUnwrittenOutputFiles", Frozen::DagNode::kFlagAllowUnwrittenOutputFiles, false);
+    flags |= GetNodeFlag(json, "BanContentDigestForInputs", Frozen::DagNode::kFlagBanContentDigestForInputs, false);
+    flags |= GetNodeFlag(json, "EarlyCutoff", Frozen::DagNode::kFlagEarlyCutoff, false);
+
+    node->m_Flags = flags;
+
+    node->m_Env.m_Items = nullptr;
+    node->m_Env.m_Count = 0;
+    if (const JsonArrayValue *env_vars = FindArrayValue(json, "Env"))
+    {
+        DagInputEnvVar *vars = LinearAllocateArray<DagInputEnvVar>(alloc, env_vars->m_Count);
+        for (size_t i = 0, count = env_vars->m_Count; i < count; ++i)
+        {
+            vars[i].m_Key = FindStringValue(env_vars->m_Values[i], "Key");
+            vars[i].m_Value = FindStringValue(env_vars->m_Values[i], "Value");
+
+            if (!vars[i].m_Key || !vars[i].m_Value)
+                return false;
+        }
+        node->m_Env.m_Items = vars;
+        node->m_Env.m_Count = env_vars->m_Count;
+    }
+
+    node->m_FileSignatures = FileSignaturesFromJson(json, alloc);
+    node->m_GlobSignatures = GlobSignaturesFromJson(json, alloc);
+
+    return IntArrayFromJson(json, "Deps", &node->m_Deps, alloc) &&
+           StringArrayFromJson(json, "Inputs", &node->m_Inputs, alloc) &&
+           StringArrayFromJson(json, "Outputs", &node->m_Outputs, alloc) &&
+           StringArrayFromJson(json, "TargetDirectories", &node->m_OutputDirectories, alloc) &&
+           StringArrayFromJson(json, "AuxOutputs", &node->m_AuxOutputs, alloc) &&
+           StringArrayFromJson(json, "FrontendResponseFiles", &node->m_FrontendResponseFiles, alloc) &&
+           StringArrayFromJson(json, "AllowedOutputSubstrings", &node->m_AllowedOutputSubstrings, alloc) &&
+           IntArrayFromJson(json, "SharedResources", &node->m_SharedResources, alloc);
+}
+
+static bool WriteNode(NodeWriter *w, NodeBatch *batch, const DagInputNode &node)
+{
+    BinarySegment *node_data_seg = w->m_NodeDataSeg;
+    BinarySegment *array2_seg = w->m_ArraySeg;
+    BinarySegment *str_seg = w->m_StrSeg;
+    MemAllocHeap *heap = w->m_Heap;
+    MemAllocLinear *scratch = &w->m_Scratch;
+
+    const int32_t index = batch->m_FirstIndex + int32_t(batch->m_Pending.m_Size);
+
+    // The payload of a write text file action is written to its first output.
+    if (node.m_WriteTextFilePayload != nullptr && 0 == node.m_Outputs.m_Count)
+        return false;
+
+    TempNodeGuid *guid = BufferAlloc(&batch->m_Guids, heap, 1);
+    guid->m_Node = index;
+    if (!ComputeNodeGuid(node, &guid->m_Digest))
+        return false;
+
+    const size_t record_start = BinarySegmentSize(node_data_seg);
+
+    PendingNode *pending = BufferAlloc(&batch->m_Pending, heap, 1);
+    pending->m_FirstDep = batch->m_Deps.m_Size;
+    pending->m_DepCount = int32_t(node.m_Deps.m_Count);
+    pending->m_ScannerIndex = node.m_ScannerIndex;
+    pending->m_Writer = w->m_Index;
+    pending->m_Record = record_start;
+    pending->m_Annotation = node.m_Annotation ? int64_t(BinarySegmentSize(str_seg)) : -1;
+    ComputeNodeContentDigest(node, &pending->m_ContentDigest);
+
+    BufferAppend(&batch->m_Deps, heap, node.m_Deps.m_Items, node.m_Deps.m_Count);
+
+    if (const PreviousDag *previous = w->m_Previous)
+    {
+        const Frozen::Dag *dag = previous->m_Dag;
+        const int32_t position = index < dag->m_NodeCount ? previous->m_Positions[index] : -1;
+
+        if (-1 == position || dag->m_NodeGuids[position] != guid->m_Digest)
+        {
+            batch->m_Diverged = true;
+        }
+        else if (dag->m_NodeContentDigests[position] == pending->m_ContentDigest && !node.m_FileSignatures.m_Count && !node.m_GlobSignatures.m_Count)
+        {
+            // Signatures are taken afresh on every compile, so only nodes without them are reused.
+            pending->m_Writer = -1;
+            pending->m_Record = 0;
+            pending->m_Annotation = -1;
+            return true;
+        }
+    }
+
+    ++batch->m_WrittenCount;
+
+    if (node.m_WriteTextFilePayload == nullptr)
+        WriteStringPtr(node_data_seg, str_seg, node.m_Action);
+    else
+        WriteStringPtr(node_data_seg, w->m_WriteTextFilePayloadsSeg, node.m_WriteTextFilePayload);
+
+    WriteStringPtr(node_data_seg, str_seg, node.m_Annotation);
+
+    WriteFileArray(node_data_seg, array2_seg, w->m_Paths, node.m_Inputs, scratch);
+    WriteFileArray(node_data_seg, array2_seg, w->m_Paths, node.m_Outputs, scratch);
+    WriteFileArray(node_data_seg, array2_seg, w->m_Paths, node.m_OutputDirectories, scratch);
+
+    WriteFileArray(node_data_seg, array2_seg, w->m_Paths, node.m_AuxOutputs, scratch);
+    WriteFileArray(node_data_seg, array2_seg, w->m_Paths, node.m_FrontendResponseFiles, scratch);
+
+    if (node.m_AllowedOutputSubstrings.m_Items)
+    {
+        int count = int(node.m_AllowedOutputSubstrings.m_Count);
+        BinarySegmentWriteInt32(node_data_seg, count);
+        BinarySegmentAlign(array2_seg, 4);
+        BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
+        for (int i = 0; i != count; i++)
+            WriteNodeCommonStringPtr(w, array2_seg, node.m_AllowedOutputSubstrings.m_Items[i]);
+    }
+    else
+    {
+        BinarySegmentWriteInt32(node_data_seg, 0);
+        BinarySegmentWriteNullPointer(node_data_seg);
+    }
+
+    // Environment variables
+    if (node.m_Env.m_Count > 0)
+    {
+        BinarySegmentAlign(array2_seg, 4);
+        BinarySegmentWriteInt32(node_data_seg, (int)node.m_Env.m_Count);
+        BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
+        for (size_t i = 0, count = node.m_Env.m_Count; i < count; ++i)
+        {
+            WriteNodeCommonStringPtr(w, array2_seg, node.m_Env.m_Items[i].m_Key);
+            WriteNodeCommonStringPtr(w, array2_seg, node.m_Env.m_Items[i].m_Value);
+        }
+    }
+    else
+    {
+        BinarySegmentWriteInt32(node_data_seg, 0);
+        BinarySegmentWriteNullPointer(node_data_seg);
+    }
+
+    // The scanner may not have been read yet; see PatchScanners().
+    BinarySegmentWriteNullPointer(node_data_seg);
+
+    if (node.m_SharedResources.m_Count > 0)
+    {
+        BinarySegmentAlign(array2_seg, 4);
+        BinarySegmentWriteInt32(node_data_seg, static_cast<int>(node.m_SharedResources.m_Count));
+        BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
+        for (size_t i = 0, count = node.m_SharedResources.m_Count; i < count; ++i)
+            BinarySegmentWriteInt32(array2_seg, node.m_SharedResources.m_Items[i]);
+    }
+    else
+    {
+        BinarySegmentWriteInt32(node_data_seg, 0);
+        BinarySegmentWriteNullPointer(node_data_seg);
+    }
+
+    EmitFileSignatures(node.m_FileSignatures, node_data_seg, array2_seg, str_seg);
+    EmitGlobSignatures(node.m_GlobSignatures, node_data_seg, array2_seg, str_seg, heap, scratch);
+
+    uint32_t flags = node.m_Flags;
+
+    if (node.m_WriteTextFilePayload != nullptr)
+        flags |= Frozen::DagNode::kFlagIsWriteTextFileAction;
+
+    BinarySegmentWriteUint32(node_data_seg, flags);
+    BinarySegmentWriteUint32(node_data_seg, uint32_t(index));
+
+    CHECK(BinarySegmentSize(node_data_seg) - record_start == sizeof(Frozen::DagNode));
+    return true;
+}
+
+static bool NodeFromBinary(const BinaryDagInput *input, int32_t index, DagInputNode *node, MemAllocLinear *alloc);
+
+static int32_t BatchNodeCount(const NodeBatch *batch)
+{
+    return batch->m_Binary ? batch->m_BinaryCount : int32_t(batch->m_Nodes.m_Size);
+}
+
+static void WriteBatch(NodeWriter *w, NodeBatch *batch)
+{
+    for (int32_t i = 0, count = BatchNodeCount(batch); i < count; ++i)
+    {
+        MemAllocLinearScope scratch_scope(&w->m_Scratch);
+        DagInputNode node;
+        bool valid;
+
+        if (batch->m_Binary)
+        {
+            valid = NodeFromBinary(batch->m_Binary, batch->m_FirstIndex + i, &node, &w->m_Scratch);
+        }
+        else
+        {
+            const JsonObjectValue *json = batch->m_Nodes[i]->AsObject();
+            valid = json && NodeFromJson(json, &node, &w->m_Scratch);
+        }
+
+        if (!valid || !WriteNode(w, batch, node))
+        {
+            batch->m_FailedIndex = batch->m_FirstIndex + i;
+            return;
+        }
+    }
+}
+
+// Largest batch handed to a writer, in nodes and in bytes of parsed JSON.
+static const size_t kNodeBatchSize = 256;
+static const size_t kNodeBatchBytes = MB(1);
+
+// A batch is handed off once it holds kNodeBatchBytes, so its allocator needs
+// room for a full batch plus one more node. Writers only use scratch per node.
+static const size_t kNodeBatchAllocSize = MB(16);
+static const size_t kNodeScratchSize = MB(16);
+
+// Hands batches of parsed nodes to a pool of writers, and gathers the results
+// back in input order.
+struct NodeCompiler
+{
+    MemAllocHeap *m_Heap;
+    // Start of the node array in the node data segment.
+    BinaryLocator m_Records;
+    int m_WriterCount;
+    NodeWriter *m_Writers;
+    // Zero to write every batch on the reading thread.
+    int m_ThreadCount;
+    ThreadId *m_Threads;
+    // Ring of batches; m_InFlight of them, starting at m_Oldest, are queued, being written or done.
+    int m_BatchCount;
+    NodeBatch *m_Batches;
+    int m_Oldest;
+    int m_InFlight;
+    Mutex m_Lock;
+    ConditionVariable m_WorkAvailable;
+    ConditionVariable m_BatchDone;
+    bool m_Quit;
+    int32_t m_NodeCount;
+    int32_t m_FailedIndex;
+    // Set to only write the nodes that changed since the previous DAG.
+    const PreviousDag *m_Previous;
+    int32_t m_WrittenCount;
+    // Set once the previous DAG can't be reused after all.
+    bool m_Diverged;
+    // Paths of all nodes, shared by the writers.
+    PathTable m_Paths;
+    // Results of the retired batches.
+    Buffer<TempNodeGuid> m_Guids;
+    Buffer<PendingNode> m_Pending;
+    Buffer<int32_t> m_Deps;
+};
+
+static ThreadRoutineReturnType TUNDRA_STDCALL NodeWriterThreadRoutine(void *param)
+{
+    NodeWriter *w = (NodeWriter *)param;
+    NodeCompiler *c = w->m_Compiler;
+
+    MutexLock(&c->m_Lock);
+
+    while (!c->m_Quit)
+    {
+        NodeBatch *batch = nullptr;
+        for (int i = 0; i < c->m_InFlight && !batch; ++i)
+        {
+            NodeBatch *candidate = &c->m_Batches[(c->m_Oldest + i) % c->m_BatchCount];
+            if (NodeBatch::kQueued == candidate->m_State)
+                batch = candidate;
+        }
+
+        if (!batch)
+        {
+            CondWait(&c->m_WorkAvailable, &c->m_Lock);
+            continue;
+        }
+
+        batch->m_State = NodeBatch::kWriting;
+        MutexUnlock(&c->m_Lock);
+
+        WriteBatch(w, batch);
+
+        MutexLock(&c->m_Lock);
+        batch->m_State = NodeBatch::kDone;
+        CondSignal(&c->m_BatchDone);
+    }
+
+    MutexUnlock(&c->m_Lock);
+    return 0;
+}
+
+// The first writer writes straight into node_data_seg.
+static void NodeCompilerInit(NodeCompiler *c, BinaryWriter *writer, BinarySegment *node_data_seg, BinarySegment *previous_seg, MemAllocHeap *heap, int thread_count, const PreviousDag *previous)
+{
+    c->m_Heap = heap;
+    c->m_Records = BinarySegmentPosition(node_data_seg);
+    c->m_ThreadCount = thread_count > 1 ? thread_count : 0;
+    c->m_WriterCount = thread_count > 1 ? thread_count : 1;
+    c->m_Writers = HeapAllocateArray<NodeWriter>(heap, c->m_WriterCount);
+    c->m_Threads = HeapAllocateArray<ThreadId>(heap, c->m_WriterCount);
+    c->m_BatchCount = 2 * c->m_WriterCount;
+    c->m_Batches = HeapAllocateArray<NodeBatch>(heap, c->m_BatchCount);
+    c->m_Oldest = 0;
+    c->m_InFlight = 0;
+    c->m_Quit = false;
+    c->m_NodeCount = 0;
+    c->m_FailedIndex = -1;
+    c->m_Previous = previous;
+    c->m_WrittenCount = 0;
+    c->m_Diverged = false;
+    BufferInit(&c->m_Guids);
+    BufferInit(&c->m_Pending);
+    BufferInit(&c->m_Deps);
+    PathTableInit(&c->m_Paths, writer, previous_seg, previous, heap);
+    MutexInit(&c->m_Lock);
+    CondInit(&c->m_WorkAvailable);
+    CondInit(&c->m_BatchDone);
+
+    for (int i = 0; i < c->m_WriterCount; ++i)
+    {
+        NodeWriter *w = &c->m_Writers[i];
+        w->m_Compiler = c;
+        w->m_Index = i;
+        w->m_NodeDataSeg = 0 == i ? node_data_seg : BinaryWriterAddSegment(writer);
+        w->m_ArraySeg = BinaryWriterAddSegment(writer);
+        w->m_StrSeg = BinaryWriterAddSegment(writer);
+        w->m_WriteTextFilePayloadsSeg = BinaryWriterAddSegment(writer);
+        w->m_Heap = heap;
+        w->m_Previous = previous;
+        w->m_Paths = &c->m_Paths;
+        HashTableInit(&w->m_SharedStrings, heap);
+        BufferInit(&w->m_KeyChunks);
+        w->m_KeyChunk = nullptr;
+        w->m_KeyChunkUsed = kKeyChunkSize;
+        LinearAllocInit(&w->m_Scratch, heap, kNodeScratchSize, "node writer scratch");
+    }
+
+    for (int i = 0; i < c->m_BatchCount; ++i)
+    {
+        NodeBatch *batch = &c->m_Batches[i];
+        batch->m_State = NodeBatch::kFree;
+        LinearAllocInit(&batch->m_Alloc, heap, kNodeBatchAllocSize, "json node alloc");
+        BufferInit(&batch->m_Nodes);
+        BufferInit(&batch->m_Guids);
+        BufferInit(&batch->m_Pending);
+        BufferInit(&batch->m_Deps);
+    }
+
+    for (int i = 0; i < c->m_ThreadCount; ++i)
+        c->m_Threads[i] = ThreadStart(NodeWriterThreadRoutine, &c->m_Writers[i], "Dag Compile Thread");
+}
+
+static void NodeCompilerDestroy(NodeCompiler *c)
+{
+    MemAllocHeap *heap = c->m_Heap;
+
+    MutexLock(&c->m_Lock);
+    c->m_Quit = true;
+    CondBroadcast(&c->m_WorkAvailable);
+    MutexUnlock(&c->m_Lock);
+
+    for (int i = 0; i < c->m_ThreadCount; ++i)
+        ThreadJoin(c->m_Threads[i]);
+
+    for (int i = 0; i < c->m_BatchCount; ++i)
+    {
+        NodeBatch *batch = &c->m_Batches[i];
+        BufferDestroy(&batch->m_Deps, heap);
+        BufferDestroy(&batch->m_Pending, heap);
+        BufferDestroy(&batch->m_Guids, heap);
+        BufferDestroy(&batch->m_Nodes, heap);
+        LinearAllocDestroy(&batch->m_Alloc);
+    }
+
+    for (int i = 0; i < c->m_WriterCount; ++i)
+    {
+        LinearAllocDestroy(&c->m_Writers[i].m_Scratch);
+        for (char *chunk : c->m_Writers[i].m_KeyChunks)
+            HeapFree(heap, chunk);
+        BufferDestroy(&c->m_Writers[i].m_KeyChunks, heap);
+        HashTableDestroy(&c->m_Writers[i].m_SharedStrings);
+    }
+
+    CondDestroy(&c->m_BatchDone);
+    CondDestroy(&c->m_WorkAvailable);
+    MutexDestroy(&c->m_Lock);
+    PathTableDestroy(&c->m_Paths);
+    BufferDestroy(&c->m_Deps, heap);
+    BufferDestroy(&c->m_Pending, heap);
+    BufferDestroy(&c->m_Guids, heap);
+    HeapFree(heap, c->m_Batches);
+    HeapFree(heap, c->m_Threads);
+    HeapFree(heap, c->m_Writers);
+}
+
+// Wait for the oldest batch in flight and append its results.
+static void NodeCompilerRetire(NodeCompiler *c)
+{
+    MemAllocHeap *heap = c->m_Heap;
+    NodeBatch *batch = &c->m_Batches[c->m_Oldest];
+
+    MutexLock(&c->m_Lock);
+    while (NodeBatch::kDone != batch->m_State)
+        CondWait(&c->m_BatchDone, &c->m_Lock);
+    c->m_Oldest = (c->m_Oldest + 1) % c->m_BatchCount;
+    --c->m_InFlight;
+    MutexUnlock(&c->m_Lock);
+
+    if (-1 == c->m_FailedIndex)
+    {
+        const size_t dep_base = c->m_Deps.m_Size;
+
+        c->m_FailedIndex = batch->m_FailedIndex;
+        c->m_WrittenCount += batch->m_WrittenCount;
+        c->m_Diverged = c->m_Diverged || batch->m_Diverged;
+        BufferAppend(&c->m_Guids, heap, batch->m_Guids.m_Storage, batch->m_Guids.m_Size);
+        BufferAppend(&c->m_Deps, heap, batch->m_Deps.m_Storage, batch->m_Deps.m_Size);
+
+        for (PendingNode pending : batch->m_Pending)
+        {
+            pending.m_FirstDep += dep_base;
+            BufferAppendOne(&c->m_Pending, heap, pending);
         }
     }
-    return defaultValue;
+
+    BufferClear(&batch->m_Nodes);
+    BufferClear(&batch->m_Guids);
+    BufferClear(&batch->m_Pending);
+    BufferClear(&batch->m_Deps);
+    LinearAllocReset(&batch->m_Alloc);
+    batch->m_State = NodeBatch::kFree;
+
+    // Past a point, writing the whole DAG again is cheaper than patching the previous one.
+    if (c->m_Previous && c->m_WrittenCount > c->m_Previous->m_Dag->m_NodeCount / 4)
+        c->m_Diverged = true;
 }
 
-static uint32_t GetNodeFlag(const JsonObjectValue *node, const char *name, uint32_t value, bool defaultValue = false)
+// Get a free batch to parse nodes into.
+static NodeBatch *NodeCompilerBeginBatch(NodeCompiler *c)
 {
-    return GetNodeFlagBool(node, name, defaultValue) ? value : 0;
+    if (c->m_InFlight == c->m_BatchCount)
+        NodeCompilerRetire(c);
+
+    NodeBatch *batch = &c->m_Batches[(c->m_Oldest + c->m_InFlight) % c->m_BatchCount];
+    batch->m_FirstIndex = c->m_NodeCount;
+    batch->m_Binary = nullptr;
+    batch->m_BinaryCount = 0;
+    batch->m_WrittenCount = 0;
+    batch->m_Diverged = false;
+    batch->m_FailedIndex = -1;
+    return batch;
 }
 
-static void EmitFileSignatures(const JsonObjectValue *json, BinarySegment *main_seg, BinarySegment *aux_seg, BinarySegment *str_seg)
+static void NodeCompilerSubmit(NodeCompiler *c, NodeBatch *batch)
 {
-    if (const JsonArrayValue *file_sigs = FindArrayValue(json, "FileSignatures"))
-    {
-        size_t count = file_sigs->m_Count;
-        BinarySegmentWriteInt32(main_seg, (int)count);
-        BinarySegmentWritePointer(main_seg, BinarySegmentPosition(aux_seg));
-        for (size_t i = 0; i < count; ++i)
-        {
-            if (const JsonObjectValue *sig = file_sigs->m_Values[i]->AsObject())
-            {
-                const char *path = FindStringValue(sig, "File");
-
-                if (!path)
-                {
-                    Croak("bad FileSignatures data: could not get 'File' member for object at index %zu\n", i);
-                }
+    c->m_NodeCount += BatchNodeCount(batch);
 
-                int64_t timestamp = GetFileInfo(path).m_Timestamp;
-                WriteStringPtr(aux_seg, str_seg, path);
-                char padding[4] = {0, 0, 0, 0};
-                BinarySegmentWrite(aux_seg, padding, 4);
-                BinarySegmentWriteUint64(aux_seg, uint64_t(timestamp));
-            }
-            else
-            {
-                Croak("bad FileSignatures data: array entry at index %zu was not an Object\n", i);
-            }
-        }
-    }
-    else
+    if (0 == c->m_ThreadCount)
     {
-        BinarySegmentWriteInt32(main_seg, 0);
-        BinarySegmentWriteNullPointer(main_seg);
+        WriteBatch(&c->m_Writers[0], batch);
+        batch->m_State = NodeBatch::kDone;
+        ++c->m_InFlight;
+        NodeCompilerRetire(c);
+        return;
     }
-};
 
-static void EmitGlobSignatures(const JsonObjectValue *json, BinarySegment *main_seg, BinarySegment *aux_seg, BinarySegment *str_seg, MemAllocHeap *heap, MemAllocLinear *scratch)
-{
-    if (const JsonArrayValue *glob_sigs = FindArrayValue(json, "GlobSignatures"))
-    {
-        size_t count = glob_sigs->m_Count;
-        BinarySegmentWriteInt32(main_seg, (int)count);
-        BinarySegmentWritePointer(main_seg, BinarySegmentPosition(aux_seg));
-        for (size_t i = 0; i < count; ++i)
-        {
-            if (const JsonObjectValue *sig = glob_sigs->m_Values[i]->AsObject())
-            {
-                const char *path = FindStringValue(sig, "Path");
-                if (!path)
-                {
-                    Croak("bad GlobSignatures data\n");
-                }
+    MutexLock(&c->m_Lock);
+    batch->m_State = NodeBatch::kQueued;
+    ++c->m_InFlight;
+    CondSignal(&c->m_WorkAvailable);
+    MutexUnlock(&c->m_Lock);
+}
 
-                const char *filter = FindStringValue(sig, "Filter");
-                bool recurse = FindIntValue(sig, "Recurse", 0) == 1;
+// Wait for every batch in flight. Returns false if a node couldn't be written.
+static bool NodeCompilerFinish(NodeCompiler *c)
+{
+    while (c->m_InFlight > 0)
+        NodeCompilerRetire(c);
 
-                HashDigest digest = CalculateGlobSignatureFor(path, filter, recurse, heap, scratch);
+    if (c->m_Previous && c->m_NodeCount != c->m_Previous->m_Dag->m_NodeCount)
+        c->m_Diverged = true;
 
-                WriteStringPtr(aux_seg, str_seg, path);
-                WriteStringPtr(aux_seg, str_seg, filter);
-                BinarySegmentWrite(aux_seg, (char *)&digest, sizeof digest);
-                BinarySegmentWriteInt32(aux_seg, recurse ? 1 : 0);
-            }
-        }
-    }
-    else
+    if (-1 != c->m_FailedIndex)
     {
-        BinarySegmentWriteInt32(main_seg, 0);
-        BinarySegmentWriteNullPointer(main_seg);
+        Log(kError, "bad data for node %d", c->m_FailedIndex);
+        return false;
     }
+
+    return true;
 }
 
-static bool WriteNodes(
-    const JsonArrayValue *nodes,
-    BinarySegment *main_seg,
-    BinarySegment *node_data_seg,
-    BinarySegment *array2_seg,
-    BinarySegment *str_seg,
-    BinarySegment *writetextfile_payloads_seg,
-    BinaryLocator scanner_ptrs[],
-    MemAllocHeap *heap,
-    HashTable<CommonStringRecord, kFlagCaseSensitive> *shared_strings,
-    MemAllocLinear *scratch,
-    const TempNodeGuid *order,
-    const int32_t *remap_table)
+// Sort the nodes by guid and compute where each input index ends up.
+static bool SortNodeGuids(NodeCompiler *c, int32_t *remap_table)
 {
-    BinarySegmentWritePointer(main_seg, BinarySegmentPosition(node_data_seg)); // m_DagNodes
-
-    MemAllocLinearScope scratch_scope(scratch);
+    TempNodeGuid *guid_table = c->m_Guids.m_Storage;
+    size_t node_count = c->m_Guids.m_Size;
 
-    size_t node_count = nodes->m_Count;
+    std::sort(guid_table, guid_table + node_count);
 
-    struct BacklinkRec
+    for (size_t i = 1; i < node_count; ++i)
     {
-        Buffer<int32_t> m_Links;
-    };
-
-    BacklinkRec *links = HeapAllocateArrayZeroed<BacklinkRec>(heap, node_count);
+        if (guid_table[i - 1].m_Digest == guid_table[i].m_Digest)
+        {
+            auto annotation = [c](int node) -> const char * {
+                const PendingNode &pending = c->m_Pending[node];
+                if (pending.m_Annotation < 0)
+                    return "(null)";
+                return (const char *)BinarySegmentDataAt(c->m_Writers[pending.m_Writer].m_StrSeg, size_t(pending.m_Annotation));
+            };
+            char digest[kDigestStringSize];
+            DigestToString(digest, guid_table[i].m_Digest);
+            Log(kError, "duplicate node guids: %s and %s share common GUID (%s)", annotation(guid_table[i - 1].m_Node), annotation(guid_table[i].m_Node), digest);
+            return false;
+        }
+    }
 
     for (size_t i = 0; i < node_count; ++i)
     {
-        const JsonObjectValue *node = nodes->m_Values[i]->AsObject();
-        if (!node)
-            return false;
-
-        const JsonArrayValue *deps = FindArrayValue(node, "Deps");
+        remap_table[guid_table[i].m_Node] = (int32_t)i;
+    }
 
-        if (EmptyArray(deps))
-            continue;
+    return true;
+}
 
-        for (size_t di = 0, count = deps->m_Count; di < count; ++di)
-        {
-            if (const JsonNumberValue *dep_index_n = deps->m_Values[di]->AsNumber())
-            {
-                int32_t dep_index = (int)dep_index_n->m_Number;
-                if (dep_index < 0 || dep_index >= (int)node_count)
-                    return false;
+// Move the records of all writers into one array, in guid order.
+static void GatherNodes(NodeCompiler *c, BinarySegment *node_data_seg, BinaryLocator records, const int32_t *remap_table)
+{
+    MemAllocHeap *heap = c->m_Heap;
+    const size_t node_count = c->m_Pending.m_Size;
 
-                BufferAppendOne(&links[dep_index].m_Links, heap, int32_t(i));
-            }
-            else
-            {
-                return false;
-            }
-        }
+    size_t *writer_base = HeapAllocateArray<size_t>(heap, c->m_WriterCount);
+    for (int i = 0; i < c->m_WriterCount; ++i)
+    {
+        BinarySegment *seg = c->m_Writers[i].m_NodeDataSeg;
+        writer_base[i] = seg == node_data_seg ? 0 : BinarySegmentSize(node_data_seg) - records.m_Offset;
+        if (seg != node_data_seg)
+            BinarySegmentMove(node_data_seg, seg);
     }
 
-    uint32_t *reverse_remap = (uint32_t *)HeapAllocate(heap, node_count * sizeof(uint32_t));
-    for (uint32_t i = 0; i < node_count; ++i)
+    int32_t *new_index = HeapAllocateArray<int32_t>(heap, node_count);
+    for (size_t i = 0; i < node_count; ++i)
     {
-        reverse_remap[remap_table[i]] = i;
+        const PendingNode &pending = c->m_Pending[i];
+        new_index[(writer_base[pending.m_Writer] + pending.m_Record) / sizeof(Frozen::DagNode)] = remap_table[i];
     }
 
-    for (size_t ni = 0; ni < node_count; ++ni)
-    {
-        const int32_t i = order[ni].m_Node;
-        const JsonObjectValue *node = nodes->m_Values[i]->AsObject();
+    BinarySegmentPermuteRecords(node_data_seg, records.m_Offset, sizeof(Frozen::DagNode), node_count, new_index, heap);
 
-        const char *action = FindStringValue(node, "Action");
-        const char *annotation = FindStringValue(node, "Annotation");
-        const JsonArrayValue *deps = FindArrayValue(node, "Deps");
-        const JsonArrayValue *inputs = FindArrayValue(node, "Inputs");
-        const JsonArrayValue *outputs = FindArrayValue(node, "Outputs");
-        const JsonArrayValue *output_dirs = FindArrayValue(node, "TargetDirectories");
-        const JsonArrayValue *aux_outputs = FindArrayValue(node, "AuxOutputs");
-        const JsonArrayValue *env_vars = FindArrayValue(node, "Env");
-        const int scanner_index = (int)FindIntValue(node, "ScannerIndex", -1);
-        const JsonArrayValue *shared_resources = FindArrayValue(node, "SharedResources");
-        const JsonArrayValue *frontend_rsps = FindArrayValue(node, "FrontendResponseFiles");
-        const JsonArrayValue *allowedOutputSubstrings = FindArrayValue(node, "AllowedOutputSubstrings");
-        const char *writetextfile_payload = FindStringValue(node, "WriteTextFilePayload");
+    HeapFree(heap, new_index);
+    HeapFree(heap, writer_base);
+}
 
-        if (writetextfile_payload == nullptr)
-            WriteStringPtr(node_data_seg, str_seg, action);
-        else
-            WriteStringPtr(node_data_seg, writetextfile_payloads_seg, writetextfile_payload);
+// Write the changed records over their slots in the copy of the previous DAG.
+static void ReplaceNodes(NodeCompiler *c, BinarySegment *previous_seg, BinaryLocator records, const int32_t *remap_table)
+{
+    MemAllocHeap *heap = c->m_Heap;
 
-        WriteStringPtr(node_data_seg, str_seg, annotation);
+    for (int w = 0; w < c->m_WriterCount; ++w)
+    {
+        BinarySegment *seg = c->m_Writers[w].m_NodeDataSeg;
+        size_t *dst_offsets = HeapAllocateArray<size_t>(heap, BinarySegmentSize(seg) / sizeof(Frozen::DagNode) + 1);
 
-        if (deps)
-        {
-            BinarySegmentAlign(array2_seg, 4);
-            BinarySegmentWriteInt32(node_data_seg, (int)deps->m_Count);
-            BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
-            for (size_t i = 0, count = deps->m_Count; i < count; ++i)
-            {
-                if (const JsonNumberValue *dep_index = deps->m_Values[i]->AsNumber())
-                {
-                    int index = (int)dep_index->m_Number;
-                    int remapped_index = remap_table[index];
-                    BinarySegmentWriteInt32(array2_seg, remapped_index);
-                }
-                else
-                {
-                    return false;
-                }
-            }
-        }
-        else
+        for (size_t i = 0, count = c->m_Pending.m_Size; i < count; ++i)
         {
-            BinarySegmentWriteInt32(node_data_seg, 0);
-            BinarySegmentWriteNullPointer(node_data_seg);
+            const PendingNode &pending = c->m_Pending[i];
+            if (pending.m_Writer == w)
+                dst_offsets[pending.m_Record / sizeof(Frozen::DagNode)] = records.m_Offset + size_t(remap_table[i]) * sizeof(Frozen::DagNode);
         }
 
-        const Buffer<int32_t> &backlinks = links[i].m_Links;
-        if (backlinks.m_Size > 0)
-        {
-            BinarySegmentWriteInt32(node_data_seg, (int)backlinks.m_Size);
-            BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
-            for (int32_t index : backlinks)
-            {
-                BinarySegmentWriteInt32(array2_seg, remap_table[index]);
-            }
-        }
-        else
-        {
-            BinarySegmentWriteInt32(node_data_seg, 0);
-            BinarySegmentWriteNullPointer(node_data_seg);
-        }
+        BinarySegmentTransferRecords(previous_seg, seg, sizeof(Frozen::DagNode), dst_offsets);
+        HeapFree(heap, dst_offsets);
+    }
+}
 
-        WriteFileArray(node_data_seg, array2_seg, str_seg, inputs);
-        WriteFileArray(node_data_seg, array2_seg, str_seg, outputs);
-        WriteFileArray(node_data_seg, array2_seg, str_seg, output_dirs);
+// Write the dependencies and backlinks of all nodes as index arrays with offsets, in guid order.
+static void WriteNodeLinks(NodeCompiler *c, BinarySegment *main_seg, BinarySegment *array_seg, const int32_t *remap_table)
+{
+    MemAllocHeap *heap = c->m_Heap;
+    const size_t node_count = c->m_Pending.m_Size;
+    const size_t link_count = c->m_Deps.m_Size;
 
-        WriteFileArray(node_data_seg, array2_seg, str_seg, aux_outputs);
-        WriteFileArray(node_data_seg, array2_seg, str_seg, frontend_rsps);
+    int32_t *dep_start = HeapAllocateArrayZeroed<int32_t>(heap, node_count + 1);
+    int32_t *link_start = HeapAllocateArrayZeroed<int32_t>(heap, node_count + 1);
+    int32_t *deps = HeapAllocateArray<int32_t>(heap, link_count + 1);
+    int32_t *links = HeapAllocateArray<int32_t>(heap, link_count + 1);
 
-        if (allowedOutputSubstrings)
-        {
-            int count = allowedOutputSubstrings->m_Count;
-            BinarySegmentWriteInt32(node_data_seg, count);
-            BinarySegmentAlign(array2_seg, 4);
-            BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
-            for (int i = 0; i != count; i++)
-                WriteCommonStringPtr(array2_seg, str_seg, allowedOutputSubstrings->m_Values[i]->AsString()->m_String, shared_strings, scratch);
-        }
-        else
-        {
-            BinarySegmentWriteInt32(node_data_seg, 0);
-            BinarySegmentWriteNullPointer(node_data_seg);
-        }
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        const PendingNode &pending = c->m_Pending[i];
+        dep_start[remap_table[i] + 1] = pending.m_DepCount;
+        for (int32_t d = 0; d < pending.m_DepCount; ++d)
+            ++link_start[remap_table[c->m_Deps[pending.m_FirstDep + d]] + 1];
+    }
 
-        // Environment variables
-        if (env_vars && env_vars->m_Count > 0)
-        {
-            BinarySegmentAlign(array2_seg, 4);
-            BinarySegmentWriteInt32(node_data_seg, (int)env_vars->m_Count);
-            BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
-            for (size_t i = 0, count = env_vars->m_Count; i < count; ++i)
-            {
-                const char *key = FindStringValue(env_vars->m_Values[i], "Key");
-                const char *value = FindStringValue(env_vars->m_Values[i], "Value");
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        dep_start[i + 1] += dep_start[i];
+        link_start[i + 1] += link_start[i];
+    }
 
-                if (!key || !value)
-                    return false;
+    // Backlinks are filled in input order, so link_fill[n] ends up at link_start[n + 1].
+    int32_t *link_fill = HeapAllocateArray<int32_t>(heap, node_count + 1);
+    memcpy(link_fill, link_start, sizeof(int32_t) * (node_count + 1));
 
-                WriteCommonStringPtr(array2_seg, str_seg, key, shared_strings, scratch);
-                WriteCommonStringPtr(array2_seg, str_seg, value, shared_strings, scratch);
-            }
-        }
-        else
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        const PendingNode &pending = c->m_Pending[i];
+        const int32_t node = remap_table[i];
+        for (int32_t d = 0; d < pending.m_DepCount; ++d)
         {
-            BinarySegmentWriteInt32(node_data_seg, 0);
-            BinarySegmentWriteNullPointer(node_data_seg);
+            const int32_t dep = remap_table[c->m_Deps[pending.m_FirstDep + d]];
+            deps[dep_start[node] + d] = dep;
+            links[link_fill[dep]++] = node;
         }
+    }
 
-        if (-1 != scanner_index)
-        {
-            BinarySegmentWritePointer(node_data_seg, scanner_ptrs[scanner_index]);
-        }
-        else
-        {
-            BinarySegmentWriteNullPointer(node_data_seg);
-        }
+    // Priorities: visit each node once all nodes that depend on it are done, starting
+    // from the nodes nothing depends on. Nodes on a cycle keep what they have so far.
+    int32_t *priorities = HeapAllocateArray<int32_t>(heap, node_count);
+    int32_t *stack = HeapAllocateArray<int32_t>(heap, node_count + 1);
+    size_t stack_size = 0;
 
-        if (shared_resources && shared_resources->m_Count > 0)
-        {
-            BinarySegmentAlign(array2_seg, 4);
-            BinarySegmentWriteInt32(node_data_seg, static_cast<int>(shared_resources->m_Count));
-            BinarySegmentWritePointer(node_data_seg, BinarySegmentPosition(array2_seg));
-            for (size_t i = 0, count = shared_resources->m_Count; i < count; ++i)
-            {
-                if (const JsonNumberValue *res_index = shared_resources->m_Values[i]->AsNumber())
-                {
-                    BinarySegmentWriteInt32(array2_seg, static_cast<int>(res_index->m_Number));
-                }
-                else
-                {
-                    return false;
-                }
-            }
-        }
-        else
+    for (size_t i = 0; i < node_count; ++i)
+    {
+        priorities[i] = 1;
+        link_fill[i] = link_start[i + 1] - link_start[i];
+        if (0 == link_fill[i])
+            stack[stack_size++] = int32_t(i);
+    }
+
+    while (stack_size > 0)
+    {
+        const int32_t node = stack[--stack_size];
+        for (int32_t k = dep_start[node]; k < dep_start[node + 1]; ++k)
         {
-            BinarySegmentWriteInt32(node_data_seg, 0);
-            BinarySegmentWriteNullPointer(node_data_seg);
+            const int32_t dep = deps[k];
+            if (priorities[dep] < priorities[node] + 1)
+                priorities[dep] = priorities[node] + 1;
+            if (0 == --link_fill[dep])
+                stack[stack_size++] = dep;
         }
+    }
 
-        EmitFileSignatures(node, node_data_seg, array2_seg, str_seg);
-        EmitGlobSignatures(node, node_data_seg, array2_seg, str_seg, heap, scratch);
+    auto write_array = [=](const int32_t *data, size_t count) {
+        BinarySegmentAlign(array_seg, 4);
+        BinarySegmentWritePointer(main_seg, BinarySegmentPosition(array_seg));
+        BinarySegmentWrite(array_seg, data, sizeof(int32_t) * count);
+    };
 
-        uint32_t flags = 0;
+    write_array(dep_start, node_count + 1); // m_DependencyOffsets
+    BinarySegmentWriteInt32(main_seg, int32_t(link_count));
+    write_array(deps, link_count); // m_Dependencies
+    write_array(link_start, node_count + 1); // m_BackLinkOffsets
+    BinarySegmentWriteInt32(main_seg, int32_t(link_count));
+    write_array(links, link_count); // m_BackLinks
+    write_array(priorities, node_count); // m_NodePriorities
+
+    HeapFree(heap, stack);
+    HeapFree(heap, priorities);
+    HeapFree(heap, link_fill);
+    HeapFree(heap, links);
+    HeapFree(heap, deps);
+    HeapFree(heap, link_start);
+    HeapFree(heap, dep_start);
+}
 
-        flags |= GetNodeFlag(node, "OverwriteOutputs", Frozen::DagNode::kFlagOverwriteOutputs, true);
-        flags |= GetNodeFlag(node, "PreciousOutputs", Frozen::DagNode::kFlagPreciousOutputs);
-        flags |= GetNodeFlag(node, "AllowUnexpectedOutput", Frozen::DagNode::kFlagAllowUnexpectedOutput, false);
-        flags |= GetNodeFlag(node, "AllowUnwrittenOutputFiles", Frozen::DagNode::kFlagAllowUnwrittenOutputFiles, false);
-        flags |= GetNodeFlag(node, "BanContentDigestForInputs", Frozen::DagNode::kFlagBanContentDigestForInputs, false);
+// Point the gathered node records at their scanners.
+static bool PatchScanners(
+    NodeCompiler *c,
+    BinarySegment *node_data_seg,
+    BinaryLocator records,
+    const int32_t *remap_table,
+    const BinaryLocator *scanner_ptrs,
+    size_t scanner_count)
+{
+    for (size_t i = 0, node_count = c->m_Pending.m_Size; i < node_count; ++i)
+    {
+        const PendingNode &pending = c->m_Pending[i];
 
-        if (writetextfile_payload != nullptr)
-            flags |= Frozen::DagNode::kFlagIsWriteTextFileAction;
+        if (-1 == pending.m_ScannerIndex)
+            continue;
 
-        BinarySegmentWriteUint32(node_data_seg, flags);
-        BinarySegmentWriteUint32(node_data_seg, reverse_remap[ni]);
-    }
+        if (pending.m_ScannerIndex < 0 || size_t(pending.m_ScannerIndex) >= scanner_count)
+        {
+            fprintf(stderr, "bad scanner index %d\n", pending.m_ScannerIndex);
+            return false;
+        }
 
-    for (size_t i = 0; i < node_count; ++i)
-    {
-        BufferDestroy(&links[i].m_Links, heap);
+        const size_t record = records.m_Offset + size_t(remap_table[i]) * sizeof(Frozen::DagNode);
+        BinarySegmentWritePointerAt(node_data_seg, record + offsetof(Frozen::DagNode, m_Scanner), scanner_ptrs[pending.m_ScannerIndex]);
     }
 
-    HeapFree(heap, reverse_remap);
-    HeapFree(heap, links);
-
     return true;
 }
 
@@ -512,6 +1568,81 @@ static bool GetBoolean(const JsonObjectValue *obj, const char *name)
     return false;
 }
 
+void WriteKeywordTrie(BinarySegment *segment, BinarySegment *array_seg, const char *const *keywords, int keyword_count, MemAllocLinear *scratch)
+{
+    MemAllocLinearScope scratch_scope(scratch);
+
+    struct BuildNode
+    {
+        int m_FirstChild;
+        int m_NextSibling;
+        int m_ChildCount;
+        int m_KeywordIndex;
+        char m_Char;
+    };
+
+    size_t max_nodes = 1;
+    for (int i = 0; i < keyword_count; ++i)
+        max_nodes += strlen(keywords[i]);
+
+    BuildNode *nodes = LinearAllocateArray<BuildNode>(scratch, max_nodes);
+    int node_count = 1;
+    nodes[0] = BuildNode{-1, -1, 0, -1, 0};
+
+    for (int i = 0; i < keyword_count; ++i)
+    {
+        int cur = 0;
+        for (const char *p = keywords[i]; *p; ++p)
+        {
+            int *link = &nodes[cur].m_FirstChild;
+            while (*link != -1 && nodes[*link].m_Char != *p)
+                link = &nodes[*link].m_NextSibling;
+
+            if (*link == -1)
+            {
+                nodes[node_count] = BuildNode{-1, -1, 0, -1, *p};
+                nodes[cur].m_ChildCount++;
+                *link = node_count++;
+            }
+
+            cur = *link;
+        }
+
+        // Keywords are tried in order, so an earlier duplicate wins.
+        if (nodes[cur].m_KeywordIndex == -1)
+            nodes[cur].m_KeywordIndex = i;
+    }
+
+    // Lay the nodes out breadth first so that siblings are contiguous.
+    int *order = LinearAllocateArray<int>(scratch, node_count);
+    int *remap = LinearAllocateArray<int>(scratch, node_count);
+    int tail = 1;
+    order[0] = 0;
+    for (int head = 0; head < tail; ++head)
+    {
+        for (int child = nodes[order[head]].m_FirstChild; child != -1; child = nodes[child].m_NextSibling)
+            order[tail++] = child;
+    }
+
+    for (int i = 0; i < node_count; ++i)
+        remap[order[i]] = i;
+
+    BinarySegmentAlign(array_seg, 4);
+    BinarySegmentWriteInt32(segment, node_count);
+    BinarySegmentWritePointer(segment, BinarySegmentPosition(array_seg));
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        // Siblings have distinct characters and keywords can't contain NUL, so there are at most 255.
+        const BuildNode &node = nodes[order[i]];
+        CHECK(node.m_ChildCount <= UINT8_MAX);
+        BinarySegmentWriteInt32(array_seg, node.m_FirstChild != -1 ? remap[node.m_FirstChild] : 0);
+        BinarySegmentWriteInt16(array_seg, (int16_t)node.m_KeywordIndex);
+        BinarySegmentWriteUint8(array_seg, (uint8_t)node.m_ChildCount);
+        BinarySegmentWriteUint8(array_seg, (uint8_t)node.m_Char);
+    }
+}
+
 static bool WriteScanner(BinaryLocator *ptr_out, BinarySegment *seg, BinarySegment *array_seg, BinarySegment *str_seg, const JsonObjectValue *data, HashTable<CommonStringRecord, kFlagCaseSensitive> *shared_strings, MemAllocLinear *scratch)
 {
     if (!data)
@@ -571,12 +1702,19 @@ static bool WriteScanner(BinaryLocator *ptr_out, BinarySegment *seg, BinarySegme
             (follow_kws ? follow_kws->m_Count : 0) +
             (nofollow_kws ? nofollow_kws->m_Count : 0);
 
+        if (kw_count > INT16_MAX)
+            return false;
+
+        MemAllocLinearScope scratch_scope(scratch);
+        const char **kw_strings = LinearAllocateArray<const char *>(scratch, kw_count);
+        int kw_index = 0;
+
         BinarySegmentWriteInt32(seg, (int)kw_count);
         if (kw_count > 0)
         {
             BinarySegmentAlign(array_seg, 4);
             BinarySegmentWritePointer(seg, BinarySegmentPosition(array_seg));
-            auto write_kws = [array_seg, str_seg](const JsonArrayValue *array, bool follow) -> bool {
+            auto write_kws = [array_seg, str_seg, kw_strings, &kw_index](const JsonArrayValue *array, bool follow) -> bool {
                 if (array)
                 {
                     for (size_t i = 0, count = array->m_Count; i < count; ++i)
@@ -584,124 +1722,30 @@ static bool WriteScanner(BinaryLocator *ptr_out, BinarySegment *seg, BinarySegme
                         const JsonStringValue *value = array->m_Values[i]->AsString();
                         if (!value)
                             return false;
+                        kw_strings[kw_index++] = value->m_String;
                         WriteStringPtr(array_seg, str_seg, value->m_String);
                         BinarySegmentWriteInt16(array_seg, (int16_t)strlen(value->m_String));
-                        BinarySegmentWriteUint8(array_seg, follow ? 1 : 0);
-                        BinarySegmentWriteUint8(array_seg, 0);
-                    }
-                }
-                return true;
-            };
-            if (!write_kws(follow_kws, true))
-                return false;
-            if (!write_kws(nofollow_kws, false))
-                return false;
-        }
-        else
-        {
-            BinarySegmentWriteNullPointer(seg);
-        }
-    }
-
-    HashFinalize(&h, static_cast<HashDigest *>(digest_space));
-
-    return true;
-}
-
-bool ComputeNodeGuids(const JsonArrayValue *nodes, int32_t *remap_table, TempNodeGuid *guid_table)
-{
-    size_t node_count = nodes->m_Count;
-    for (size_t i = 0; i < node_count; ++i)
-    {
-        const JsonObjectValue *nobj = nodes->m_Values[i]->AsObject();
-
-        if (!nobj)
-            return false;
-
-        guid_table[i].m_Node = (int)i;
-
-        HashState h;
-        HashInit(&h);
-
-        const JsonArrayValue *outputs = FindArrayValue(nobj, "Outputs");
-        bool didHashAnyOutputs = false;
-        if (outputs)
-        {
-            for (size_t fi = 0, fi_count = outputs->m_Count; fi < fi_count; ++fi)
-            {
-                if (const JsonStringValue *str = outputs->m_Values[fi]->AsString())
-                {
-                    HashAddString(&h, str->m_String);
-                    didHashAnyOutputs = true;
-                }
-            }
-        }
-
-        if (didHashAnyOutputs)
-        {
-            HashAddString(&h, "salt for outputs");
-        }
-        else
-        {
-            // For nodes with no outputs, preserve the legacy behaviour
-
-            const char *action = FindStringValue(nobj, "Action");
-            const JsonArrayValue *inputs = FindArrayValue(nobj, "Inputs");
-
-            if (action && action[0])
-                HashAddString(&h, action);
-
-            if (inputs)
-            {
-                for (size_t fi = 0, fi_count = inputs->m_Count; fi < fi_count; ++fi)
-                {
-                    if (const JsonStringValue *str = inputs->m_Values[fi]->AsString())
-                    {
-                        HashAddString(&h, str->m_String);
-                    }
-                }
-            }
-
-            const char *annotation = FindStringValue(nobj, "Annotation");
-
-            if (annotation)
-                HashAddString(&h, annotation);
-
-            if ((!action || action[0] == '\0') && !inputs && !annotation)
-            {
+                        BinarySegmentWriteUint8(array_seg, follow ? 1 : 0);
+                        BinarySegmentWriteUint8(array_seg, 0);
+                    }
+                }
+                return true;
+            };
+            if (!write_kws(follow_kws, true))
+                return false;
+            if (!write_kws(nofollow_kws, false))
                 return false;
-            }
-
-            HashAddString(&h, "salt for legacy");
         }
-
-        HashFinalize(&h, &guid_table[i].m_Digest);
-    }
-
-    std::sort(guid_table, guid_table + node_count);
-
-    for (size_t i = 1; i < node_count; ++i)
-    {
-        if (guid_table[i - 1].m_Digest == guid_table[i].m_Digest)
+        else
         {
-            int i0 = guid_table[i - 1].m_Node;
-            int i1 = guid_table[i].m_Node;
-            const JsonObjectValue *o0 = nodes->m_Values[i0]->AsObject();
-            const JsonObjectValue *o1 = nodes->m_Values[i1]->AsObject();
-            const char *anno0 = FindStringValue(o0, "Annotation");
-            const char *anno1 = FindStringValue(o1, "Annotation");
-            char digest[kDigestStringSize];
-            DigestToString(digest, guid_table[i].m_Digest);
-            Log(kError, "duplicate node guids: %s and %s share common GUID (%s)", anno0, anno1, digest);
-            return false;
+            BinarySegmentWriteNullPointer(seg);
         }
-    }
 
-    for (size_t i = 0; i < node_count; ++i)
-    {
-        remap_table[guid_table[i].m_Node] = (int32_t)i;
+        WriteKeywordTrie(seg, array_seg, kw_strings, kw_index, scratch);
     }
 
+    HashFinalize(&h, static_cast<HashDigest *>(digest_space));
+
     return true;
 }
 
@@ -781,33 +1825,297 @@ bool WriteSharedResources(const JsonArrayValue *resources, BinarySegment *main_s
     return true;
 }
 
-static bool CompileDag(const JsonObjectValue *root, BinaryWriter *writer, MemAllocHeap *heap, MemAllocLinear *scratch)
+// A binary input file (see DagInput.hpp) whose header and strings have been checked.
+struct BinaryDagInput
+{
+    const DagInput::Header *m_Header;
+    const DagInput::Node *m_Nodes;
+    const int32_t *m_Indices;
+    // Pointers into the file.
+    const char **m_Strings;
+    const char *m_Root;
+};
+
+static bool SectionValid(size_t file_size, uint64_t offset, uint64_t size, uint64_t alignment)
+{
+    return 0 == (offset & (alignment - 1)) && offset <= file_size && size <= file_size - offset;
+}
+
+// Node ranges and indices are checked as the nodes are read.
+static bool BinaryDagInputOpen(BinaryDagInput *self, const char *data, size_t size, MemAllocLinear *alloc)
+{
+    const DagInput::Header *header = (const DagInput::Header *)data;
+
+    if (size < sizeof *header || DagInput::Header::MagicNumber != header->m_MagicNumber || DagInput::Header::Version != header->m_Version)
+    {
+        Log(kError, "binary DAG input has a bad header");
+        return false;
+    }
+
+    if (!SectionValid(size, header->m_StringOffsets, sizeof(uint32_t) * uint64_t(header->m_StringCount), 4) ||
+        !SectionValid(size, header->m_StringData, header->m_StringDataSize, 4) ||
+        !SectionValid(size, header->m_Nodes, sizeof(DagInput::Node) * uint64_t(header->m_NodeCount), 4) ||
+        !SectionValid(size, header->m_Indices, sizeof(int32_t) * uint64_t(header->m_IndexCount), 4) ||
+        !SectionValid(size, header->m_Root, header->m_RootSize, 1))
+    {
+        Log(kError, "binary DAG input is truncated");
+        return false;
+    }
+
+    const uint32_t *string_offsets = (const uint32_t *)(data + header->m_StringOffsets);
+    const char *string_data = data + header->m_StringData;
+    const uint64_t string_data_size = header->m_StringDataSize;
+
+    self->m_Header = header;
+    self->m_Nodes = (const DagInput::Node *)(data + header->m_Nodes);
+    self->m_Indices = (const int32_t *)(data + header->m_Indices);
+    self->m_Strings = LinearAllocateArray<const char *>(alloc, header->m_StringCount);
+    self->m_Root = data + header->m_Root;
+
+    for (uint32_t i = 0; i < header->m_StringCount; ++i)
+    {
+        const uint64_t offset = string_offsets[i];
+        uint32_t length = 0;
+
+        if (0 == (offset & 3) && offset + sizeof length <= string_data_size)
+            memcpy(&length, string_data + offset, sizeof length);
+
+        if ((offset & 3) || offset + sizeof length + length >= string_data_size || string_data[offset + sizeof length + length])
+        {
+            Log(kError, "binary DAG input has a bad string at index %u", i);
+            return false;
+        }
+
+        self->m_Strings[i] = string_data + offset + sizeof length;
+    }
+
+    return true;
+}
+
+static bool RangeValid(const BinaryDagInput *input, const DagInput::Range &range, uint32_t stride)
+{
+    const uint32_t index_count = input->m_Header->m_IndexCount;
+    return range.m_First <= index_count && range.m_Count <= index_count - range.m_First && 0 == range.m_Count % stride;
+}
+
+// -1 reads as null.
+static bool StringFromBinary(const BinaryDagInput *input, int32_t index, const char **out)
+{
+    if (-1 == index)
+    {
+        *out = nullptr;
+        return true;
+    }
+
+    if (index < 0 || uint32_t(index) >= input->m_Header->m_StringCount)
+        return false;
+
+    *out = input->m_Strings[index];
+    return true;
+}
+
+static bool IntArrayFromBinary(const BinaryDagInput *input, const DagInput::Range &range, DagInputArray<int32_t> *out)
+{
+    if (!RangeValid(input, range, 1))
+        return false;
+
+    out->m_Items = range.m_Count ? input->m_Indices + range.m_First : nullptr;
+    out->m_Count = range.m_Count;
+    return true;
+}
+
+static bool StringArrayFromBinary(const BinaryDagInput *input, const DagInput::Range &range, DagInputArray<const char *> *out, MemAllocLinear *alloc)
+{
+    out->m_Items = nullptr;
+    out->m_Count = 0;
+
+    if (!RangeValid(input, range, 1))
+        return false;
+
+    if (0 == range.m_Count)
+        return true;
+
+    const char **items = LinearAllocateArray<const char *>(alloc, range.m_Count);
+    for (uint32_t i = 0; i < range.m_Count; ++i)
+    {
+        if (!StringFromBinary(input, input->m_Indices[range.m_First + i], &items[i]) || !items[i])
+            return false;
+    }
+
+    out->m_Items = items;
+    out->m_Count = range.m_Count;
+    return true;
+}
+
+// Node flags a frontend may set. Like with JSON input, kFlagIsWriteTextFileAction
+// follows from the presence of a payload.
+static const uint32_t kFrontendNodeFlags =
+    Frozen::DagNode::kFlagOverwriteOutputs |
+    Frozen::DagNode::kFlagPreciousOutputs |
+    Frozen::DagNode::kFlagAllowUnexpectedOutput |
+    Frozen::DagNode::kFlagAllowUnwrittenOutputFiles |
+    Frozen::DagNode::kFlagBanContentDigestForInputs |
+    Frozen::DagNode::kFlagEarlyCutoff;
+
+static bool NodeFromBinary(const BinaryDagInput *input, int32_t index, DagInputNode *node, MemAllocLinear *alloc)
+{
+    const DagInput::Node &record = input->m_Nodes[index];
+    const int32_t *indices = input->m_Indices;
+
+    node->m_ScannerIndex = record.m_ScannerIndex;
+    node->m_Flags = record.m_Flags & kFrontendNodeFlags;
+
+    if (!StringFromBinary(input, record.m_Action, &node->m_Action) ||
+        !StringFromBinary(input, record.m_Annotation, &node->m_Annotation) ||
+        !StringFromBinary(input, record.m_WriteTextFilePayload, &node->m_WriteTextFilePayload) ||
+        !IntArrayFromBinary(input, record.m_Deps, &node->m_Deps) ||
+        !StringArrayFromBinary(input, record.m_Inputs, &node->m_Inputs, alloc) ||
+        !StringArrayFromBinary(input, record.m_Outputs, &node->m_Outputs, alloc) ||
+        !StringArrayFromBinary(input, record.m_OutputDirectories, &node->m_OutputDirectories, alloc) ||
+        !StringArrayFromBinary(input, record.m_AuxOutputs, &node->m_AuxOutputs, alloc) ||
+        !StringArrayFromBinary(input, record.m_FrontendResponseFiles, &node->m_FrontendResponseFiles, alloc) ||
+        !StringArrayFromBinary(input, record.m_AllowedOutputSubstrings, &node->m_AllowedOutputSubstrings, alloc) ||
+        !IntArrayFromBinary(input, record.m_SharedResources, &node->m_SharedResources) ||
+        !StringArrayFromBinary(input, record.m_FileSignatures, &node->m_FileSignatures, alloc) ||
+        !RangeValid(input, record.m_Env, 2) ||
+        !RangeValid(input, record.m_GlobSignatures, 3))
+    {
+        return false;
+    }
+
+    DagInputEnvVar *vars = LinearAllocateArray<DagInputEnvVar>(alloc, record.m_Env.m_Count / 2);
+    for (uint32_t i = 0; i < record.m_Env.m_Count / 2; ++i)
+    {
+        const int32_t *pair = indices + record.m_Env.m_First + 2 * i;
+        if (!StringFromBinary(input, pair[0], &vars[i].m_Key) || !StringFromBinary(input, pair[1], &vars[i].m_Value) || !vars[i].m_Key || !vars[i].m_Value)
+            return false;
+    }
+    node->m_Env.m_Items = vars;
+    node->m_Env.m_Count = record.m_Env.m_Count / 2;
+
+    DagInputGlob *globs = LinearAllocateArray<DagInputGlob>(alloc, record.m_GlobSignatures.m_Count / 3);
+    for (uint32_t i = 0; i < record.m_GlobSignatures.m_Count / 3; ++i)
+    {
+        const int32_t *triple = indices + record.m_GlobSignatures.m_First + 3 * i;
+        if (!StringFromBinary(input, triple[0], &globs[i].m_Path) || !StringFromBinary(input, triple[1], &globs[i].m_Filter) || !globs[i].m_Path)
+            return false;
+        globs[i].m_Recurse = 1 == triple[2];
+    }
+    node->m_GlobSignatures.m_Items = record.m_GlobSignatures.m_Count ? globs : nullptr;
+    node->m_GlobSignatures.m_Count = record.m_GlobSignatures.m_Count / 3;
+
+    return true;
+}
+
+// How much of the input to read between releasing the pages behind the cursor.
+static const size_t kJsonDiscardInterval = MB(64);
+
+// Stream the root object of the input. Nodes are handed to the compiler as they
+// are read; the remaining members are small and are kept as a tree in alloc.
+static bool ReadDagJson(
+    JsonReader *reader,
+    MemoryMappedFile *json_file,
+    NodeCompiler *compiler,
+    size_t *key_count_out,
+    Buffer<const char *> *names,
+    Buffer<const JsonValue *> *values,
+    MemAllocHeap *heap,
+    MemAllocLinear *alloc,
+    MemAllocLinear *scratch)
 {
-    HashTable<CommonStringRecord, kFlagCaseSensitive> shared_strings;
-    HashTableInit(&shared_strings, heap);
+    size_t discarded = 0;
+    const char *key;
+
+    if (!JsonReaderBeginObject(reader))
+        return false;
+
+    while (JsonReaderNextKey(reader, &key))
+    {
+        ++*key_count_out;
+
+        if (0 != strcmp(key, "Nodes"))
+        {
+            const JsonValue *value = JsonReaderParseValue(reader, alloc, scratch);
+            if (!value)
+                return false;
+
+            BufferAppendOne(names, heap, key);
+            BufferAppendOne(values, heap, value);
+            continue;
+        }
+
+        if (!JsonReaderBeginArray(reader))
+            return false;
+
+        NodeBatch *batch = nullptr;
+
+        while (JsonReaderNextElement(reader))
+        {
+            if (!batch)
+                batch = NodeCompilerBeginBatch(compiler);
+
+            const JsonValue *value = JsonReaderParseValue(reader, &batch->m_Alloc, scratch);
+            if (!value)
+                return false;
+
+            BufferAppendOne(&batch->m_Nodes, heap, value);
+
+            if (batch->m_Nodes.m_Size == kNodeBatchSize || batch->m_Alloc.m_Offset >= kNodeBatchBytes)
+            {
+                NodeCompilerSubmit(compiler, batch);
+                batch = nullptr;
+
+                if (-1 != compiler->m_FailedIndex || compiler->m_Diverged)
+                    return false;
+            }
+
+            // Nothing behind the cursor is looked at again.
+            size_t offset = JsonReaderOffset(reader);
+            if (offset - discarded >= kJsonDiscardInterval)
+            {
+                MmapFileDiscard(json_file, discarded, offset - discarded);
+                discarded = offset;
+            }
+        }
 
-    BinarySegment *main_seg = BinaryWriterAddSegment(writer);
-    BinarySegment *node_guid_seg = BinaryWriterAddSegment(writer);
-    BinarySegment *node_data_seg = BinaryWriterAddSegment(writer);
-    BinarySegment *aux_seg = BinaryWriterAddSegment(writer);
-    BinarySegment *aux2_seg = BinaryWriterAddSegment(writer);
-    BinarySegment *str_seg = BinaryWriterAddSegment(writer);
-    BinarySegment *writetextfile_payloads_seg = BinaryWriterAddSegment(writer);
+        if (batch)
+            NodeCompilerSubmit(compiler, batch);
 
-    const JsonArrayValue *nodes = FindArrayValue(root, "Nodes");
+        if (JsonReaderError(reader)[0])
+            return false;
+    }
+
+    return !JsonReaderError(reader)[0] && JsonReaderFinish(reader);
+}
+
+static bool CompileDag(
+    const JsonObjectValue *root,
+    NodeCompiler *compiler,
+    BinarySegment *main_seg,
+    BinarySegment *node_guid_seg,
+    BinarySegment *node_data_seg,
+    BinarySegment *previous_seg,
+    BinarySegment *aux_seg,
+    BinarySegment *aux2_seg,
+    BinarySegment *str_seg,
+    HashTable<CommonStringRecord, kFlagCaseSensitive> *shared_strings,
+    MemAllocHeap *heap,
+    MemAllocLinear *scratch)
+{
     const JsonArrayValue *scanners = FindArrayValue(root, "Scanners");
     const JsonArrayValue *shared_resources = FindArrayValue(root, "SharedResources");
     const char *identifier = FindStringValue(root, "Identifier", "default");
 
     // Write scanners, store pointers
     BinaryLocator *scanner_ptrs = nullptr;
+    size_t scanner_count = EmptyArray(scanners) ? 0 : scanners->m_Count;
 
-    if (!EmptyArray(scanners))
+    if (scanner_count > 0)
     {
-        scanner_ptrs = (BinaryLocator *)alloca(sizeof(BinaryLocator) * scanners->m_Count);
-        for (size_t i = 0, count = scanners->m_Count; i < count; ++i)
+        scanner_ptrs = (BinaryLocator *)alloca(sizeof(BinaryLocator) * scanner_count);
+        for (size_t i = 0; i < scanner_count; ++i)
         {
-            if (!WriteScanner(&scanner_ptrs[i], aux_seg, aux2_seg, str_seg, scanners->m_Values[i]->AsObject(), &shared_strings, scratch))
+            if (!WriteScanner(&scanner_ptrs[i], aux_seg, aux2_seg, str_seg, scanners->m_Values[i]->AsObject(), shared_strings, scratch))
             {
                 fprintf(stderr, "invalid scanner data\n");
                 return false;
@@ -820,27 +2128,83 @@ static bool CompileDag(const JsonObjectValue *root, BinaryWriter *writer, MemAll
 
     BinarySegmentWriteUint32(main_seg, Djb2Hash(identifier));
 
+    size_t node_count = compiler->m_Pending.m_Size;
+
+    for (int32_t dep_index : compiler->m_Deps)
+    {
+        if (dep_index < 0 || dep_index >= (int)node_count)
+        {
+            Log(kError, "node dependency index %d out of range", dep_index);
+            return false;
+        }
+    }
+
     // Compute node guids and index remapping table.
     // FIXME: this just leaks
-    int32_t *remap_table = HeapAllocateArray<int32_t>(heap, nodes->m_Count);
-    TempNodeGuid *guid_table = HeapAllocateArray<TempNodeGuid>(heap, nodes->m_Count);
+    int32_t *remap_table = HeapAllocateArray<int32_t>(heap, node_count);
 
-    if (!ComputeNodeGuids(nodes, remap_table, guid_table))
+    // When patching the previous DAG, the guids are known to be those it was sorted by.
+    const PreviousDag *previous = compiler->m_Previous;
+    if (previous)
+        memcpy(remap_table, previous->m_Positions, sizeof(int32_t) * node_count);
+    else if (!SortNodeGuids(compiler, remap_table))
         return false;
 
     // m_NodeCount
-    size_t node_count = nodes->m_Count;
     BinarySegmentWriteInt32(main_seg, int(node_count));
 
-    // Write node guids
-    BinarySegmentWritePointer(main_seg, BinarySegmentPosition(node_guid_seg)); // m_NodeGuids
-    for (size_t i = 0; i < node_count; ++i)
+    BinarySegment *record_seg = node_data_seg;
+    BinaryLocator records = compiler->m_Records;
+
+    if (previous)
+    {
+        // Everything the unchanged nodes point to is already in the previous DAG; take it as is.
+        const char *base = (const char *)previous->m_File.m_Address;
+        BinaryLocator guids = BinarySegmentPosition(previous_seg);
+        records = BinarySegmentPosition(previous_seg);
+        BinarySegmentWrite(previous_seg, base, previous->m_File.m_Size);
+
+        guids.m_Offset += size_t((const char *)previous->m_Dag->m_NodeGuids.Get() - base);
+        BinarySegmentWritePointer(main_seg, guids); // m_NodeGuids
+
+        record_seg = previous_seg;
+        records.m_Offset += size_t((const char *)previous->m_Dag->m_DagNodes.Get() - base);
+    }
+    else
     {
-        BinarySegmentWrite(node_guid_seg, (char *)&guid_table[i].m_Digest, sizeof guid_table[i].m_Digest);
+        // Write node guids
+        BinarySegmentWritePointer(main_seg, BinarySegmentPosition(node_guid_seg)); // m_NodeGuids
+        for (size_t i = 0; i < node_count; ++i)
+        {
+            const TempNodeGuid &guid = compiler->m_Guids[i];
+            BinarySegmentWrite(node_guid_seg, (const char *)&guid.m_Digest, sizeof guid.m_Digest);
+        }
     }
 
     // Write nodes.
-    if (!WriteNodes(nodes, main_seg, node_data_seg, aux_seg, str_seg, writetextfile_payloads_seg, scanner_ptrs, heap, &shared_strings, scratch, guid_table, remap_table))
+    BinarySegmentWritePointer(main_seg, records); // m_DagNodes
+
+    HashDigest *content_digests = HeapAllocateArray<HashDigest>(heap, node_count);
+    for (size_t i = 0; i < node_count; ++i)
+        content_digests[remap_table[i]] = compiler->m_Pending[i].m_ContentDigest;
+
+    BinarySegmentWritePointer(main_seg, BinarySegmentPosition(node_guid_seg)); // m_NodeContentDigests
+    BinarySegmentWrite(node_guid_seg, content_digests, sizeof(HashDigest) * node_count);
+    HeapFree(heap, content_digests);
+
+    BinarySegmentWriteInt32(main_seg, previous ? previous->m_Dag->m_IncrementalCompileCount + 1 : 0);
+    BinarySegmentWriteUint32(main_seg, previous ? previous->m_Dag->m_CompactSize : 0); // filled in by DagOutputFlush
+
+    WriteNodeLinks(compiler, main_seg, aux_seg, remap_table);
+
+    PathTableEmit(&compiler->m_Paths, main_seg, aux_seg);
+
+    if (previous)
+        ReplaceNodes(compiler, record_seg, records, remap_table);
+    else
+        GatherNodes(compiler, record_seg, records, remap_table);
+
+    if (!PatchScanners(compiler, record_seg, records, remap_table, scanner_ptrs, scanner_count))
         return false;
 
     const JsonObjectValue *named_nodes = FindObjectValue(root, "NamedNodes");
@@ -879,8 +2243,11 @@ static bool CompileDag(const JsonObjectValue *root, BinaryWriter *writer, MemAll
     if (!WriteSharedResources(shared_resources, main_seg, aux_seg, aux2_seg, str_seg))
         return false;
 
-    EmitFileSignatures(root, main_seg, aux_seg, str_seg);
-    EmitGlobSignatures(root, main_seg, aux_seg, str_seg, heap, scratch);
+    {
+        MemAllocLinearScope scratch_scope(scratch);
+        EmitFileSignatures(FileSignaturesFromJson(root, scratch), main_seg, aux_seg, str_seg);
+        EmitGlobSignatures(GlobSignaturesFromJson(root, scratch), main_seg, aux_seg, str_seg, heap, scratch);
+    }
 
     // Emit hashes of file extensions to sign using SHA-1 content digest instead of the normal timestamp signing.
     if (const JsonArrayValue *sha_exts = FindArrayValue(root, "ContentDigestExtensions"))
@@ -913,6 +2280,12 @@ static bool CompileDag(const JsonObjectValue *root, BinaryWriter *writer, MemAll
     }
 
     BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "DaysToKeepUnreferencedNodesAround", -1));
+    BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "ScanCacheContentDigests", 0));
+    BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "CacheDaysToKeep", 7));
+    BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "DigestCacheMaxRecords", 0));
+    BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "ScanCacheMaxRecords", 0));
+    BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "ExtendedTimestampSignatures", 0));
+    BinarySegmentWriteInt32(main_seg, (int)FindIntValue(root, "CompressFilesAboveKb", 0));
 
     WriteStringPtr(main_seg, str_seg, FindStringValue(root, "StateFileName", ".tundra2.state"));
     WriteStringPtr(main_seg, str_seg, FindStringValue(root, "StateFileNameTmp", ".tundra2.state.tmp"));
@@ -925,15 +2298,98 @@ static bool CompileDag(const JsonObjectValue *root, BinaryWriter *writer, MemAll
 
     WriteStringPtr(main_seg, str_seg, FindStringValue(root, "BuildTitle", "Tundra"));
     WriteStringPtr(main_seg, str_seg, FindStringValue(root, "StructuredLogFileName"));
-
-    HashTableDestroy(&shared_strings);
+    WriteStringPtr(main_seg, str_seg, FindStringValue(root, "ContentDigestXattr"));
+    WriteStringPtr(main_seg, str_seg, FindStringValue(root, "SharedDigestStore"));
 
     //write magic number again at the end to pretect against writing too much / too little data and not noticing.
     BinarySegmentWriteUint32(main_seg, Frozen::Dag::MagicNumber);
     return true;
 }
 
-static bool CreateDagFromJsonData(char *json_memory, const char *dag_fn)
+// The frozen DAG being written, whichever format the input is in.
+struct DagOutput
+{
+    BinaryWriter m_Writer;
+    BinarySegment *m_MainSeg;
+    BinarySegment *m_NodeGuidSeg;
+    BinarySegment *m_NodeDataSeg;
+    BinarySegment *m_AuxSeg;
+    BinarySegment *m_Aux2Seg;
+    BinarySegment *m_StrSeg;
+    // Holds a copy of the previous DAG when recompiling incrementally.
+    BinarySegment *m_PreviousSeg;
+    HashTable<CommonStringRecord, kFlagCaseSensitive> m_SharedStrings;
+    PreviousDag m_Previous;
+    bool m_HasPrevious;
+    NodeCompiler m_Compiler;
+};
+
+// Unless incremental is false, the DAG in dag_fn is picked up to be patched.
+static void DagOutputInit(DagOutput *self, const char *dag_fn, bool incremental, MemAllocHeap *heap, int thread_count)
+{
+    HashTableInit(&self->m_SharedStrings, heap);
+    BinaryWriterInit(&self->m_Writer, heap);
+
+    self->m_MainSeg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_NodeGuidSeg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_NodeDataSeg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_AuxSeg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_Aux2Seg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_StrSeg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_PreviousSeg = BinaryWriterAddSegment(&self->m_Writer);
+
+    self->m_HasPrevious = incremental && PreviousDagLoad(&self->m_Previous, dag_fn, heap);
+
+    NodeCompilerInit(&self->m_Compiler, &self->m_Writer, self->m_NodeDataSeg, self->m_PreviousSeg, heap, thread_count, self->m_HasPrevious ? &self->m_Previous : nullptr);
+}
+
+static void DagOutputDestroy(DagOutput *self, MemAllocHeap *heap)
+{
+    if (self->m_HasPrevious)
+        PreviousDagDestroy(&self->m_Previous, heap);
+    self->m_HasPrevious = false;
+
+    NodeCompilerDestroy(&self->m_Compiler);
+    BinaryWriterDestroy(&self->m_Writer);
+    HashTableDestroy(&self->m_SharedStrings);
+}
+
+// Compile the root and the nodes handed to the compiler, and write the result to dag_fn.
+static bool DagOutputFlush(DagOutput *self, const JsonObjectValue *root, const char *dag_fn, MemAllocHeap *heap, MemAllocLinear *scratch)
+{
+    if (!CompileDag(root, &self->m_Compiler, self->m_MainSeg, self->m_NodeGuidSeg, self->m_NodeDataSeg, self->m_PreviousSeg, self->m_AuxSeg, self->m_Aux2Seg, self->m_StrSeg, &self->m_SharedStrings, heap, scratch))
+        return false;
+
+    // A DAG written in full records its own size, so later recompiles can tell how much they added.
+    if (!self->m_HasPrevious)
+    {
+        size_t size = 0;
+        for (BinarySegment *seg : self->m_Writer.m_Segments)
+            size += (BinarySegmentSize(seg) + 15) & ~size_t(15);
+
+        const uint32_t compact_size = uint32_t(size);
+        BinarySegmentWriteAt(self->m_MainSeg, offsetof(Frozen::Dag, m_CompactSize), &compact_size, sizeof compact_size);
+    }
+
+    // The previous DAG has been copied; let go of it before its file is rewritten.
+    if (self->m_HasPrevious)
+        PreviousDagDestroy(&self->m_Previous, heap);
+    self->m_HasPrevious = false;
+
+    const int64_t compress_above_kb = FindIntValue(root, "CompressFilesAboveKb", 0);
+    self->m_Writer.m_CompressThreshold = compress_above_kb > 0 ? size_t(compress_above_kb) * 1024 : 0;
+
+    return BinaryWriterFlush(&self->m_Writer, dag_fn);
+}
+
+// Whether the nodes read don't match the previous DAG after all, so that the
+// input has to be compiled again in full.
+static bool DagOutputDiverged(const DagOutput *self)
+{
+    return self->m_Compiler.m_Diverged;
+}
+
+static bool CreateDagFromJsonData(MemoryMappedFile *json_file, const char *dag_fn, int thread_count, bool incremental, bool *diverged_out)
 {
     MemAllocHeap heap;
     HeapInit(&heap);
@@ -944,41 +2400,114 @@ static bool CreateDagFromJsonData(char *json_memory, const char *dag_fn)
     LinearAllocInit(&alloc, &heap, MB(256), "json alloc");
     LinearAllocInit(&scratch, &heap, MB(64), "json scratch");
 
-    char error_msg[1024];
+    DagOutput output;
+    DagOutputInit(&output, dag_fn, incremental, &heap, thread_count);
+
+    Buffer<const char *> names;
+    Buffer<const JsonValue *> values;
+    BufferInit(&names);
+    BufferInit(&values);
+
+    JsonReader *reader = JsonReaderCreate(&heap, (const char *)json_file->m_Address, json_file->m_Size, &alloc);
 
-    bool result = false;
+    size_t key_count = 0;
+    bool result = ReadDagJson(reader, json_file, &output.m_Compiler, &key_count, &names, &values, &heap, &alloc, &scratch);
 
-    const JsonValue *value = JsonParse(json_memory, &alloc, &scratch, error_msg);
+    if (!result && JsonReaderError(reader)[0])
+        Log(kError, "failed to parse JSON: %s", JsonReaderError(reader));
 
-    if (value)
+    result = NodeCompilerFinish(&output.m_Compiler) && result;
+
+    *diverged_out = DagOutputDiverged(&output) && !JsonReaderError(reader)[0];
+    result = result && !*diverged_out;
+
+    if (result && 0 == key_count)
     {
-        if (const JsonObjectValue *obj = value->AsObject())
-        {
-            if (obj->m_Count == 0)
-            {
-                Log(kInfo, "Nothing to do");
-                exit(0);
-            }
+        Log(kInfo, "Nothing to do");
+        exit(0);
+    }
 
-            BinaryWriter writer;
-            BinaryWriterInit(&writer, &heap);
+    if (result)
+    {
+        JsonObjectValue root;
+        root.m_Type = JsonValue::kObject;
+        root.m_Count = names.m_Size;
+        root.m_Names = names.m_Storage;
+        root.m_Values = values.m_Storage;
 
-            result = CompileDag(obj, &writer, &heap, &scratch);
+        result = DagOutputFlush(&output, &root, dag_fn, &heap, &scratch);
+    }
 
-            result = result && BinaryWriterFlush(&writer, dag_fn);
+    JsonReaderDestroy(reader);
+    BufferDestroy(&values, &heap);
+    BufferDestroy(&names, &heap);
+    DagOutputDestroy(&output, &heap);
 
-            BinaryWriterDestroy(&writer);
-        }
-        else
-        {
-            Log(kError, "bad JSON structure");
-        }
+    LinearAllocDestroy(&scratch);
+    LinearAllocDestroy(&alloc);
+
+    HeapDestroy(&heap);
+    return result;
+}
+
+static bool CreateDagFromBinaryData(MemoryMappedFile *input_file, const char *dag_fn, int thread_count, bool incremental, bool *diverged_out)
+{
+    MemAllocHeap heap;
+    HeapInit(&heap);
+
+    MemAllocLinear alloc;
+    MemAllocLinear scratch;
+
+    LinearAllocInit(&alloc, &heap, MB(256), "binary input alloc");
+    LinearAllocInit(&scratch, &heap, MB(64), "binary input scratch");
+
+    DagOutput output;
+    DagOutputInit(&output, dag_fn, incremental, &heap, thread_count);
+
+    BinaryDagInput input;
+    const JsonObjectValue *root = nullptr;
+
+    bool result = BinaryDagInputOpen(&input, (const char *)input_file->m_Address, input_file->m_Size, &alloc);
+
+    if (result)
+    {
+        const uint32_t root_size = input.m_Header->m_RootSize;
+        char *root_text = root_size ? StrDupN(&alloc, input.m_Root, root_size) : StrDup(&alloc, "{}");
+        char error_msg[1024];
+
+        const JsonValue *value = JsonParse(root_text, &alloc, &scratch, error_msg);
+        root = value ? value->AsObject() : nullptr;
+
+        if (!value)
+            Log(kError, "failed to parse binary DAG input root: %s", error_msg);
+        else if (!root || root->Find("Nodes"))
+            Log(kError, "binary DAG input root must be an object without Nodes");
+
+        result = root && !root->Find("Nodes");
     }
-    else
+
+    if (result)
     {
-        Log(kError, "failed to parse JSON: %s", error_msg);
+        NodeCompiler *compiler = &output.m_Compiler;
+        const int32_t node_count = int32_t(input.m_Header->m_NodeCount);
+
+        for (int32_t first = 0; first < node_count && -1 == compiler->m_FailedIndex && !compiler->m_Diverged; first += int32_t(kNodeBatchSize))
+        {
+            NodeBatch *batch = NodeCompilerBeginBatch(compiler);
+            batch->m_Binary = &input;
+            batch->m_BinaryCount = std::min(node_count - first, int32_t(kNodeBatchSize));
+            NodeCompilerSubmit(compiler, batch);
+        }
+
+        result = NodeCompilerFinish(compiler);
+        *diverged_out = DagOutputDiverged(&output);
+        result = result && !*diverged_out;
     }
 
+    result = result && DagOutputFlush(&output, root, dag_fn, &heap, &scratch);
+
+    DagOutputDestroy(&output, &heap);
+
     LinearAllocDestroy(&scratch);
     LinearAllocDestroy(&alloc);
 
@@ -986,7 +2515,7 @@ static bool CreateDagFromJsonData(char *json_memory, const char *dag_fn)
     return result;
 }
 
-bool FreezeDagJson(const char* json_filename, const char* dag_fn)
+bool FreezeDagJson(const char* json_filename, const char* dag_fn, int thread_count, bool incremental)
 {
     FileInfo json_info = GetFileInfo(json_filename);
     if (!json_info.Exists())
@@ -995,35 +2524,47 @@ bool FreezeDagJson(const char* json_filename, const char* dag_fn)
         return false;
     }
 
-    size_t json_size = size_t(json_info.m_Size + 1);
-    char *json_memory = (char *)malloc(json_size);
-    if (!json_memory)
-        Croak("couldn't allocate memory for JSON buffer");
+    // The input is only read, and front to back, so it is mapped rather than loaded.
+    MemoryMappedFile json_file;
+    MmapFileInit(&json_file);
+    MmapFileMap(&json_file, json_filename);
 
-    FILE *f = fopen(json_filename, "rb");
-    if (!f)
+    if (!MmapFileValid(&json_file))
     {
-        Log(kError, "couldn't open %s for reading", json_filename);
+        Log(kError, "couldn't map %s for reading", json_filename);
         return false;
     }
 
-    size_t read_count = fread(json_memory, 1, json_size - 1, f);
-    if (json_size - 1 != read_count)
+    MmapFileAdviseSequential(&json_file);
+
+    bool diverged = false;
+    bool success = CreateDagFromJsonData(&json_file, dag_fn, thread_count, incremental, &diverged);
+    if (diverged)
+        success = CreateDagFromJsonData(&json_file, dag_fn, thread_count, false, &diverged);
+
+    MmapFileDestroy(&json_file);
+
+    return success;
+}
+
+bool FreezeDagBinary(const char* input_filename, const char* dag_fn, int thread_count, bool incremental)
+{
+    MemoryMappedFile input_file;
+    MmapFileInit(&input_file);
+    MmapFileMap(&input_file, input_filename);
+
+    if (!MmapFileValid(&input_file))
     {
-        fclose(f);
-        free(json_memory);
-        Log(kError, "couldn't read JSON data (%d bytes read out of %d)",
-            json_filename, (int)read_count, (int)json_size);
+        Log(kError, "couldn't map %s for reading", input_filename);
         return false;
     }
 
-    fclose(f);
-
-    json_memory[json_size - 1] = 0;
-
-    bool success = CreateDagFromJsonData(json_memory, dag_fn);
+    bool diverged = false;
+    bool success = CreateDagFromBinaryData(&input_file, dag_fn, thread_count, incremental, &diverged);
+    if (diverged)
+        success = CreateDagFromBinaryData(&input_file, dag_fn, thread_count, false, &diverged);
 
-    free(json_memory);
+    MmapFileDestroy(&input_file);
 
     return success;
 }
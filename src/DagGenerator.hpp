@@ -10,5 +10,12 @@ struct CommonStringRecord
 struct MemAllocLinear;
 
 
-bool FreezeDagJson(const char* json_filename, const char* dag_filename);
+// Compile the frontend's JSON into a frozen DAG. Nodes are written by thread_count threads; 1 or less writes them on the calling thread.
+// If incremental is set and the nodes are the same ones, in the same order, as in the DAG already in
+// dag_filename, only the nodes that changed are written and the rest of that DAG is reused.
+bool FreezeDagJson(const char* json_filename, const char* dag_filename, int thread_count, bool incremental);
+// Like FreezeDagJson(), for the binary input described in DagInput.hpp.
+bool FreezeDagBinary(const char* input_filename, const char* dag_filename, int thread_count, bool incremental);
 void WriteCommonStringPtr(BinarySegment *segment, BinarySegment *str_seg, const char *ptr, HashTable<CommonStringRecord, 0> *table, MemAllocLinear *scratch);
+// Write a FrozenArray<Frozen::KeywordTrieNode> for the keywords to segment, with the nodes in array_seg.
+void WriteKeywordTrie(BinarySegment *segment, BinarySegment *array_seg, const char *const *keywords, int keyword_count, MemAllocLinear *scratch);
@@ -0,0 +1,118 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Binary DAG input, an alternative to the JSON the frontend normally writes.
+// Strings are stored once, length prefixed and null terminated, and referred
+// to by index; nodes are fixed size records whose variable length members are
+// ranges of a shared index array. Everything but the nodes is small and is
+// carried as a JSON object, with the same members as the JSON input.
+//
+// All offsets are from the start of the file; all sections are 8 byte aligned.
+namespace DagInput
+{
+    struct Header
+    {
+        static const uint32_t MagicNumber = 0x49474454; // "TDGI"
+        static const uint32_t Version = 1;
+
+        uint32_t m_MagicNumber;
+        uint32_t m_Version;
+        uint32_t m_StringCount;
+        uint32_t m_NodeCount;
+        uint32_t m_IndexCount;
+        uint32_t m_RootSize;
+        // uint32_t[m_StringCount], each the offset of a string from m_StringData.
+        uint64_t m_StringOffsets;
+        // Each string is a uint32_t length, the characters and a null, padded to 4 bytes.
+        uint64_t m_StringData;
+        uint64_t m_StringDataSize;
+        // Node[m_NodeCount]
+        uint64_t m_Nodes;
+        // int32_t[m_IndexCount]
+        uint64_t m_Indices;
+        // m_RootSize bytes of JSON, not null terminated.
+        uint64_t m_Root;
+    };
+    static_assert(sizeof(Header) == 72, "struct layout");
+
+    // A run of the index array.
+    struct Range
+    {
+        uint32_t m_First;
+        uint32_t m_Count;
+    };
+
+    struct Node
+    {
+        // String indices, or -1.
+        int32_t m_Action;
+        int32_t m_Annotation;
+        int32_t m_WriteTextFilePayload;
+        // Index into the "Scanners" member of the root, or -1.
+        int32_t m_ScannerIndex;
+        // Frozen::DagNode::kFlag* bits.
+        uint32_t m_Flags;
+        // Node indices.
+        Range m_Deps;
+        // String indices.
+        Range m_Inputs;
+        Range m_Outputs;
+        Range m_OutputDirectories;
+        Range m_AuxOutputs;
+        Range m_FrontendResponseFiles;
+        Range m_AllowedOutputSubstrings;
+        // Pairs of key and value string indices.
+        Range m_Env;
+        // Indices into the "SharedResources" member of the root.
+        Range m_SharedResources;
+        // String indices of files whose timestamps to track.
+        Range m_FileSignatures;
+        // Triples of path string index, filter string index or -1, and 1 to recurse or 0.
+        Range m_GlobSignatures;
+    };
+    static_assert(sizeof(Node) == 108, "struct layout");
+}
+
+// m_Items is null when the member is absent (or, in binary input, empty).
+template <typename T>
+struct DagInputArray
+{
+    const T *m_Items;
+    size_t m_Count;
+};
+
+struct DagInputEnvVar
+{
+    const char *m_Key;
+    const char *m_Value;
+};
+
+struct DagInputGlob
+{
+    const char *m_Path;
+    const char *m_Filter;
+    bool m_Recurse;
+};
+
+// A node as the frontend describes it, whichever format it came in.
+struct DagInputNode
+{
+    const char *m_Action;
+    const char *m_Annotation;
+    // Set for nodes that write a text file rather than run an action.
+    const char *m_WriteTextFilePayload;
+    int32_t m_ScannerIndex;
+    uint32_t m_Flags;
+    DagInputArray<int32_t> m_Deps;
+    DagInputArray<const char *> m_Inputs;
+    DagInputArray<const char *> m_Outputs;
+    DagInputArray<const char *> m_OutputDirectories;
+    DagInputArray<const char *> m_AuxOutputs;
+    DagInputArray<const char *> m_FrontendResponseFiles;
+    DagInputArray<const char *> m_AllowedOutputSubstrings;
+    DagInputArray<DagInputEnvVar> m_Env;
+    DagInputArray<int32_t> m_SharedResources;
+    DagInputArray<const char *> m_FileSignatures;
+    DagInputArray<DagInputGlob> m_GlobSignatures;
+};
@@ -0,0 +1,219 @@
+#include "DagInputWriter.hpp"
+#include "MemAllocHeap.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+static const size_t kKeyChunkSize = 1024 * 1024;
+
+void DagInputWriterInit(DagInputWriter *self, MemAllocHeap *heap)
+{
+    self->m_Heap = heap;
+    HashTableInit(&self->m_StringIndices, heap);
+    BufferInit(&self->m_KeyChunks);
+    self->m_KeyChunk = nullptr;
+    self->m_KeyChunkUsed = kKeyChunkSize;
+    BufferInit(&self->m_StringOffsets);
+    BufferInit(&self->m_StringData);
+    BufferInit(&self->m_Nodes);
+    BufferInit(&self->m_Indices);
+    BufferInit(&self->m_Root);
+}
+
+void DagInputWriterDestroy(DagInputWriter *self)
+{
+    MemAllocHeap *heap = self->m_Heap;
+
+    for (char *chunk : self->m_KeyChunks)
+        HeapFree(heap, chunk);
+
+    BufferDestroy(&self->m_Root, heap);
+    BufferDestroy(&self->m_Indices, heap);
+    BufferDestroy(&self->m_Nodes, heap);
+    BufferDestroy(&self->m_StringData, heap);
+    BufferDestroy(&self->m_StringOffsets, heap);
+    BufferDestroy(&self->m_KeyChunks, heap);
+    HashTableDestroy(&self->m_StringIndices);
+}
+
+// Keep a copy of a string that stays put for as long as the writer lives.
+static const char *CopyKey(DagInputWriter *self, const char *text, size_t size)
+{
+    if (size > kKeyChunkSize)
+    {
+        char *block = (char *)HeapAllocate(self->m_Heap, size);
+        BufferAppendOne(&self->m_KeyChunks, self->m_Heap, block);
+        memcpy(block, text, size);
+        return block;
+    }
+
+    if (self->m_KeyChunkUsed + size > kKeyChunkSize)
+    {
+        self->m_KeyChunk = (char *)HeapAllocate(self->m_Heap, kKeyChunkSize);
+        self->m_KeyChunkUsed = 0;
+        BufferAppendOne(&self->m_KeyChunks, self->m_Heap, self->m_KeyChunk);
+    }
+
+    char *copy = self->m_KeyChunk + self->m_KeyChunkUsed;
+    self->m_KeyChunkUsed += size;
+    memcpy(copy, text, size);
+    return copy;
+}
+
+static int32_t StringIndex(DagInputWriter *self, const char *text)
+{
+    if (!text)
+        return -1;
+
+    const uint32_t hash = Djb2Hash(text);
+    if (int32_t *index = HashTableLookup(&self->m_StringIndices, hash, text))
+        return *index;
+
+    const uint32_t length = uint32_t(strlen(text));
+    const int32_t index = int32_t(self->m_StringOffsets.m_Size);
+
+    if (self->m_StringData.m_Size > UINT32_MAX - length - 8)
+        Croak("binary DAG input: too much string data");
+
+    BufferAppendOne(&self->m_StringOffsets, self->m_Heap, uint32_t(self->m_StringData.m_Size));
+    BufferAppend(&self->m_StringData, self->m_Heap, (const uint8_t *)&length, sizeof length);
+    BufferAppend(&self->m_StringData, self->m_Heap, (const uint8_t *)text, length + 1);
+    while (self->m_StringData.m_Size & 3)
+        BufferAppendOne(&self->m_StringData, self->m_Heap, uint8_t(0));
+
+    HashTableInsert(&self->m_StringIndices, hash, CopyKey(self, text, length + 1), index);
+    return index;
+}
+
+static DagInput::Range BeginRange(DagInputWriter *self)
+{
+    DagInput::Range range;
+    range.m_First = uint32_t(self->m_Indices.m_Size);
+    range.m_Count = 0;
+    return range;
+}
+
+static DagInput::Range WriteIntRange(DagInputWriter *self, const DagInputArray<int32_t> &values)
+{
+    DagInput::Range range = BeginRange(self);
+    BufferAppend(&self->m_Indices, self->m_Heap, values.m_Items, values.m_Count);
+    range.m_Count = uint32_t(values.m_Count);
+    return range;
+}
+
+static DagInput::Range WriteStringRange(DagInputWriter *self, const DagInputArray<const char *> &strings)
+{
+    DagInput::Range range = BeginRange(self);
+    for (size_t i = 0; i < strings.m_Count; ++i)
+        BufferAppendOne(&self->m_Indices, self->m_Heap, StringIndex(self, strings.m_Items[i]));
+    range.m_Count = uint32_t(strings.m_Count);
+    return range;
+}
+
+int32_t DagInputWriterAddNode(DagInputWriter *self, const DagInputNode &node)
+{
+    MemAllocHeap *heap = self->m_Heap;
+    DagInput::Node record;
+
+    record.m_Action = StringIndex(self, node.m_Action);
+    record.m_Annotation = StringIndex(self, node.m_Annotation);
+    record.m_WriteTextFilePayload = StringIndex(self, node.m_WriteTextFilePayload);
+    record.m_ScannerIndex = node.m_ScannerIndex;
+    record.m_Flags = node.m_Flags;
+    record.m_Deps = WriteIntRange(self, node.m_Deps);
+    record.m_Inputs = WriteStringRange(self, node.m_Inputs);
+    record.m_Outputs = WriteStringRange(self, node.m_Outputs);
+    record.m_OutputDirectories = WriteStringRange(self, node.m_OutputDirectories);
+    record.m_AuxOutputs = WriteStringRange(self, node.m_AuxOutputs);
+    record.m_FrontendResponseFiles = WriteStringRange(self, node.m_FrontendResponseFiles);
+    record.m_AllowedOutputSubstrings = WriteStringRange(self, node.m_AllowedOutputSubstrings);
+
+    record.m_Env = BeginRange(self);
+    for (size_t i = 0; i < node.m_Env.m_Count; ++i)
+    {
+        BufferAppendOne(&self->m_Indices, heap, StringIndex(self, node.m_Env.m_Items[i].m_Key));
+        BufferAppendOne(&self->m_Indices, heap, StringIndex(self, node.m_Env.m_Items[i].m_Value));
+    }
+    record.m_Env.m_Count = uint32_t(2 * node.m_Env.m_Count);
+
+    record.m_SharedResources = WriteIntRange(self, node.m_SharedResources);
+    record.m_FileSignatures = WriteStringRange(self, node.m_FileSignatures);
+
+    record.m_GlobSignatures = BeginRange(self);
+    for (size_t i = 0; i < node.m_GlobSignatures.m_Count; ++i)
+    {
+        const DagInputGlob &glob = node.m_GlobSignatures.m_Items[i];
+        BufferAppendOne(&self->m_Indices, heap, StringIndex(self, glob.m_Path));
+        BufferAppendOne(&self->m_Indices, heap, StringIndex(self, glob.m_Filter));
+        BufferAppendOne(&self->m_Indices, heap, int32_t(glob.m_Recurse ? 1 : 0));
+    }
+    record.m_GlobSignatures.m_Count = uint32_t(3 * node.m_GlobSignatures.m_Count);
+
+    BufferAppendOne(&self->m_Nodes, heap, record);
+    return int32_t(self->m_Nodes.m_Size - 1);
+}
+
+void DagInputWriterSetRoot(DagInputWriter *self, const char *json)
+{
+    BufferClear(&self->m_Root);
+    BufferAppend(&self->m_Root, self->m_Heap, json, strlen(json));
+}
+
+static uint64_t AlignSection(uint64_t offset)
+{
+    return (offset + 7) & ~uint64_t(7);
+}
+
+bool DagInputWriterFlush(DagInputWriter *self, const char *filename)
+{
+    DagInput::Header header;
+    memset(&header, 0, sizeof header);
+
+    header.m_MagicNumber = DagInput::Header::MagicNumber;
+    header.m_Version = DagInput::Header::Version;
+    header.m_StringCount = uint32_t(self->m_StringOffsets.m_Size);
+    header.m_NodeCount = uint32_t(self->m_Nodes.m_Size);
+    header.m_IndexCount = uint32_t(self->m_Indices.m_Size);
+    header.m_RootSize = uint32_t(self->m_Root.m_Size);
+    header.m_StringOffsets = AlignSection(sizeof header);
+    header.m_StringData = AlignSection(header.m_StringOffsets + sizeof(uint32_t) * self->m_StringOffsets.m_Size);
+    header.m_StringDataSize = self->m_StringData.m_Size;
+    header.m_Nodes = AlignSection(header.m_StringData + header.m_StringDataSize);
+    header.m_Indices = AlignSection(header.m_Nodes + sizeof(DagInput::Node) * self->m_Nodes.m_Size);
+    header.m_Root = AlignSection(header.m_Indices + sizeof(int32_t) * self->m_Indices.m_Size);
+
+    FILE *f = fopen(filename, "wb");
+    if (!f)
+    {
+        Log(kError, "couldn't open %s for writing", filename);
+        return false;
+    }
+
+    uint64_t position = 0;
+    bool success = true;
+
+    auto write_section = [&](uint64_t offset, const void *data, size_t size) {
+        static const char padding[8] = {0};
+        if (offset > position)
+            success = success && offset - position == fwrite(padding, 1, size_t(offset - position), f);
+        success = success && size == fwrite(data, 1, size, f);
+        position = offset + size;
+    };
+
+    write_section(0, &header, sizeof header);
+    write_section(header.m_StringOffsets, self->m_StringOffsets.m_Storage, sizeof(uint32_t) * self->m_StringOffsets.m_Size);
+    write_section(header.m_StringData, self->m_StringData.m_Storage, self->m_StringData.m_Size);
+    write_section(header.m_Nodes, self->m_Nodes.m_Storage, sizeof(DagInput::Node) * self->m_Nodes.m_Size);
+    write_section(header.m_Indices, self->m_Indices.m_Storage, sizeof(int32_t) * self->m_Indices.m_Size);
+    write_section(header.m_Root, self->m_Root.m_Storage, self->m_Root.m_Size);
+
+    if (0 != fclose(f))
+        success = false;
+
+    if (!success)
+        Log(kError, "couldn't write %s", filename);
+
+    return success;
+}
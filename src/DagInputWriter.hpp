@@ -0,0 +1,36 @@
+#pragma once
+
+#include "DagInput.hpp"
+#include "Buffer.hpp"
+#include "HashTable.hpp"
+
+struct MemAllocHeap;
+
+// Reference writer for binary DAG input (see DagInput.hpp), for frontends to
+// link or to copy. Strings are deduplicated as they are added.
+struct DagInputWriter
+{
+    MemAllocHeap *m_Heap;
+    HashTable<int32_t, kFlagCaseSensitive> m_StringIndices;
+    // Copies of the strings, as keys for m_StringIndices.
+    Buffer<char *> m_KeyChunks;
+    char *m_KeyChunk;
+    size_t m_KeyChunkUsed;
+    Buffer<uint32_t> m_StringOffsets;
+    Buffer<uint8_t> m_StringData;
+    Buffer<DagInput::Node> m_Nodes;
+    Buffer<int32_t> m_Indices;
+    Buffer<char> m_Root;
+};
+
+void DagInputWriterInit(DagInputWriter *self, MemAllocHeap *heap);
+void DagInputWriterDestroy(DagInputWriter *self);
+
+// Add a node, returning the index other nodes depend on it by. Unlike the JSON
+// input, m_Flags has no defaults; kFlagOverwriteOutputs must be set explicitly.
+int32_t DagInputWriterAddNode(DagInputWriter *self, const DagInputNode &node);
+
+// Everything but the nodes, as a JSON object with the members of the JSON input.
+void DagInputWriterSetRoot(DagInputWriter *self, const char *json);
+
+bool DagInputWriterFlush(DagInputWriter *self, const char *filename);
@@ -14,6 +14,7 @@ void DigestCacheInit(DigestCache *self, size_t heap_size, const char *filename)
 
     self->m_Initialized = true;
     self->m_State = nullptr;
+    self->m_FrozenAccessed = nullptr;
 
     HeapInit(&self->m_Heap);
     LinearAllocInit(&self->m_Allocator, &self->m_Heap, heap_size / 2, "digest allocator");
@@ -22,32 +23,19 @@ void DigestCacheInit(DigestCache *self, size_t heap_size, const char *filename)
 
     self->m_AccessTime = time(nullptr);
 
-    MmapFileMap(&self->m_StateFile, filename);
+    // By default, throw out records that haven't been accessed in a week.
+    CacheRetentionInit(&self->m_Retention, self->m_AccessTime, 7, 0);
+    self->m_CompressThreshold = 0;
+
+    MmapFileMapFrozen(&self->m_StateFile, filename);
     if (MmapFileValid(&self->m_StateFile))
     {
         const Frozen::DigestCacheState *state = (const Frozen::DigestCacheState *)self->m_StateFile.m_Address;
         if (Frozen::DigestCacheState::MagicNumber == state->m_MagicNumber)
         {
-            const uint64_t time_now = time(nullptr);
-
-            // Throw out records that haven't been accessed in a week.
-            const uint64_t cutoff_time = time_now - 7 * 24 * 60 * 60;
-
+            // Frozen records are looked up in place; only note which ones get used so their access time survives the next save.
             self->m_State = state;
-
-            //HashTablePrepareBulkInsert(&self->m_Table, state->m_Records.GetCount());
-
-            for (const Frozen::DigestRecord &record : state->m_Records)
-            {
-                if (record.m_AccessTime < cutoff_time)
-                    continue;
-
-                DigestCacheRecord r;
-                r.m_ContentDigest = record.m_ContentDigest;
-                r.m_Timestamp = record.m_Timestamp;
-                r.m_AccessTime = record.m_AccessTime;
-                HashTableInsert(&self->m_Table, record.m_FilenameHash, record.m_Filename.Get(), r);
-            }
+            self->m_FrozenAccessed = HeapAllocateArrayZeroed<uint8_t>(&self->m_Heap, state->m_Records.GetCount() + 1);
             Log(kDebug, "digest cache initialized -- %d entries", state->m_Records.GetCount());
         }
         else
@@ -61,6 +49,7 @@ void DigestCacheDestroy(DigestCache *self)
 {
     if (!self->m_Initialized)
         return;
+    HeapFree(&self->m_Heap, self->m_FrozenAccessed);
     HashTableDestroy(&self->m_Table);
     MmapFileDestroy(&self->m_StateFile);
     LinearAllocDestroy(&self->m_Allocator);
@@ -68,23 +57,131 @@ void DigestCacheDestroy(DigestCache *self)
     ReadWriteLockDestroy(&self->m_Lock);
 }
 
+void DigestCacheSetRetention(DigestCache *self, int32_t days_to_keep, uint32_t max_records)
+{
+    CacheRetentionInit(&self->m_Retention, self->m_AccessTime, days_to_keep, max_records);
+}
+
+void DigestCacheSetCompressThreshold(DigestCache *self, size_t threshold)
+{
+    self->m_CompressThreshold = threshold;
+}
+
+// Write an open-addressing index over the record hashes so lookups in the
+// mapped file don't have to scan every record.
+static uint32_t DigestCacheEmitIndex(BinarySegment *index_seg, MemAllocHeap *heap, const uint32_t *hashes, uint32_t record_count, BinaryLocator *index_ptr)
+{
+    if (0 == record_count)
+        return 0;
+
+    // Keep the load factor at or below 50% to keep probe sequences short.
+    uint32_t index_size = NextPowerOfTwo(record_count * 2);
+    if (index_size < 16)
+        index_size = 16;
+
+    const uint32_t mask = index_size - 1;
+    Frozen::DigestIndexSlot *slots = HeapAllocateArray<Frozen::DigestIndexSlot>(heap, index_size);
+
+    for (uint32_t i = 0; i < index_size; ++i)
+    {
+        slots[i].m_FilenameHash = 0;
+        slots[i].m_Index = -1;
+    }
+
+    for (uint32_t i = 0; i < record_count; ++i)
+    {
+        uint32_t slot = hashes[i] & mask;
+
+        while (slots[slot].m_Index >= 0)
+            slot = (slot + 1) & mask;
+
+        slots[slot].m_FilenameHash = hashes[i];
+        slots[slot].m_Index = int32_t(i);
+    }
+
+    *index_ptr = BinarySegmentPosition(index_seg);
+    BinarySegmentWrite(index_seg, slots, sizeof(Frozen::DigestIndexSlot) * index_size);
+
+    HeapFree(heap, slots);
+
+    return index_size;
+}
+
+const Frozen::DigestRecord *DigestCacheFindFrozen(const Frozen::DigestCacheState *state, const char *filename, uint32_t hash)
+{
+    const uint32_t index_size = state->m_IndexSize;
+
+    if (0 == index_size)
+        return nullptr;
+
+    const Frozen::DigestIndexSlot *slots = state->m_Index.Get();
+    const Frozen::DigestRecord *records = state->m_Records.GetArray();
+    uint32_t slot = hash & (index_size - 1);
+
+    for (;;)
+    {
+        const Frozen::DigestIndexSlot &s = slots[slot];
+
+        if (s.m_Index < 0)
+            return nullptr;
+
+        if (s.m_FilenameHash == hash && 0 == HashTableCompare<kFlagPathStrings>(records[s.m_Index].m_Filename, filename))
+            return &records[s.m_Index];
+
+        slot = (slot + 1) & (index_size - 1);
+    }
+}
+
+// Visit the overlay, then frozen records that weren't replaced by it.
+template <typename Callback>
+static void DigestCacheForEachRecord(DigestCache *self, Callback callback)
+{
+    HashTableWalk(&self->m_Table, [&](size_t index, uint32_t hash, const char *path, const DigestCacheRecord &r) {
+        callback(hash, path, r.m_Timestamp, r.m_AccessTime, r.m_ContentDigest);
+    });
+
+    if (const Frozen::DigestCacheState *state = self->m_State)
+    {
+        const int32_t count = state->m_Records.GetCount();
+        for (int32_t i = 0; i < count; ++i)
+        {
+            const Frozen::DigestRecord &record = state->m_Records[i];
+
+            if (HashTableLookup(&self->m_Table, record.m_FilenameHash, record.m_Filename.Get()))
+                continue;
+
+            const uint64_t access_time = self->m_FrozenAccessed[i] ? self->m_AccessTime : record.m_AccessTime;
+            callback(record.m_FilenameHash, record.m_Filename.Get(), record.m_Timestamp, access_time, record.m_ContentDigest);
+        }
+    }
+}
+
 bool DigestCacheSave(DigestCache *self, MemAllocHeap *serialization_heap, const char *filename, const char *tmp_filename)
 {
     TimingScope timing_scope(nullptr, &g_Stats.m_DigestCacheSaveTimeCycles);
 
     BinaryWriter writer;
     BinaryWriterInit(&writer, serialization_heap);
+    writer.m_CompressThreshold = self->m_CompressThreshold;
 
     BinarySegment *main_seg = BinaryWriterAddSegment(&writer);
     BinarySegment *array_seg = BinaryWriterAddSegment(&writer);
     BinarySegment *string_seg = BinaryWriterAddSegment(&writer);
+    BinarySegment *index_seg = BinaryWriterAddSegment(&writer);
     BinaryLocator array_ptr = BinarySegmentPosition(array_seg);
 
-    auto save_record = [=](size_t index, uint32_t hash, const char *path, const DigestCacheRecord &r) {
-        BinarySegmentWriteUint64(array_seg, r.m_Timestamp);
-        BinarySegmentWriteUint64(array_seg, r.m_AccessTime);
+    uint32_t record_capacity = self->m_Table.m_RecordCount;
+    if (self->m_State)
+        record_capacity += self->m_State->m_Records.GetCount();
+    uint32_t *hashes = HeapAllocateArray<uint32_t>(serialization_heap, record_capacity > 0 ? record_capacity : 1);
+    uint32_t hashes_out = 0;
+
+    auto save_record = [=, &hashes_out](uint32_t hash, const char *path, uint64_t timestamp, uint64_t access_time, const HashDigest &digest) {
+        hashes[hashes_out++] = hash;
+        BinarySegmentWriteUint64(array_seg, timestamp);
+        BinarySegmentWriteUint64(array_seg, access_time);
         BinarySegmentWriteUint32(array_seg, hash);
-        BinarySegmentWrite(array_seg, &r.m_ContentDigest, sizeof(r.m_ContentDigest));
+        BinarySegmentWrite(array_seg, &digest, sizeof(digest));
         BinarySegmentWritePointer(array_seg, BinarySegmentPosition(string_seg));
         BinarySegmentWriteStringData(string_seg, path);
         BinarySegmentWriteUint32(array_seg, 0); // m_Padding
@@ -93,14 +190,42 @@ bool DigestCacheSave(DigestCache *self, MemAllocHeap *serialization_heap, const
 #endif
     };
 
-    HashTableWalk(&self->m_Table, save_record);
+    CacheRetention *retention = &self->m_Retention;
+
+    if (retention->m_MaxRecords)
+    {
+        uint64_t *access_times = HeapAllocateArray<uint64_t>(serialization_heap, record_capacity > 0 ? record_capacity : 1);
+        uint32_t time_count = 0;
+        DigestCacheForEachRecord(self, [&](uint32_t, const char *, uint64_t, uint64_t access_time, const HashDigest &) {
+            access_times[time_count++] = access_time;
+        });
+        CacheRetentionApplyBudget(retention, access_times, time_count);
+        HeapFree(serialization_heap, access_times);
+    }
+
+    DigestCacheForEachRecord(self, [&](uint32_t hash, const char *path, uint64_t timestamp, uint64_t access_time, const HashDigest &digest) {
+        if (CacheRetentionKeep(retention, access_time))
+            save_record(hash, path, timestamp, access_time, digest);
+    });
+
+    g_Stats.m_DigestCacheEntriesDropped += retention->m_Evicted;
+
+    BinaryLocator index_ptr;
+    const uint32_t index_size = DigestCacheEmitIndex(index_seg, serialization_heap, hashes, hashes_out, &index_ptr);
+    HeapFree(serialization_heap, hashes);
 
     BinarySegmentWriteUint32(main_seg, Frozen::DigestCacheState::MagicNumber);
-    BinarySegmentWriteInt32(main_seg, (int)self->m_Table.m_RecordCount);
+    BinarySegmentWriteInt32(main_seg, (int)hashes_out);
     BinarySegmentWritePointer(main_seg, array_ptr);
+    BinarySegmentWriteUint32(main_seg, index_size);
+    if (index_size)
+        BinarySegmentWritePointer(main_seg, index_ptr);
+    else
+        BinarySegmentWriteNullPointer(main_seg);
     BinarySegmentWriteUint32(main_seg, Frozen::DigestCacheState::MagicNumber);
 
-    // Unmap old state to avoid sharing conflicts on Windows.
+    // Unmap old state to avoid sharing conflicts on Windows. Frozen records are
+    // no longer visible after this, so saving must be the last use of the cache.
     MmapFileUnmap(&self->m_StateFile);
     self->m_State = nullptr;
 
@@ -120,6 +245,20 @@ bool DigestCacheSave(DigestCache *self, MemAllocHeap *serialization_heap, const
     return success;
 }
 
+// Look up a frozen record that is still young enough to be used.
+static const Frozen::DigestRecord *FindLiveFrozenRecord(DigestCache *self, const char *filename, uint32_t hash)
+{
+    if (!self->m_State)
+        return nullptr;
+
+    const Frozen::DigestRecord *record = DigestCacheFindFrozen(self->m_State, filename, hash);
+
+    if (record && record->m_AccessTime < self->m_Retention.m_CutoffTime)
+        return nullptr;
+
+    return record;
+}
+
 bool DigestCacheGet(DigestCache *self, const char *filename, uint32_t hash, uint64_t timestamp, HashDigest *digest_out)
 {
     bool result = false;
@@ -136,6 +275,16 @@ bool DigestCacheGet(DigestCache *self, const char *filename, uint32_t hash, uint
             result = true;
         }
     }
+    else if (const Frozen::DigestRecord *record = FindLiveFrozenRecord(self, filename, hash))
+    {
+        if (record->m_Timestamp == timestamp)
+        {
+            // Same benign race as above; every writer stores the same value.
+            self->m_FrozenAccessed[record - self->m_State->m_Records.GetArray()] = 1;
+            *digest_out = record->m_ContentDigest;
+            result = true;
+        }
+    }
 
     ReadWriteUnlockRead(&self->m_Lock);
 
@@ -174,30 +323,26 @@ bool DigestCacheHasChanged(DigestCache *self, const char *filename, uint32_t has
         return false;
     }
 
-    const Frozen::DigestRecord *prevDigest = nullptr;
-    for (const Frozen::DigestRecord &frozenRecord : self->m_State->m_Records)
-    {
-        if (frozenRecord.m_FilenameHash != hash)
-            continue;
-
-        if (strcmp(frozenRecord.m_Filename, filename) != 0)
-            continue;
-
-        prevDigest = &frozenRecord;
-        break;
-    }
+    const Frozen::DigestRecord *prevDigest = DigestCacheFindFrozen(self->m_State, filename, hash);
 
     ReadWriteLockRead(&self->m_Lock);
     DigestCacheRecord *r = (DigestCacheRecord *)HashTableLookup(&self->m_Table, hash, filename);
     ReadWriteUnlockRead(&self->m_Lock);
 
-    if (prevDigest == nullptr && r == nullptr)
+    // Without an overlay record the current digest is whatever frozen record is still live.
+    const HashDigest *current = nullptr;
+    if (r)
+        current = &r->m_ContentDigest;
+    else if (const Frozen::DigestRecord *record = FindLiveFrozenRecord(self, filename, hash))
+        current = &record->m_ContentDigest;
+
+    if (prevDigest == nullptr && current == nullptr)
         return false;
 
-    if (prevDigest == nullptr || r == nullptr)
+    if (prevDigest == nullptr || current == nullptr)
         return true;
 
-    return prevDigest->m_ContentDigest != r->m_ContentDigest;
+    return prevDigest->m_ContentDigest != *current;
 }
 
 
@@ -8,6 +8,7 @@
 #include "MemAllocLinear.hpp"
 #include "MemAllocHeap.hpp"
 #include "ReadWriteLock.hpp"
+#include "CacheRetention.hpp"
 
 
 struct MemAllocHeap;
@@ -31,12 +32,23 @@ namespace Frozen
     };
     static_assert(sizeof(Frozen::DigestRecord) == 48, "struct size");
 
+    // Open-addressing index slot into m_Records, keyed by filename hash. Empty slots have m_Index == -1.
+    struct DigestIndexSlot
+    {
+        uint32_t m_FilenameHash;
+        int32_t m_Index;
+    };
+    static_assert(sizeof(DigestIndexSlot) == 8, "struct layout");
+
     struct DigestCacheState
     {
-        static const uint32_t MagicNumber = 0x12781fa7 ^ kTundraHashMagic;
+        static const uint32_t MagicNumber = 0x7a1c03e5 ^ kTundraHashMagic;
 
         uint32_t m_MagicNumber;
         FrozenArray<Frozen::DigestRecord> m_Records;
+        uint32_t m_IndexSize; // power of two
+        FrozenPtr<DigestIndexSlot> m_Index;
+        uint32_t m_MagicNumberEnd;
     };
 }
 
@@ -47,26 +59,40 @@ struct DigestCacheRecord
     uint64_t m_AccessTime;
 };
 
+// Lookups probe the mapped frozen state directly. m_Table is an overlay that only
+// holds records that were added or updated since the state was loaded.
 struct DigestCache
 {
     bool m_Initialized;
     ReadWriteLock m_Lock;
     const Frozen::DigestCacheState *m_State;
+    uint8_t *m_FrozenAccessed;
     MemAllocHeap m_Heap;
     MemAllocLinear m_Allocator;
     MemoryMappedFile m_StateFile;
     HashTable<DigestCacheRecord, kFlagPathStrings> m_Table;
     uint64_t m_AccessTime;
+    CacheRetention m_Retention;
+    // Saved caches of at least this many bytes are block compressed; zero never compresses.
+    size_t m_CompressThreshold;
 };
 
 void DigestCacheInit(DigestCache *self, size_t heap_size, const char *filename);
 
 void DigestCacheDestroy(DigestCache *self);
 
+// Records unused for days_to_keep days are dropped (default 7). When max_records is non-zero, the
+// least recently used records beyond that count are evicted on save.
+void DigestCacheSetRetention(DigestCache *self, int32_t days_to_keep, uint32_t max_records);
+
+void DigestCacheSetCompressThreshold(DigestCache *self, size_t threshold);
+
 bool DigestCacheSave(DigestCache *self, MemAllocHeap *serialization_heap, const char *filename, const char *tmp_filename);
 
 bool DigestCacheGet(DigestCache *self, const char *filename, uint32_t hash, uint64_t timestamp, HashDigest *digest_out);
 
 void DigestCacheSet(DigestCache *self, const char *filename, uint32_t hash, uint64_t timestamp, const HashDigest &digest);
 
+const Frozen::DigestRecord *DigestCacheFindFrozen(const Frozen::DigestCacheState *state, const char *filename, uint32_t hash);
+
 bool DigestCacheHasChanged(DigestCache *self, const char *filename, uint32_t hash);
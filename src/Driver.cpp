@@ -21,6 +21,8 @@
 #include "FileSign.hpp"
 #include "DynamicOutputDirectories.hpp"
 #include "PathUtil.hpp"
+#include "Thread.hpp"
+#include "Atomic.hpp"
 
 #include <time.h>
 #include <stdio.h>
@@ -54,8 +56,10 @@ TundraStats g_Stats;
 static const char *s_BuildFile;
 static const char *s_DagFileName;
 
+// Number of records in the machine-wide digest store; about 16MB on disk.
+static const uint32_t kSharedDigestStoreSlots = 1 << 18;
+
 static bool DriverPrepareDag(Driver *self, const char *dag_fn);
-static bool DriverCheckDagSignatures(Driver *self, char *out_of_date_reason, int out_of_date_reason_maxlength);
 
 void DriverInitializeTundraFilePaths(DriverOptions *driverOptions)
 {
@@ -98,7 +102,7 @@ static bool LoadFrozenData(const char *fn, MemoryMappedFile *result, const Froze
 
     MmapFileInit(&mapping);
 
-    MmapFileMap(&mapping, fn);
+    MmapFileMapFrozen(&mapping, fn);
 
     if (MmapFileValid(&mapping))
     {
@@ -178,10 +182,9 @@ static void GetIncludesRecursive(const HashDigest &scannerGuid, const char *fn,
     HashDigest scan_key;
     ComputeScanCacheKey(&scan_key, fn, scannerGuid);
 
-    const int32_t count = scan_data->m_EntryCount;
-    if (const HashDigest *ptr = BinarySearch(scan_data->m_Keys.Get(), count, scan_key))
+    const int index = ScanCacheFindFrozen(scan_data, scan_key);
+    if (index >= 0)
     {
-        int index = int(ptr - scan_data->m_Keys.Get());
         const Frozen::ScanCacheEntry *entry = scan_data->m_Data.Get() + index;
         int file_count = entry->m_IncludedFiles.GetCount();
         for (int i = 0; i < file_count; ++i)
@@ -246,11 +249,10 @@ bool DriverReportIncludes(Driver *self)
     HashTableWalk(&seen, [&](uint32_t index, uint32_t hash, const char *filename, const HashDigest &scannerguid) {
         HashDigest scan_key;
         ComputeScanCacheKey(&scan_key, filename, scannerguid);
-        const int32_t count = scan_data->m_EntryCount;
-        if (const HashDigest *ptr = BinarySearch(scan_data->m_Keys.Get(), count, scan_key))
+        const int entry_index = ScanCacheFindFrozen(scan_data, scan_key);
+        if (entry_index >= 0)
         {
-            int index = int(ptr - scan_data->m_Keys.Get());
-            const Frozen::ScanCacheEntry *entry = scan_data->m_Data.Get() + index;
+            const Frozen::ScanCacheEntry *entry = scan_data->m_Data.Get() + entry_index;
             int file_count = entry->m_IncludedFiles.GetCount();
             JsonWriteStartObject(&msg);
             JsonWriteKeyName(&msg, "file");
@@ -318,8 +320,27 @@ void DriverReportStartup(Driver *self, const char **targets, int target_count)
     LogStructured(&msg);
 }
 
+// The scan cache journal lives next to the frozen scan cache file.
+static void GetScanCacheJournalFileName(char *buffer, size_t buffer_size, const Frozen::Dag *dag)
+{
+    snprintf(buffer, buffer_size, "%s.log", dag->m_ScanCacheFileName.Get());
+    buffer[buffer_size - 1] = '\0';
+}
+
+// The glob cache lives next to the DAG, as glob signatures are computed while the DAG is frozen.
+static void GetGlobCacheFileName(char *buffer, size_t buffer_size, const char *suffix)
+{
+    snprintf(buffer, buffer_size, "%s.globs%s", s_DagFileName, suffix);
+    buffer[buffer_size - 1] = '\0';
+}
+
 bool DriverInitData(Driver *self)
 {
+    char glob_cache_fn[kMaxPathLength];
+    GetGlobCacheFileName(glob_cache_fn, sizeof glob_cache_fn, "");
+    GlobCacheInit(&self->m_GlobCache, MB(64), glob_cache_fn);
+    FileSignSetGlobCache(&self->m_GlobCache);
+
     if (!DriverPrepareDag(self, s_DagFileName))
         return false;
 
@@ -330,12 +351,33 @@ bool DriverInitData(Driver *self)
         SetStructuredLogFileName(self->m_DagData->m_StructuredLogFileName);
 
     DigestCacheInit(&self->m_DigestCache, MB(128), self->m_DagData->m_DigestCacheFileName);
+    DigestCacheSetRetention(&self->m_DigestCache, self->m_DagData->m_CacheDaysToKeep, self->m_DagData->m_DigestCacheMaxRecords);
+    DigestCacheSetCompressThreshold(&self->m_DigestCache, DagCompressThreshold(self->m_DagData));
+    GlobCacheSetRetention(&self->m_GlobCache, self->m_DagData->m_CacheDaysToKeep);
+    GlobCacheSetCompressThreshold(&self->m_GlobCache, DagCompressThreshold(self->m_DagData));
+    FileSignSetDigestXattr(self->m_DagData->m_ContentDigestXattr);
+    FileSignSetExtendedTimestamps(self->m_DagData->m_ExtendedTimestampSignatures != 0);
+
+    if (const char *shared_store = self->m_DagData->m_SharedDigestStoreFileName.Get())
+    {
+        if (SharedDigestStoreOpen(&self->m_SharedDigestStore, shared_store, kSharedDigestStoreSlots))
+            FileSignSetSharedDigestStore(&self->m_SharedDigestStore);
+    }
 
     LoadFrozenData<Frozen::AllBuiltNodes>(self->m_DagData->m_StateFileName, &self->m_StateFile, &self->m_AllBuiltNodes);
 
     LoadFrozenData<Frozen::ScanData>(self->m_DagData->m_ScanCacheFileName, &self->m_ScanFile, &self->m_ScanData);
 
     ScanCacheSetCache(&self->m_ScanCache, self->m_ScanData);
+    ScanCacheSetRetention(&self->m_ScanCache, self->m_DagData->m_CacheDaysToKeep, self->m_DagData->m_ScanCacheMaxRecords);
+    ScanCacheSetCompressThreshold(&self->m_ScanCache, DagCompressThreshold(self->m_DagData));
+
+    if (self->m_DagData->m_ScanCacheContentDigests)
+        ScanCacheSetDigestCache(&self->m_ScanCache, &self->m_DigestCache);
+
+    char journal_fn[kMaxPathLength];
+    GetScanCacheJournalFileName(journal_fn, sizeof journal_fn, self->m_DagData);
+    ScanCacheLoadJournal(&self->m_ScanCache, journal_fn);
 
     return true;
 }
@@ -359,6 +401,133 @@ static bool ExitRequestingFrontendRun(const char *reason_fmt, ...)
 }
 
 
+// Signatures checked per thread started; starting a thread costs about as much as a few hundred stat calls.
+static const int kDagSignaturesPerThread = 256;
+
+// State shared by the threads checking the DAG signatures.
+struct DagSignatureCheck
+{
+    const Frozen::Dag *m_Dag;
+    MemAllocHeap *m_Heap;
+    // Signatures are claimed one at a time; globs come first as they are the slow ones.
+    uint32_t m_NextIndex;
+    uint32_t m_SignatureCount;
+    // Set by the first thread to find a change, which alone writes m_Reason.
+    uint32_t m_Changed;
+    char *m_Reason;
+    int m_ReasonMaxLength;
+};
+
+static void DagSignatureCheckRun(DagSignatureCheck *check, MemAllocLinear *scratch)
+{
+    const Frozen::Dag *dag_data = check->m_Dag;
+    const uint32_t glob_count = dag_data->m_GlobSignatures.GetCount();
+
+    while (!check->m_Changed)
+    {
+        const uint32_t index = AtomicIncrement(&check->m_NextIndex) - 1;
+        if (index >= check->m_SignatureCount)
+            break;
+
+        if (index < glob_count)
+        {
+            // Check directory listing fingerprints
+            // Note that the digest computation in here must match the one in LuaListDirectory
+            // The digests computed there are stored in the signature block by frontend code.
+            const Frozen::DagGlobSignature &sig = dag_data->m_GlobSignatures[index];
+            HashDigest digest = CalculateGlobSignatureFor(sig.m_Path, sig.m_Filter, sig.m_Recurse, check->m_Heap, scratch);
+
+            // Compare digest with the one stored in the signature block
+            if (0 != memcmp(&digest, &sig.m_Digest, sizeof digest) && AtomicCompareAndSwap(&check->m_Changed, 0, 1))
+            {
+                char stored[kDigestStringSize], actual[kDigestStringSize];
+                DigestToString(stored, sig.m_Digest);
+                DigestToString(actual, digest);
+                snprintf(check->m_Reason, check->m_ReasonMaxLength, "directory contents changed: %s", sig.m_Path.Get());
+                Log(kInfo, "DAG out of date: file glob change for %s (%s => %s)", sig.m_Path.Get(), stored, actual);
+            }
+        }
+        else
+        {
+            // Check timestamps of frontend files used to produce the DAG
+            const Frozen::DagFileSignature &sig = dag_data->m_FileSignatures[index - glob_count];
+            FileInfo info = GetFileInfo(sig.m_Path);
+
+            if (info.m_Timestamp != sig.m_Timestamp && AtomicCompareAndSwap(&check->m_Changed, 0, 1))
+                snprintf(check->m_Reason, check->m_ReasonMaxLength, "FileSignature timestamp changed: %s", sig.m_Path.Get());
+        }
+    }
+}
+
+static ThreadRoutineReturnType TUNDRA_STDCALL DagSignatureCheckThreadRoutine(void *param)
+{
+    DagSignatureCheck *check = (DagSignatureCheck *)param;
+
+    MemAllocLinear scratch;
+    LinearAllocInit(&scratch, check->m_Heap, MB(64), "signature check scratch");
+    LinearAllocSetOwner(&scratch, ThreadCurrent());
+
+    DagSignatureCheckRun(check, &scratch);
+
+    LinearAllocDestroy(&scratch);
+    return 0;
+}
+
+// Start threads checking the DAG signatures; returns how many were started.
+static int DriverStartDagSignatureCheck(Driver *self, DagSignatureCheck *check, ThreadId *threads, char *out_of_date_reason, int out_of_date_reason_maxlength)
+{
+    const Frozen::Dag *dag_data = self->m_DagData;
+
+#if ENABLED(CHECKED_BUILD)
+    // Paranoia - make sure the data is sorted.
+    for (int i = 1, count = dag_data->m_NodeCount; i < count; ++i)
+    {
+        if (dag_data->m_NodeGuids[i] < dag_data->m_NodeGuids[i - 1])
+            Croak("DAG data is not sorted by guid");
+    }
+#endif
+
+    Log(kDebug, "checking file signatures for DAG data");
+
+    check->m_Dag = dag_data;
+    check->m_Heap = &self->m_Heap;
+    check->m_NextIndex = 0;
+    check->m_SignatureCount = dag_data->m_GlobSignatures.GetCount() + dag_data->m_FileSignatures.GetCount();
+    check->m_Changed = 0;
+    check->m_Reason = out_of_date_reason;
+    check->m_ReasonMaxLength = out_of_date_reason_maxlength;
+
+    // The calling thread takes a share of the signatures too.
+    int thread_count = std::min(self->m_Options.m_ThreadCount, int(check->m_SignatureCount / kDagSignaturesPerThread));
+    thread_count = std::max(thread_count - 1, 0);
+
+    for (int i = 0; i < thread_count; ++i)
+        threads[i] = ThreadStart(DagSignatureCheckThreadRoutine, check, "Signature Check Thread");
+
+    return thread_count;
+}
+
+// Check the remaining signatures on this thread and wait for the others; returns true if the DAG is up to date.
+static bool DriverFinishDagSignatureCheck(Driver *self, DagSignatureCheck *check, ThreadId *threads, int thread_count)
+{
+    DagSignatureCheckRun(check, &self->m_Allocator);
+
+    for (int i = 0; i < thread_count; ++i)
+        ThreadJoin(threads[i]);
+
+    return 0 == check->m_Changed;
+}
+
+// Start reading a file into the page cache, without mapping it for use.
+static void PrefetchFile(const char *fn)
+{
+    MemoryMappedFile file;
+    MmapFileInit(&file);
+    MmapFileMap(&file, fn);
+    MmapFilePrefetch(&file);
+    MmapFileDestroy(&file);
+}
+
 static bool DriverPrepareDag(Driver *self, const char *dag_fn)
 {
     const int out_of_date_reason_length = 500;
@@ -371,25 +540,38 @@ static bool DriverPrepareDag(Driver *self, const char *dag_fn)
     snprintf(json_filename, sizeof json_filename, "%s.json", dag_fn);
     json_filename[sizeof(json_filename) - 1] = '\0';
 
+    char bin_filename[kMaxPathLength];
+    snprintf(bin_filename, sizeof bin_filename, "%s.bin", dag_fn);
+    bin_filename[sizeof(bin_filename) - 1] = '\0';
+
     FileInfo dag_info = GetFileInfo(dag_fn);
     FileInfo json_info = GetFileInfo(json_filename);
+    FileInfo bin_info = GetFileInfo(bin_filename);
 
-    if (!dag_info.Exists() && !json_info.Exists())
+    // The frontend may write binary input (see DagInput.hpp) instead of JSON; use whichever is newer.
+    const bool use_bin = bin_info.Exists() && (!json_info.Exists() || bin_info.m_Timestamp >= json_info.m_Timestamp);
+    const char *input_filename = use_bin ? bin_filename : json_filename;
+    const FileInfo input_info = use_bin ? bin_info : json_info;
+
+    if (!dag_info.Exists() && !input_info.Exists())
         return ExitRequestingFrontendRun("%s does not exist yet", json_filename);
 
-    if (json_info.Exists())
+    if (input_info.Exists())
     {
         bool dagExists = dag_info.Exists();
-        if (!dagExists || json_info.m_Timestamp > dag_info.m_Timestamp)
+        if (!dagExists || input_info.m_Timestamp > dag_info.m_Timestamp)
         {
-            const char* reason = dagExists ? "Timestamp of .json > .dag" : ".dag file didn't exist";
+            const char* reason = dagExists ? (use_bin ? "Timestamp of .bin > .dag" : "Timestamp of .json > .dag") : ".dag file didn't exist";
 
             uint64_t time_exec_started = TimerGet();
-            if (!FreezeDagJson(json_filename, dag_fn))
-                return ExitRequestingFrontendRun("%s failed to freeze", json_filename);
+            const bool incremental = !self->m_Options.m_DontReusePreviousResults;
+            bool frozen = use_bin ? FreezeDagBinary(input_filename, dag_fn, self->m_Options.m_ThreadCount, incremental)
+                                  : FreezeDagJson(input_filename, dag_fn, self->m_Options.m_ThreadCount, incremental);
+            if (!frozen)
+                return ExitRequestingFrontendRun("%s failed to freeze", input_filename);
             uint64_t now = TimerGet();
             double duration = TimerDiffSeconds(time_exec_started, now);
-            PrintMessage(MessageStatusLevel::Success, duration, "Freezing %s into .dag (%s)", FindFileNameInside(json_filename), reason);
+            PrintMessage(MessageStatusLevel::Success, duration, "Freezing %s into .dag (%s)", FindFileNameInside(input_filename), reason);
         }
     }
 
@@ -403,7 +585,21 @@ static bool DriverPrepareDag(Driver *self, const char *dag_fn)
     bool dagIsValid;
     {
         ProfilerScope prof_scope("DriverCheckDagSignatures", 0);
-        dagIsValid = DriverCheckDagSignatures(self, out_of_date_reason, out_of_date_reason_length);
+
+        DagSignatureCheck check;
+        ThreadId threads[kMaxBuildThreads];
+        const int thread_count = DriverStartDagSignatureCheck(self, &check, threads, out_of_date_reason, out_of_date_reason_length);
+
+        // DriverInitData() maps the build state and scan cache if the DAG is valid. Have
+        // their pages read in while the other threads check; mapping them, which may
+        // mean decompressing, waits until the DAG is known to be valid.
+        if (thread_count > 0)
+        {
+            PrefetchFile(self->m_DagData->m_StateFileName);
+            PrefetchFile(self->m_DagData->m_ScanCacheFileName);
+        }
+
+        dagIsValid = DriverFinishDagSignatureCheck(self, &check, threads, thread_count);
     }
 
     uint64_t now = TimerGet();
@@ -431,58 +627,6 @@ static bool DriverPrepareDag(Driver *self, const char *dag_fn)
     return false;
 }
 
-static bool DriverCheckDagSignatures(Driver *self, char *out_of_date_reason, int out_of_date_reason_maxlength)
-{
-    const Frozen::Dag *dag_data = self->m_DagData;
-
-#if ENABLED(CHECKED_BUILD)
-    // Paranoia - make sure the data is sorted.
-    for (int i = 1, count = dag_data->m_NodeCount; i < count; ++i)
-    {
-        if (dag_data->m_NodeGuids[i] < dag_data->m_NodeGuids[i - 1])
-            Croak("DAG data is not sorted by guid");
-    }
-#endif
-
-    Log(kDebug, "checking file signatures for DAG data");
-
-    // Check timestamps of frontend files used to produce the DAG
-    for (const Frozen::DagFileSignature &sig : dag_data->m_FileSignatures)
-    {
-        const char *path = sig.m_Path;
-
-        uint64_t timestamp = sig.m_Timestamp;
-        FileInfo info = GetFileInfo(path);
-
-        if (info.m_Timestamp != timestamp)
-        {
-            snprintf(out_of_date_reason, out_of_date_reason_maxlength, "FileSignature timestamp changed: %s", sig.m_Path.Get());
-            return false;
-        }
-    }
-
-    // Check directory listing fingerprints
-    // Note that the digest computation in here must match the one in LuaListDirectory
-    // The digests computed there are stored in the signature block by frontend code.
-    for (const Frozen::DagGlobSignature &sig : dag_data->m_GlobSignatures)
-    {
-        HashDigest digest = CalculateGlobSignatureFor(sig.m_Path, sig.m_Filter, sig.m_Recurse, &self->m_Heap, &self->m_Allocator);
-
-        // Compare digest with the one stored in the signature block
-        if (0 != memcmp(&digest, &sig.m_Digest, sizeof digest))
-        {
-            char stored[kDigestStringSize], actual[kDigestStringSize];
-            DigestToString(stored, sig.m_Digest);
-            DigestToString(actual, digest);
-            snprintf(out_of_date_reason, out_of_date_reason_maxlength, "directory contents changed: %s", sig.m_Path.Get());
-            Log(kInfo, "DAG out of date: file glob change for %s (%s => %s)", sig.m_Path.Get(), stored, actual);
-            return false;
-        }
-    }
-
-    return true;
-}
-
 static int LevenshteinDistanceNoCase(const char *s, const char *t)
 {
     int n = (int)strlen(s);
@@ -606,13 +750,14 @@ static void FindNodesByName(
         char cleaned_path[kMaxPathLength];
         PathFormat(cleaned_path, &pathbuf);
 
-        const uint32_t filename_hash = Djb2HashPath(cleaned_path);
-        for (int node_index = 0; node_index != dag->m_NodeCount; node_index++)
+        // Outputs are compared by path index, so paths no node names need no scan at all.
+        const int32_t path_index = DagFindPath(dag, cleaned_path, Djb2HashPath(cleaned_path));
+        for (int node_index = 0; node_index != dag->m_NodeCount && -1 != path_index; node_index++)
         {
             const Frozen::DagNode &node = dag->m_DagNodes[node_index];
-            for (const FrozenFileAndHash &output : node.m_OutputFiles)
+            for (const Frozen::DagFile &output : node.m_OutputFiles)
             {
-                if (filename_hash == output.m_FilenameHash && 0 == PathCompare(output.m_Filename, cleaned_path))
+                if (output.m_PathIndex == path_index)
                 {
                     BufferAppendOne(out_nodes, heap, node_index);
                     Log(kDebug, "mapped %s to node %d (based on output file)", name, node_index);
@@ -689,8 +834,6 @@ bool DriverPrepareNodes(Driver *self, const char **targets, int target_count)
 
         if (0 == (node_visited_bits[dag_word] & dag_bit))
         {
-            const Frozen::DagNode *node = src_nodes + dag_index;
-
             BufferAppendOne(&node_indices, &self->m_Heap, dag_index);
 
             node_visited_bits[dag_word] |= dag_bit;
@@ -699,7 +842,8 @@ bool DriverPrepareNodes(Driver *self, const char **targets, int target_count)
             ++node_count;
 
             // Stash node dependencies on the work queue to keep iterating
-            BufferAppend(&node_stack, &self->m_Heap, node->m_Dependencies.GetArray(), node->m_Dependencies.GetCount());
+            const DagNodeIndices deps = DagNodeDependencies(dag, dag_index);
+            BufferAppend(&node_stack, &self->m_Heap, deps.begin(), deps.GetCount());
         }
     }
 
@@ -774,6 +918,7 @@ bool DriverInit(Driver *self, const DriverOptions *options)
     MmapFileInit(&self->m_DagFile);
     MmapFileInit(&self->m_StateFile);
     MmapFileInit(&self->m_ScanFile);
+    SharedDigestStoreInit(&self->m_SharedDigestStore);
 
 
     self->m_DagData = nullptr;
@@ -785,7 +930,7 @@ bool DriverInit(Driver *self, const DriverOptions *options)
 
     self->m_Options = *options;
 
-    // This linear allocator is only accessed when the state cache is locked.
+    // This linear allocator is only used as scratch space when saving the scan cache.
     LinearAllocInit(&self->m_ScanCacheAllocator, &self->m_Heap, MB(64), "scan cache");
     ScanCacheInit(&self->m_ScanCache, &self->m_Heap, &self->m_ScanCacheAllocator);
 
@@ -798,12 +943,21 @@ bool DriverInit(Driver *self, const DriverOptions *options)
 
 void DriverDestroy(Driver *self)
 {
+    FileSignSetSharedDigestStore(nullptr);
+    SharedDigestStoreDestroy(&self->m_SharedDigestStore);
+
     DigestCacheDestroy(&self->m_DigestCache);
 
+    FileSignSetGlobCache(nullptr);
+    GlobCacheDestroy(&self->m_GlobCache);
+
     StatCacheDestroy(&self->m_StatCache);
 
     ScanCacheDestroy(&self->m_ScanCache);
 
+    for (size_t i = 0, count = self->m_RuntimeNodes.m_Size; i < count; ++i)
+        HeapFree(&self->m_Heap, self->m_RuntimeNodes.m_Storage[i].m_OutputDigests);
+
     BufferDestroy(&self->m_RuntimeNodes, &self->m_Heap);
     BufferDestroy(&self->m_DagNodeIndexToRuntimeNodeIndex_Table, &self->m_Heap);
 
@@ -831,6 +985,7 @@ BuildResult::Enum DriverBuild(Driver *self, int* out_finished_node_count)
     queue_config.m_DriverOptions = &self->m_Options;
     queue_config.m_Flags = 0;
     queue_config.m_Heap = &self->m_Heap;
+    queue_config.m_Dag = dag;
     queue_config.m_DagNodes = self->m_DagData->m_DagNodes;
     queue_config.m_RuntimeNodes = self->m_RuntimeNodes.m_Storage;
     queue_config.m_TotalRuntimeNodeCount = (int)self->m_RuntimeNodes.m_Size;
@@ -904,6 +1059,18 @@ bool DriverSaveScanCache(Driver *self)
     if (!ScanCacheDirty(scan_cache))
         return true;
 
+    char journal_fn[kMaxPathLength];
+    GetScanCacheJournalFileName(journal_fn, sizeof journal_fn, self->m_DagData);
+
+    // Small incremental changes only get appended to the journal.
+    if (!ScanCacheShouldCompact(scan_cache))
+    {
+        if (ScanCacheAppendJournal(scan_cache, journal_fn))
+            return true;
+
+        Log(kDebug, "Failed to append to %s - doing a full scan cache save", journal_fn);
+    }
+
     // This will be invalidated.
     self->m_ScanData = nullptr;
 
@@ -921,6 +1088,10 @@ bool DriverSaveScanCache(Driver *self)
         remove(self->m_DagData->m_ScanCacheFileNameTmp);
     }
 
+    // All journal records are now part of the frozen file.
+    if (success)
+        remove(journal_fn);
+
     return success;
 }
 
@@ -931,6 +1102,17 @@ bool DriverSaveDigestCache(Driver *self)
     return DigestCacheSave(&self->m_DigestCache, &self->m_Heap, self->m_DagData->m_DigestCacheFileName, self->m_DagData->m_DigestCacheFileNameTmp);
 }
 
+bool DriverSaveGlobCache(Driver *self)
+{
+    char glob_cache_fn[kMaxPathLength], glob_cache_tmp_fn[kMaxPathLength];
+    GetGlobCacheFileName(glob_cache_fn, sizeof glob_cache_fn, "");
+    GetGlobCacheFileName(glob_cache_tmp_fn, sizeof glob_cache_tmp_fn, ".tmp");
+
+    // Listings are no longer reused once the cache is saved.
+    FileSignSetGlobCache(nullptr);
+    return GlobCacheSave(&self->m_GlobCache, &self->m_Heap, glob_cache_fn, glob_cache_tmp_fn);
+}
+
 struct StateSavingSegments
 {
     BinarySegment *main;
@@ -1001,6 +1183,7 @@ bool DriverSaveAllBuiltNodes(Driver *self)
 
     BinaryWriter writer;
     BinaryWriterInit(&writer, &self->m_Heap);
+    writer.m_CompressThreshold = DagCompressThreshold(self->m_DagData);
 
     StateSavingSegments segments;
     BinarySegment *main_seg = BinaryWriterAddSegment(&writer);
@@ -1046,6 +1229,16 @@ bool DriverSaveAllBuiltNodes(Driver *self)
     int emitted_built_nodes_count = 0;
     uint32_t this_dag_hashed_identifier = self->m_DagData->m_HashedIdentifier;
 
+    auto WriteOutputDigests = [=](const Frozen::NodeOutputDigest *digests, int32_t count) -> void {
+        BinarySegmentWriteInt32(built_nodes_seg, count);
+        BinarySegmentWritePointer(built_nodes_seg, BinarySegmentPosition(array_seg));
+        for (int32_t i = 0; i < count; ++i)
+        {
+            BinarySegmentWriteUint64(array_seg, digests[i].m_Timestamp);
+            BinarySegmentWrite(array_seg, &digests[i].m_ContentDigest, sizeof(HashDigest));
+        }
+    };
+
     auto EmitBuiltNodeFromRuntimeNode = [=, &emitted_built_nodes_count, &shared_strings](const RuntimeNode* runtime_node, const HashDigest *guid) -> void {
         emitted_built_nodes_count++;
         MemAllocLinear *scratch = &self->m_Allocator;
@@ -1138,6 +1331,12 @@ bool DriverSaveAllBuiltNodes(Driver *self)
 
         if (haveToAddOurselves)
             BinarySegmentWriteUint32(array_seg, this_dag_hashed_identifier);
+
+        // The node ran, so digests from an earlier build no longer describe its outputs.
+        if (runtime_node->m_OutputDigests)
+            WriteOutputDigests(runtime_node->m_OutputDigests, dag_node->m_OutputFiles.GetCount());
+        else
+            WriteOutputDigests(nullptr, 0);
     };
 
     auto EmitBuiltNodeFromPreviouslyBuiltNode = [=, &emitted_built_nodes_count, &shared_strings](const Frozen::BuiltNode *built_node, const HashDigest *guid) -> void {
@@ -1169,6 +1368,8 @@ bool DriverSaveAllBuiltNodes(Driver *self)
         BinarySegmentWriteInt32(built_nodes_seg, dag_count);
         BinarySegmentWritePointer(built_nodes_seg, BinarySegmentPosition(array_seg));
         BinarySegmentWrite(array_seg, built_node->m_DagsWeHaveSeenThisNodeInPreviously.GetArray(), dag_count * sizeof(uint32_t));
+
+        WriteOutputDigests(built_node->m_OutputDigests.GetArray(), built_node->m_OutputDigests.GetCount());
     };
 
     auto RuntimeNodeGuidForRuntimeNodeIndex = [=](size_t index) -> const HashDigest * {
@@ -1349,19 +1550,13 @@ void DriverRemoveStaleOutputs(Driver *self)
         return;
     }
 
-    HashSet<kFlagPathStrings> file_table;
-    HashSetInit(&file_table, &self->m_Heap);
+    // Flag the paths of all current regular and aux output files.
+    uint8_t *is_output = HeapAllocateArrayZeroed<uint8_t>(&self->m_Heap, dag->m_Paths.GetCount() + 1);
     HashSet<kFlagPathStrings> directory_table;
     HashSetInit(&directory_table, &self->m_Heap);
 
-    // Insert all current regular and aux output files into the hash table.
-    auto add_file = [&file_table](const FrozenFileAndHash &p) -> void {
-        const uint32_t hash = p.m_FilenameHash;
-
-        if (!HashSetLookup(&file_table, hash, p.m_Filename))
-        {
-            HashSetInsert(&file_table, hash, p.m_Filename);
-        }
+    auto add_file = [is_output](const Frozen::DagFile &p) -> void {
+        is_output[p.m_PathIndex] = 1;
     };
 
     auto add_directory = [&directory_table](const FrozenFileAndHash &p) -> void {
@@ -1377,10 +1572,10 @@ void DriverRemoveStaleOutputs(Driver *self)
     {
         const Frozen::DagNode *node = dag->m_DagNodes + i;
 
-        for (const FrozenFileAndHash &p : node->m_OutputFiles)
+        for (const Frozen::DagFile &p : node->m_OutputFiles)
             add_file(p);
 
-        for (const FrozenFileAndHash &p : node->m_AuxOutputFiles)
+        for (const Frozen::DagFile &p : node->m_AuxOutputFiles)
             add_file(p);
 
         for (const FrozenFileAndHash &p : node->m_OutputDirectories)
@@ -1419,11 +1614,12 @@ void DriverRemoveStaleOutputs(Driver *self)
     // Check all output files in the state if they're still around.
     // Otherwise schedule them (and all their parent dirs) for nuking.
     // We will rely on the fact that we can't rmdir() non-empty directories.
-    auto check_file = [&file_table, &nuke_table, add_parent_directories_to_nuke_table, &directory_table, startsWith](const FrozenFileAndHash& fileAndHash) {
+    auto check_file = [dag, is_output, &nuke_table, add_parent_directories_to_nuke_table, &directory_table, startsWith](const FrozenFileAndHash& fileAndHash) {
         uint32_t path_hash = fileAndHash.m_FilenameHash;
         const char* path = fileAndHash.m_Filename.Get();
 
-        if (HashSetLookup(&file_table, path_hash, path))
+        const int32_t path_index = DagFindPath(dag, path, path_hash);
+        if (-1 != path_index && is_output[path_index])
             return;
 
         bool wasChild = false;
@@ -1504,7 +1700,7 @@ void DriverRemoveStaleOutputs(Driver *self)
     HashSetDestroy(&nuke_table);
     HashSetDestroy(&directory_table);
     HashSetDestroy(&outputdir_nuke_table);
-    HashSetDestroy(&file_table);
+    HeapFree(&self->m_Heap, is_output);
 }
 
 
@@ -9,6 +9,8 @@
 #include "ScanCache.hpp"
 #include "StatCache.hpp"
 #include "DigestCache.hpp"
+#include "GlobCache.hpp"
+#include "SharedDigestStore.hpp"
 
 
 namespace Frozen {
@@ -80,6 +82,8 @@ struct Driver
     StatCache m_StatCache;
 
     DigestCache m_DigestCache;
+    SharedDigestStore m_SharedDigestStore;
+    GlobCache m_GlobCache;
 };
 
 bool DriverInit(Driver *self, const DriverOptions *options);
@@ -106,5 +110,6 @@ bool DriverInitData(Driver *self);
 bool DriverSaveScanCache(Driver *self);
 bool DriverSaveAllBuiltNodes(Driver *self);
 bool DriverSaveDigestCache(Driver *self);
+bool DriverSaveGlobCache(Driver *self);
 
 void DriverInitializeTundraFilePaths(DriverOptions *driverOptions);
@@ -5,6 +5,7 @@
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <time.h>
 
 
 #if defined(TUNDRA_WIN32_MINGW)
@@ -24,12 +25,19 @@ extern "C"
 #if defined(TUNDRA_UNIX)
 #include <fcntl.h>
 #include <unistd.h>
+#include <utime.h>
 #include <dirent.h>
 #include <fnmatch.h>
 #include <ftw.h>
+#if defined(TUNDRA_LINUX) || defined(TUNDRA_APPLE)
+#include <sys/xattr.h>
+#elif defined(TUNDRA_FREEBSD) || defined(TUNDRA_NETBSD)
+#include <sys/extattr.h>
+#endif
 #elif defined(TUNDRA_WIN32)
 #include <windows.h>
 #include <shlwapi.h>
+#include <sys/utime.h>
 #include <filesystem>
 #endif
 
@@ -37,6 +45,14 @@ struct StatCache;
 
 const uint64_t kDirectoryTimestamp = 1;
 
+static uint32_t HashFileIdentity(uint64_t device, uint64_t inode, uint64_t change_time)
+{
+    uint64_t h = inode * 0x9e3779b97f4a7c15ull;
+    h ^= device + (h << 6) + (h >> 2);
+    h ^= change_time + (h << 6) + (h >> 2);
+    return uint32_t(h ^ (h >> 32));
+}
+
 FileInfo GetFileInfo(const char *path)
 {
     TimingScope timing_scope(&g_Stats.m_StatCount, &g_Stats.m_StatTimeCycles);
@@ -103,6 +119,8 @@ FileInfo GetFileInfo(const char *path)
     // Do not allow directories to expose real timestamps, as it's not reliable behaviour across platforms
     result.m_Timestamp = (flags & FileInfo::kFlagDirectory) ? kDirectoryTimestamp : stbuf.st_mtime;
     result.m_Size = stbuf.st_size;
+    // st_ctime is the inode change time on Unix and the creation time on Windows; either catches files replaced with preserved mtimes.
+    result.m_IdentityHash = (flags & FileInfo::kFlagDirectory) ? 0 : HashFileIdentity(stbuf.st_dev, stbuf.st_ino, stbuf.st_ctime);
 
     return result;
 
@@ -110,10 +128,88 @@ Failure:
     result.m_Flags = errno == ENOENT ? flags : FileInfo::kFlagError;
     result.m_Timestamp = 0;
     result.m_Size = 0;
+    result.m_IdentityHash = 0;
 
     return result;
 }
 
+bool GetFileIdentity(const char *path, FileIdentity *identity_out)
+{
+    TimingScope timing_scope(&g_Stats.m_StatCount, &g_Stats.m_StatTimeCycles);
+
+#if defined(TUNDRA_UNIX)
+    struct stat stbuf;
+    if (0 != stat(path, &stbuf))
+        return false;
+
+    identity_out->m_Device = stbuf.st_dev;
+    identity_out->m_Inode = stbuf.st_ino;
+    identity_out->m_Size = stbuf.st_size;
+    identity_out->m_ModifiedTime = stbuf.st_mtime;
+    identity_out->m_ChangeTime = stbuf.st_ctime;
+    return true;
+#elif defined(TUNDRA_WIN32)
+    HANDLE h;
+    const DWORD share = FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE;
+
+    if (strlen(path) >= MAX_PATH)
+    {
+        const int widePathLength = LongPathToPrefixedWidePath(path, NULL, 0);
+        wchar_t *widePath = static_cast<wchar_t *>(alloca(sizeof(wchar_t) * widePathLength));
+        LongPathToPrefixedWidePath(path, widePath, widePathLength);
+        h = CreateFileW(widePath, FILE_READ_ATTRIBUTES, share, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    }
+    else
+    {
+        h = CreateFileA(path, FILE_READ_ATTRIBUTES, share, NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL);
+    }
+
+    if (INVALID_HANDLE_VALUE == h)
+        return false;
+
+    BY_HANDLE_FILE_INFORMATION info;
+    FILE_BASIC_INFO basic;
+    bool success = GetFileInformationByHandle(h, &info) && GetFileInformationByHandleEx(h, FileBasicInfo, &basic, sizeof basic);
+    CloseHandle(h);
+
+    if (!success)
+        return false;
+
+    identity_out->m_Device = info.dwVolumeSerialNumber;
+    identity_out->m_Inode = (uint64_t(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+    identity_out->m_Size = (uint64_t(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+    identity_out->m_ModifiedTime = basic.LastWriteTime.QuadPart;
+    identity_out->m_ChangeTime = basic.ChangeTime.QuadPart;
+    return true;
+#endif
+}
+
+uint64_t GetFileIdentityTimeNow()
+{
+#if defined(TUNDRA_UNIX)
+    return uint64_t(time(nullptr));
+#elif defined(TUNDRA_WIN32)
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    return uint64_t(now.dwHighDateTime) << 32 | now.dwLowDateTime;
+#endif
+}
+
+bool SetFileTimestamp(const char *path, uint64_t timestamp)
+{
+#if defined(TUNDRA_UNIX)
+    struct utimbuf times;
+    times.actime = (time_t)timestamp;
+    times.modtime = (time_t)timestamp;
+    return 0 == utime(path, &times);
+#elif defined(TUNDRA_WIN32)
+    struct __utimbuf64 times;
+    times.actime = (__time64_t)timestamp;
+    times.modtime = (__time64_t)timestamp;
+    return 0 == _utime64(path, &times);
+#endif
+}
+
 bool ShouldFilter(const char *name)
 {
     return ShouldFilter(name, strlen(name));
@@ -146,6 +242,17 @@ bool ShouldFilter(const char *name, size_t len)
     return false;
 }
 
+bool MatchesFilter(const char *name, const char *filter)
+{
+    if (!filter)
+        return true;
+#if defined(TUNDRA_UNIX)
+    return fnmatch(filter, name, 0) == 0;
+#else
+    return PathMatchSpec(name, filter) != FALSE;
+#endif
+}
+
 void ListDirectory(
     const char *path,
     const char *filter,
@@ -182,7 +289,7 @@ void ListDirectory(
         if (ShouldFilter(entry.d_name, len))
             continue;
 
-        bool matchesFilter = !filter || fnmatch(filter, entry.d_name, 0) == 0;
+        bool matchesFilter = MatchesFilter(entry.d_name, filter);
 
         // If we are recursing, we need to continue to find out whether this is a directory
         if (!matchesFilter && !recurse)
@@ -243,7 +350,7 @@ void ListDirectory(
     {
         if (ShouldFilter(find_data.cFileName, strlen(find_data.cFileName)))
             continue;
-        bool matchesFilter = !filter || PathMatchSpec(find_data.cFileName, filter);
+        bool matchesFilter = MatchesFilter(find_data.cFileName, filter);
         if (!matchesFilter && !recurse)
             continue;
 
@@ -260,6 +367,7 @@ void ListDirectory(
 
         FileInfo info;
         info.m_Flags = FileInfo::kFlagExists;
+        info.m_IdentityHash = 0;
         info.m_Size = uint64_t(find_data.nFileSizeHigh) << 32 | find_data.nFileSizeLow;
         info.m_Timestamp = (ft - kEpochDiff) / kRateDiff;
 
@@ -316,3 +424,31 @@ bool DeleteDirectory(const char* path)
     return true;
 #endif
 }
+
+int GetFileExtendedAttribute(const char *path, const char *name, char *buffer, size_t buffer_size)
+{
+#if defined(TUNDRA_LINUX)
+    char full_name[256];
+    snprintf(full_name, sizeof full_name, "user.%s", name);
+    ssize_t size = getxattr(path, full_name, buffer, buffer_size);
+    return size < 0 ? -1 : (int)size;
+#elif defined(TUNDRA_APPLE)
+    ssize_t size = getxattr(path, name, buffer, buffer_size, 0, 0);
+    return size < 0 ? -1 : (int)size;
+#elif defined(TUNDRA_FREEBSD) || defined(TUNDRA_NETBSD)
+    ssize_t size = extattr_get_file(path, EXTATTR_NAMESPACE_USER, name, buffer, buffer_size);
+    return size < 0 ? -1 : (int)size;
+#elif defined(TUNDRA_WIN32)
+    char stream_name[MAX_PATH * 2];
+    snprintf(stream_name, sizeof stream_name, "%s:%s", path, name);
+    HANDLE h = CreateFileA(stream_name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == h)
+        return -1;
+    DWORD bytes_read = 0;
+    BOOL ok = ReadFile(h, buffer, (DWORD)buffer_size, &bytes_read, NULL);
+    CloseHandle(h);
+    return ok ? (int)bytes_read : -1;
+#else
+    return -1;
+#endif
+}
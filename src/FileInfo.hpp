@@ -15,6 +15,8 @@ struct FileInfo
     };
 
     uint32_t m_Flags;
+    // Hash of device, inode and change time; lives in what would otherwise be padding.
+    uint32_t m_IdentityHash;
     uint64_t m_Size;
     uint64_t m_Timestamp;
 
@@ -23,12 +25,34 @@ struct FileInfo
     bool IsDirectory() const { return 0 != (kFlagDirectory & m_Flags); }
     bool IsSymlink() const { return 0 != (kFlagSymlink & m_Flags); }
 };
+static_assert(sizeof(FileInfo) == 24, "stat cache records should stay compact");
 
 FileInfo GetFileInfo(const char *path);
 
+// Identifies a particular version of a file on this machine, across paths and checkouts.
+struct FileIdentity
+{
+    uint64_t m_Device;
+    uint64_t m_Inode;
+    uint64_t m_Size;
+    uint64_t m_ModifiedTime;
+    uint64_t m_ChangeTime;
+};
+
+bool GetFileIdentity(const char *path, FileIdentity *identity_out);
+
+// The current time in the units of FileIdentity::m_ModifiedTime and m_ChangeTime.
+uint64_t GetFileIdentityTimeNow();
+
+// Set the modification time of a file, in the units of FileInfo::m_Timestamp.
+bool SetFileTimestamp(const char *path, uint64_t timestamp);
+
 bool ShouldFilter(const char *name);
 bool ShouldFilter(const char *name, size_t len);
 
+// Whether a directory entry name matches a ListDirectory() filter; a null filter matches everything.
+bool MatchesFilter(const char *name, const char *filter);
+
 void ListDirectory(
     const char *dir,
     const char *filter,
@@ -37,3 +61,7 @@ void ListDirectory(
     void (*callback)(void *user_data, const FileInfo &info, const char *path));
 
 bool DeleteDirectory(const char* path);
+
+// Read a user extended attribute (an alternate data stream on Windows) into buffer.
+// Returns the value length, or -1 if the attribute is missing or unsupported.
+int GetFileExtendedAttribute(const char *path, const char *name, char *buffer, size_t buffer_size);
@@ -1,48 +1,485 @@
 #include "FileSign.hpp"
 #include "Hash.hpp"
 #include "StatCache.hpp"
+#include "FileInfo.hpp"
 #include "Stats.hpp"
 #include "DigestCache.hpp"
+#include "GlobCache.hpp"
+#include "SharedDigestStore.hpp"
 #include "Buffer.hpp"
+#include "MemoryMappedFile.hpp"
+#include "Mutex.hpp"
+#include "ConditionVar.hpp"
 #include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
 
+#if defined(TUNDRA_UNIX)
+#include <signal.h>
+#include <setjmp.h>
+#endif
 
+enum
+{
+    // Files at least this large are hashed straight from a memory mapping.
+    kDigestMmapThreshold = 256 * 1024,
+    kDigestReadBufferSize = 64 * 1024,
+
+    // Files at least this large get a tree digest: a digest over the digests of
+    // fixed size chunks, so that idle build threads can hash chunks in parallel.
+    kDigestTreeThreshold = 32 * 1024 * 1024,
+    kDigestMinChunkSize = 8 * 1024 * 1024,
+    kDigestMaxChunks = 256
+};
+
+// A tree digest in progress. The chunk counters are protected by the helper lock.
+struct DigestJob
+{
+    const uint8_t *m_Data;
+    size_t m_Size;
+    size_t m_ChunkSize;
+    HashDigest *m_ChunkDigests;
+    uint32_t m_ChunkCount;
+    uint32_t m_NextChunk;
+    uint32_t m_FinishedChunks;
+    // Set if the file behind m_Data was truncated while a chunk was hashed.
+    bool m_Failed;
+    DigestJob *m_Next;
+};
+
+static struct
+{
+    bool m_Enabled;
+    Mutex m_Lock;
+    ConditionVariable m_ChunkFinished;
+    DigestJob *volatile m_Jobs;
+    void (*m_Wakeup)(void *user_data);
+    void *m_WakeupData;
+} s_DigestHelpers;
+
+// The chunk size only depends on the total size, so digests are stable.
+static size_t DigestChunkSize(uint64_t size)
+{
+    uint64_t chunk_size = (size + kDigestMaxChunks - 1) / kDigestMaxChunks;
+    chunk_size = (chunk_size + kDigestMinChunkSize - 1) & ~uint64_t(kDigestMinChunkSize - 1);
+    return chunk_size < kDigestMinChunkSize ? kDigestMinChunkSize : (size_t)chunk_size;
+}
 
-static void ComputeFileSignatureSha1(HashState *state, StatCache *stat_cache, DigestCache *digest_cache, const char *filename, uint32_t fn_hash)
+static void FinalizeTreeDigest(HashDigest *digest_out, uint64_t size, const HashDigest *chunk_digests, uint32_t chunk_count)
 {
-    FileInfo file_info = StatCacheStat(stat_cache, filename, fn_hash);
+    HashState h;
+    HashInit(&h);
+    HashAddString(&h, "tree");
+    HashAddInteger(&h, size);
+    HashUpdate(&h, chunk_digests, chunk_count * sizeof(HashDigest));
+    HashFinalize(&h, digest_out);
+}
 
-    if (!file_info.Exists())
+#if defined(TUNDRA_UNIX)
+// Reading a mapping past the end of a file that another process truncated raises
+// SIGBUS. Threads hashing mapped data point this at a jump buffer to return to.
+static thread_local sigjmp_buf *s_MappedReadGuard;
+
+static void MappedReadFaultHandler(int sig)
+{
+    if (sigjmp_buf *guard = s_MappedReadGuard)
+        siglongjmp(*guard, 1);
+
+    // Not a guarded read; fault again with the default action.
+    signal(sig, SIG_DFL);
+}
+
+static bool InstallMappedReadFaultHandler()
+{
+    struct sigaction action;
+    memset(&action, 0, sizeof action);
+    action.sa_handler = MappedReadFaultHandler;
+    sigemptyset(&action.sa_mask);
+    return 0 == sigaction(SIGBUS, &action, nullptr);
+}
+#endif
+
+// Files are only hashed through mappings once truncation can be recovered from.
+static bool MappedReadsGuarded()
+{
+#if defined(TUNDRA_UNIX)
+    static const bool s_Installed = InstallMappedReadFaultHandler();
+    return s_Installed;
+#else
+    return true;
+#endif
+}
+
+// Hash data that may be a file mapping. Returns false if the file was truncated meanwhile.
+// Windows doesn't let files with mapped views be truncated.
+static bool HashMappedData(const uint8_t *data, size_t size, HashDigest *digest_out)
+{
+#if defined(TUNDRA_UNIX)
+    sigjmp_buf guard;
+    if (sigsetjmp(guard, 1))
     {
-        HashAddInteger(state, ~0ull);
+        s_MappedReadGuard = nullptr;
+        return false;
+    }
+    s_MappedReadGuard = &guard;
+#endif
+
+    HashState h;
+    HashInit(&h);
+    HashUpdate(&h, data, size);
+    HashFinalize(&h, digest_out);
+
+#if defined(TUNDRA_UNIX)
+    s_MappedReadGuard = nullptr;
+#endif
+    return true;
+}
+
+static void HashChunk(DigestJob *job, uint32_t chunk)
+{
+    size_t offset = chunk * job->m_ChunkSize;
+    size_t remain = job->m_Size - offset;
+    if (!HashMappedData(job->m_Data + offset, remain < job->m_ChunkSize ? remain : job->m_ChunkSize, &job->m_ChunkDigests[chunk]))
+        job->m_Failed = true;
+}
+
+// Claim and hash chunks until none are left. Called and returns with the helper lock held.
+static uint32_t HashChunksLocked(DigestJob *job)
+{
+    uint32_t count = 0;
+
+    while (job->m_NextChunk < job->m_ChunkCount)
+    {
+        uint32_t chunk = job->m_NextChunk++;
+
+        MutexUnlock(&s_DigestHelpers.m_Lock);
+        HashChunk(job, chunk);
+        MutexLock(&s_DigestHelpers.m_Lock);
+
+        if (++job->m_FinishedChunks == job->m_ChunkCount)
+            CondBroadcast(&s_DigestHelpers.m_ChunkFinished);
+
+        ++count;
+    }
+
+    return count;
+}
+
+void FileSignInitHelpers(void (*wakeup)(void *user_data), void *user_data)
+{
+    MutexInit(&s_DigestHelpers.m_Lock);
+    CondInit(&s_DigestHelpers.m_ChunkFinished);
+    s_DigestHelpers.m_Jobs = nullptr;
+    s_DigestHelpers.m_Wakeup = wakeup;
+    s_DigestHelpers.m_WakeupData = user_data;
+    s_DigestHelpers.m_Enabled = true;
+}
+
+void FileSignDestroyHelpers()
+{
+    if (!s_DigestHelpers.m_Enabled)
         return;
+
+    CHECK(nullptr == s_DigestHelpers.m_Jobs);
+    s_DigestHelpers.m_Enabled = false;
+    CondDestroy(&s_DigestHelpers.m_ChunkFinished);
+    MutexDestroy(&s_DigestHelpers.m_Lock);
+}
+
+bool FileSignHelpWithDigests()
+{
+    if (!s_DigestHelpers.m_Enabled || nullptr == s_DigestHelpers.m_Jobs)
+        return false;
+
+    uint32_t count = 0;
+
+    MutexLock(&s_DigestHelpers.m_Lock);
+
+    // Rescan from the head after each job; a job we were working on may have been unlinked meanwhile.
+    for (;;)
+    {
+        DigestJob *job = s_DigestHelpers.m_Jobs;
+        while (job && job->m_NextChunk == job->m_ChunkCount)
+            job = job->m_Next;
+
+        if (!job)
+            break;
+
+        count += HashChunksLocked(job);
     }
 
-    HashDigest digest;
+    g_Stats.m_FileDigestHelperChunks += count;
+
+    MutexUnlock(&s_DigestHelpers.m_Lock);
+
+    return count > 0;
+}
+
+static bool ComputeMappedContentDigest(HashDigest *digest_out, const void *data, size_t size)
+{
+    if (size < kDigestTreeThreshold)
+        return HashMappedData(static_cast<const uint8_t *>(data), size, digest_out);
+
+    HashDigest chunk_digests[kDigestMaxChunks];
+
+    DigestJob job;
+    job.m_Data = static_cast<const uint8_t *>(data);
+    job.m_Size = size;
+    job.m_ChunkSize = DigestChunkSize(size);
+    job.m_ChunkDigests = chunk_digests;
+    job.m_ChunkCount = uint32_t((size + job.m_ChunkSize - 1) / job.m_ChunkSize);
+    job.m_NextChunk = 0;
+    job.m_FinishedChunks = 0;
+    job.m_Failed = false;
+    job.m_Next = nullptr;
+
+    if (s_DigestHelpers.m_Enabled)
+    {
+        MutexLock(&s_DigestHelpers.m_Lock);
+        job.m_Next = s_DigestHelpers.m_Jobs;
+        s_DigestHelpers.m_Jobs = &job;
+        MutexUnlock(&s_DigestHelpers.m_Lock);
+
+        s_DigestHelpers.m_Wakeup(s_DigestHelpers.m_WakeupData);
+
+        MutexLock(&s_DigestHelpers.m_Lock);
+        HashChunksLocked(&job);
+
+        DigestJob *volatile *link = &s_DigestHelpers.m_Jobs;
+        while (*link != &job)
+            link = &(*link)->m_Next;
+        *link = job.m_Next;
 
-    if (!DigestCacheGet(digest_cache, filename, fn_hash, file_info.m_Timestamp, &digest))
+        // Wait for chunks still being hashed by helpers.
+        while (job.m_FinishedChunks < job.m_ChunkCount)
+            CondWait(&s_DigestHelpers.m_ChunkFinished, &s_DigestHelpers.m_Lock);
+        MutexUnlock(&s_DigestHelpers.m_Lock);
+    }
+    else
+    {
+        for (uint32_t i = 0; i < job.m_ChunkCount; ++i)
+            HashChunk(&job, i);
+    }
+
+    if (job.m_Failed)
+        return false;
+
+    FinalizeTreeDigest(digest_out, size, chunk_digests, job.m_ChunkCount);
+    return true;
+}
+
+void ComputeContentDigest(HashDigest *digest_out, const void *data, size_t size)
+{
+    ComputeMappedContentDigest(digest_out, data, size);
+}
+
+bool ComputeFileDigest(const char *filename, uint64_t file_size, HashDigest *digest_out)
+{
+    if (file_size >= kDigestMmapThreshold && MappedReadsGuarded())
     {
-        TimingScope timing_scope(&g_Stats.m_FileDigestCount, &g_Stats.m_FileDigestTimeCycles);
+        MemoryMappedFile mapping;
+        MmapFileInit(&mapping);
+        MmapFileMap(&mapping, filename);
+
+        if (MmapFileValid(&mapping))
+        {
+            MmapFileAdviseSequential(&mapping);
+            const bool hashed = ComputeMappedContentDigest(digest_out, mapping.m_Address, mapping.m_Size);
+            MmapFileDestroy(&mapping);
+
+            if (hashed)
+                return true;
 
-        FILE *f = fopen(filename, "rb");
-        if (!f)
+            // The file is being rewritten; read whatever it holds now instead.
+            Log(kDebug, "%s was truncated while hashing it, reading it instead", filename);
+        }
+        else
         {
-            HashAddString(state, "<missing>");
-            return;
+            MmapFileDestroy(&mapping);
         }
+    }
+
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+        return false;
+
+    // We read in large chunks ourselves, so skip the stdio buffer copy.
+    setvbuf(f, nullptr, _IONBF, 0);
 
+    // Without a mapping, large files are hashed one tree chunk at a time on this thread.
+    const bool tree = file_size >= kDigestTreeThreshold;
+    const uint64_t chunk_size = tree ? DigestChunkSize(file_size) : ~uint64_t(0);
+    HashDigest chunk_digests[kDigestMaxChunks];
+    uint32_t chunk_count = 0;
+    uint64_t total_size = 0;
+
+    char buffer[kDigestReadBufferSize];
+
+    for (;;)
+    {
         HashState h;
         HashInit(&h);
 
-        char buffer[8192];
-        while (size_t nbytes = fread(buffer, 1, sizeof buffer, f))
+        uint64_t chunk_bytes = 0;
+        while (chunk_bytes < chunk_size)
         {
+            uint64_t want = chunk_size - chunk_bytes < sizeof buffer ? chunk_size - chunk_bytes : sizeof buffer;
+            size_t nbytes = fread(buffer, 1, (size_t)want, f);
+            if (0 == nbytes)
+                break;
             HashUpdate(&h, buffer, nbytes);
+            chunk_bytes += nbytes;
+        }
+
+        total_size += chunk_bytes;
+
+        if (!tree)
+        {
+            HashFinalize(&h, digest_out);
+            break;
+        }
+
+        if (0 == chunk_bytes)
+            break;
+
+        HashFinalize(&h, &chunk_digests[chunk_count++]);
+
+        if (chunk_bytes < chunk_size || chunk_count == kDigestMaxChunks)
+            break;
+    }
+
+    fclose(f);
+
+    if (tree)
+        FinalizeTreeDigest(digest_out, total_size, chunk_digests, chunk_count);
+
+    return true;
+}
+
+static const char *s_DigestXattrName;
+
+void FileSignSetDigestXattr(const char *xattr_name)
+{
+    s_DigestXattrName = xattr_name && xattr_name[0] ? xattr_name : nullptr;
+}
+
+// Read a hash recorded by an external tool in an extended attribute of the form
+// "<mtime> <hash>", provided the mtime matches the file's current timestamp. The
+// hash is in the tool's own format, so it can't stand in for a content digest;
+// instead it becomes a digest cache key for the content digest of files with that
+// hash. This only saves reading files whose contents were hashed before, e.g. ones
+// a sync re-touched or copied; new contents are still read once.
+static bool GetXattrDigestKey(const char *filename, uint64_t timestamp, char *key_out, size_t key_size)
+{
+    if (!s_DigestXattrName)
+        return false;
+
+    char value[256];
+    int len = GetFileExtendedAttribute(filename, s_DigestXattrName, value, sizeof value - 1);
+    if (len <= 0)
+        return false;
+    value[len] = '\0';
+
+    char *hash_start;
+    uint64_t recorded_mtime = strtoull(value, &hash_start, 10);
+    if (hash_start == value || recorded_mtime != timestamp)
+        return false;
+
+    while (isspace(*hash_start))
+        ++hash_start;
+
+    char *hash_end = hash_start + strlen(hash_start);
+    while (hash_end > hash_start && isspace(hash_end[-1]))
+        --hash_end;
+
+    if (hash_end == hash_start)
+        return false;
+
+    // No path contains a newline, so these keys can't clash with file records. A
+    // truncated key could match another hash, so skip the cache if it doesn't fit.
+    int key_len = snprintf(key_out, key_size, "%s\n%.*s", s_DigestXattrName, int(hash_end - hash_start), hash_start);
+    return key_len > 0 && size_t(key_len) < key_size;
+}
+
+static bool s_ExtendedTimestamps;
+
+void FileSignSetExtendedTimestamps(bool enabled)
+{
+    s_ExtendedTimestamps = enabled;
+}
+
+uint64_t FileSignatureTimestamp(const FileInfo &info)
+{
+    // Directory sizes change with their contents, so keep directories on the plain timestamp.
+    if (!s_ExtendedTimestamps || info.IsDirectory())
+        return info.m_Timestamp;
+
+    uint64_t h = info.m_Timestamp;
+    h ^= (info.m_Size * 0x9e3779b97f4a7c15ull) + (h << 6) + (h >> 2);
+    h ^= uint64_t(info.m_IdentityHash) << 32;
+    return h;
+}
+
+static SharedDigestStore *s_SharedDigestStore;
+
+void FileSignSetSharedDigestStore(SharedDigestStore *store)
+{
+    s_SharedDigestStore = store;
+}
+
+static void ComputeFileSignatureSha1(HashState *state, StatCache *stat_cache, DigestCache *digest_cache, const char *filename, uint32_t fn_hash)
+{
+    FileInfo file_info = StatCacheStat(stat_cache, filename, fn_hash);
+
+    if (!file_info.Exists())
+    {
+        HashAddInteger(state, ~0ull);
+        return;
+    }
+
+    HashDigest digest;
+
+    const uint64_t timestamp = FileSignatureTimestamp(file_info);
+
+    if (!DigestCacheGet(digest_cache, filename, fn_hash, timestamp, &digest))
+    {
+        // Other checkouts on this machine may already have hashed the very same file.
+        FileIdentity identity;
+        const bool use_shared_store = s_SharedDigestStore && GetFileIdentity(filename, &identity);
+
+        if (use_shared_store && SharedDigestStoreGet(s_SharedDigestStore, identity, &digest))
+        {
+            AtomicIncrement(&g_Stats.m_SharedDigestStoreHits);
+        }
+        else
+        {
+            char xattr_key[320];
+            const bool use_xattr = GetXattrDigestKey(filename, file_info.m_Timestamp, xattr_key, sizeof xattr_key);
+            const uint32_t xattr_key_hash = use_xattr ? Djb2HashPath(xattr_key) : 0;
+
+            if (use_xattr && DigestCacheGet(digest_cache, xattr_key, xattr_key_hash, 0, &digest))
+            {
+                AtomicIncrement(&g_Stats.m_DigestXattrHits);
+            }
+            else
+            {
+                TimingScope timing_scope(&g_Stats.m_FileDigestCount, &g_Stats.m_FileDigestTimeCycles);
+
+                if (!ComputeFileDigest(filename, file_info.m_Size, &digest))
+                {
+                    HashAddString(state, "<missing>");
+                    return;
+                }
+
+                if (use_xattr)
+                    DigestCacheSet(digest_cache, xattr_key, xattr_key_hash, 0, digest);
+            }
+
+            if (use_shared_store)
+                SharedDigestStoreSet(s_SharedDigestStore, identity, digest);
         }
-        fclose(f);
 
-        HashFinalize(&h, &digest);
-        DigestCacheSet(digest_cache, filename, fn_hash, file_info.m_Timestamp, digest);
+        DigestCacheSet(digest_cache, filename, fn_hash, timestamp, digest);
     }
     else
     {
@@ -56,7 +493,7 @@ static bool ComputeFileSignatureTimestamp(HashState *out, StatCache *stat_cache,
 {
     FileInfo info = StatCacheStat(stat_cache, filename, hash);
     if (info.Exists())
-        HashAddInteger(out, info.m_Timestamp);
+        HashAddInteger(out, FileSignatureTimestamp(info));
     else
         HashAddInteger(out, ~0ull);
     return false;
@@ -94,7 +531,17 @@ void ComputeFileSignature(
         ComputeFileSignatureTimestamp(out, stat_cache, filename, fn_hash);
 }
 
-HashDigest CalculateGlobSignatureFor(const char *path, const char *filter, bool recurse, MemAllocHeap *heap, MemAllocLinear *scratch)
+static GlobCache *s_GlobCache;
+
+void FileSignSetGlobCache(GlobCache *cache)
+{
+    s_GlobCache = cache;
+}
+
+// List a single directory for a glob: a digest of the names of the entries that
+// match the filter, all zeros if there are none, and the names of every
+// subdirectory, as a recursive glob descends into them whatever the filter.
+static void ListGlobDirectory(const char *path, const char *filter, MemAllocHeap *heap, MemAllocLinear *scratch, GlobCacheRecord *out)
 {
     // Helper for directory iteration + memory allocation of strings.  We need to
     // buffer the filenames as we need them in sorted order to ensure the results
@@ -103,29 +550,19 @@ HashDigest CalculateGlobSignatureFor(const char *path, const char *filter, bool
     {
         MemAllocLinear *m_Allocator;
         MemAllocHeap *m_Heap;
+        size_t m_PathLength;
+        const char *m_Filter;
         Buffer<const char *> m_Dirs;
         Buffer<const char *> m_Files;
 
-        void Init(MemAllocHeap *heap, MemAllocLinear *linear)
-        {
-            m_Allocator = linear;
-            m_Heap = heap;
-            BufferInit(&m_Dirs);
-            BufferInit(&m_Files);
-        }
-
-        void Destroy()
-        {
-            BufferDestroy(&m_Files, m_Heap);
-            BufferDestroy(&m_Dirs, m_Heap);
-        }
-
         static void Callback(void *user_data, const FileInfo &info, const char *path)
         {
             IterContext *self = (IterContext *)user_data;
-            char *data = StrDup(self->m_Allocator, path);
-            Buffer<const char *> *target = info.IsDirectory() ? &self->m_Dirs : &self->m_Files;
-            BufferAppendOne(target, self->m_Heap, data);
+            const char *name = path + self->m_PathLength + 1;
+            if (info.IsDirectory())
+                BufferAppendOne(&self->m_Dirs, self->m_Heap, (const char *)StrDup(self->m_Allocator, name));
+            else if (MatchesFilter(name, self->m_Filter))
+                BufferAppendOne(&self->m_Files, self->m_Heap, (const char *)StrDup(self->m_Allocator, name));
         }
 
         static int SortStringPtrs(const void *l, const void *r)
@@ -134,47 +571,162 @@ HashDigest CalculateGlobSignatureFor(const char *path, const char *filter, bool
         }
     };
 
+    IterContext ctx;
+    ctx.m_Allocator = scratch;
+    ctx.m_Heap = heap;
+    ctx.m_PathLength = strlen(path);
+    ctx.m_Filter = filter;
+    BufferInit(&ctx.m_Dirs);
+    BufferInit(&ctx.m_Files);
+
+    ListDirectory(path, nullptr, false, &ctx, IterContext::Callback);
+    AtomicIncrement(&g_Stats.m_GlobListings);
+
+    qsort(ctx.m_Dirs.m_Storage, ctx.m_Dirs.m_Size, sizeof(const char *), IterContext::SortStringPtrs);
+    qsort(ctx.m_Files.m_Storage, ctx.m_Files.m_Size, sizeof(const char *), IterContext::SortStringPtrs);
+
     HashState h;
     HashInit(&h);
+    bool any_match = false;
+    size_t names_size = 0;
 
-    FileInfo pathInfo = GetFileInfo(path);
-    HashAddInteger(&h, pathInfo.Exists() ? 1 : 0);
-    HashAddInteger(&h, pathInfo.IsDirectory() ? 1 : 0);
+    for (const char *name : ctx.m_Dirs)
+    {
+        names_size += strlen(name) + 1;
+        if (!MatchesFilter(name, filter))
+            continue;
+        HashAddPath(&h, name);
+        HashAddSeparator(&h);
+        any_match = true;
+    }
+
+    // Add an extra separator to catch a directory that turned into a file
     HashAddSeparator(&h);
 
-    if (pathInfo.Exists() && pathInfo.IsDirectory())
+    for (const char *name : ctx.m_Files)
     {
-        // Set up to rewind allocator for each loop iteration
-        MemAllocLinearScope mem_scope(scratch);
+        HashAddPath(&h, name);
+        HashAddSeparator(&h);
+        any_match = true;
+    }
+
+    HashFinalize(&h, &out->m_Digest);
+    if (!any_match)
+        memset(&out->m_Digest, 0, sizeof out->m_Digest);
+
+    char *names = LinearAllocateArray<char>(scratch, names_size + 1);
+    out->m_Subdirectories = names;
+    out->m_SubdirectoriesSize = uint32_t(names_size);
+    for (const char *name : ctx.m_Dirs)
+    {
+        size_t len = strlen(name) + 1;
+        memcpy(names, name, len);
+        names += len;
+    }
 
-        // Set up context
-        IterContext ctx;
-        ctx.Init(heap, scratch);
+    BufferDestroy(&ctx.m_Files, heap);
+    BufferDestroy(&ctx.m_Dirs, heap);
+}
+
+// Digest the matches in a directory, and below it if recursing. Subtrees without
+// matches are left out, so the digest only depends on the paths that match.
+// Returns false if there were none.
+static bool GlobDirectoryDigest(const char *path, const char *filter, bool recurse, MemAllocHeap *heap, MemAllocLinear *scratch, HashDigest *digest_out)
+{
+    // Set up to rewind allocator for each directory
+    MemAllocLinearScope mem_scope(scratch);
+
+    // Listings are only recorded for directories whose times are older than
+    // this, so any change made from here on moves them past the recorded ones.
+    const uint64_t now = GetFileIdentityTimeNow();
 
-        // Get directory data
-        ListDirectory(path, filter, recurse, &ctx, IterContext::Callback);
+    FileIdentity identity;
+    const bool cacheable = s_GlobCache && GetFileIdentity(path, &identity);
+    const char *key = nullptr;
+    uint32_t key_hash = 0;
+
+    GlobCacheRecord listing;
+
+    if (cacheable)
+    {
+        key = GlobCacheMakeKey(scratch, path, filter);
+        key_hash = Djb2HashPath(key);
+    }
 
-        // Sort data
-        qsort(ctx.m_Dirs.m_Storage, ctx.m_Dirs.m_Size, sizeof(const char *), IterContext::SortStringPtrs);
-        qsort(ctx.m_Files.m_Storage, ctx.m_Files.m_Size, sizeof(const char *), IterContext::SortStringPtrs);
+    if (cacheable && GlobCacheGet(s_GlobCache, key, key_hash, identity.m_ModifiedTime, identity.m_ChangeTime, &listing))
+    {
+        AtomicIncrement(&g_Stats.m_GlobCacheHits);
+    }
+    else
+    {
+        ListGlobDirectory(path, filter, heap, scratch, &listing);
 
-        // Compute digest
-        for (const char *p : ctx.m_Dirs)
+        if (cacheable && identity.m_ModifiedTime < now && identity.m_ChangeTime < now)
         {
-            HashAddPath(&h, p);
-            HashAddSeparator(&h);
+            listing.m_ModifiedTime = identity.m_ModifiedTime;
+            listing.m_ChangeTime = identity.m_ChangeTime;
+            GlobCacheSet(s_GlobCache, key, key_hash, listing);
         }
+    }
+
+    HashDigest empty;
+    memset(&empty, 0, sizeof empty);
+    bool any_match = listing.m_Digest != empty;
 
-        // Add an extra separator to catch a directory that turned into a file
+    if (!recurse)
+    {
+        *digest_out = listing.m_Digest;
+        return any_match;
+    }
+
+    HashState h;
+    HashInit(&h);
+    HashUpdate(&h, &listing.m_Digest, sizeof listing.m_Digest);
+
+    const size_t path_len = strlen(path);
+    const char *name = listing.m_Subdirectories;
+    const char *names_end = name + listing.m_SubdirectoriesSize;
+
+    for (; name < names_end; name += strlen(name) + 1)
+    {
+        const size_t name_len = strlen(name);
+        char *child = LinearAllocateArray<char>(scratch, path_len + name_len + 2);
+        memcpy(child, path, path_len);
+        child[path_len] = '/';
+        memcpy(child + path_len + 1, name, name_len + 1);
+
+        HashDigest child_digest;
+        if (!GlobDirectoryDigest(child, filter, recurse, heap, scratch, &child_digest))
+            continue;
+
+        HashAddSeparator(&h);
+        HashAddPath(&h, name);
         HashAddSeparator(&h);
+        HashUpdate(&h, &child_digest, sizeof child_digest);
+        any_match = true;
+    }
 
-        for (const char *p : ctx.m_Files)
-        {
-            HashAddPath(&h, p);
-            HashAddSeparator(&h);
-        }
+    HashFinalize(&h, digest_out);
+    return any_match;
+}
+
+HashDigest CalculateGlobSignatureFor(const char *path, const char *filter, bool recurse, MemAllocHeap *heap, MemAllocLinear *scratch)
+{
+    TimingScope timing_scope(&g_Stats.m_GlobCount, &g_Stats.m_GlobTimeCycles);
+
+    HashState h;
+    HashInit(&h);
 
-        ctx.Destroy();
+    FileInfo pathInfo = GetFileInfo(path);
+    HashAddInteger(&h, pathInfo.Exists() ? 1 : 0);
+    HashAddInteger(&h, pathInfo.IsDirectory() ? 1 : 0);
+    HashAddSeparator(&h);
+
+    if (pathInfo.Exists() && pathInfo.IsDirectory())
+    {
+        HashDigest listing;
+        GlobDirectoryDigest(path, filter, recurse, heap, scratch, &listing);
+        HashUpdate(&h, &listing, sizeof listing);
     }
     else if (pathInfo.IsFile())
     {
@@ -8,6 +8,9 @@ struct StatCache;
 struct DigestCache;
 struct MemAllocHeap;
 struct MemAllocLinear;
+struct SharedDigestStore;
+struct GlobCache;
+struct FileInfo;
 
 void ComputeFileSignature(
     HashState *out, // out
@@ -21,4 +24,33 @@ void ComputeFileSignature(
 
 HashDigest CalculateGlobSignatureFor(const char *path, const char *filter, bool recurse, MemAllocHeap *heap, MemAllocLinear *scratch);
 
+// Reuse the listings of unchanged directories when computing glob signatures, or nullptr to always list them.
+void FileSignSetGlobCache(GlobCache *cache);
+
+// Digest of file contents, as stored in the digest cache. Large inputs are hashed
+// as a tree of chunks that idle build threads can help with.
+void ComputeContentDigest(HashDigest *digest_out, const void *data, size_t size);
+
+// Content digest of a file on disk, as ComputeContentDigest would compute it.
+bool ComputeFileDigest(const char *filename, uint64_t file_size, HashDigest *digest_out);
+
+// Let idle build threads help with digests of large files; wakeup is called when there is work.
+void FileSignInitHelpers(void (*wakeup)(void *user_data), void *user_data);
+void FileSignDestroyHelpers();
+
+// Hash chunks of large files that other threads are digesting. Returns true if any work was done.
+bool FileSignHelpWithDigests();
+
+// Trust digests recorded in the named extended attribute by external tools, or nullptr to disable.
+void FileSignSetDigestXattr(const char *xattr_name);
+
+// Consult and fill a machine-wide digest store on digest cache misses, or nullptr to disable.
+void FileSignSetSharedDigestStore(SharedDigestStore *store);
+
+// Also fold size, inode and change time into timestamp signatures, so files replaced with preserved mtimes are noticed.
+void FileSignSetExtendedTimestamps(bool enabled);
+
+// The timestamp used for signatures and for validating cached digests and scan results.
+uint64_t FileSignatureTimestamp(const FileInfo &info);
+
 bool ShouldUseSHA1SignatureFor(const char *filename, const uint32_t sha_extension_hashes[], int sha_extension_hash_count);
@@ -0,0 +1,196 @@
+#include "GlobCache.hpp"
+#include "BinaryWriter.hpp"
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+
+
+
+void GlobCacheInit(GlobCache *self, size_t heap_size, const char *filename)
+{
+    ReadWriteLockInit(&self->m_Lock);
+
+    self->m_Initialized = true;
+
+    HeapInit(&self->m_Heap);
+    LinearAllocInit(&self->m_Allocator, &self->m_Heap, heap_size, "glob cache allocator");
+    MmapFileInit(&self->m_StateFile);
+    HashTableInit(&self->m_Table, &self->m_Heap);
+
+    self->m_AccessTime = time(nullptr);
+
+    CacheRetentionInit(&self->m_Retention, self->m_AccessTime, 7, 0);
+    self->m_CompressThreshold = 0;
+
+    MmapFileMapFrozen(&self->m_StateFile, filename);
+    if (!MmapFileValid(&self->m_StateFile))
+        return;
+
+    const Frozen::GlobCacheState *state = (const Frozen::GlobCacheState *)self->m_StateFile.m_Address;
+    if (self->m_StateFile.m_Size < sizeof(Frozen::GlobCacheState) || Frozen::GlobCacheState::MagicNumber != state->m_MagicNumber)
+    {
+        MmapFileUnmap(&self->m_StateFile);
+        return;
+    }
+
+    for (const Frozen::GlobDirectoryRecord &frozen : state->m_Records)
+    {
+        GlobCacheRecord r;
+        r.m_ModifiedTime = frozen.m_ModifiedTime;
+        r.m_ChangeTime = frozen.m_ChangeTime;
+        r.m_AccessTime = frozen.m_AccessTime;
+        r.m_Digest = frozen.m_Digest;
+        r.m_Subdirectories = frozen.m_Subdirectories.GetArray();
+        r.m_SubdirectoriesSize = uint32_t(frozen.m_Subdirectories.GetCount());
+        HashTableInsert(&self->m_Table, frozen.m_KeyHash, frozen.m_Key.Get(), r);
+    }
+
+    Log(kDebug, "glob cache initialized -- %d entries", state->m_Records.GetCount());
+}
+
+void GlobCacheDestroy(GlobCache *self)
+{
+    if (!self->m_Initialized)
+        return;
+    HashTableDestroy(&self->m_Table);
+    MmapFileDestroy(&self->m_StateFile);
+    LinearAllocDestroy(&self->m_Allocator);
+    HeapDestroy(&self->m_Heap);
+    ReadWriteLockDestroy(&self->m_Lock);
+    self->m_Initialized = false;
+}
+
+void GlobCacheSetRetention(GlobCache *self, int32_t days_to_keep)
+{
+    CacheRetentionInit(&self->m_Retention, self->m_AccessTime, days_to_keep, 0);
+}
+
+void GlobCacheSetCompressThreshold(GlobCache *self, size_t threshold)
+{
+    self->m_CompressThreshold = threshold;
+}
+
+bool GlobCacheSave(GlobCache *self, MemAllocHeap *serialization_heap, const char *filename, const char *tmp_filename)
+{
+    BinaryWriter writer;
+    BinaryWriterInit(&writer, serialization_heap);
+    writer.m_CompressThreshold = self->m_CompressThreshold;
+
+    BinarySegment *main_seg = BinaryWriterAddSegment(&writer);
+    BinarySegment *array_seg = BinaryWriterAddSegment(&writer);
+    BinarySegment *string_seg = BinaryWriterAddSegment(&writer);
+    BinaryLocator array_ptr = BinarySegmentPosition(array_seg);
+
+    int32_t record_count = 0;
+
+    HashTableWalk(&self->m_Table, [&](size_t index, uint32_t hash, const char *key, const GlobCacheRecord &r) {
+        if (!CacheRetentionKeep(&self->m_Retention, r.m_AccessTime))
+            return;
+
+        ++record_count;
+        BinarySegmentWriteUint64(array_seg, r.m_ModifiedTime);
+        BinarySegmentWriteUint64(array_seg, r.m_ChangeTime);
+        BinarySegmentWriteUint64(array_seg, r.m_AccessTime);
+        BinarySegmentWritePointer(array_seg, BinarySegmentPosition(string_seg));
+        BinarySegmentWriteStringData(string_seg, key);
+        BinarySegmentWriteUint32(array_seg, hash);
+        BinarySegmentWriteInt32(array_seg, int32_t(r.m_SubdirectoriesSize));
+        if (r.m_SubdirectoriesSize)
+        {
+            BinarySegmentWritePointer(array_seg, BinarySegmentPosition(string_seg));
+            BinarySegmentWrite(string_seg, r.m_Subdirectories, r.m_SubdirectoriesSize);
+        }
+        else
+        {
+            BinarySegmentWriteNullPointer(array_seg);
+        }
+        BinarySegmentWrite(array_seg, &r.m_Digest, sizeof(r.m_Digest));
+#if ENABLED(USE_SHA1_HASH)
+        BinarySegmentWriteUint32(array_seg, 0); // m_Padding
+#endif
+    });
+
+    BinarySegmentWriteUint32(main_seg, Frozen::GlobCacheState::MagicNumber);
+    BinarySegmentWriteInt32(main_seg, record_count);
+    BinarySegmentWritePointer(main_seg, array_ptr);
+    BinarySegmentWriteUint32(main_seg, Frozen::GlobCacheState::MagicNumber);
+
+    // Unmap old state to avoid sharing conflicts on Windows. Frozen records are
+    // no longer visible after this, so saving must be the last use of the cache.
+    MmapFileUnmap(&self->m_StateFile);
+    HashTableDestroy(&self->m_Table);
+    HashTableInit(&self->m_Table, &self->m_Heap);
+
+    bool success = BinaryWriterFlush(&writer, tmp_filename);
+
+    if (success)
+    {
+        success = RenameFile(tmp_filename, filename);
+    }
+    else
+    {
+        remove(tmp_filename);
+    }
+
+    BinaryWriterDestroy(&writer);
+
+    return success;
+}
+
+const char *GlobCacheMakeKey(MemAllocLinear *scratch, const char *path, const char *filter)
+{
+    const size_t path_len = strlen(path);
+    const size_t filter_len = filter ? strlen(filter) : 0;
+
+    char *key = LinearAllocateArray<char>(scratch, path_len + filter_len + 2);
+    memcpy(key, path, path_len);
+    key[path_len] = '\n';
+    memcpy(key + path_len + 1, filter ? filter : "", filter_len);
+    key[path_len + filter_len + 1] = '\0';
+    return key;
+}
+
+bool GlobCacheGet(GlobCache *self, const char *key, uint32_t hash, uint64_t modified_time, uint64_t change_time, GlobCacheRecord *record_out)
+{
+    bool result = false;
+
+    ReadWriteLockRead(&self->m_Lock);
+
+    if (GlobCacheRecord *r = HashTableLookup(&self->m_Table, hash, key))
+    {
+        if (r->m_ModifiedTime == modified_time && r->m_ChangeTime == change_time)
+        {
+            // Technically violates r/w lock - doesn't matter
+            r->m_AccessTime = self->m_AccessTime;
+            *record_out = *r;
+            result = true;
+        }
+    }
+
+    ReadWriteUnlockRead(&self->m_Lock);
+
+    return result;
+}
+
+void GlobCacheSet(GlobCache *self, const char *key, uint32_t hash, const GlobCacheRecord &record)
+{
+    ReadWriteLockWrite(&self->m_Lock);
+
+    GlobCacheRecord copy = record;
+    copy.m_AccessTime = self->m_AccessTime;
+    copy.m_Subdirectories = nullptr;
+    if (record.m_SubdirectoriesSize)
+    {
+        char *names = LinearAllocateArray<char>(&self->m_Allocator, record.m_SubdirectoriesSize);
+        memcpy(names, record.m_Subdirectories, record.m_SubdirectoriesSize);
+        copy.m_Subdirectories = names;
+    }
+
+    if (GlobCacheRecord *r = HashTableLookup(&self->m_Table, hash, key))
+        *r = copy;
+    else
+        HashTableInsert(&self->m_Table, hash, StrDup(&self->m_Allocator, key), copy);
+
+    ReadWriteUnlockWrite(&self->m_Lock);
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Common.hpp"
+#include "BinaryData.hpp"
+#include "Hash.hpp"
+#include "HashTable.hpp"
+#include "MemoryMappedFile.hpp"
+#include "MemAllocLinear.hpp"
+#include "MemAllocHeap.hpp"
+#include "ReadWriteLock.hpp"
+#include "CacheRetention.hpp"
+
+// Remembers the listing of each directory a glob signature visits, so the
+// directory only has to be listed again when its modification or change time
+// moves. Records are keyed by the directory path and the filter, separated by
+// a newline (see GlobCacheMakeKey).
+
+namespace Frozen
+{
+    struct GlobDirectoryRecord
+    {
+        uint64_t m_ModifiedTime;
+        uint64_t m_ChangeTime;
+        uint64_t m_AccessTime;
+        FrozenString m_Key;
+        uint32_t m_KeyHash;
+        // Names of every subdirectory, sorted, each null terminated.
+        FrozenArray<char> m_Subdirectories;
+        HashDigest m_Digest;
+    #if ENABLED(USE_SHA1_HASH)
+        uint32_t m_Padding;
+    #endif
+    };
+    static_assert(sizeof(Frozen::GlobDirectoryRecord) == 64 || sizeof(Frozen::GlobDirectoryRecord) == 56, "struct size");
+
+    struct GlobCacheState
+    {
+        static const uint32_t MagicNumber = 0x52e0b7c3 ^ kTundraHashMagic;
+
+        uint32_t m_MagicNumber;
+        FrozenArray<Frozen::GlobDirectoryRecord> m_Records;
+        uint32_t m_MagicNumberEnd;
+    };
+}
+
+struct GlobCacheRecord
+{
+    uint64_t m_ModifiedTime;
+    uint64_t m_ChangeTime;
+    uint64_t m_AccessTime;
+    // Digest of the entries of this directory that match the filter.
+    HashDigest m_Digest;
+    const char *m_Subdirectories;
+    uint32_t m_SubdirectoriesSize;
+};
+
+// Frozen records are copied into m_Table when the cache is loaded and refer to
+// the mapped file, which stays mapped until the cache is saved.
+struct GlobCache
+{
+    bool m_Initialized;
+    ReadWriteLock m_Lock;
+    MemAllocHeap m_Heap;
+    MemAllocLinear m_Allocator;
+    MemoryMappedFile m_StateFile;
+    HashTable<GlobCacheRecord, kFlagPathStrings> m_Table;
+    uint64_t m_AccessTime;
+    CacheRetention m_Retention;
+    // Saved caches of at least this many bytes are block compressed; zero never compresses.
+    size_t m_CompressThreshold;
+};
+
+void GlobCacheInit(GlobCache *self, size_t heap_size, const char *filename);
+
+void GlobCacheDestroy(GlobCache *self);
+
+// Records unused for days_to_keep days are dropped (default 7).
+void GlobCacheSetRetention(GlobCache *self, int32_t days_to_keep);
+
+void GlobCacheSetCompressThreshold(GlobCache *self, size_t threshold);
+
+bool GlobCacheSave(GlobCache *self, MemAllocHeap *serialization_heap, const char *filename, const char *tmp_filename);
+
+// Write the record key for a directory listed under a filter, which may be null, into scratch.
+const char *GlobCacheMakeKey(MemAllocLinear *scratch, const char *path, const char *filter);
+
+// Find the listing recorded for a directory, provided its times still match. The
+// subdirectory names stay valid until the cache is saved or destroyed.
+bool GlobCacheGet(GlobCache *self, const char *key, uint32_t hash, uint64_t modified_time, uint64_t change_time, GlobCacheRecord *record_out);
+
+// Record the listing of a directory; the subdirectory names are copied.
+void GlobCacheSet(GlobCache *self, const char *key, uint32_t hash, const GlobCacheRecord &record);
@@ -8,6 +8,7 @@
 
 void HashInitImpl(HashStateImpl *impl);
 void HashBlock(const uint8_t *data, HashStateImpl *state, void *debug_file);
+void HashBlocks(const uint8_t *data, size_t block_count, HashStateImpl *state);
 void HashFinalizeImpl(HashStateImpl *self, HashDigest *digest);
 
 void HashUpdate(HashState *self, const void *data_in, size_t size)
@@ -36,12 +37,20 @@ void HashUpdate(HashState *self, const void *data_in, size_t size)
                 used = 0;
             }
         }
-        else
+        else if (self->m_DebugFile)
         {
             HashBlock(data, state, self->m_DebugFile);
             data += sizeof self->m_Buffer;
             remain -= sizeof self->m_Buffer;
         }
+        else
+        {
+            // Hash all whole blocks straight from the caller's memory.
+            const size_t block_count = remain / sizeof self->m_Buffer;
+            HashBlocks(data, block_count, state);
+            data += block_count * sizeof self->m_Buffer;
+            remain -= block_count * sizeof self->m_Buffer;
+        }
     }
 
     self->m_BufUsed = used;
@@ -201,3 +201,6 @@ void DigestToString(char (&buffer)[kDigestStringSize], const HashDigest &digest)
 
 // Quickie to generate a hash digest from a single string
 void HashSingleString(HashDigest *digest_out, const char *string);
+
+// Name of the block hashing implementation selected for this CPU.
+const char *HashBackendName();
@@ -2,6 +2,16 @@
 
 #include <cstdio>
 #include <cctype>
+#include <cstring>
+
+#if ENABLED(USE_SIMD_HASH)
+#if defined(_M_X64)
+#include <immintrin.h>
+#include <intrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#endif
 
 // This is a 128-bit hash adapted from the xxhash project - https://code.google.com/p/xxhash/
 //
@@ -20,6 +30,8 @@ static inline uint32_t RotateLeft(uint32_t value, int amount)
     return (value << amount) | (value >> (32 - amount));
 }
 
+typedef void (*HashBlocksFn)(const uint8_t *data, size_t block_count, HashStateImpl *state);
+
 void HashBlock(const uint8_t *block, HashStateImpl *state, void *debug_file_)
 {
     const uint32_t *p = (const uint32_t *)block;
@@ -86,6 +98,271 @@ void HashBlock(const uint8_t *block, HashStateImpl *state, void *debug_file_)
     }
 }
 
+// Hash a run of whole blocks one lane at a time.
+void HashBlocksScalar(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    for (size_t i = 0; i < block_count; ++i)
+        HashBlock(data + i * 64, state, nullptr);
+}
+
+// The 16 accumulators in m_V each consume one 32-bit word of every 64-byte block
+// and never mix until finalization, so vector versions process the block as 16
+// independent lanes and produce exactly the same digests as the scalar code.
+//
+// The x86 backends live in target-attributed functions so the rest of the file keeps
+// the baseline ISA. GCC before 4.9 only declares the SSE4.1/AVX2 intrinsics when the
+// whole file is built with -msse4.1/-mavx2, so GCC and clang use vector extensions,
+// which they lower to the same instructions inside those functions. MSVC has no
+// vector extensions but declares every intrinsic unconditionally.
+#if ENABLED(USE_SIMD_HASH)
+#if defined(__x86_64__) || defined(_M_X64)
+
+#if defined(__GNUC__)
+
+typedef uint32_t HashLanes4 __attribute__((vector_size(16)));
+typedef uint32_t HashLanes8 __attribute__((vector_size(32)));
+
+#define TUNDRA_LANES(s, offset)                           \
+    memcpy(&d, data + offset, sizeof d);                  \
+    s += d * p2;                                          \
+    s = (s << r13) | (s >> r19);                          \
+    s *= p1
+
+__attribute__((target("sse4.1")))
+static void HashBlocksSse41(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    const HashLanes4 p1 = {kPrime32_1, kPrime32_1, kPrime32_1, kPrime32_1};
+    const HashLanes4 p2 = {kPrime32_2, kPrime32_2, kPrime32_2, kPrime32_2};
+    const HashLanes4 r13 = {13, 13, 13, 13};
+    const HashLanes4 r19 = {19, 19, 19, 19};
+    HashLanes4 s0, s1, s2, s3, d;
+    memcpy(&s0, &state->m_V[0], sizeof s0);
+    memcpy(&s1, &state->m_V[1], sizeof s1);
+    memcpy(&s2, &state->m_V[2], sizeof s2);
+    memcpy(&s3, &state->m_V[3], sizeof s3);
+
+    for (size_t i = 0; i < block_count; ++i, data += 64)
+    {
+        TUNDRA_LANES(s0, 0);
+        TUNDRA_LANES(s1, 16);
+        TUNDRA_LANES(s2, 32);
+        TUNDRA_LANES(s3, 48);
+    }
+
+    memcpy(&state->m_V[0], &s0, sizeof s0);
+    memcpy(&state->m_V[1], &s1, sizeof s1);
+    memcpy(&state->m_V[2], &s2, sizeof s2);
+    memcpy(&state->m_V[3], &s3, sizeof s3);
+}
+
+__attribute__((target("avx2")))
+static void HashBlocksAvx2(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    const HashLanes8 p1 = {kPrime32_1, kPrime32_1, kPrime32_1, kPrime32_1, kPrime32_1, kPrime32_1, kPrime32_1, kPrime32_1};
+    const HashLanes8 p2 = {kPrime32_2, kPrime32_2, kPrime32_2, kPrime32_2, kPrime32_2, kPrime32_2, kPrime32_2, kPrime32_2};
+    const HashLanes8 r13 = {13, 13, 13, 13, 13, 13, 13, 13};
+    const HashLanes8 r19 = {19, 19, 19, 19, 19, 19, 19, 19};
+    HashLanes8 s0, s1, d;
+    memcpy(&s0, &state->m_V[0], sizeof s0);
+    memcpy(&s1, &state->m_V[2], sizeof s1);
+
+    for (size_t i = 0; i < block_count; ++i, data += 64)
+    {
+        TUNDRA_LANES(s0, 0);
+        TUNDRA_LANES(s1, 32);
+    }
+
+    memcpy(&state->m_V[0], &s0, sizeof s0);
+    memcpy(&state->m_V[2], &s1, sizeof s1);
+}
+
+#undef TUNDRA_LANES
+
+#else
+
+static void HashBlocksSse41(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    const __m128i p1 = _mm_set1_epi32((int)kPrime32_1);
+    const __m128i p2 = _mm_set1_epi32((int)kPrime32_2);
+    __m128i *v = (__m128i *)state->m_V;
+    __m128i s0 = _mm_load_si128(v + 0), s1 = _mm_load_si128(v + 1);
+    __m128i s2 = _mm_load_si128(v + 2), s3 = _mm_load_si128(v + 3);
+
+#define TUNDRA_LANES(s, offset)                                                                   \
+    s = _mm_add_epi32(s, _mm_mullo_epi32(_mm_loadu_si128((const __m128i *)(data + offset)), p2)); \
+    s = _mm_or_si128(_mm_slli_epi32(s, 13), _mm_srli_epi32(s, 19));                               \
+    s = _mm_mullo_epi32(s, p1)
+
+    for (size_t i = 0; i < block_count; ++i, data += 64)
+    {
+        TUNDRA_LANES(s0, 0);
+        TUNDRA_LANES(s1, 16);
+        TUNDRA_LANES(s2, 32);
+        TUNDRA_LANES(s3, 48);
+    }
+#undef TUNDRA_LANES
+
+    _mm_store_si128(v + 0, s0);
+    _mm_store_si128(v + 1, s1);
+    _mm_store_si128(v + 2, s2);
+    _mm_store_si128(v + 3, s3);
+}
+
+static void HashBlocksAvx2(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    const __m256i p1 = _mm256_set1_epi32((int)kPrime32_1);
+    const __m256i p2 = _mm256_set1_epi32((int)kPrime32_2);
+    __m256i *v = (__m256i *)state->m_V;
+    __m256i s0 = _mm256_loadu_si256(v + 0), s1 = _mm256_loadu_si256(v + 1);
+
+#define TUNDRA_LANES(s, offset)                                                                            \
+    s = _mm256_add_epi32(s, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(data + offset)), p2)); \
+    s = _mm256_or_si256(_mm256_slli_epi32(s, 13), _mm256_srli_epi32(s, 19));                               \
+    s = _mm256_mullo_epi32(s, p1)
+
+    for (size_t i = 0; i < block_count; ++i, data += 64)
+    {
+        TUNDRA_LANES(s0, 0);
+        TUNDRA_LANES(s1, 32);
+    }
+#undef TUNDRA_LANES
+
+    _mm256_storeu_si256(v + 0, s0);
+    _mm256_storeu_si256(v + 1, s1);
+}
+
+#endif
+
+static bool CpuHasFeature(int leaf, int reg, int bit)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    if (leaf == 7)
+    {
+        // AVX registers are only usable if the OS saves them on context switches.
+        __cpuidex(info, 1, 0);
+        if (0 == (info[2] & (1 << 27)) || 6 != (_xgetbv(0) & 6))
+            return false;
+    }
+    __cpuidex(info, leaf, 0);
+    return 0 != (info[reg] & (1 << bit));
+#else
+    // Ask the compiler runtime; it also checks that the OS saves the AVX state. The runtime
+    // fills in its CPU model from a constructor, which may not have run yet if we're
+    // called from another static initializer.
+#if defined(__clang__)
+#if __has_builtin(__builtin_cpu_init)
+    __builtin_cpu_init();
+#endif
+#else
+    __builtin_cpu_init();
+#endif
+    if (leaf == 7)
+        return __builtin_cpu_supports("avx2");
+    return __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static HashBlocksFn SelectHashBlocks(const char **name_out)
+{
+    if (CpuHasFeature(7, 1, 5))
+    {
+        *name_out = "avx2";
+        return HashBlocksAvx2;
+    }
+    if (CpuHasFeature(1, 2, 19))
+    {
+        *name_out = "sse4.1";
+        return HashBlocksSse41;
+    }
+    *name_out = "scalar";
+    return HashBlocksScalar;
+}
+
+#elif defined(__aarch64__)
+
+static void HashBlocksNeon(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    const uint32x4_t p1 = vdupq_n_u32(kPrime32_1);
+    const uint32x4_t p2 = vdupq_n_u32(kPrime32_2);
+    uint32_t *v = &state->m_V[0][0];
+    uint32x4_t s0 = vld1q_u32(v + 0), s1 = vld1q_u32(v + 4);
+    uint32x4_t s2 = vld1q_u32(v + 8), s3 = vld1q_u32(v + 12);
+
+#define TUNDRA_LANES(s, offset)                                                  \
+    s = vmlaq_u32(s, vld1q_u32((const uint32_t *)(data + offset)), p2);          \
+    s = vsriq_n_u32(vshlq_n_u32(s, 13), s, 19);                                  \
+    s = vmulq_u32(s, p1)
+
+    for (size_t i = 0; i < block_count; ++i, data += 64)
+    {
+        TUNDRA_LANES(s0, 0);
+        TUNDRA_LANES(s1, 16);
+        TUNDRA_LANES(s2, 32);
+        TUNDRA_LANES(s3, 48);
+    }
+#undef TUNDRA_LANES
+
+    vst1q_u32(v + 0, s0);
+    vst1q_u32(v + 4, s1);
+    vst1q_u32(v + 8, s2);
+    vst1q_u32(v + 12, s3);
+}
+
+static HashBlocksFn SelectHashBlocks(const char **name_out)
+{
+    // NEON is mandatory on AArch64.
+    *name_out = "neon";
+    return HashBlocksNeon;
+}
+
+#else
+
+static HashBlocksFn SelectHashBlocks(const char **name_out)
+{
+    *name_out = "scalar";
+    return HashBlocksScalar;
+}
+
+#endif
+#else
+
+static HashBlocksFn SelectHashBlocks(const char **name_out)
+{
+    *name_out = "scalar";
+    return HashBlocksScalar;
+}
+
+#endif
+
+struct HashBackend
+{
+    const char *m_Name;
+    HashBlocksFn m_Blocks;
+
+    HashBackend()
+    {
+        m_Blocks = SelectHashBlocks(&m_Name);
+    }
+};
+
+// Selected on first use so hashing from static initializers is safe.
+static const HashBackend &GetHashBackend()
+{
+    static const HashBackend backend;
+    return backend;
+}
+
+void HashBlocks(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    GetHashBackend().m_Blocks(data, block_count, state);
+}
+
+const char *HashBackendName()
+{
+    return GetHashBackend().m_Name;
+}
+
 void HashInitImpl(HashStateImpl *self)
 {
     uint32_t seeds[4] = {0x89caf13a, 0x179fa534, 0x5199afcc, 0xef901315};
@@ -62,6 +62,17 @@ void HashBlock(const uint8_t *block, HashStateImpl *state, void *debug_file_)
     state->m_State[4] += e;
 }
 
+void HashBlocks(const uint8_t *data, size_t block_count, HashStateImpl *state)
+{
+    for (size_t i = 0; i < block_count; ++i)
+        HashBlock(data + i * 64, state, nullptr);
+}
+
+const char *HashBackendName()
+{
+    return "sha1";
+}
+
 void HashInitImpl(HashStateImpl *self)
 {
     self->m_State[0] = 0x67452301;
@@ -104,6 +104,13 @@ inline int FastCompareNoCase(const char *lhs, const char *rhs)
     }
 }
 
+// Compares strings the way a table with kFlags does.
+template <uint32_t kFlags>
+inline int HashTableCompare(const char *lhs, const char *rhs)
+{
+    return (kFlags & kFlagCaseInsensitive) ? FastCompareNoCase(lhs, rhs) : strcmp(lhs, rhs);
+}
+
 template <uint32_t kFlags>
 int HashTableBaseLookup(HashTableBase<kFlags> *self, uint32_t hash, const char *string)
 {
@@ -128,6 +128,38 @@ ScanIncludesCpp(char *buffer, MemAllocLinear *allocator)
     return list.m_Head;
 }
 
+// Find the first keyword (in configuration order) that prefixes the string,
+// walking the keyword trie once.
+static const Frozen::KeywordData *
+MatchKeyword(const char *start, const Frozen::GenericScannerData &config)
+{
+    const Frozen::KeywordTrieNode *nodes = config.m_KeywordTrie.GetArray();
+    if (0 == config.m_KeywordTrie.GetCount())
+        return nullptr;
+
+    const Frozen::KeywordTrieNode *node = nodes;
+    int best = node->m_KeywordIndex;
+
+    for (const char *p = start; *p; ++p)
+    {
+        const Frozen::KeywordTrieNode *child = nodes + node->m_FirstChild;
+        const Frozen::KeywordTrieNode *end = child + node->m_ChildCount;
+
+        while (child != end && child->m_Char != *p)
+            ++child;
+
+        if (child == end)
+            break;
+
+        node = child;
+
+        if (uint32_t(node->m_KeywordIndex) < uint32_t(best))
+            best = node->m_KeywordIndex;
+    }
+
+    return best >= 0 ? &config.m_Keywords[best] : nullptr;
+}
+
 static IncludeData *
 ScanLineGeneric(MemAllocLinear *allocator, const char *start_in, const Frozen::GenericScannerData &config)
 {
@@ -144,16 +176,7 @@ ScanLineGeneric(MemAllocLinear *allocator, const char *start_in, const Frozen::G
     if (require_ws && start == start_in)
         return nullptr;
 
-    const Frozen::KeywordData *keyword = nullptr;
-
-    for (const Frozen::KeywordData &kwdata : config.m_Keywords)
-    {
-        if (0 == strncmp(kwdata.m_String, start, kwdata.m_StringLength))
-        {
-            keyword = &kwdata;
-            break;
-        }
-    }
+    const Frozen::KeywordData *keyword = MatchKeyword(start, config);
 
     if (!keyword)
         return nullptr;
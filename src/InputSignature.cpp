@@ -177,7 +177,7 @@ static void ReportInputSignatureChanges(
         // command that is different may be in response file(s).
         for (const Frozen::NodeInputFileData &oldInput : previously_built_node->m_InputFiles)
         {
-            const FrozenFileAndHash *newInput;
+            const Frozen::DagFile *newInput;
             for (newInput = dagnode->m_InputFiles.begin(); newInput != dagnode->m_InputFiles.end(); ++newInput)
             {
                 if (strcmp(newInput->m_Filename, oldInput.m_Filename) == 0)
@@ -30,17 +30,21 @@ static void DumpDag(const Frozen::Dag *data)
             printf(" precious");
         if (node.m_Flags & Frozen::DagNode::kFlagOverwriteOutputs)
             printf(" overwrite");
+        if (node.m_Flags & Frozen::DagNode::kFlagEarlyCutoff)
+            printf(" earlycutoff");
 
         printf("\n  action: %s\n", node.m_Action.Get());
         printf("  annotation: %s\n", node.m_Annotation.Get());
 
+        printf("  priority: %d\n", data->m_NodePriorities[i]);
+
         printf("  dependencies:");
-        for (int32_t dep : node.m_Dependencies)
+        for (int32_t dep : DagNodeDependencies(data, i))
             printf(" %u", dep);
         printf("\n");
 
         printf("  backlinks:");
-        for (int32_t link : node.m_BackLinks)
+        for (int32_t link : DagNodeBackLinks(data, i))
             printf(" %u", link);
         printf("\n");
 
@@ -108,6 +112,7 @@ static void DumpDag(const Frozen::Dag *data)
                     printf("      \"%s\" (%d bytes) follow: %s\n",
                            kw.m_String.Get(), kw.m_StringLength, kw.m_ShouldFollow ? "yes" : "no");
                 }
+                printf("    keyword trie nodes: %d\n", gs->m_KeywordTrie.GetCount());
             }
         }
 
@@ -136,6 +141,14 @@ static void DumpDag(const Frozen::Dag *data)
     printf("m_DigestCacheFileName : %s\n", data->m_DigestCacheFileName.Get());
     printf("m_DigestCacheFileNameTmp : %s\n", data->m_DigestCacheFileNameTmp.Get());
     printf("m_BuildTitle : %s\n", data->m_BuildTitle.Get());
+    printf("m_ScanCacheContentDigests : %d\n", data->m_ScanCacheContentDigests);
+    printf("m_CacheDaysToKeep : %d\n", data->m_CacheDaysToKeep);
+    printf("m_DigestCacheMaxRecords : %d\n", data->m_DigestCacheMaxRecords);
+    printf("m_ScanCacheMaxRecords : %d\n", data->m_ScanCacheMaxRecords);
+    printf("m_ExtendedTimestampSignatures : %d\n", data->m_ExtendedTimestampSignatures);
+    printf("m_CompressFilesAboveKb : %d\n", data->m_CompressFilesAboveKb);
+    printf("m_ContentDigestXattr : %s\n", data->m_ContentDigestXattr.Get() ? data->m_ContentDigestXattr.Get() : "");
+    printf("m_SharedDigestStoreFileName : %s\n", data->m_SharedDigestStoreFileName.Get() ? data->m_SharedDigestStoreFileName.Get() : "");
 
     printf("\nSHA-1 signatures enabled for extension hashes:\n");
     for (const uint32_t ext : data->m_ShaExtensionHashes)
@@ -178,6 +191,16 @@ static void DumpState(const Frozen::AllBuiltNodes *data)
         for (int i=0; i!=node.m_ImplicitInputFiles.GetCount(); i++)
             printf("    %lld %s\n", node.m_ImplicitInputFiles[i].m_Timestamp, node.m_ImplicitInputFiles[i].m_Filename.Get());
 
+        if (node.m_OutputDigests.GetCount() > 0)
+        {
+            printf("  output digests:\n");
+            for (const Frozen::NodeOutputDigest &output : node.m_OutputDigests)
+            {
+                DigestToString(digest_str, output.m_ContentDigest);
+                printf("    %lld %s\n", (long long)output.m_Timestamp, digest_str);
+            }
+        }
+
         printf("\n");
     }
 }
@@ -187,6 +210,7 @@ static void DumpScanCache(const Frozen::ScanData *data)
     int entry_count = data->m_EntryCount;
     printf("magic number: 0x%08x\n", data->m_MagicNumber);
     printf("entry count: %d\n", entry_count);
+    printf("index size: %u\n", data->m_IndexSize);
     for (int i = 0; i < entry_count; ++i)
     {
         printf("entry %d:\n", i);
@@ -215,6 +239,7 @@ static const char *FmtTime(uint64_t t)
 static void DumpDigestCache(const Frozen::DigestCacheState *data)
 {
     printf("record count: %d\n", data->m_Records.GetCount());
+    printf("index size: %u\n", data->m_IndexSize);
     for (const Frozen::DigestRecord &r : data->m_Records)
     {
         char digest_str[kDigestStringSize];
@@ -235,7 +260,7 @@ int main(int argc, char *argv[])
     const char *fn = argc >= 2 ? argv[1] : ".tundra2.dag";
 
     MmapFileInit(&f);
-    MmapFileMap(&f, fn);
+    MmapFileMapFrozen(&f, fn);
 
     if (MmapFileValid(&f))
     {
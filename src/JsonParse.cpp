@@ -1,5 +1,7 @@
 #include "JsonParse.hpp"
+#include "JsonStructuralIndex.hpp"
 #include "MemAllocLinear.hpp"
+#include "MemAllocHeap.hpp"
 #include "Stats.hpp"
 
 #include <ctype.h>
@@ -58,16 +60,24 @@ static const JsonLexeme s_FalseLexeme = {kJsonLexBoolean, {false}};
 
 struct JsonLexerState
 {
+    char *m_Buffer;
     char *m_Cursor;
+    // Only maintained without an index; see JsonLexerLineNumber().
     int m_LineNumber;
+    JsonStructuralIndex *m_Index;
+    // If set, strings are copied here and the buffer is never written. Requires an index.
+    MemAllocLinear *m_StringAlloc;
     JsonLexeme m_Lexeme;
     char m_Error[1024];
 };
 
-static void JsonLexerStateInit(JsonLexerState *self, char *buffer)
+static void JsonLexerStateInit(JsonLexerState *self, char *buffer, JsonStructuralIndex *index)
 {
+    self->m_Buffer = buffer;
     self->m_Cursor = buffer;
     self->m_LineNumber = 1;
+    self->m_Index = index;
+    self->m_StringAlloc = nullptr;
     self->m_Lexeme.m_Type = kJsonLexInvalid;
     self->m_Error[0] = '\0';
 }
@@ -93,32 +103,52 @@ static char *SkipWhitespace(JsonLexerState *state)
     return ptr;
 }
 
+// The indexed lexer never walks whitespace, so it counts lines only when an error needs them.
+static int JsonLexerLineNumber(const JsonLexerState *state)
+{
+    if (!state->m_Index)
+        return state->m_LineNumber;
+
+    int line_number = 1;
+    for (const char *p = state->m_Buffer; p < state->m_Cursor; ++p)
+    {
+        if ('\n' == *p)
+            ++line_number;
+    }
+    return line_number;
+}
+
 static JsonLexeme JsonLexerError(JsonLexerState *state, const char *error)
 {
-    snprintf(state->m_Error, sizeof state->m_Error, "%d: %s", state->m_LineNumber, error);
+    snprintf(state->m_Error, sizeof state->m_Error, "%d: %s", JsonLexerLineNumber(state), error);
     return s_ErrorLexeme;
 }
 
-static JsonLexeme GetNumberLexeme(JsonLexerState *state)
+static JsonLexeme ScanNumber(JsonLexerState *state, const char *text, const char **end_out)
 {
-    char *start = state->m_Cursor;
     char *end = nullptr;
 
     JsonLexeme result;
 
     result.m_Type = kJsonLexNumber;
-    result.m_Number = strtod(start, &end);
-    state->m_Cursor = end;
-    return start != end ? result : JsonLexerError(state, "bad number");
+    result.m_Number = strtod(text, &end);
+    *end_out = end;
+    return text != end ? result : JsonLexerError(state, "bad number");
 }
 
-static JsonLexeme GetStringLexeme(JsonLexerState *state)
+static JsonLexeme GetNumberLexeme(JsonLexerState *state)
 {
-    JsonLexeme result;
+    const char *end;
+    JsonLexeme result = ScanNumber(state, state->m_Cursor, &end);
+    state->m_Cursor += end - state->m_Cursor;
+    return result;
+}
 
-    char *rptr = state->m_Cursor;
-    char *wptr = rptr;
-    ++rptr; // skip quote
+// Decode the string whose contents start at rptr into wptr. The output never runs
+// ahead of the input, so wptr may point into the same buffer.
+static JsonLexeme DecodeStringLexeme(JsonLexerState *state, char *rptr, char *wptr)
+{
+    JsonLexeme result;
 
     result.m_Type = kJsonLexString;
     result.m_String = wptr;
@@ -209,46 +239,195 @@ static JsonLexeme GetStringLexeme(JsonLexerState *state)
     return result;
 }
 
-static JsonLexeme GetLiteralLexeme(JsonLexerState *state)
+static JsonLexeme GetStringLexeme(JsonLexerState *state)
+{
+    char *quote = state->m_Cursor;
+    return DecodeStringLexeme(state, quote + 1, quote);
+}
+
+// Match true, false or null at text. Errors are reported at the lexer's cursor.
+static JsonLexeme ScanLiteral(JsonLexerState *state, const char *text, const char **end_out)
 {
-    char *rptr = state->m_Cursor;
-    char *eptr = rptr;
+    const char *eptr = text;
     while (isalnum(*eptr))
     {
         eptr++;
     }
 
-    size_t kwlen = (eptr - rptr);
+    size_t kwlen = (eptr - text);
+    *end_out = eptr;
 
     if (4 == kwlen)
     {
-        if (0 == strncmp("true", rptr, 4))
-        {
-            state->m_Cursor = eptr;
+        if (0 == strncmp("true", text, 4))
             return s_TrueLexeme;
-        }
-
-        else if (0 == strncmp("null", rptr, 4))
-        {
-            state->m_Cursor = eptr;
+        else if (0 == strncmp("null", text, 4))
             return s_NullLexeme;
-        }
     }
 
     else if (5 == kwlen)
     {
-        if (0 == strncmp("false", rptr, 5))
-        {
-            state->m_Cursor = eptr;
+        if (0 == strncmp("false", text, 5))
             return s_FalseLexeme;
-        }
     }
 
     return JsonLexerError(state, "invalid literal, expected one of false, true or null");
 }
 
+static JsonLexeme GetLiteralLexeme(JsonLexerState *state)
+{
+    const char *end;
+    JsonLexeme result = ScanLiteral(state, state->m_Cursor, &end);
+    if (kJsonLexError != result.m_Type)
+        state->m_Cursor += end - state->m_Cursor;
+    return result;
+}
+
+// With the index, a string's closing quote is the next offset after its opening quote.
+static JsonLexeme GetIndexedStringLexeme(JsonLexerState *state)
+{
+    char *open = state->m_Cursor;
+    size_t close_offset = JsonStructuralIndexNext(state->m_Index);
+    if (close_offset == state->m_Index->m_Length)
+        return JsonLexerError(state, "end of file inside string");
+
+    char *close = state->m_Buffer + close_offset;
+    const size_t length = close - open - 1;
+    const bool has_escapes = nullptr != memchr(open + 1, '\\', length);
+
+    if (MemAllocLinear *alloc = state->m_StringAlloc)
+    {
+        char *copy = (char *)LinearAllocate(alloc, length + 1, 1);
+        if (has_escapes)
+            return DecodeStringLexeme(state, open + 1, copy);
+
+        memcpy(copy, open + 1, length);
+        copy[length] = '\0';
+        state->m_Cursor = close + 1;
+
+        JsonLexeme result;
+        result.m_Type = kJsonLexString;
+        result.m_String = copy;
+        return result;
+    }
+
+    // Escapes have to be decoded, which moves characters; other strings are terminated in place.
+    if (has_escapes)
+        return GetStringLexeme(state);
+
+    *close = '\0';
+    state->m_Cursor = close + 1;
+
+    JsonLexeme result;
+    result.m_Type = kJsonLexString;
+    result.m_String = open + 1;
+    return result;
+}
+
+static bool IsScalarTerminator(char ch)
+{
+    switch (ch)
+    {
+    case ' ':
+    case '\t':
+    case '\n':
+    case '\v':
+    case '\f':
+    case '\r':
+    case '{':
+    case '}':
+    case '[':
+    case ']':
+    case ':':
+    case ',':
+    case '"':
+    case '\0':
+        return true;
+    default:
+        return false;
+    }
+}
+
+// The index only points at the start of a scalar, so find its end before parsing it.
+static JsonLexeme GetIndexedScalarLexeme(JsonLexerState *state)
+{
+    char *p = state->m_Cursor;
+    const size_t available = state->m_Index->m_Length - (p - state->m_Buffer);
+
+    size_t length = 0;
+    while (length < available && !IsScalarTerminator(p[length]))
+        ++length;
+
+    // Parsing stops at the terminator. A scalar that ends the buffer is only terminated
+    // if the buffer is, so copy it out when the buffer belongs to a reader.
+    char *text = p;
+    if (length == available && state->m_StringAlloc)
+    {
+        text = (char *)LinearAllocate(state->m_StringAlloc, length + 1, 1);
+        memcpy(text, p, length);
+        text[length] = '\0';
+    }
+
+    // Parse the scalar, then move the cursor by however much was consumed.
+    const char *end;
+    JsonLexeme result = ('-' == text[0] || isdigit(text[0])) ? ScanNumber(state, text, &end) : ScanLiteral(state, text, &end);
+    const size_t consumed = end - text;
+    state->m_Cursor = p + consumed;
+
+    if (kJsonLexError != result.m_Type && consumed < length)
+        return JsonLexerError(state, "unexpected characters after value");
+
+    return result;
+}
+
+static JsonLexeme JsonLexerFetchIndexed(JsonLexerState *state)
+{
+    const size_t offset = JsonStructuralIndexNext(state->m_Index);
+    char *p = state->m_Buffer + offset;
+    state->m_Cursor = p;
+
+    if (offset == state->m_Index->m_Length)
+        return s_EofLexeme;
+
+    switch (*p)
+    {
+    case '"':
+        return GetIndexedStringLexeme(state);
+
+    case '{':
+        state->m_Cursor = p + 1;
+        return s_BeginObjectLexeme;
+
+    case '}':
+        state->m_Cursor = p + 1;
+        return s_EndObjectLexeme;
+
+    case '[':
+        state->m_Cursor = p + 1;
+        return s_BeginArrayLexeme;
+
+    case ']':
+        state->m_Cursor = p + 1;
+        return s_EndArrayLexeme;
+
+    case ',':
+        state->m_Cursor = p + 1;
+        return s_ValueSeparatorLexeme;
+
+    case ':':
+        state->m_Cursor = p + 1;
+        return s_NameSeparatorLexeme;
+
+    default:
+        return GetIndexedScalarLexeme(state);
+    }
+}
+
 static JsonLexeme JsonLexerFetchNext(JsonLexerState *state)
 {
+    if (state->m_Index)
+        return JsonLexerFetchIndexed(state);
+
     char *p = SkipWhitespace(state);
     char ch = *p;
 
@@ -356,9 +535,9 @@ struct JsonState
     MemAllocLinear *m_Scratch;
 };
 
-static void JsonStateInit(JsonState *state, MemAllocLinear *alloc, MemAllocLinear *scratch, char *buffer)
+static void JsonStateInit(JsonState *state, MemAllocLinear *alloc, MemAllocLinear *scratch, char *buffer, JsonStructuralIndex *index)
 {
-    JsonLexerStateInit(&state->m_Lexer, buffer);
+    JsonLexerStateInit(&state->m_Lexer, buffer, index);
     state->m_ErrorMessage[0] = '\0';
     state->m_Allocator = alloc;
     state->m_Scratch = scratch;
@@ -366,7 +545,7 @@ static void JsonStateInit(JsonState *state, MemAllocLinear *alloc, MemAllocLinea
 
 static JsonValue *JsonError(JsonState *state, const char *error)
 {
-    snprintf(state->m_ErrorMessage, sizeof state->m_ErrorMessage, "line %d: %s", state->m_Lexer.m_LineNumber, error);
+    snprintf(state->m_ErrorMessage, sizeof state->m_ErrorMessage, "line %d: %s", JsonLexerLineNumber(&state->m_Lexer), error);
     return nullptr;
 }
 
@@ -657,22 +836,26 @@ static const JsonValue *JsonParseValue(JsonState *json_state)
     return result;
 }
 
-const JsonValue *JsonParse(
-    char *buffer,
-    MemAllocLinear *allocator,
-    MemAllocLinear *scratch,
-    char (&error_message)[1024])
+// Harmless to do multiple times.
+static void SetupStatics()
 {
-    TimingScope timing_scope(nullptr, &g_Stats.m_JsonParseTimeCycles);
-
-    // Setup statics. Harmless to do multiple times.
     s_TrueValue.m_Type = JsonValue::kBoolean;
     s_TrueValue.m_Boolean = true;
     s_FalseValue.m_Type = JsonValue::kBoolean;
     s_FalseValue.m_Boolean = false;
+}
+
+static const JsonValue *JsonParseWithIndex(
+    char *buffer,
+    MemAllocLinear *allocator,
+    MemAllocLinear *scratch,
+    char (&error_message)[1024],
+    JsonStructuralIndex *index)
+{
+    SetupStatics();
 
     JsonState json_state;
-    JsonStateInit(&json_state, allocator, scratch, buffer);
+    JsonStateInit(&json_state, allocator, scratch, buffer, index);
 
     const JsonValue *root = JsonParseValue(&json_state);
 
@@ -694,4 +877,195 @@ const JsonValue *JsonParse(
     return root;
 }
 
+const JsonValue *JsonParse(
+    char *buffer,
+    MemAllocLinear *allocator,
+    MemAllocLinear *scratch,
+    char (&error_message)[1024])
+{
+    TimingScope timing_scope(nullptr, &g_Stats.m_JsonParseTimeCycles);
+
+    JsonStructuralIndex index;
+    JsonStructuralIndexInit(&index, buffer, strlen(buffer));
+
+    return JsonParseWithIndex(buffer, allocator, scratch, error_message, &index);
+}
+
+const JsonValue *JsonParseUnindexed(
+    char *buffer,
+    MemAllocLinear *allocator,
+    MemAllocLinear *scratch,
+    char (&error_message)[1024])
+{
+    return JsonParseWithIndex(buffer, allocator, scratch, error_message, nullptr);
+}
+
+struct JsonReader
+{
+    enum
+    {
+        kMaxDepth = 32
+    };
+
+    JsonState m_State;
+    JsonStructuralIndex m_Index;
+    MemAllocHeap *m_Heap;
+    // Allocator for keys and lookahead; values go where JsonReaderParseValue() says.
+    MemAllocLinear *m_Allocator;
+    int m_Depth;
+    // Whether the innermost open containers are still before their first item.
+    bool m_First[kMaxDepth];
+};
+
+JsonReader *JsonReaderCreate(MemAllocHeap *heap, const char *buffer, size_t length, MemAllocLinear *alloc)
+{
+    SetupStatics();
+
+    JsonReader *self = (JsonReader *)HeapAllocate(heap, sizeof(JsonReader));
+    JsonStructuralIndexInit(&self->m_Index, buffer, length);
+
+    // The lexer copies strings out rather than terminating them in place, so the buffer is only read.
+    JsonStateInit(&self->m_State, alloc, nullptr, const_cast<char *>(buffer), &self->m_Index);
+    self->m_State.m_Lexer.m_StringAlloc = alloc;
+
+    self->m_Heap = heap;
+    self->m_Allocator = alloc;
+    self->m_Depth = 0;
+    return self;
+}
+
+void JsonReaderDestroy(JsonReader *self)
+{
+    HeapFree(self->m_Heap, self);
+}
+
+static bool JsonReaderEnter(JsonReader *self, JsonLexemeType type, const char *error)
+{
+    if (JsonReader::kMaxDepth == self->m_Depth)
+    {
+        JsonError(&self->m_State, "nesting too deep");
+        return false;
+    }
+
+    if (!JsonLexerExpect(&self->m_State.m_Lexer, type))
+    {
+        JsonError(&self->m_State, error);
+        return false;
+    }
+
+    self->m_First[self->m_Depth++] = true;
+    return true;
+}
+
+bool JsonReaderBeginObject(JsonReader *self)
+{
+    return JsonReaderEnter(self, kJsonLexBeginObject, "expected '{'");
+}
+
+bool JsonReaderBeginArray(JsonReader *self)
+{
+    return JsonReaderEnter(self, kJsonLexBeginArray, "expected '['");
+}
+
+// Step over the comma before the next item of the innermost container, or out of the container at its end.
+static bool JsonReaderAdvance(JsonReader *self, JsonLexemeType end_type)
+{
+    TimingScope timing_scope(nullptr, &g_Stats.m_JsonParseTimeCycles);
+
+    JsonLexerState *lexer = &self->m_State.m_Lexer;
+
+    CHECK(self->m_Depth > 0);
+
+    JsonLexeme l = JsonLexerPeek(lexer);
 
+    if (end_type == l.m_Type)
+    {
+        JsonLexerSkip(lexer);
+        --self->m_Depth;
+        return false;
+    }
+
+    bool &first = self->m_First[self->m_Depth - 1];
+    if (!first)
+    {
+        if (kJsonLexValueSeparator != l.m_Type)
+        {
+            JsonError(&self->m_State, "expected ','");
+            return false;
+        }
+
+        JsonLexerSkip(lexer);
+    }
+
+    first = false;
+    return true;
+}
+
+bool JsonReaderNextKey(JsonReader *self, const char **key_out)
+{
+    if (!JsonReaderAdvance(self, kJsonLexEndObject))
+        return false;
+
+    JsonLexerState *lexer = &self->m_State.m_Lexer;
+
+    JsonLexeme key;
+    if (!JsonLexerExpect(lexer, kJsonLexString, &key))
+    {
+        JsonError(&self->m_State, "expected key name");
+        return false;
+    }
+
+    if (!JsonLexerExpect(lexer, kJsonLexNameSeparator))
+    {
+        JsonError(&self->m_State, "expected ':'");
+        return false;
+    }
+
+    *key_out = key.m_String;
+    return true;
+}
+
+bool JsonReaderNextElement(JsonReader *self)
+{
+    return JsonReaderAdvance(self, kJsonLexEndArray);
+}
+
+const JsonValue *JsonReaderParseValue(JsonReader *self, MemAllocLinear *alloc, MemAllocLinear *scratch)
+{
+    TimingScope timing_scope(nullptr, &g_Stats.m_JsonParseTimeCycles);
+
+    JsonState *state = &self->m_State;
+
+    state->m_Allocator = alloc;
+    state->m_Scratch = scratch;
+    state->m_Lexer.m_StringAlloc = alloc;
+
+    const JsonValue *value = JsonParseValue(state);
+
+    state->m_Lexer.m_StringAlloc = self->m_Allocator;
+    return value;
+}
+
+bool JsonReaderFinish(JsonReader *self)
+{
+    if (!JsonLexerExpect(&self->m_State.m_Lexer, kJsonLexEof))
+    {
+        JsonError(&self->m_State, "data after document");
+        return false;
+    }
+
+    return true;
+}
+
+size_t JsonReaderOffset(const JsonReader *self)
+{
+    return self->m_State.m_Lexer.m_Cursor - self->m_State.m_Lexer.m_Buffer;
+}
+
+const char *JsonReaderError(const JsonReader *self)
+{
+    if (self->m_State.m_ErrorMessage[0])
+        return self->m_State.m_ErrorMessage;
+
+    return self->m_State.m_Lexer.m_Error;
+}
@@ -6,6 +6,7 @@
 
 
 struct MemAllocLinear;
+struct MemAllocHeap;
 
 struct JsonValue
 {
@@ -148,3 +149,45 @@ const JsonValue *JsonParse(
     MemAllocLinear *allocator,
     MemAllocLinear *scratch,
     char (&error_message)[1024]);
+
+// Byte-at-a-time parser that doesn't build a structural index first. Gives the
+// same results as JsonParse(); kept as a reference for tests and benchmarks.
+const JsonValue *JsonParseUnindexed(
+    char *buffer,
+    MemAllocLinear *allocator,
+    MemAllocLinear *scratch,
+    char (&error_message)[1024]);
+
+// Pull parser for documents too big to hold as one JsonValue tree. Containers
+// are stepped through an item at a time and only the values asked for are built
+// as trees. The buffer is never written to and needn't be null terminated;
+// strings are copied into the allocators.
+struct JsonReader;
+
+// Keys, and values the reader has to look ahead at, are allocated from alloc.
+JsonReader *JsonReaderCreate(MemAllocHeap *heap, const char *buffer, size_t length, MemAllocLinear *alloc);
+void JsonReaderDestroy(JsonReader *self);
+
+// Enter the object or array at the cursor.
+bool JsonReaderBeginObject(JsonReader *self);
+bool JsonReaderBeginArray(JsonReader *self);
+
+// Move to the next member of the innermost object and return its name. Returns
+// false after the end of the object, or on an error; see JsonReaderError().
+bool JsonReaderNextKey(JsonReader *self, const char **key_out);
+
+// Move to the next element of the innermost array. Returns false after the end
+// of the array, or on an error.
+bool JsonReaderNextElement(JsonReader *self);
+
+// Parse the value at the cursor as a tree.
+const JsonValue *JsonReaderParseValue(JsonReader *self, MemAllocLinear *alloc, MemAllocLinear *scratch);
+
+// Check that nothing follows the document.
+bool JsonReaderFinish(JsonReader *self);
+
+// Offset of the cursor in the buffer.
+size_t JsonReaderOffset(const JsonReader *self);
+
+// Empty unless parsing failed.
+const char *JsonReaderError(const JsonReader *self);
@@ -0,0 +1,279 @@
+#include "JsonStructuralIndex.hpp"
+
+#include <string.h>
+
+#if ENABLED(USE_SIMD_JSON)
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+
+
+// One bit per byte of a block.
+struct JsonBlockMasks
+{
+    uint64_t m_Quote;
+    uint64_t m_Backslash;
+    uint64_t m_Structural;
+    uint64_t m_Whitespace;
+};
+
+static inline int CountTrailingZeroes64(uint64_t v)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzll(v);
+#elif defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, v);
+    return (int)index;
+#else
+#error unsupported compiler
+#endif
+}
+
+#if ENABLED(USE_SIMD_JSON) && (defined(__x86_64__) || defined(_M_X64))
+
+// SSE2 is part of the x86-64 baseline, so there's nothing to detect.
+static void ClassifyBlockVector(const uint8_t *data, JsonBlockMasks *out)
+{
+    const __m128i quote_char = _mm_set1_epi8('"');
+    const __m128i backslash_char = _mm_set1_epi8('\\');
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i open_char = _mm_set1_epi8('{');   // '[' with the 0x20 bit set
+    const __m128i close_char = _mm_set1_epi8('}');  // ']' with the 0x20 bit set
+    const __m128i colon_char = _mm_set1_epi8(':');
+    const __m128i comma_char = _mm_set1_epi8(',');
+    const __m128i space_char = _mm_set1_epi8(' ');
+    const __m128i tab_char = _mm_set1_epi8('\t');     // '\t' '\n' '\v' '\f' '\r' are contiguous
+    const __m128i control_span = _mm_set1_epi8('\r' - '\t');
+
+    uint64_t quote = 0, backslash = 0, structural = 0, whitespace = 0;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(data + i * 16));
+        const __m128i folded = _mm_or_si128(v, case_bit);
+        const int shift = i * 16;
+
+        quote |= uint64_t((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, quote_char))) << shift;
+        backslash |= uint64_t((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, backslash_char))) << shift;
+
+        __m128i s = _mm_or_si128(_mm_cmpeq_epi8(folded, open_char), _mm_cmpeq_epi8(folded, close_char));
+        s = _mm_or_si128(s, _mm_or_si128(_mm_cmpeq_epi8(v, colon_char), _mm_cmpeq_epi8(v, comma_char)));
+        structural |= uint64_t((uint32_t)_mm_movemask_epi8(s)) << shift;
+
+        const __m128i control = _mm_sub_epi8(v, tab_char);
+        __m128i w = _mm_cmpeq_epi8(_mm_min_epu8(control, control_span), control);
+        w = _mm_or_si128(w, _mm_cmpeq_epi8(v, space_char));
+        whitespace |= uint64_t((uint32_t)_mm_movemask_epi8(w)) << shift;
+    }
+
+    out->m_Quote = quote;
+    out->m_Backslash = backslash;
+    out->m_Structural = structural;
+    out->m_Whitespace = whitespace;
+}
+
+static const char s_BackendName[] = "sse2";
+
+#elif ENABLED(USE_SIMD_JSON) && defined(__aarch64__)
+
+// Collapse four byte masks of 0x00/0xff into one bit per byte.
+static inline uint64_t NeonBitMask(uint8x16_t a, uint8x16_t b, uint8x16_t c, uint8x16_t d)
+{
+    static const uint8_t kBits[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    const uint8x16_t bits = vld1q_u8(kBits);
+
+    uint8x16_t sum0 = vpaddq_u8(vandq_u8(a, bits), vandq_u8(b, bits));
+    uint8x16_t sum1 = vpaddq_u8(vandq_u8(c, bits), vandq_u8(d, bits));
+    sum0 = vpaddq_u8(sum0, sum1);
+    sum0 = vpaddq_u8(sum0, sum0);
+    return vgetq_lane_u64(vreinterpretq_u64_u8(sum0), 0);
+}
+
+// NEON is mandatory on AArch64.
+static void ClassifyBlockVector(const uint8_t *data, JsonBlockMasks *out)
+{
+    uint8x16_t q[4], b[4], s[4], w[4];
+
+    for (int i = 0; i < 4; ++i)
+    {
+        const uint8x16_t v = vld1q_u8(data + i * 16);
+        const uint8x16_t folded = vorrq_u8(v, vdupq_n_u8(0x20));
+
+        q[i] = vceqq_u8(v, vdupq_n_u8('"'));
+        b[i] = vceqq_u8(v, vdupq_n_u8('\\'));
+        s[i] = vorrq_u8(vorrq_u8(vceqq_u8(folded, vdupq_n_u8('{')), vceqq_u8(folded, vdupq_n_u8('}'))),
+                        vorrq_u8(vceqq_u8(v, vdupq_n_u8(':')), vceqq_u8(v, vdupq_n_u8(','))));
+        w[i] = vorrq_u8(vceqq_u8(v, vdupq_n_u8(' ')),
+                        vcleq_u8(vsubq_u8(v, vdupq_n_u8('\t')), vdupq_n_u8('\r' - '\t')));
+    }
+
+    out->m_Quote = NeonBitMask(q[0], q[1], q[2], q[3]);
+    out->m_Backslash = NeonBitMask(b[0], b[1], b[2], b[3]);
+    out->m_Structural = NeonBitMask(s[0], s[1], s[2], s[3]);
+    out->m_Whitespace = NeonBitMask(w[0], w[1], w[2], w[3]);
+}
+
+static const char s_BackendName[] = "neon";
+
+#else
+
+static void ClassifyBlockScalar(const uint8_t *data, JsonBlockMasks *out)
+{
+    uint64_t quote = 0, backslash = 0, structural = 0, whitespace = 0;
+
+    for (int i = 0; i < JsonStructuralIndex::kBlockSize; ++i)
+    {
+        const uint64_t bit = uint64_t(1) << i;
+        switch (data[i])
+        {
+        case '"':
+            quote |= bit;
+            break;
+        case '\\':
+            backslash |= bit;
+            break;
+        case '{':
+        case '}':
+        case '[':
+        case ']':
+        case ':':
+        case ',':
+            structural |= bit;
+            break;
+        case ' ':
+        case '\t':
+        case '\n':
+        case '\v':
+        case '\f':
+        case '\r':
+            whitespace |= bit;
+            break;
+        }
+    }
+
+    out->m_Quote = quote;
+    out->m_Backslash = backslash;
+    out->m_Structural = structural;
+    out->m_Whitespace = whitespace;
+}
+
+static void ClassifyBlockVector(const uint8_t *data, JsonBlockMasks *out)
+{
+    ClassifyBlockScalar(data, out);
+}
+
+static const char s_BackendName[] = "scalar";
+
+#endif
+
+// Bits of characters preceded by an odd number of backslashes. Runs of
+// backslashes that start on an odd bit are flipped onto even bits by the
+// carry of an addition, so every other bit of each run can be picked with one
+// constant mask. (This is the approach from simdjson.)
+static inline uint64_t FindEscaped(uint64_t backslash, uint64_t *prev_escaped)
+{
+    const uint64_t even_bits = 0x5555555555555555ull;
+
+    backslash &= ~*prev_escaped;
+    const uint64_t follows_escape = (backslash << 1) | *prev_escaped;
+    const uint64_t odd_sequence_starts = backslash & ~even_bits & ~follows_escape;
+    const uint64_t sequences_starting_on_even_bits = odd_sequence_starts + backslash;
+    *prev_escaped = sequences_starting_on_even_bits < odd_sequence_starts ? 1 : 0;
+    const uint64_t invert_mask = sequences_starting_on_even_bits << 1;
+
+    return (even_bits ^ invert_mask) & follows_escape;
+}
+
+// Each bit becomes the xor of itself and all lower bits.
+static inline uint64_t PrefixXor(uint64_t bits)
+{
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+static uint64_t IndexBlock(JsonStructuralIndex *self, const uint8_t *data)
+{
+    JsonBlockMasks masks;
+    ClassifyBlockVector(data, &masks);
+
+    const uint64_t escaped = FindEscaped(masks.m_Backslash, &self->m_PrevEscaped);
+    const uint64_t quote = masks.m_Quote & ~escaped;
+
+    // Set from an opening quote up to, but not including, its closing quote.
+    const uint64_t in_string = PrefixXor(quote) ^ self->m_PrevInString;
+    self->m_PrevInString = uint64_t(int64_t(in_string) >> 63);
+
+    // Numbers and literals are runs of anything else; only their first character matters.
+    const uint64_t scalar = ~(masks.m_Structural | masks.m_Whitespace | quote | in_string);
+    const uint64_t scalar_start = scalar & ~((scalar << 1) | self->m_PrevScalar);
+    self->m_PrevScalar = scalar >> 63;
+
+    return (masks.m_Structural & ~in_string) | quote | scalar_start;
+}
+
+void JsonStructuralIndexInit(JsonStructuralIndex *self, const char *buffer, size_t length)
+{
+    self->m_Buffer = buffer;
+    self->m_Length = length;
+    self->m_NextBlock = 0;
+    self->m_PrevEscaped = 0;
+    self->m_PrevInString = 0;
+    self->m_PrevScalar = 0;
+    self->m_Count = 0;
+    self->m_Read = 0;
+}
+
+void JsonStructuralIndexRefill(JsonStructuralIndex *self)
+{
+    const size_t block_size = JsonStructuralIndex::kBlockSize;
+    const size_t block_count = (self->m_Length + block_size - 1) / block_size;
+
+    uint32_t count = 0;
+
+    // Keep going past a full batch that found nothing, e.g. inside a long string, so zero means the end.
+    for (int i = 0; (i < JsonStructuralIndex::kBatchBlocks || 0 == count) && self->m_NextBlock < block_count; ++i)
+    {
+        const size_t base = self->m_NextBlock * block_size;
+        const uint8_t *data = (const uint8_t *)self->m_Buffer + base;
+
+        // Pad the last block with whitespace so it can be classified like any other.
+        uint8_t tail[JsonStructuralIndex::kBlockSize];
+        if (base + block_size > self->m_Length)
+        {
+            memset(tail, ' ', sizeof tail);
+            memcpy(tail, data, self->m_Length - base);
+            data = tail;
+        }
+
+        uint64_t bits = IndexBlock(self, data);
+        while (bits)
+        {
+            self->m_Offsets[count++] = base + CountTrailingZeroes64(bits);
+            bits &= bits - 1;
+        }
+
+        ++self->m_NextBlock;
+    }
+
+    self->m_Count = count;
+    self->m_Read = 0;
+}
+
+const char *JsonStructuralBackendName()
+{
+    return s_BackendName;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "Common.hpp"
+
+// First pass of the JSON parser. Classifies the document 64 bytes at a time and
+// yields the offsets of everything the parser needs to look at: brackets,
+// braces, colons and commas outside strings, every unescaped quote, and the
+// first character of each number or literal. Whitespace and string contents are
+// never visited byte by byte.
+//
+// Offsets are produced a batch of blocks at a time, so memory use doesn't grow
+// with the document.
+struct JsonStructuralIndex
+{
+    enum
+    {
+        kBlockSize = 64,
+        kBatchBlocks = 16,
+        kCapacity = kBatchBlocks * kBlockSize
+    };
+
+    const char *m_Buffer;
+    size_t m_Length;
+    size_t m_NextBlock;
+
+    // State carried from one block to the next.
+    uint64_t m_PrevEscaped;
+    uint64_t m_PrevInString;
+    uint64_t m_PrevScalar;
+
+    uint32_t m_Count;
+    uint32_t m_Read;
+    size_t m_Offsets[kCapacity];
+};
+
+void JsonStructuralIndexInit(JsonStructuralIndex *self, const char *buffer, size_t length);
+
+// Classify the next batch of blocks. Leaves m_Count at zero at the end of the document.
+void JsonStructuralIndexRefill(JsonStructuralIndex *self);
+
+// Offset of the next structural character, or the document length at the end.
+inline size_t JsonStructuralIndexNext(JsonStructuralIndex *self)
+{
+    if (self->m_Read == self->m_Count)
+    {
+        JsonStructuralIndexRefill(self);
+        if (0 == self->m_Count)
+            return self->m_Length;
+    }
+
+    return self->m_Offsets[self->m_Read++];
+}
+
+// Name of the block classifier in use, for diagnostics.
+const char *JsonStructuralBackendName();
@@ -0,0 +1,204 @@
+#include "Lz4.hpp"
+
+#include <string.h>
+
+// The format is a run of sequences, each a token byte, literals and a match:
+// the high nibble of the token is the literal count and the low nibble the
+// match length less four, a nibble of 15 meaning that more length bytes follow.
+// The match is a 16-bit little endian offset back into the output. The last
+// sequence has literals only, and the last five bytes are always literals.
+
+static const int kHashBits = 12;
+static const size_t kMinMatch = 4;
+static const size_t kLastLiterals = 5;
+static const size_t kMatchStartLimit = 12;
+static const size_t kMaxOffset = 65535;
+
+static inline uint32_t Read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static inline uint32_t HashSequence(uint32_t v)
+{
+    return (v * 2654435761U) >> (32 - kHashBits);
+}
+
+static uint8_t *WriteLength(uint8_t *op, const uint8_t *op_end, size_t length)
+{
+    for (; length >= 255; length -= 255)
+    {
+        if (op == op_end)
+            return nullptr;
+        *op++ = 255;
+    }
+
+    if (op == op_end)
+        return nullptr;
+    *op++ = uint8_t(length);
+    return op;
+}
+
+// Write a sequence; a match length of zero writes the final literals. Returns null if dst is full.
+static uint8_t *WriteSequence(uint8_t *op, const uint8_t *op_end, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_length)
+{
+    if (op == op_end)
+        return nullptr;
+
+    uint8_t *token = op++;
+    *token = uint8_t((literal_count < 15 ? literal_count : 15) << 4);
+
+    if (literal_count >= 15 && !(op = WriteLength(op, op_end, literal_count - 15)))
+        return nullptr;
+
+    if (size_t(op_end - op) < literal_count)
+        return nullptr;
+    memcpy(op, literals, literal_count);
+    op += literal_count;
+
+    if (0 == match_length)
+        return op;
+
+    if (op_end - op < 2)
+        return nullptr;
+    *op++ = uint8_t(offset);
+    *op++ = uint8_t(offset >> 8);
+
+    const size_t length = match_length - kMinMatch;
+    *token |= uint8_t(length < 15 ? length : 15);
+
+    if (length >= 15 && !(op = WriteLength(op, op_end, length - 15)))
+        return nullptr;
+
+    return op;
+}
+
+size_t Lz4Compress(const void *src, size_t src_size, void *dst, size_t dst_capacity)
+{
+    const uint8_t *base = (const uint8_t *)src;
+    const uint8_t *end = base + src_size;
+    const uint8_t *anchor = base;
+    const uint8_t *ip = base;
+    uint8_t *op = (uint8_t *)dst;
+    uint8_t *op_end = op + dst_capacity;
+
+    if (src_size > kMatchStartLimit)
+    {
+        // Positions of recent sequences by hash; a stale or empty slot just fails the compare.
+        uint32_t table[1 << kHashBits];
+        memset(table, 0, sizeof table);
+
+        const uint8_t *match_start_limit = end - kMatchStartLimit;
+        const uint8_t *match_end_limit = end - kLastLiterals;
+        uint32_t misses = 0;
+
+        while (ip < match_start_limit)
+        {
+            const uint32_t sequence = Read32(ip);
+            const uint32_t hash = HashSequence(sequence);
+            const uint8_t *ref = base + table[hash];
+            table[hash] = uint32_t(ip - base);
+
+            if (ref >= ip || size_t(ip - ref) > kMaxOffset || Read32(ref) != sequence)
+            {
+                // Skip ahead faster through data that doesn't compress.
+                ip += 1 + (misses++ >> 6);
+                continue;
+            }
+
+            misses = 0;
+
+            const uint8_t *match_end = ip + kMinMatch;
+            ref += kMinMatch;
+            while (match_end < match_end_limit && *match_end == *ref)
+            {
+                ++match_end;
+                ++ref;
+            }
+
+            op = WriteSequence(op, op_end, anchor, size_t(ip - anchor), size_t(match_end - ref), size_t(match_end - ip));
+            if (!op)
+                return 0;
+
+            ip = anchor = match_end;
+        }
+    }
+
+    op = WriteSequence(op, op_end, anchor, size_t(end - anchor), 0, 0);
+    if (!op)
+        return 0;
+
+    return size_t(op - (uint8_t *)dst);
+}
+
+static const uint8_t *ReadLength(const uint8_t *ip, const uint8_t *ip_end, size_t *length)
+{
+    uint8_t b;
+    do
+    {
+        if (ip == ip_end)
+            return nullptr;
+        b = *ip++;
+        *length += b;
+    } while (255 == b);
+
+    return ip;
+}
+
+bool Lz4Decompress(const void *src, size_t src_size, void *dst, size_t dst_size)
+{
+    const uint8_t *ip = (const uint8_t *)src;
+    const uint8_t *ip_end = ip + src_size;
+    uint8_t *base = (uint8_t *)dst;
+    uint8_t *op = base;
+    uint8_t *op_end = op + dst_size;
+
+    while (ip < ip_end)
+    {
+        const uint8_t token = *ip++;
+
+        size_t literal_count = token >> 4;
+        if (15 == literal_count && !(ip = ReadLength(ip, ip_end, &literal_count)))
+            return false;
+
+        if (size_t(ip_end - ip) < literal_count || size_t(op_end - op) < literal_count)
+            return false;
+        memcpy(op, ip, literal_count);
+        ip += literal_count;
+        op += literal_count;
+
+        // The last sequence has no match.
+        if (ip == ip_end)
+            break;
+
+        if (ip_end - ip < 2)
+            return false;
+        const size_t offset = size_t(ip[0]) | size_t(ip[1]) << 8;
+        ip += 2;
+
+        size_t length = token & 15;
+        if (15 == length && !(ip = ReadLength(ip, ip_end, &length)))
+            return false;
+        length += kMinMatch;
+
+        if (0 == offset || size_t(op - base) < offset || size_t(op_end - op) < length)
+            return false;
+
+        const uint8_t *ref = op - offset;
+        if (offset >= length)
+        {
+            memcpy(op, ref, length);
+            op += length;
+        }
+        else
+        {
+            // The match overlaps the bytes it produces, repeating them.
+            while (length--)
+                *op++ = *ref++;
+        }
+    }
+
+    return op == op_end;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "Common.hpp"
+
+// Compression in the LZ4 block format. Blocks hold no sizes of their own, so
+// the caller keeps track of both the compressed and the decompressed size.
+
+// Largest compressed size of size bytes of input.
+inline size_t Lz4CompressBound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+// Compress src into dst. Returns the compressed size, or zero if it doesn't fit in dst_capacity bytes.
+size_t Lz4Compress(const void *src, size_t src_size, void *dst, size_t dst_capacity);
+
+// Decompress src into dst, which must be exactly dst_size bytes. Returns false if the data is damaged.
+bool Lz4Decompress(const void *src, size_t src_size, void *dst, size_t dst_size);
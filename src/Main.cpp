@@ -476,6 +476,9 @@ int main(int argc, char *argv[])
     if (!DriverSaveDigestCache(&driver))
         Log(kWarning, "Couldn't save SHA1 digest cache");
 
+    if (!DriverSaveGlobCache(&driver))
+        Log(kWarning, "Couldn't save glob cache");
+
 leave:
     if (options.m_ThrottleOnHumanActivity)
         HumanActivityDetectionDestroy();
@@ -500,12 +503,24 @@ leave:
         printf("  inserts:         %10u\n", g_Stats.m_ScanCacheInserts);
         printf("  save time:       %10.2f ms\n", TimerToSeconds(g_Stats.m_ScanCacheSaveTime) * 1000.0);
         printf("  entries dropped: %10u\n", g_Stats.m_ScanCacheEntriesDropped);
+        printf("  journal appends: %10u\n", g_Stats.m_ScanCacheJournalAppends);
+        printf("  content hits:    %10u\n", g_Stats.m_ScanCacheContentHits);
         printf("file signing:\n");
+        printf("  hash backend:    %10s\n", HashBackendName());
         printf("  cache hits:      %10u\n", g_Stats.m_DigestCacheHits);
+        printf("  xattr hits:      %10u\n", g_Stats.m_DigestXattrHits);
+        printf("  shared hits:     %10u\n", g_Stats.m_SharedDigestStoreHits);
         printf("  cache get time:  %10.2f ms\n", TimerToSeconds(g_Stats.m_DigestCacheGetTimeCycles) * 1000.0);
         printf("  cache save time: %10.2f ms\n", TimerToSeconds(g_Stats.m_DigestCacheSaveTimeCycles) * 1000.0);
+        printf("  entries dropped: %10u\n", g_Stats.m_DigestCacheEntriesDropped);
         printf("  digests:         %10u\n", g_Stats.m_FileDigestCount);
         printf("  digest time:     %10.2f ms\n", TimerToSeconds(g_Stats.m_FileDigestTimeCycles) * 1000.0);
+        printf("  helper chunks:   %10u\n", g_Stats.m_FileDigestHelperChunks);
+        printf("glob signatures:\n");
+        printf("  globs:           %10u\n", g_Stats.m_GlobCount);
+        printf("  glob time:       %10.2f ms\n", TimerToSeconds(g_Stats.m_GlobTimeCycles) * 1000.0);
+        printf("  listings:        %10u\n", g_Stats.m_GlobListings);
+        printf("  cache hits:      %10u\n", g_Stats.m_GlobCacheHits);
         printf("stat cache:\n");
         printf("  hits:            %10u\n", g_Stats.m_StatCacheHits);
         printf("  misses:          %10u\n", g_Stats.m_StatCacheMisses);
@@ -517,11 +532,14 @@ leave:
         printf("  state save time: %10.2f ms\n", TimerToSeconds(g_Stats.m_StateSaveTimeCycles) * 1000.0);
         printf("  exec() count:    %10u\n", g_Stats.m_ExecCount);
         printf("  exec() time:     %10.2f s\n", TimerToSeconds(g_Stats.m_ExecTimeCycles));
+        printf("  early cutoffs:   %10u\n", g_Stats.m_EarlyCutoffOutputs);
         printf("low-level syscalls:\n");
         printf("  mmap() calls:    %10u\n", g_Stats.m_MmapCalls);
         printf("  mmap() time:     %10.2f ms\n", TimerToSeconds(g_Stats.m_MmapTimeCycles) * 1000.0);
         printf("  munmap() calls:  %10u\n", g_Stats.m_MunmapCalls);
         printf("  munmap() time:   %10.2f ms\n", TimerToSeconds(g_Stats.m_MunmapTimeCycles) * 1000.0);
+        printf("  decompressions:  %10u\n", g_Stats.m_DecompressCalls);
+        printf("  decompress time: %10.2f ms\n", TimerToSeconds(g_Stats.m_DecompressTimeCycles) * 1000.0);
         printf("  stat() calls:    %10u\n", g_Stats.m_StatCount);
         printf("  stat() time:     %10.2f ms\n", TimerToSeconds(g_Stats.m_StatTimeCycles) * 1000.0);
     }
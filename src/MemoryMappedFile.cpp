@@ -1,6 +1,10 @@
 #include "MemoryMappedFile.hpp"
+#include "BinaryData.hpp"
+#include "Lz4.hpp"
 #include "Stats.hpp"
 
+#include <string.h>
+
 #if defined(TUNDRA_UNIX)
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -21,6 +25,7 @@ static void Clear(MemoryMappedFile *file)
     file->m_Size = 0;
     file->m_SysData[0] = 0;
     file->m_SysData[1] = 0;
+    file->m_Anonymous = false;
 }
 
 void MmapFileInit(MemoryMappedFile *self)
@@ -50,11 +55,14 @@ void MmapFileMap(MemoryMappedFile *self, const char *fn)
     if (0 != fstat(fd, &stbuf))
         goto error;
 
+    if (0 == stbuf.st_size)
+        goto error;
+
     self->m_Address = mmap(NULL, stbuf.st_size, PROT_READ, MAP_FILE | MAP_PRIVATE, fd, 0);
     self->m_Size = stbuf.st_size;
     self->m_SysData[0] = fd;
 
-    if (self->m_Address)
+    if (MAP_FAILED != self->m_Address)
         return;
 
 error:
@@ -74,11 +82,50 @@ void MmapFileUnmap(MemoryMappedFile *self)
         if (0 != munmap(self->m_Address, self->m_Size))
             CroakErrno("munmap(%p, %d) failed", self->m_Address, (int)self->m_Size);
 
-        close((int)self->m_SysData[0]);
+        if (!self->m_Anonymous)
+            close((int)self->m_SysData[0]);
     }
 
     Clear(self);
 }
+
+// Map size bytes of zeroed, writable memory not backed by a file.
+static bool MmapFileAllocate(MemoryMappedFile *self, size_t size)
+{
+    void *address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == address)
+        return false;
+
+    self->m_Address = address;
+    self->m_Size = size;
+    self->m_Anonymous = true;
+    return true;
+}
+
+void MmapFileAdviseSequential(MemoryMappedFile *self)
+{
+    if (self->m_Address)
+        madvise(self->m_Address, self->m_Size, MADV_SEQUENTIAL);
+}
+
+void MmapFilePrefetch(MemoryMappedFile *self)
+{
+    // Readahead happens in the background; decompressed data is already in memory.
+    if (self->m_Address && !self->m_Anonymous)
+        madvise(self->m_Address, self->m_Size, MADV_WILLNEED);
+}
+
+void MmapFileDiscard(MemoryMappedFile *self, size_t offset, size_t size)
+{
+    // Only whole pages inside the range can go.
+    const size_t page_size = size_t(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + page_size - 1) & ~(page_size - 1);
+    size_t end = (offset + size) & ~(page_size - 1);
+
+    // Anonymous pages would come back as zeros.
+    if (self->m_Address && !self->m_Anonymous && begin < end)
+        madvise((char *)self->m_Address + begin, end - begin, MADV_DONTNEED);
+}
 #endif
 
 #if defined(TUNDRA_WIN32)
@@ -116,7 +163,7 @@ void MmapFileMap(MemoryMappedFile *self, const char *fn)
         return;
     }
 
-    void *address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, DWORD(file_size));
+    void *address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
 
     if (nullptr == address)
     {
@@ -137,7 +184,14 @@ void MmapFileUnmap(MemoryMappedFile *self)
 {
     TimingScope timing_scope(&g_Stats.m_MmapCalls, &g_Stats.m_MmapTimeCycles);
 
-    if (self->m_Address)
+    if (self->m_Address && self->m_Anonymous)
+    {
+        if (!VirtualFree(self->m_Address, 0, MEM_RELEASE))
+        {
+            CroakErrno("VirtualFree() failed");
+        }
+    }
+    else if (self->m_Address)
     {
         if (!UnmapViewOfFile(self->m_Address))
         {
@@ -153,6 +207,94 @@ void MmapFileUnmap(MemoryMappedFile *self)
 
     Clear(self);
 }
+
+// Map size bytes of zeroed, writable memory not backed by a file.
+static bool MmapFileAllocate(MemoryMappedFile *self, size_t size)
+{
+    void *address = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (nullptr == address)
+        return false;
+
+    self->m_Address = address;
+    self->m_Size = size;
+    self->m_Anonymous = true;
+    return true;
+}
+
+void MmapFileAdviseSequential(MemoryMappedFile *self)
+{
+    // The cache manager already reads ahead for sequential access to mapped views.
+}
+
+void MmapFilePrefetch(MemoryMappedFile *self)
+{
+    if (!self->m_Address || self->m_Anonymous)
+        return;
+
+    // Fault the pages in by touching one byte of each.
+    const volatile char *p = (const volatile char *)self->m_Address;
+    for (size_t offset = 0; offset < self->m_Size; offset += 4096)
+        (void)p[offset];
+}
+
+void MmapFileDiscard(MemoryMappedFile *self, size_t offset, size_t size)
+{
+    // Clean pages of a mapped view are trimmed from the working set as needed.
+}
 #endif
 
+void MmapFileMapFrozen(MemoryMappedFile *self, const char *fn)
+{
+    MmapFileMap(self, fn);
+
+    if (!MmapFileValid(self) || self->m_Size < sizeof(Frozen::CompressedFileHeader))
+        return;
+
+    const Frozen::CompressedFileHeader *header = (const Frozen::CompressedFileHeader *)self->m_Address;
+    if (Frozen::CompressedFileHeader::MagicNumber != header->m_MagicNumber)
+        return;
+
+    TimingScope timing_scope(&g_Stats.m_DecompressCalls, &g_Stats.m_DecompressTimeCycles);
+
+    MemoryMappedFile packed = *self;
+    MmapFileInit(self);
+
+    const char *file_data = (const char *)packed.m_Address;
+    const uint64_t block_size = header->m_BlockSize;
+    const uint64_t data_size = header->m_DataSize;
+    const uint64_t block_count = block_size ? (data_size + block_size - 1) / block_size : 0;
+    const uint64_t *offsets = (const uint64_t *)(header + 1);
+
+    // The block offsets, and the end of the last block, must fit in the file.
+    bool valid = block_count > 0 && (packed.m_Size - sizeof *header) / sizeof(uint64_t) > block_count;
 
+    if (valid && !MmapFileAllocate(self, size_t(data_size)))
+    {
+        Log(kWarning, "%s: couldn't allocate %llu bytes to decompress into", fn, (unsigned long long)data_size);
+    }
+    else if (valid)
+    {
+        for (uint64_t i = 0; valid && i < block_count; ++i)
+        {
+            const uint64_t begin = offsets[i];
+            const uint64_t end = offsets[i + 1];
+            const uint64_t size = i + 1 < block_count ? block_size : data_size - i * block_size;
+            char *out = (char *)self->m_Address + i * block_size;
+
+            if (begin > end || end > packed.m_Size)
+                valid = false;
+            else if (end - begin == size)
+                memcpy(out, file_data + begin, size_t(size));
+            else
+                valid = Lz4Decompress(file_data + begin, size_t(end - begin), out, size_t(size));
+        }
+    }
+
+    if (!valid)
+    {
+        Log(kWarning, "%s: damaged compressed file", fn);
+        MmapFileUnmap(self);
+    }
+
+    MmapFileUnmap(&packed);
+}
@@ -7,6 +7,8 @@ struct MemoryMappedFile
     void *m_Address;
     size_t m_Size;
     uintptr_t m_SysData[2];
+    // Set when the data was decompressed into memory rather than mapped from the file.
+    bool m_Anonymous;
 };
 
 void MmapFileInit(MemoryMappedFile *file);
@@ -17,6 +19,20 @@ void MmapFileMap(MemoryMappedFile *file, const char *fn);
 
 void MmapFileUnmap(MemoryMappedFile *file);
 
+// Map a file written by BinaryWriterFlush(). Block compressed files are
+// decompressed into memory; anything else is mapped as is.
+void MmapFileMapFrozen(MemoryMappedFile *file, const char *fn);
+
+// Hint that the mapping will be read once from start to end.
+void MmapFileAdviseSequential(MemoryMappedFile *file);
+
+// Start reading the whole mapping into memory ahead of use.
+void MmapFilePrefetch(MemoryMappedFile *file);
+
+// Drop the pages of a range that won't be read again from memory. They are
+// read back in from the file if touched.
+void MmapFileDiscard(MemoryMappedFile *file, size_t offset, size_t size);
+
 inline bool MmapFileValid(MemoryMappedFile *file)
 {
     return file->m_Address != nullptr;
@@ -47,6 +47,51 @@ static int SlowCallback(void *user_data)
     return sendNextCallbackIn;
 }
 
+void ComputeEarlyCutoffDigests(const Frozen::DagNode *node_data, const Frozen::BuiltNode *prev, Frozen::NodeOutputDigest *digests_out)
+{
+    for (int32_t i = 0, n_outputs = node_data->m_OutputFiles.GetCount(); i < n_outputs; ++i)
+    {
+        const FrozenFileAndHash &output = node_data->m_OutputFiles[i];
+        Frozen::NodeOutputDigest *digest = digests_out + i;
+        memset(digest, 0, sizeof *digest);
+
+        FileInfo info = GetFileInfo(output.m_Filename);
+        if (!info.IsFile() || !ComputeFileDigest(output.m_Filename, info.m_Size, &digest->m_ContentDigest))
+            continue;
+
+        digest->m_Timestamp = info.m_Timestamp;
+
+        if (prev == nullptr || !prev->m_WasBuiltSuccessfully || i >= prev->m_OutputDigests.GetCount() || i >= prev->m_OutputFiles.GetCount())
+            continue;
+
+        const Frozen::NodeOutputDigest &prev_digest = prev->m_OutputDigests[i];
+        if (prev->m_OutputFiles[i].m_FilenameHash != output.m_FilenameHash || 0 == prev_digest.m_Timestamp)
+            continue;
+
+        if (prev_digest.m_ContentDigest != digest->m_ContentDigest || prev_digest.m_Timestamp == info.m_Timestamp)
+            continue;
+
+        if (SetFileTimestamp(output.m_Filename, prev_digest.m_Timestamp))
+        {
+            Log(kDebug, "%s is unchanged, restoring its timestamp", output.m_Filename.Get());
+            digest->m_Timestamp = prev_digest.m_Timestamp;
+            AtomicIncrement(&g_Stats.m_EarlyCutoffOutputs);
+        }
+    }
+}
+
+static void ApplyEarlyCutoff(ThreadState *thread_state, RuntimeNode *node)
+{
+    const int32_t n_outputs = node->m_DagNode->m_OutputFiles.GetCount();
+
+    if (0 == n_outputs)
+        return;
+
+    Frozen::NodeOutputDigest *digests = HeapAllocateArray<Frozen::NodeOutputDigest>(thread_state->m_Queue->m_Config.m_Heap, n_outputs);
+    ComputeEarlyCutoffDigests(node->m_DagNode, node->m_BuiltNode, digests);
+    node->m_OutputDigests = digests;
+}
+
 static ExecResult WriteTextFile(const char *payload, const char *target_file, MemAllocHeap *heap)
 {
     ExecResult result;
@@ -223,7 +268,7 @@ NodeBuildResult::Enum RunAction(BuildQueue *queue, ThreadState *thread_state, Ru
             for (int i = 0; i < n_outputs; i++)
             {
                 FileInfo info = GetFileInfo(node_data->m_OutputFiles[i].m_Filename);
-                pre_timestamps[i] = info.m_Timestamp;
+                pre_timestamps[i] = FileSignatureTimestamp(info);
             }
 
         if (isWriteFileAction)
@@ -240,7 +285,7 @@ NodeBuildResult::Enum RunAction(BuildQueue *queue, ThreadState *thread_state, Ru
             for (int i = 0; i < n_outputs; i++)
             {
                 FileInfo info = GetFileInfo(node_data->m_OutputFiles[i].m_Filename);
-                bool untouched = pre_timestamps[i] == info.m_Timestamp;
+                bool untouched = pre_timestamps[i] == FileSignatureTimestamp(info);
                 untouched_outputs[i] = untouched;
                 if (untouched)
                     passedOutputValidation = ValidationResult::UnwrittenOutputFileFail;
@@ -291,6 +336,9 @@ NodeBuildResult::Enum RunAction(BuildQueue *queue, ThreadState *thread_state, Ru
         Log(kSpam, "Process return code %d", result.m_ReturnCode);
     }
 
+    if (0 == result.m_ReturnCode && passedOutputValidation < ValidationResult::UnexpectedConsoleOutputFail && (node_data->m_Flags & Frozen::DagNode::kFlagEarlyCutoff))
+        ApplyEarlyCutoff(thread_state, node);
+
     for (const FrozenFileAndHash &output : node_data->m_OutputFiles)
     {
         StatCacheMarkDirty(stat_cache, output.m_Filename, output.m_FilenameHash);
@@ -5,5 +5,10 @@ struct BuildQueue;
 struct ThreadState;
 struct Mutex;
 
+// Hash the outputs of a node that just ran into digests_out, one per output file. Any output that is
+// byte-identical to what the previous build recorded in prev gets its previous timestamp back, so
+// nodes that depend on it by timestamp stay up to date.
+void ComputeEarlyCutoffDigests(const Frozen::DagNode *node_data, const Frozen::BuiltNode *prev, Frozen::NodeOutputDigest *digests_out);
+
 NodeBuildResult::Enum RunAction(BuildQueue *queue, ThreadState *thread_state, RuntimeNode *node, Mutex *queue_lock);
 
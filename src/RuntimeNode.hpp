@@ -25,6 +25,7 @@ namespace Frozen
 {
     struct DagNode;
     struct BuiltNode;
+    struct NodeOutputDigest;
 }
 
 struct SinglyLinkedPathList;
@@ -44,6 +45,9 @@ struct RuntimeNode
     HashDigest m_InputSignature;
 
     SinglyLinkedPathList* m_DynamicallyDiscoveredOutputFiles;
+
+    // Output digests for early cutoff nodes that ran, one per DAG output file; heap allocated.
+    Frozen::NodeOutputDigest *m_OutputDigests;
 };
 
 inline bool RuntimeNodeIsQueued(const RuntimeNode *runtime_node)
@@ -12,6 +12,7 @@
 #include "Profiler.hpp"
 
 #include <algorithm>
+#include <stdio.h>
 #include <time.h>
 
 
@@ -22,9 +23,42 @@ struct ScanCache::Record
     uint64_t m_FileTimestamp;
     int m_IncludeCount;
     FileAndHash *m_Includes;
-    Record *m_Next;
+    // True if this record is already stored in the journal.
+    bool m_Persisted;
 };
 
+// The journal is an append-only log of records added since the last full
+// save. It starts with this header, followed by size-prefixed records:
+//
+//   uint32_t   payload size
+//   HashDigest key
+//   uint64_t   file timestamp
+//   uint32_t   include count
+//   include count * { uint32_t filename hash, nul-terminated filename }
+//
+// A record that was only partially written (e.g. due to a crash) is ignored.
+struct ScanJournalHeader
+{
+    static const uint32_t MagicNumber = 0x15171001 ^ kTundraHashMagic;
+
+    uint32_t m_MagicNumber;
+    uint32_t m_Padding;
+    uint64_t m_CreationTime;
+};
+
+// Compact the journal into the frozen file when it holds this many records, or
+// more than an eighth of the frozen record count, whichever is larger.
+static const uint32_t kJournalMinCompactRecords = 4096;
+
+// Compact at least once a day so frozen access times stay reasonably fresh.
+static const uint64_t kJournalMaxAgeSeconds = 24 * 60 * 60;
+
+// Size of the blocks stripe arenas allocate from the heap.
+static const size_t kArenaBlockSize = 64 * 1024;
+
+// Each arena block starts with a pointer to the previously allocated block.
+static const size_t kArenaHeaderSize = 16;
+
 void ComputeScanCacheKey(
     HashDigest *key_out,
     const char *filename,
@@ -42,18 +76,54 @@ void ComputeScanCacheKey(
 #endif
 }
 
+void ComputeScanCacheContentKey(
+    HashDigest *key_out,
+    const HashDigest &scan_key,
+    const HashDigest &content_digest)
+{
+    HashState h;
+    HashInit(&h);
+    HashUpdate(&h, &scan_key, sizeof scan_key);
+    HashUpdate(&h, &content_digest, sizeof content_digest);
+    HashFinalize(&h, key_out);
+}
+
 void ScanCacheInit(ScanCache *self, MemAllocHeap *heap, MemAllocLinear *allocator)
 {
     self->m_Initialized = true;
     self->m_FrozenData = nullptr;
     self->m_Heap = heap;
     self->m_Allocator = allocator;
-    self->m_RecordCount = 0;
-    self->m_TableSize = 0;
-    self->m_Table = nullptr;
+    self->m_DigestCache = nullptr;
     self->m_FrozenAccess = nullptr;
+    self->m_JournalRecordCount = 0;
+    self->m_JournalCreationTime = 0;
 
-    ReadWriteLockInit(&self->m_Lock);
+    // By default, keep old entries for a week.
+    CacheRetentionInit(&self->m_Retention, time(nullptr), 7, 0);
+    self->m_CompressThreshold = 0;
+
+    for (ScanCache::Stripe &stripe : self->m_Stripes)
+    {
+        ReadWriteLockInit(&stripe.m_Lock);
+        stripe.m_RecordCount = 0;
+        stripe.m_DirtyCount = 0;
+        stripe.m_TableSize = 0;
+        stripe.m_Table = nullptr;
+        stripe.m_ArenaBlock = nullptr;
+        stripe.m_ArenaUsed = 0;
+        stripe.m_ArenaSize = 0;
+    }
+}
+
+void ScanCacheSetRetention(ScanCache *self, int32_t days_to_keep, uint32_t max_records)
+{
+    CacheRetentionInit(&self->m_Retention, time(nullptr), days_to_keep, max_records);
+}
+
+void ScanCacheSetCompressThreshold(ScanCache *self, size_t threshold)
+{
+    self->m_CompressThreshold = threshold;
 }
 
 void ScanCacheDestroy(ScanCache *self)
@@ -61,8 +131,63 @@ void ScanCacheDestroy(ScanCache *self)
     if (!self->m_Initialized)
         return;
     HeapFree(self->m_Heap, self->m_FrozenAccess);
-    HeapFree(self->m_Heap, self->m_Table);
-    ReadWriteLockDestroy(&self->m_Lock);
+
+    for (ScanCache::Stripe &stripe : self->m_Stripes)
+    {
+        char *block = stripe.m_ArenaBlock;
+        while (block)
+        {
+            char *prev;
+            memcpy(&prev, block, sizeof prev);
+            HeapFree(self->m_Heap, block);
+            block = prev;
+        }
+
+        HeapFree(self->m_Heap, stripe.m_Table);
+        ReadWriteLockDestroy(&stripe.m_Lock);
+    }
+}
+
+static ScanCache::Stripe *GetStripe(ScanCache *self, uint32_t hash)
+{
+    return &self->m_Stripes[hash >> ScanCache::kStripeShift];
+}
+
+// Allocate memory from a stripe's arena. The stripe must be locked for writing.
+static void *StripeAllocate(MemAllocHeap *heap, ScanCache::Stripe *stripe, size_t size, size_t align)
+{
+    size_t offset = TD_ALIGN(stripe->m_ArenaUsed, align);
+
+    if (nullptr == stripe->m_ArenaBlock || offset + size > stripe->m_ArenaSize)
+    {
+        size_t block_size = kArenaBlockSize;
+        if (size + kArenaHeaderSize > block_size)
+            block_size = size + kArenaHeaderSize;
+
+        char *block = (char *)HeapAllocate(heap, block_size);
+        memcpy(block, &stripe->m_ArenaBlock, sizeof(char *));
+
+        stripe->m_ArenaBlock = block;
+        stripe->m_ArenaSize = block_size;
+        offset = kArenaHeaderSize;
+    }
+
+    stripe->m_ArenaUsed = offset + size;
+    return stripe->m_ArenaBlock + offset;
+}
+
+template <typename T>
+static T *StripeAllocateArray(MemAllocHeap *heap, ScanCache::Stripe *stripe, size_t count)
+{
+    return static_cast<T *>(StripeAllocate(heap, stripe, sizeof(T) * count, ALIGNOF(T)));
+}
+
+static char *StripeStrDup(MemAllocHeap *heap, ScanCache::Stripe *stripe, const char *str)
+{
+    size_t len = strlen(str) + 1;
+    char *result = static_cast<char *>(StripeAllocate(heap, stripe, len, 1));
+    memcpy(result, str, len);
+    return result;
 }
 
 void ScanCacheSetCache(ScanCache *self, const Frozen::ScanData *frozen_data)
@@ -86,28 +211,52 @@ void ScanCacheSetCache(ScanCache *self, const Frozen::ScanData *frozen_data)
     }
 }
 
-static ScanCache::Record *LookupDynamic(ScanCache *self, const HashDigest &key)
+void ScanCacheSetDigestCache(ScanCache *self, DigestCache *digest_cache)
+{
+    self->m_DigestCache = digest_cache;
+}
+
+int ScanCacheFindFrozen(const Frozen::ScanData *data, const HashDigest &key)
 {
-    uint32_t table_size = self->m_TableSize;
+    // Only an empty cache is written without an index.
+    const uint32_t index_size = data->m_IndexSize;
+    if (0 == index_size)
+        return -1;
+
+    const HashDigest *keys = data->m_Keys.Get();
+    const Frozen::ScanIndexSlot *slots = data->m_Index.Get();
+    const uint32_t hash = ScanCacheKeyHash(key);
+    uint32_t slot = hash & (index_size - 1);
+
+    for (;;)
+    {
+        const Frozen::ScanIndexSlot &s = slots[slot];
+
+        if (s.m_Index < 0)
+            return -1;
+
+        if (s.m_Hash == hash && keys[s.m_Index] == key)
+            return s.m_Index;
+
+        slot = (slot + 1) & (index_size - 1);
+    }
+}
+
+// Find a record in a stripe's table. The stripe must be locked.
+static ScanCache::Record *LookupDynamic(ScanCache::Stripe *stripe, const HashDigest &key, uint32_t hash)
+{
+    uint32_t table_size = stripe->m_TableSize;
 
     if (table_size > 0)
     {
-#if ENABLED(USE_SHA1_HASH)
-        const uint32_t hash = key.m_Words.m_C;
-#elif ENABLED(USE_FAST_HASH)
-        const uint32_t hash = key.m_Words32[0];
-#endif
         uint32_t index = hash & (table_size - 1);
 
-        ScanCache::Record *chain = self->m_Table[index];
-        while (chain)
+        while (ScanCache::Record *record = stripe->m_Table[index])
         {
-            if (key == chain->m_Key)
-            {
-                return chain;
-            }
+            if (key == record->m_Key)
+                return record;
 
-            chain = chain->m_Next;
+            index = (index + 1) & (table_size - 1);
         }
     }
 
@@ -125,11 +274,10 @@ bool ScanCacheLookup(ScanCache *self, const HashDigest &key, uint64_t timestamp,
 
     if (scan_data)
     {
-        const int32_t count = scan_data->m_EntryCount;
+        const int index = ScanCacheFindFrozen(scan_data, key);
 
-        if (const HashDigest *ptr = BinarySearch(scan_data->m_Keys.Get(), count, key))
+        if (index >= 0)
         {
-            int index = int(ptr - scan_data->m_Keys.Get());
             const Frozen::ScanCacheEntry *entry = scan_data->m_Data.Get() + index;
 
             if (entry->m_FileTimestamp == timestamp)
@@ -164,9 +312,12 @@ bool ScanCacheLookup(ScanCache *self, const HashDigest &key, uint64_t timestamp,
         result_out->m_IncludedFileCount = 0;
         result_out->m_IncludedFiles = nullptr;
 
-        ReadWriteLockRead(&self->m_Lock);
+        const uint32_t hash = ScanCacheKeyHash(key);
+        ScanCache::Stripe *stripe = GetStripe(self, hash);
 
-        if (ScanCache::Record *record = LookupDynamic(self, key))
+        ReadWriteLockRead(&stripe->m_Lock);
+
+        if (ScanCache::Record *record = LookupDynamic(stripe, key, hash))
         {
             if (record->m_FileTimestamp == timestamp)
             {
@@ -176,7 +327,7 @@ bool ScanCacheLookup(ScanCache *self, const HashDigest &key, uint64_t timestamp,
             }
         }
 
-        ReadWriteUnlockRead(&self->m_Lock);
+        ReadWriteUnlockRead(&stripe->m_Lock);
 
         if (success)
         {
@@ -192,123 +343,375 @@ bool ScanCacheLookup(ScanCache *self, const HashDigest &key, uint64_t timestamp,
     return success;
 }
 
-static void ScanCachePrepareInsert(ScanCache *self)
+// Make room for one more record in a stripe. The stripe must be locked for writing.
+static void StripePrepareInsert(MemAllocHeap *heap, ScanCache::Stripe *stripe)
 {
     // Check if a rehash is needed.
-    size_t old_size = self->m_TableSize;
+    const uint32_t old_size = stripe->m_TableSize;
 
     if (old_size > 0)
     {
-        int64_t load = 0x100 * self->m_RecordCount / old_size;
+        uint64_t load = 0x100 * uint64_t(stripe->m_RecordCount + 1) / old_size;
         if (load < 0xc0)
             return;
     }
 
-    MemAllocHeap *heap = self->m_Heap;
-    size_t new_size = NextPowerOfTwo(uint32_t(old_size + 1));
-
-    if (new_size < 64)
-        new_size = 64;
+    uint32_t new_size = old_size ? old_size * 2 : 64;
 
-    ScanCache::Record **old_table = self->m_Table;
+    ScanCache::Record **old_table = stripe->m_Table;
     ScanCache::Record **new_table = HeapAllocateArrayZeroed<ScanCache::Record *>(heap, new_size);
 
-    for (size_t i = 0; i < old_size; ++i)
+    for (uint32_t i = 0; i < old_size; ++i)
     {
-        ScanCache::Record *r = old_table[i];
-        while (r)
+        if (ScanCache::Record *r = old_table[i])
         {
-            ScanCache::Record *next = r->m_Next;
-#if ENABLED(USE_SHA1_HASH)
-            uint32_t hash = r->m_Key.m_Words.m_C;
-#elif ENABLED(USE_FAST_HASH)
-            uint32_t hash = r->m_Key.m_Words32[0];
-#endif
-            uint32_t index = hash & (new_size - 1);
+            uint32_t index = ScanCacheKeyHash(r->m_Key) & (new_size - 1);
 
-            r->m_Next = new_table[index];
-            new_table[index] = r;
+            while (new_table[index])
+                index = (index + 1) & (new_size - 1);
 
-            r = next;
+            new_table[index] = r;
         }
     }
 
-    self->m_TableSize = (uint32_t)new_size;
-    self->m_Table = new_table;
+    stripe->m_TableSize = new_size;
+    stripe->m_Table = new_table;
 
     HeapFree(heap, old_table);
 }
 
-void ScanCacheInsert(
+static void ScanCacheInsertImpl(
     ScanCache *self,
     const HashDigest &key,
     uint64_t timestamp,
     const char **included_files,
-    int count)
+    int count,
+    bool persisted)
 {
-    AtomicIncrement(&g_Stats.m_ScanCacheInserts);
+    MemAllocHeap *heap = self->m_Heap;
+    const uint32_t hash = ScanCacheKeyHash(key);
+    ScanCache::Stripe *stripe = GetStripe(self, hash);
 
-    ReadWriteLockWrite(&self->m_Lock);
+    ReadWriteLockWrite(&stripe->m_Lock);
 
-    ScanCache::Record *record = LookupDynamic(self, key);
+    ScanCache::Record *record = LookupDynamic(stripe, key, hash);
 
     // See if we have this record already (races to insert same include set are possible)
     if (nullptr == record || record->m_FileTimestamp != timestamp)
     {
-        // Make sure we have room to insert.
-        ScanCachePrepareInsert(self);
-
-        uint32_t table_size = self->m_TableSize;
-#if ENABLED(USE_SHA1_HASH)
-        uint32_t hash = key.m_Words.m_C;
-#elif ENABLED(USE_FAST_HASH)
-        uint32_t hash = key.m_Words32[0];
-#endif
-        uint32_t index = hash & (table_size - 1);
-
         // Allocate a new record if needed
         const bool is_fresh = record == nullptr;
 
         if (is_fresh)
         {
-            record = LinearAllocate<ScanCache::Record>(self->m_Allocator);
+            record = StripeAllocateArray<ScanCache::Record>(heap, stripe, 1);
             record->m_Key = key;
+            record->m_Persisted = true;
         }
 
+        // Track records that need to go into the journal.
+        if (record->m_Persisted && !persisted)
+            stripe->m_DirtyCount++;
+        else if (!record->m_Persisted && persisted)
+            stripe->m_DirtyCount--;
+
+        record->m_Persisted = persisted;
         record->m_FileTimestamp = timestamp;
         record->m_IncludeCount = count;
-        record->m_Includes = LinearAllocateArray<FileAndHash>(self->m_Allocator, count);
+        record->m_Includes = StripeAllocateArray<FileAndHash>(heap, stripe, count);
 
         for (int i = 0; i < count; ++i)
         {
-            record->m_Includes[i].m_Filename = StrDup(self->m_Allocator, included_files[i]);
+            record->m_Includes[i].m_Filename = StripeStrDup(heap, stripe, included_files[i]);
             record->m_Includes[i].m_FilenameHash = Djb2HashPath(included_files[i]);
         }
 
         if (is_fresh)
         {
-            record->m_Next = self->m_Table[index];
-            self->m_Table[index] = record;
-            self->m_RecordCount++;
+            // Make sure we have room to insert.
+            StripePrepareInsert(heap, stripe);
+
+            const uint32_t table_size = stripe->m_TableSize;
+            uint32_t index = hash & (table_size - 1);
+
+            while (stripe->m_Table[index])
+                index = (index + 1) & (table_size - 1);
+
+            stripe->m_Table[index] = record;
+            stripe->m_RecordCount++;
         }
     }
 
-    ReadWriteUnlockWrite(&self->m_Lock);
+    ReadWriteUnlockWrite(&stripe->m_Lock);
 }
 
-bool ScanCacheDirty(ScanCache *self)
+void ScanCacheInsert(
+    ScanCache *self,
+    const HashDigest &key,
+    uint64_t timestamp,
+    const char **included_files,
+    int count)
 {
-    bool result;
+    AtomicIncrement(&g_Stats.m_ScanCacheInserts);
 
-    ReadWriteLockRead(&self->m_Lock);
+    ScanCacheInsertImpl(self, key, timestamp, included_files, count, false);
+}
 
-    result = self->m_RecordCount > 0;
+static uint32_t ScanCacheRecordCount(ScanCache *self)
+{
+    uint32_t result = 0;
 
-    ReadWriteUnlockRead(&self->m_Lock);
+    for (ScanCache::Stripe &stripe : self->m_Stripes)
+    {
+        ReadWriteLockRead(&stripe.m_Lock);
+        result += stripe.m_RecordCount;
+        ReadWriteUnlockRead(&stripe.m_Lock);
+    }
 
     return result;
 }
 
+bool ScanCacheDirty(ScanCache *self)
+{
+    for (ScanCache::Stripe &stripe : self->m_Stripes)
+    {
+        ReadWriteLockRead(&stripe.m_Lock);
+        bool dirty = stripe.m_DirtyCount > 0;
+        ReadWriteUnlockRead(&stripe.m_Lock);
+
+        if (dirty)
+            return true;
+    }
+
+    return false;
+}
+
+void ScanCacheLoadJournal(ScanCache *self, const char *fn)
+{
+    ProfilerScope prof_scope("Tundra LoadScanCacheJournal", 0);
+
+    FILE *f = fopen(fn, "rb");
+    if (!f)
+        return;
+
+    MemAllocHeap *heap = self->m_Heap;
+    char *data = nullptr;
+    long file_size = 0;
+
+    if (0 == fseek(f, 0, SEEK_END) && (file_size = ftell(f)) > 0)
+    {
+        rewind(f);
+        data = (char *)HeapAllocate(heap, file_size);
+        if (1 != fread(data, file_size, 1, f))
+            file_size = 0;
+    }
+
+    fclose(f);
+
+    ScanJournalHeader header;
+    if (size_t(file_size) < sizeof header)
+    {
+        HeapFree(heap, data);
+        return;
+    }
+
+    memcpy(&header, data, sizeof header);
+    if (header.m_MagicNumber != ScanJournalHeader::MagicNumber)
+    {
+        Log(kDebug, "%s: bad magic number %08x - ignoring scan cache journal", fn, header.m_MagicNumber);
+        HeapFree(heap, data);
+        return;
+    }
+
+    Buffer<const char *> includes;
+    BufferInit(&includes);
+
+    uint32_t record_count = 0;
+    size_t pos = sizeof header;
+    size_t valid_end = pos;
+
+    for (;;)
+    {
+        uint32_t payload_size;
+        if (pos + sizeof payload_size > size_t(file_size))
+            break;
+        memcpy(&payload_size, data + pos, sizeof payload_size);
+        pos += sizeof payload_size;
+
+        if (pos + payload_size > size_t(file_size))
+            break;
+
+        const char *payload = data + pos;
+        const char *payload_end = payload + payload_size;
+        pos += payload_size;
+
+        HashDigest key;
+        uint64_t timestamp;
+        uint32_t include_count;
+
+        if (payload_size < sizeof key + sizeof timestamp + sizeof include_count)
+            break;
+
+        memcpy(&key, payload, sizeof key);
+        payload += sizeof key;
+        memcpy(&timestamp, payload, sizeof timestamp);
+        payload += sizeof timestamp;
+        memcpy(&include_count, payload, sizeof include_count);
+        payload += sizeof include_count;
+
+        BufferClear(&includes);
+
+        for (uint32_t i = 0; i < include_count && payload < payload_end; ++i)
+        {
+            payload += sizeof(uint32_t); // filename hash, recomputed on insert
+            BufferAppendOne(&includes, heap, payload);
+            payload += strlen(payload) + 1;
+        }
+
+        if (includes.m_Size != include_count || payload != payload_end)
+        {
+            Log(kWarning, "%s: corrupt scan cache journal record - ignoring remainder", fn);
+            break;
+        }
+
+        ScanCacheInsertImpl(self, key, timestamp, includes.m_Storage, (int)include_count, true);
+        ++record_count;
+        valid_end = pos;
+    }
+
+    BufferDestroy(&includes, heap);
+    HeapFree(heap, data);
+
+    // Records appended after a damaged tail would never be read back, so mark the
+    // recovered records dirty to have them written to a fresh journal instead.
+    if (valid_end != size_t(file_size))
+    {
+        Log(kDebug, "%s: scan cache journal has a damaged tail - it will be rewritten", fn);
+
+        for (ScanCache::Stripe &stripe : self->m_Stripes)
+        {
+            for (uint32_t ti = 0, tsize = stripe.m_TableSize; ti < tsize; ++ti)
+            {
+                ScanCache::Record *record = stripe.m_Table[ti];
+                if (nullptr != record && record->m_Persisted)
+                {
+                    record->m_Persisted = false;
+                    stripe.m_DirtyCount++;
+                }
+            }
+        }
+
+        record_count = 0;
+    }
+
+    self->m_JournalRecordCount = record_count;
+    self->m_JournalCreationTime = header.m_CreationTime;
+
+    Log(kDebug, "Scan cache journal %s replayed - %u records", fn, record_count);
+}
+
+bool ScanCacheShouldCompact(ScanCache *self)
+{
+    // Without a frozen file to append to, always do a full save.
+    const Frozen::ScanData *frozen_data = self->m_FrozenData;
+    if (nullptr == frozen_data)
+        return true;
+
+    uint32_t dirty_count = 0;
+    for (ScanCache::Stripe &stripe : self->m_Stripes)
+        dirty_count += stripe.m_DirtyCount;
+
+    uint32_t limit = uint32_t(frozen_data->m_EntryCount) / 8;
+    if (limit < kJournalMinCompactRecords)
+        limit = kJournalMinCompactRecords;
+
+    if (self->m_JournalRecordCount + dirty_count > limit)
+        return true;
+
+    const uint64_t now = time(nullptr);
+    if (self->m_JournalRecordCount > 0 && now - self->m_JournalCreationTime > kJournalMaxAgeSeconds)
+        return true;
+
+    return false;
+}
+
+bool ScanCacheAppendJournal(ScanCache *self, const char *fn)
+{
+    TimingScope timing_scope(nullptr, &g_Stats.m_ScanCacheSaveTime);
+    ProfilerScope prof_scope("Tundra AppendScanCacheJournal", 0);
+
+    MemAllocHeap *heap = self->m_Heap;
+    const bool fresh_journal = 0 == self->m_JournalRecordCount;
+
+    FILE *f = fopen(fn, fresh_journal ? "wb" : "ab");
+    if (!f)
+        return false;
+
+    bool success = true;
+
+    if (fresh_journal)
+    {
+        ScanJournalHeader header;
+        header.m_MagicNumber = ScanJournalHeader::MagicNumber;
+        header.m_Padding = 0;
+        header.m_CreationTime = time(nullptr);
+        success = 1 == fwrite(&header, sizeof header, 1, f);
+        self->m_JournalCreationTime = header.m_CreationTime;
+    }
+
+    // Serialize all dirty records into one buffer and write it in one go.
+    Buffer<uint8_t> out;
+    BufferInitWithCapacity(&out, heap, 64 * 1024);
+
+    uint32_t records_out = 0;
+
+    for (ScanCache::Stripe &stripe : self->m_Stripes)
+    {
+        for (uint32_t ti = 0, tsize = stripe.m_TableSize; ti < tsize; ++ti)
+        {
+            ScanCache::Record *record = stripe.m_Table[ti];
+
+            if (nullptr == record || record->m_Persisted)
+                continue;
+
+            const size_t size_pos = out.m_Size;
+            BufferAlloc(&out, heap, sizeof(uint32_t));
+            BufferAppend(&out, heap, (const uint8_t *)&record->m_Key, sizeof record->m_Key);
+            BufferAppend(&out, heap, (const uint8_t *)&record->m_FileTimestamp, sizeof record->m_FileTimestamp);
+            uint32_t include_count = uint32_t(record->m_IncludeCount);
+            BufferAppend(&out, heap, (const uint8_t *)&include_count, sizeof include_count);
+
+            for (int i = 0; i < record->m_IncludeCount; ++i)
+            {
+                const FileAndHash &include = record->m_Includes[i];
+                BufferAppend(&out, heap, (const uint8_t *)&include.m_FilenameHash, sizeof include.m_FilenameHash);
+                BufferAppend(&out, heap, (const uint8_t *)include.m_Filename, strlen(include.m_Filename) + 1);
+            }
+
+            uint32_t payload_size = uint32_t(out.m_Size - size_pos - sizeof(uint32_t));
+            memcpy(out.m_Storage + size_pos, &payload_size, sizeof payload_size);
+
+            record->m_Persisted = true;
+            ++records_out;
+        }
+
+        stripe.m_DirtyCount = 0;
+    }
+
+    if (success && out.m_Size > 0)
+        success = out.m_Size == fwrite(out.m_Storage, 1, out.m_Size, f);
+
+    if (0 != fclose(f))
+        success = false;
+
+    BufferDestroy(&out, heap);
+
+    self->m_JournalRecordCount += records_out;
+    g_Stats.m_ScanCacheJournalAppends += records_out;
+
+    return success;
+}
+
 static bool SortRecordsByHash(const ScanCache::Record *l, const ScanCache::Record *r)
 {
     return l->m_Key < r->m_Key;
@@ -323,10 +726,13 @@ struct ScanCacheWriter
     BinarySegment *m_TimestampSeg;
     BinarySegment *m_ArraySeg;
     BinarySegment *m_StringSeg;
+    BinarySegment *m_IndexSeg;
     BinaryLocator m_DigestPtr;
     BinaryLocator m_EntryPtr;
     BinaryLocator m_TimestampPtr;
     uint32_t m_RecordsOut;
+    MemAllocHeap *m_Heap;
+    Buffer<uint32_t> m_KeyHashes;
 };
 
 static void ScanCacheWriterInit(ScanCacheWriter *self, MemAllocHeap *heap)
@@ -339,26 +745,81 @@ static void ScanCacheWriterInit(ScanCacheWriter *self, MemAllocHeap *heap)
     self->m_TimestampSeg = BinaryWriterAddSegment(&self->m_Writer);
     self->m_ArraySeg = BinaryWriterAddSegment(&self->m_Writer);
     self->m_StringSeg = BinaryWriterAddSegment(&self->m_Writer);
+    self->m_IndexSeg = BinaryWriterAddSegment(&self->m_Writer);
 
     self->m_DigestPtr = BinarySegmentPosition(self->m_DigestSeg);
     self->m_EntryPtr = BinarySegmentPosition(self->m_DataSeg);
     self->m_TimestampPtr = BinarySegmentPosition(self->m_TimestampSeg);
 
     self->m_RecordsOut = 0;
+    self->m_Heap = heap;
+    BufferInit(&self->m_KeyHashes);
 }
 
 static void ScanCacheWriterDestroy(ScanCacheWriter *self)
 {
+    BufferDestroy(&self->m_KeyHashes, self->m_Heap);
     BinaryWriterDestroy(&self->m_Writer);
 }
 
+// Build an open-addressing index over the written keys so lookups in the
+// mapped file touch one or two cache lines instead of binary searching.
+static uint32_t ScanCacheWriterEmitIndex(ScanCacheWriter *self, BinaryLocator *index_ptr)
+{
+    const uint32_t record_count = self->m_RecordsOut;
+
+    if (0 == record_count)
+        return 0;
+
+    // Keep the load factor at or below 50% to keep probe sequences short.
+    uint32_t index_size = NextPowerOfTwo(record_count * 2);
+    if (index_size < 16)
+        index_size = 16;
+
+    const uint32_t mask = index_size - 1;
+    Frozen::ScanIndexSlot *slots = HeapAllocateArray<Frozen::ScanIndexSlot>(self->m_Heap, index_size);
+
+    for (uint32_t i = 0; i < index_size; ++i)
+    {
+        slots[i].m_Hash = 0;
+        slots[i].m_Index = -1;
+    }
+
+    for (uint32_t i = 0; i < record_count; ++i)
+    {
+        const uint32_t hash = self->m_KeyHashes[i];
+        uint32_t slot = hash & mask;
+
+        while (slots[slot].m_Index >= 0)
+            slot = (slot + 1) & mask;
+
+        slots[slot].m_Hash = hash;
+        slots[slot].m_Index = int32_t(i);
+    }
+
+    *index_ptr = BinarySegmentPosition(self->m_IndexSeg);
+    BinarySegmentWrite(self->m_IndexSeg, slots, sizeof(Frozen::ScanIndexSlot) * index_size);
+
+    HeapFree(self->m_Heap, slots);
+
+    return index_size;
+}
+
 static bool ScanCacheWriterFlush(ScanCacheWriter *self, const char *filename)
 {
+    BinaryLocator index_ptr;
+    const uint32_t index_size = ScanCacheWriterEmitIndex(self, &index_ptr);
+
     BinarySegmentWriteUint32(self->m_MainSeg, Frozen::ScanData::MagicNumber);
     BinarySegmentWriteUint32(self->m_MainSeg, self->m_RecordsOut);
     BinarySegmentWritePointer(self->m_MainSeg, self->m_DigestPtr);
     BinarySegmentWritePointer(self->m_MainSeg, self->m_EntryPtr);
     BinarySegmentWritePointer(self->m_MainSeg, self->m_TimestampPtr);
+    BinarySegmentWriteUint32(self->m_MainSeg, index_size);
+    if (index_size)
+        BinarySegmentWritePointer(self->m_MainSeg, index_ptr);
+    else
+        BinarySegmentWriteNullPointer(self->m_MainSeg);
     BinarySegmentWriteUint32(self->m_MainSeg, Frozen::ScanData::MagicNumber);
     return BinaryWriterFlush(&self->m_Writer, filename);
 }
@@ -378,7 +839,7 @@ static void WriteUniqueStringPointer(HashTable<BinaryLocator, kFlagPathStrings>
     BinarySegmentWriteStringData(string_segment, filename);
 }
 
-// Save frozen record unless timestamp is too old
+// Write one record to the frozen output.
 template <typename T>
 static void SaveRecord(
     ScanCacheWriter *self,
@@ -389,7 +850,6 @@ static void SaveRecord(
     uint64_t file_timestamp,
     uint64_t access_time)
 {
-    // TODO: Check access time to see if we should discard.
     BinarySegment *digest_seg = self->m_DigestSeg;
     BinarySegment *data_seg = self->m_DataSeg;
     BinarySegment *timestamp_seg = self->m_TimestampSeg;
@@ -405,6 +865,7 @@ static void SaveRecord(
     }
 
     BinarySegmentWrite(digest_seg, (const char *)digest->m_Data, sizeof(HashDigest));
+    BufferAppendOne(&self->m_KeyHashes, self->m_Heap, ScanCacheKeyHash(*digest));
 
     BinarySegmentWriteUint64(data_seg, file_timestamp);
     BinarySegmentWriteUint32(data_seg, uint32_t(include_count));
@@ -429,24 +890,24 @@ bool ScanCacheSave(ScanCache *self, const char *fn, MemAllocHeap *heap)
 
     ScanCacheWriter writer;
     ScanCacheWriterInit(&writer, heap);
+    writer.m_Writer.m_CompressThreshold = self->m_CompressThreshold;
 
     // Save new view of the scan cache
     //
     // Algorithm:
     //
     // - Get all records from the dynamic table (stuff we put in this session)
-    const uint32_t record_count = self->m_RecordCount;
+    const uint32_t record_count = ScanCacheRecordCount(self);
     ScanCache::Record **dyn_records = LinearAllocateArray<ScanCache::Record *>(scratch, record_count);
 
     {
         uint32_t records_out = 0;
-        for (uint32_t ti = 0, tsize = self->m_TableSize; ti < tsize; ++ti)
+        for (const ScanCache::Stripe &stripe : self->m_Stripes)
         {
-            ScanCache::Record *chain = self->m_Table[ti];
-            while (chain)
+            for (uint32_t ti = 0, tsize = stripe.m_TableSize; ti < tsize; ++ti)
             {
-                dyn_records[records_out++] = chain;
-                chain = chain->m_Next;
+                if (ScanCache::Record *record = stripe.m_Table[ti])
+                    dyn_records[records_out++] = record;
             }
         }
 
@@ -465,13 +926,31 @@ bool ScanCacheSave(ScanCache *self, const char *fn, MemAllocHeap *heap)
 
     const uint64_t now = time(nullptr);
 
-    // Keep old entries for a week.
-    const uint64_t timestamp_cutoff = now - 60 * 60 * 24 * 7;
+    CacheRetention *retention = &self->m_Retention;
 
     auto key_dynamic = [=](size_t index) -> const HashDigest * { return &dyn_records[index]->m_Key; };
     auto key_frozen = [=](size_t index) { return frozen_digests + index; };
 
-    auto save_dynamic = [&writer, dyn_records, now, &string_pool](size_t index) {
+    auto frozen_access_time = [=](size_t index) { return frozen_access[index] ? now : frozen_times[index]; };
+
+    if (retention->m_MaxRecords)
+    {
+        // Collect access times of everything we could save to find the least recently used records.
+        uint64_t *access_times = LinearAllocateArray<uint64_t>(scratch, record_count + frozen_count);
+        uint32_t time_count = 0;
+
+        auto time_dynamic = [&](size_t index) { access_times[time_count++] = now; };
+        auto time_frozen = [&](size_t index) { access_times[time_count++] = frozen_access_time(index); };
+
+        TraverseSortedArrays(record_count, time_dynamic, key_dynamic, frozen_count, time_frozen, key_frozen);
+
+        CacheRetentionApplyBudget(retention, access_times, time_count);
+    }
+
+    auto save_dynamic = [&writer, dyn_records, now, retention, &string_pool](size_t index) {
+        if (!CacheRetentionKeep(retention, now))
+            return;
+
         SaveRecord(
             &writer,
             &string_pool,
@@ -483,11 +962,9 @@ bool ScanCacheSave(ScanCache *self, const char *fn, MemAllocHeap *heap)
     };
 
     auto save_frozen = [&](size_t index) {
-        uint64_t timestamp = frozen_times[index];
-        if (frozen_access[index])
-            timestamp = now;
+        const uint64_t timestamp = frozen_access_time(index);
 
-        if (timestamp > timestamp_cutoff)
+        if (CacheRetentionKeep(retention, timestamp))
         {
             SaveRecord(
                 &writer,
@@ -502,6 +979,8 @@ bool ScanCacheSave(ScanCache *self, const char *fn, MemAllocHeap *heap)
 
     TraverseSortedArrays(record_count, save_dynamic, key_dynamic, frozen_count, save_frozen, key_frozen);
 
+    g_Stats.m_ScanCacheEntriesDropped += retention->m_Evicted;
+
     self->m_FrozenData = nullptr;
 
     bool result = ScanCacheWriterFlush(&writer, fn);
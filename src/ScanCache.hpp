@@ -2,17 +2,44 @@
 #include "Common.hpp"
 #include "Hash.hpp"
 #include "ReadWriteLock.hpp"
+#include "CacheRetention.hpp"
 
 namespace Frozen { struct ScanData; }
 struct MemAllocHeap;
 struct MemAllocLinear;
 struct MemoryMappedFile;
+struct DigestCache;
 
 void ComputeScanCacheKey(
     HashDigest *key_out,
     const char *filename,
     const HashDigest &scanner_hash);
 
+// Key for scan results of a file with a particular content digest. Records stored
+// under content keys use kScanCacheContentTimestamp in place of a file timestamp.
+void ComputeScanCacheContentKey(
+    HashDigest *key_out,
+    const HashDigest &scan_key,
+    const HashDigest &content_digest);
+
+enum
+{
+    kScanCacheContentTimestamp = 0
+};
+
+// Hash used to index scan cache records by key.
+inline uint32_t ScanCacheKeyHash(const HashDigest &key)
+{
+#if ENABLED(USE_SHA1_HASH)
+    return key.m_Words.m_C;
+#elif ENABLED(USE_FAST_HASH)
+    return key.m_Words32[0];
+#endif
+}
+
+// Find the index of a key in frozen scan data, or -1 if it is not present.
+int ScanCacheFindFrozen(const Frozen::ScanData *data, const HashDigest &key);
+
 struct ScanCacheLookupResult
 {
     int m_IncludedFileCount;
@@ -23,23 +50,74 @@ struct ScanCache
 {
     struct Record;
 
+    enum
+    {
+        // Number of independently locked partitions of the dynamic table.
+        kStripeCount = 64,
+        kStripeShift = 26
+    };
+
+    // One partition of the dynamic table. Each stripe is an open-addressing
+    // table of record pointers with its own lock and its own allocation arena,
+    // so inserts from different build threads rarely contend.
+    struct StripeData
+    {
+        ReadWriteLock m_Lock;
+        uint32_t m_RecordCount;
+        // Number of records not yet written to the journal.
+        uint32_t m_DirtyCount;
+        uint32_t m_TableSize;
+        Record **m_Table;
+
+        // Arena for records and include data; only touched with m_Lock held for writing.
+        char *m_ArenaBlock;
+        size_t m_ArenaUsed;
+        size_t m_ArenaSize;
+    };
+
+    // Stripes are padded to whole cache lines rather than aligned, as the cache is
+    // heap allocated and new doesn't honor over-alignment.
+    struct Stripe : StripeData
+    {
+        char m_Padding[64 - sizeof(StripeData) % 64];
+    };
+
     const Frozen::ScanData *m_FrozenData;
 
-    ReadWriteLock m_Lock;
     MemAllocHeap *m_Heap;
+    // Scratch allocator used when saving; only accessed from the main thread.
     MemAllocLinear *m_Allocator;
-    uint32_t m_RecordCount;
-    uint32_t m_TableSize;
-    Record **m_Table;
     bool m_Initialized;
+    // When set, scan results are also stored by content digest so they survive
+    // timestamp changes that leave file contents unchanged.
+    DigestCache *m_DigestCache;
     // Table of bits to track whether frozen records have been accessed.
     uint8_t *m_FrozenAccess;
+    // Which records survive a full save.
+    CacheRetention m_Retention;
+    // Saved caches of at least this many bytes are block compressed; zero never compresses.
+    size_t m_CompressThreshold;
+
+    // Number of records in the journal on disk, and when it was started.
+    uint32_t m_JournalRecordCount;
+    uint64_t m_JournalCreationTime;
+
+    Stripe m_Stripes[kStripeCount];
 };
 
 void ScanCacheInit(ScanCache *self, MemAllocHeap *heap, MemAllocLinear *allocator);
 
 void ScanCacheSetCache(ScanCache *self, const Frozen::ScanData *frozen_data);
 
+// Enable content digest keyed records, using the digest cache to avoid rehashing unchanged files.
+void ScanCacheSetDigestCache(ScanCache *self, DigestCache *digest_cache);
+
+// Records unused for days_to_keep days are dropped (default 7). When max_records is non-zero, the
+// least recently used records beyond that count are evicted on save.
+void ScanCacheSetRetention(ScanCache *self, int32_t days_to_keep, uint32_t max_records);
+
+void ScanCacheSetCompressThreshold(ScanCache *self, size_t threshold);
+
 void ScanCacheDestroy(ScanCache *self);
 
 bool ScanCacheLookup(ScanCache *self, const HashDigest &key, uint64_t timestamp, ScanCacheLookupResult *result_out, MemAllocLinear *scratch);
@@ -49,3 +127,12 @@ void ScanCacheInsert(ScanCache *self, const HashDigest &key, uint64_t timestamp,
 bool ScanCacheDirty(ScanCache *self);
 
 bool ScanCacheSave(ScanCache *self, const char *fn, MemAllocHeap *heap);
+
+// Replay records appended to the journal since the last full save into the dynamic table.
+void ScanCacheLoadJournal(ScanCache *self, const char *fn);
+
+// Returns true if the journal has grown large or old enough that a full save should be done instead of appending.
+bool ScanCacheShouldCompact(ScanCache *self);
+
+// Append records added this session to the journal.
+bool ScanCacheAppendJournal(ScanCache *self, const char *fn);
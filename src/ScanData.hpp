@@ -10,9 +10,17 @@ struct ScanCacheEntry
     FrozenArray<FrozenFileAndHash> m_IncludedFiles;
 };
 
+// Open-addressing index slot into the sorted key array. Empty slots have m_Index == -1.
+struct ScanIndexSlot
+{
+    uint32_t m_Hash;
+    int32_t m_Index;
+};
+static_assert(sizeof(ScanIndexSlot) == 8, "struct layout");
+
 struct ScanData
 {
-    static const uint32_t MagicNumber = 0x1517000f ^ kTundraHashMagic;
+    static const uint32_t MagicNumber = 0x15170010 ^ kTundraHashMagic;
 
     uint32_t m_MagicNumber;
 
@@ -21,6 +29,12 @@ struct ScanData
     FrozenPtr<HashDigest> m_Keys;
     FrozenPtr<ScanCacheEntry> m_Data;
     FrozenPtr<uint64_t> m_AccessTimes;
+
+    // Hash index over m_Keys (power of two sized, linear probing). Only an
+    // empty cache has a zero m_IndexSize.
+    uint32_t m_IndexSize;
+    FrozenPtr<ScanIndexSlot> m_Index;
+
     uint32_t m_MagicNumberEnd;
 };
 }
@@ -10,6 +10,9 @@
 #include "ScanCache.hpp"
 #include "StatCache.hpp"
 #include "HashTable.hpp"
+#include "DigestCache.hpp"
+#include "FileSign.hpp"
+#include "Stats.hpp"
 
 #include <stdio.h>
 
@@ -139,12 +142,69 @@ static void ScanFile(
     }
 }
 
+// Read a file into RAM and add a terminating newline character. Returns null for
+// missing or empty files.
+static char *ReadFileForScan(const char *fn, MemAllocHeap *heap, long *size_out)
+{
+    FILE *f = fopen(fn, "rb");
+    if (!f)
+        return nullptr;
+
+    if (0 != fseek(f, 0, SEEK_END))
+    {
+        fclose(f);
+        return nullptr;
+    }
+
+    long file_size = ftell(f);
+    if (-1 == file_size || 0 == file_size)
+    {
+        fclose(f);
+        return nullptr;
+    }
+
+    rewind(f);
+
+    char *buffer = (char *)HeapAllocate(heap, file_size + 2);
+    if (1 != (long)fread(buffer, file_size, 1, f))
+    {
+        HeapFree(heap, buffer);
+        fclose(f);
+        return nullptr;
+    }
+
+    fclose(f);
+
+    // Add an extra newline to sort out trailing #includes on last line
+    buffer[file_size + 0] = '\n';
+    buffer[file_size + 1] = '\0';
+
+    *size_out = file_size;
+    return buffer;
+}
+
+static void AddCachedIncludes(IncludeSet *incset, Buffer<const char *> *filename_stack, MemAllocHeap *heap, const ScanCacheLookupResult &cache_result)
+{
+    int file_count = cache_result.m_IncludedFileCount;
+    const FileAndHash *files = cache_result.m_IncludedFiles;
+
+    for (int i = 0; i < file_count; ++i)
+    {
+        if (IncludeSetAddNoDuplicateString(incset, files[i].m_Filename, files[i].m_FilenameHash))
+        {
+            // This was a new file, schedule it for scanning as well.
+            BufferAppendOne(filename_stack, heap, files[i].m_Filename);
+        }
+    }
+}
+
 bool ScanImplicitDeps(StatCache *stat_cache, const ScanInput *input, ScanOutput *output)
 {
     MemAllocHeap *scratch_heap = input->m_ScratchHeap;
     MemAllocLinear *scratch_alloc = input->m_ScratchAlloc;
     const Frozen::ScannerData *scanner_config = input->m_ScannerConfig;
     ScanCache *scan_cache = input->m_ScanCache;
+    DigestCache *digest_cache = scan_cache->m_DigestCache;
 
     Buffer<const char *> found_includes;
     Buffer<const char *> filename_stack;
@@ -170,79 +230,88 @@ bool ScanImplicitDeps(StatCache *stat_cache, const ScanInput *input, ScanOutput
 
         ComputeScanCacheKey(&scan_key, fn, scanner_config->m_ScannerGuid);
 
+        const uint64_t timestamp = FileSignatureTimestamp(info);
+
         ScanCacheLookupResult cache_result;
 
-        if (ScanCacheLookup(scan_cache, scan_key, info.m_Timestamp, &cache_result, scratch_alloc))
+        if (ScanCacheLookup(scan_cache, scan_key, timestamp, &cache_result, scratch_alloc))
         {
-            int file_count = cache_result.m_IncludedFileCount;
-            const FileAndHash *files = cache_result.m_IncludedFiles;
-
-            for (int i = 0; i < file_count; ++i)
-            {
-                if (IncludeSetAddNoDuplicateString(&incset, files[i].m_Filename, files[i].m_FilenameHash))
-                {
-                    // This was a new file, schedule it for scanning as well.
-                    BufferAppendOne(&filename_stack, scratch_heap, files[i].m_Filename);
-                }
-            }
+            AddCachedIncludes(&incset, &filename_stack, scratch_heap, cache_result);
+            continue;
         }
-        else
-        {
-            // Reset buffer
-            BufferClear(&found_includes);
 
-            // Read file into RAM, and add a terminating newline character.
-            FILE *f = fopen(fn, "rb");
-            if (!f)
-                continue;
+        long file_size = 0;
+        char *buffer = nullptr;
+        HashDigest content_key;
+
+        if (digest_cache)
+        {
+            // The timestamp changed, but the contents may not have. Look for results
+            // recorded under the content digest before scanning again.
+            uint32_t fn_hash = Djb2HashPath(fn);
+            HashDigest digest;
 
-            if (0 != fseek(f, 0, SEEK_END))
+            if (!DigestCacheGet(digest_cache, fn, fn_hash, timestamp, &digest))
             {
-                fclose(f);
-                continue;
+                if (nullptr == (buffer = ReadFileForScan(fn, scratch_heap, &file_size)))
+                    continue;
+
+                TimingScope timing_scope(&g_Stats.m_FileDigestCount, &g_Stats.m_FileDigestTimeCycles);
+                ComputeContentDigest(&digest, buffer, file_size);
+                DigestCacheSet(digest_cache, fn, fn_hash, timestamp, digest);
             }
 
-            long file_size = ftell(f);
-            if (-1 == file_size || 0 == file_size)
+            ComputeScanCacheContentKey(&content_key, scan_key, digest);
+
+            if (ScanCacheLookup(scan_cache, content_key, kScanCacheContentTimestamp, &cache_result, scratch_alloc))
             {
-                fclose(f);
+                AtomicIncrement(&g_Stats.m_ScanCacheContentHits);
+
+                // Store under the path key as well so the next lookup is a direct hit.
+                const char **includes = LinearAllocateArray<const char *>(scratch_alloc, cache_result.m_IncludedFileCount);
+                for (int i = 0; i < cache_result.m_IncludedFileCount; ++i)
+                    includes[i] = cache_result.m_IncludedFiles[i].m_Filename;
+                ScanCacheInsert(scan_cache, scan_key, timestamp, includes, cache_result.m_IncludedFileCount);
+
+                AddCachedIncludes(&incset, &filename_stack, scratch_heap, cache_result);
+
+                if (buffer)
+                    HeapFree(scratch_heap, buffer);
                 continue;
             }
+        }
 
-            rewind(f);
+        if (!buffer && nullptr == (buffer = ReadFileForScan(fn, scratch_heap, &file_size)))
+            continue;
 
-            char *buffer = (char *)HeapAllocate(scratch_heap, file_size + 2);
-            if (1 == (long)fread(buffer, file_size, 1, f))
-            {
-                // Add an extra newline to sort out trailing #includes on last line
-                buffer[file_size + 0] = '\n';
-                buffer[file_size + 1] = '\0';
+        // Reset buffer
+        BufferClear(&found_includes);
 
-                char *scan_start = buffer;
+        char *scan_start = buffer;
 
-                // Skip UTF-8 marker if present as it freaks out ctype functions
-                static const unsigned char utf8_mark[] = {0xef, 0xbb, 0xbf};
-                if (file_size >= 3 && 0 == memcmp(scan_start, utf8_mark, sizeof utf8_mark))
-                    scan_start += sizeof utf8_mark;
+        // Skip UTF-8 marker if present as it freaks out ctype functions
+        static const unsigned char utf8_mark[] = {0xef, 0xbb, 0xbf};
+        if (file_size >= 3 && 0 == memcmp(scan_start, utf8_mark, sizeof utf8_mark))
+            scan_start += sizeof utf8_mark;
 
-                ScanFile(stat_cache, fn, scan_start, input, &found_includes);
-            }
+        ScanFile(stat_cache, fn, scan_start, input, &found_includes);
+
+        // Insert result into scan cache
+        ScanCacheInsert(scan_cache, scan_key, timestamp, found_includes.m_Storage, (int)found_includes.m_Size);
 
-            // Insert result into scan cache
-            ScanCacheInsert(scan_cache, scan_key, info.m_Timestamp, found_includes.m_Storage, (int)found_includes.m_Size);
+        if (digest_cache)
+            ScanCacheInsert(scan_cache, content_key, kScanCacheContentTimestamp, found_includes.m_Storage, (int)found_includes.m_Size);
 
-            for (const char *file : found_includes)
+        for (const char *file : found_includes)
+        {
+            if (IncludeSetAddDuplicateString(&incset, file, Djb2HashPath(file)))
             {
-                if (IncludeSetAddDuplicateString(&incset, file, Djb2HashPath(file)))
-                {
-                    // This was a new file, schedule it for scanning as well.
-                    BufferAppendOne(&filename_stack, scratch_heap, file);
-                }
+                // This was a new file, schedule it for scanning as well.
+                BufferAppendOne(&filename_stack, scratch_heap, file);
             }
-
-            HeapFree(scratch_heap, buffer);
-            fclose(f);
         }
+
+        HeapFree(scratch_heap, buffer);
     }
 
     // Allocate space for output array. String data is already in scratch allocator.
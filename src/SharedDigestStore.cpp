@@ -0,0 +1,286 @@
+#include "SharedDigestStore.hpp"
+#include "FileInfo.hpp"
+#include "Atomic.hpp"
+
+#include <string.h>
+
+#if defined(TUNDRA_UNIX)
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#if defined(TUNDRA_WIN32)
+#include <windows.h>
+#endif
+
+
+
+// Number of slots a record may live in, starting at its home slot.
+static const uint32_t kProbeCount = 4;
+
+static uint32_t IdentityHash(const FileIdentity &identity)
+{
+    uint64_t h = identity.m_Inode * 0x9e3779b97f4a7c15ull;
+    h ^= identity.m_Device + (h << 6) + (h >> 2);
+    h ^= identity.m_Size + (h << 6) + (h >> 2);
+    h ^= identity.m_ModifiedTime + (h << 6) + (h >> 2);
+    h ^= identity.m_ChangeTime + (h << 6) + (h >> 2);
+    return uint32_t(h ^ (h >> 32));
+}
+
+static bool SlotMatches(const SharedDigest::Slot *slot, const FileIdentity &identity)
+{
+    return slot->m_Inode == identity.m_Inode &&
+           slot->m_Device == identity.m_Device &&
+           slot->m_Size == identity.m_Size &&
+           slot->m_ModifiedTime == identity.m_ModifiedTime &&
+           slot->m_ChangeTime == identity.m_ChangeTime;
+}
+
+static uint32_t LoadSequence(const SharedDigest::Slot *slot)
+{
+    return *(const volatile uint32_t *)&slot->m_Sequence;
+}
+
+void SharedDigestStoreInit(SharedDigestStore *self)
+{
+    self->m_Header = nullptr;
+    self->m_Slots = nullptr;
+    self->m_SlotMask = 0;
+    self->m_MappingSize = 0;
+    self->m_SysData[0] = 0;
+    self->m_SysData[1] = 0;
+}
+
+// Set up the store in a freshly mapped file, unless another process already did.
+static void PrepareMapping(SharedDigestStore *self, void *address, uint32_t slot_count, bool reset)
+{
+    SharedDigest::Header *header = (SharedDigest::Header *)address;
+
+    if (reset)
+    {
+        memset(address, 0, sizeof(SharedDigest::Header) + sizeof(SharedDigest::Slot) * size_t(slot_count));
+        header->m_SlotCount = slot_count;
+        AtomicFullBarrier();
+        header->m_MagicNumber = SharedDigest::Header::MagicNumber;
+    }
+
+    self->m_Header = header;
+    self->m_Slots = (SharedDigest::Slot *)(header + 1);
+    self->m_SlotMask = slot_count - 1;
+}
+
+#if defined(TUNDRA_UNIX)
+bool SharedDigestStoreOpen(SharedDigestStore *self, const char *filename, uint32_t slot_count)
+{
+    CHECK(slot_count && 0 == (slot_count & (slot_count - 1)));
+
+    const size_t size = sizeof(SharedDigest::Header) + sizeof(SharedDigest::Slot) * size_t(slot_count);
+
+    int fd = open(filename, O_RDWR | O_CREAT, 0666);
+    if (-1 == fd)
+    {
+        Log(kWarning, "couldn't open shared digest store %s", filename);
+        return false;
+    }
+
+    // Only one process may create or reset the file at a time.
+    flock(fd, LOCK_EX);
+
+    bool reset = true;
+    struct stat stbuf;
+    if (0 == fstat(fd, &stbuf) && size_t(stbuf.st_size) == size)
+    {
+        SharedDigest::Header header;
+        if (sizeof header == pread(fd, &header, sizeof header, 0))
+            reset = header.m_MagicNumber != SharedDigest::Header::MagicNumber || header.m_SlotCount != slot_count;
+    }
+
+    if (reset && 0 != ftruncate(fd, size))
+    {
+        flock(fd, LOCK_UN);
+        close(fd);
+        Log(kWarning, "couldn't size shared digest store %s", filename);
+        return false;
+    }
+
+    void *address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == address)
+    {
+        flock(fd, LOCK_UN);
+        close(fd);
+        Log(kWarning, "couldn't map shared digest store %s", filename);
+        return false;
+    }
+
+    PrepareMapping(self, address, slot_count, reset);
+
+    flock(fd, LOCK_UN);
+
+    self->m_MappingSize = size;
+    self->m_SysData[0] = fd;
+    return true;
+}
+
+void SharedDigestStoreDestroy(SharedDigestStore *self)
+{
+    if (self->m_Header)
+    {
+        munmap(self->m_Header, self->m_MappingSize);
+        close((int)self->m_SysData[0]);
+    }
+
+    SharedDigestStoreInit(self);
+}
+#elif defined(TUNDRA_WIN32)
+bool SharedDigestStoreOpen(SharedDigestStore *self, const char *filename, uint32_t slot_count)
+{
+    CHECK(slot_count && 0 == (slot_count & (slot_count - 1)));
+
+    const size_t size = sizeof(SharedDigest::Header) + sizeof(SharedDigest::Slot) * size_t(slot_count);
+
+    HANDLE file = CreateFileA(filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (INVALID_HANDLE_VALUE == file)
+    {
+        Log(kWarning, "couldn't open shared digest store %s", filename);
+        return false;
+    }
+
+    // Only one process may create or reset the file at a time.
+    OVERLAPPED overlapped = {};
+    LockFileEx(file, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped);
+
+    bool reset = true;
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file, &file_size) && uint64_t(file_size.QuadPart) == size)
+    {
+        SharedDigest::Header header;
+        DWORD bytes_read = 0;
+        if (ReadFile(file, &header, sizeof header, &bytes_read, NULL) && bytes_read == sizeof header)
+            reset = header.m_MagicNumber != SharedDigest::Header::MagicNumber || header.m_SlotCount != slot_count;
+    }
+
+    if (reset)
+    {
+        LARGE_INTEGER new_size;
+        new_size.QuadPart = size;
+        if (!SetFilePointerEx(file, new_size, NULL, FILE_BEGIN) || !SetEndOfFile(file))
+        {
+            UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &overlapped);
+            CloseHandle(file);
+            Log(kWarning, "couldn't size shared digest store %s", filename);
+            return false;
+        }
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    void *address = mapping ? MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0) : nullptr;
+    if (!address)
+    {
+        if (mapping)
+            CloseHandle(mapping);
+        UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &overlapped);
+        CloseHandle(file);
+        Log(kWarning, "couldn't map shared digest store %s", filename);
+        return false;
+    }
+
+    PrepareMapping(self, address, slot_count, reset);
+
+    UnlockFileEx(file, 0, MAXDWORD, MAXDWORD, &overlapped);
+
+    self->m_MappingSize = size;
+    self->m_SysData[0] = (uintptr_t)file;
+    self->m_SysData[1] = (uintptr_t)mapping;
+    return true;
+}
+
+void SharedDigestStoreDestroy(SharedDigestStore *self)
+{
+    if (self->m_Header)
+    {
+        UnmapViewOfFile(self->m_Header);
+        CloseHandle((HANDLE)self->m_SysData[1]);
+        CloseHandle((HANDLE)self->m_SysData[0]);
+    }
+
+    SharedDigestStoreInit(self);
+}
+#endif
+
+bool SharedDigestStoreGet(SharedDigestStore *self, const FileIdentity &identity, HashDigest *digest_out)
+{
+    if (!self->m_Slots)
+        return false;
+
+    const uint32_t home = IdentityHash(identity);
+
+    for (uint32_t i = 0; i < kProbeCount; ++i)
+    {
+        const SharedDigest::Slot *slot = self->m_Slots + ((home + i) & self->m_SlotMask);
+
+        // Copy the slot out between two reads of the sequence number; if a writer got in, treat it as a miss.
+        const uint32_t sequence = LoadSequence(slot);
+        if (0 == sequence || (sequence & 1))
+            continue;
+
+        AtomicFullBarrier();
+        SharedDigest::Slot copy;
+        memcpy(&copy, slot, sizeof copy);
+        AtomicFullBarrier();
+
+        if (LoadSequence(slot) != sequence)
+            continue;
+
+        if (SlotMatches(&copy, identity))
+        {
+            *digest_out = copy.m_Digest;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SharedDigestStoreSet(SharedDigestStore *self, const FileIdentity &identity, const HashDigest &digest)
+{
+    if (!self->m_Slots)
+        return;
+
+    const uint32_t home = IdentityHash(identity);
+
+    // Prefer a slot that already holds this file, then an unused one; otherwise evict one picked by the hash.
+    SharedDigest::Slot *target = nullptr;
+    for (uint32_t i = 0; i < kProbeCount && !target; ++i)
+    {
+        SharedDigest::Slot *slot = self->m_Slots + ((home + i) & self->m_SlotMask);
+        if (SlotMatches(slot, identity))
+            target = slot;
+    }
+    for (uint32_t i = 0; i < kProbeCount && !target; ++i)
+    {
+        SharedDigest::Slot *slot = self->m_Slots + ((home + i) & self->m_SlotMask);
+        if (0 == LoadSequence(slot))
+            target = slot;
+    }
+    if (!target)
+        target = self->m_Slots + ((home + (home >> 30)) & self->m_SlotMask);
+
+    // Claim the slot by making its sequence number odd. If another writer holds it, drop the record.
+    const uint32_t sequence = LoadSequence(target);
+    if ((sequence & 1) || !AtomicCompareAndSwap(&target->m_Sequence, sequence, sequence + 1))
+        return;
+
+    target->m_Device = identity.m_Device;
+    target->m_Inode = identity.m_Inode;
+    target->m_Size = identity.m_Size;
+    target->m_ModifiedTime = identity.m_ModifiedTime;
+    target->m_ChangeTime = identity.m_ChangeTime;
+    target->m_Digest = digest;
+
+    AtomicFullBarrier();
+    *(volatile uint32_t *)&target->m_Sequence = sequence + 2;
+}
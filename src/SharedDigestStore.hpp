@@ -0,0 +1,62 @@
+#pragma once
+
+#include "Common.hpp"
+#include "Hash.hpp"
+
+struct FileIdentity;
+
+// Machine-wide table of content digests, shared by every checkout through a
+// memory mapped file. Records are keyed by file identity (device, inode, size,
+// mtime and ctime) rather than path, so identical files in different checkouts
+// share a record. The table has a fixed size and is a cache; colliding records
+// simply replace each other.
+namespace SharedDigest
+{
+    struct Header
+    {
+        static const uint32_t MagicNumber = 0x5d16e0a3 ^ kTundraHashMagic;
+
+        uint32_t m_MagicNumber;
+        uint32_t m_SlotCount;
+        uint32_t m_Reserved[14];
+    };
+    static_assert(sizeof(Header) == 64, "struct layout");
+
+    struct Slot
+    {
+        // Even when the slot is stable, odd while a process is writing it; zero if never written.
+        uint32_t m_Sequence;
+        uint32_t m_Padding;
+        uint64_t m_Device;
+        uint64_t m_Inode;
+        uint64_t m_Size;
+        uint64_t m_ModifiedTime;
+        uint64_t m_ChangeTime;
+        HashDigest m_Digest;
+    };
+}
+
+struct SharedDigestStore
+{
+    SharedDigest::Header *m_Header;
+    SharedDigest::Slot *m_Slots;
+    uint32_t m_SlotMask;
+    size_t m_MappingSize;
+    uintptr_t m_SysData[2];
+};
+
+void SharedDigestStoreInit(SharedDigestStore *self);
+
+// Open or create the store at the given path. Returns false, leaving the store disabled, on failure.
+bool SharedDigestStoreOpen(SharedDigestStore *self, const char *filename, uint32_t slot_count);
+
+void SharedDigestStoreDestroy(SharedDigestStore *self);
+
+inline bool SharedDigestStoreValid(const SharedDigestStore *self)
+{
+    return self->m_Slots != nullptr;
+}
+
+bool SharedDigestStoreGet(SharedDigestStore *self, const FileIdentity &identity, HashDigest *digest_out);
+
+void SharedDigestStoreSet(SharedDigestStore *self, const FileIdentity &identity, const HashDigest &digest);
@@ -11,6 +11,8 @@ struct TundraStats
     uint32_t m_ScanCacheInserts;
     uint64_t m_ScanCacheSaveTime;
     uint32_t m_ScanCacheEntriesDropped;
+    uint32_t m_ScanCacheJournalAppends;
+    uint32_t m_ScanCacheContentHits;
 
     uint32_t m_StateSaveNew;
     uint32_t m_StateSaveOld;
@@ -21,9 +23,13 @@ struct TundraStats
     uint64_t m_MmapTimeCycles;
     uint32_t m_MunmapCalls;
     uint64_t m_MunmapTimeCycles;
+    uint32_t m_DecompressCalls;
+    uint64_t m_DecompressTimeCycles;
 
     uint32_t m_GlobCount;
     uint64_t m_GlobTimeCycles;
+    uint32_t m_GlobListings;
+    uint32_t m_GlobCacheHits;
 
     uint32_t m_StatCount;
     uint64_t m_StatTimeCycles;
@@ -34,6 +40,7 @@ struct TundraStats
     uint64_t m_StaleCheckTimeCycles;
 
     uint32_t m_ExecCount;
+    uint32_t m_EarlyCutoffOutputs;
     uint64_t m_ExecTimeCycles;
 
     uint64_t m_JsonParseTimeCycles;
@@ -41,8 +48,12 @@ struct TundraStats
     uint64_t m_DigestCacheSaveTimeCycles;
     uint64_t m_DigestCacheGetTimeCycles;
     uint32_t m_DigestCacheHits;
+    uint32_t m_DigestCacheEntriesDropped;
+    uint32_t m_DigestXattrHits;
+    uint32_t m_SharedDigestStoreHits;
     uint32_t m_FileDigestCount;
     uint64_t m_FileDigestTimeCycles;
+    uint32_t m_FileDigestHelperChunks;
 };
 
 struct TimingScope
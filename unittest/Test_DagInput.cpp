@@ -0,0 +1,424 @@
+#include "DagInputWriter.hpp"
+#include "DagGenerator.hpp"
+#include "DagData.hpp"
+#include "MemAllocHeap.hpp"
+#include "MemoryMappedFile.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+
+
+class DagInputTest : public ::testing::Test
+{
+protected:
+  MemAllocHeap heap;
+  DagInputWriter writer;
+  MemoryMappedFile json_dag;
+  MemoryMappedFile binary_dag;
+
+  static const char* JsonFileName() { return "test_daginput.json.tmp"; }
+  static const char* BinaryFileName() { return "test_daginput.bin.tmp"; }
+  static const char* JsonDagFileName() { return "test_daginput_json.dag.tmp"; }
+  static const char* BinaryDagFileName() { return "test_daginput_bin.dag.tmp"; }
+
+protected:
+  void SetUp() override
+  {
+    HeapInit(&heap);
+    DagInputWriterInit(&writer, &heap);
+    MmapFileInit(&json_dag);
+    MmapFileInit(&binary_dag);
+  }
+
+  void TearDown() override
+  {
+    MmapFileDestroy(&binary_dag);
+    MmapFileDestroy(&json_dag);
+    remove(JsonFileName());
+    remove(BinaryFileName());
+    remove(JsonDagFileName());
+    remove(BinaryDagFileName());
+    DagInputWriterDestroy(&writer);
+    HeapDestroy(&heap);
+  }
+
+  static void WriteTextFile(const char* filename, const char* text)
+  {
+    FILE* f = fopen(filename, "wb");
+    ASSERT_TRUE(f != nullptr);
+    fwrite(text, 1, strlen(text), f);
+    fclose(f);
+  }
+
+  const Frozen::Dag* MapDag(MemoryMappedFile* mapping, const char* filename)
+  {
+    MmapFileMapFrozen(mapping, filename);
+    EXPECT_TRUE(MmapFileValid(mapping));
+    const Frozen::Dag* dag = (const Frozen::Dag*)mapping->m_Address;
+    EXPECT_TRUE(Frozen::Dag::MagicNumber == dag->m_MagicNumber);
+    return dag;
+  }
+};
+
+static void ExpectSameFiles(const FrozenArray<Frozen::DagFile>& a, const FrozenArray<Frozen::DagFile>& b)
+{
+  ASSERT_EQ(a.GetCount(), b.GetCount());
+  for (int32_t i = 0; i < a.GetCount(); ++i)
+  {
+    EXPECT_STREQ(a[i].m_Filename, b[i].m_Filename);
+    EXPECT_EQ(a[i].m_FilenameHash, b[i].m_FilenameHash);
+  }
+}
+
+static void ExpectSameDag(const Frozen::Dag* expected, const Frozen::Dag* actual)
+{
+  ASSERT_EQ(expected->m_HashedIdentifier, actual->m_HashedIdentifier);
+  ASSERT_EQ(expected->m_NodeCount, actual->m_NodeCount);
+  ASSERT_EQ(1, actual->m_DefaultNodes.GetCount());
+  ASSERT_EQ(expected->m_DefaultNodes[0], actual->m_DefaultNodes[0]);
+  ASSERT_EQ(1, actual->m_NamedNodes.GetCount());
+  ASSERT_EQ(expected->m_NamedNodes[0].m_NodeIndex, actual->m_NamedNodes[0].m_NodeIndex);
+
+  for (int32_t i = 0; i < actual->m_NodeCount; ++i)
+  {
+    const Frozen::DagNode& e = expected->m_DagNodes[i];
+    const Frozen::DagNode& n = actual->m_DagNodes[i];
+
+    EXPECT_TRUE(expected->m_NodeGuids[i] == actual->m_NodeGuids[i]);
+    EXPECT_STREQ(e.m_Action, n.m_Action);
+    EXPECT_STREQ(e.m_Annotation, n.m_Annotation);
+    EXPECT_EQ(e.m_Flags, n.m_Flags);
+    EXPECT_EQ(e.m_OriginalIndex, n.m_OriginalIndex);
+
+    const DagNodeIndices e_deps = DagNodeDependencies(expected, i);
+    const DagNodeIndices n_deps = DagNodeDependencies(actual, i);
+    ASSERT_EQ(e_deps.GetCount(), n_deps.GetCount());
+    for (int32_t d = 0; d < n_deps.GetCount(); ++d)
+      EXPECT_EQ(e_deps.m_Begin[d], n_deps.m_Begin[d]);
+
+    const DagNodeIndices e_links = DagNodeBackLinks(expected, i);
+    const DagNodeIndices n_links = DagNodeBackLinks(actual, i);
+    ASSERT_EQ(e_links.GetCount(), n_links.GetCount());
+    for (int32_t d = 0; d < n_links.GetCount(); ++d)
+      EXPECT_EQ(e_links.m_Begin[d], n_links.m_Begin[d]);
+
+    EXPECT_EQ(expected->m_NodePriorities[i], actual->m_NodePriorities[i]);
+
+    ExpectSameFiles(e.m_InputFiles, n.m_InputFiles);
+    ExpectSameFiles(e.m_OutputFiles, n.m_OutputFiles);
+
+    ASSERT_EQ(e.m_EnvVars.GetCount(), n.m_EnvVars.GetCount());
+    for (int32_t v = 0; v < n.m_EnvVars.GetCount(); ++v)
+    {
+      EXPECT_STREQ(e.m_EnvVars[v].m_Name, n.m_EnvVars[v].m_Name);
+      EXPECT_STREQ(e.m_EnvVars[v].m_Value, n.m_EnvVars[v].m_Value);
+    }
+
+    ASSERT_EQ(e.m_AllowedOutputSubstrings.GetCount(), n.m_AllowedOutputSubstrings.GetCount());
+    for (int32_t s = 0; s < n.m_AllowedOutputSubstrings.GetCount(); ++s)
+      EXPECT_STREQ(e.m_AllowedOutputSubstrings[s], n.m_AllowedOutputSubstrings[s]);
+  }
+}
+
+TEST_F(DagInputTest, BinaryInputMatchesJson)
+{
+  WriteTextFile(JsonFileName(),
+    "{\"Identifier\": \"test\", \"Nodes\": ["
+    "{\"Action\": \"cc -c a.c\", \"Annotation\": \"Compile a\", \"Inputs\": [\"a.c\"], \"Outputs\": [\"a.o\"],"
+    " \"Env\": [{\"Key\": \"CC\", \"Value\": \"gcc\"}]},"
+    "{\"Action\": \"cc -c b.c\", \"Annotation\": \"Compile b\", \"Inputs\": [\"./b.c\"], \"Outputs\": [\"b.o\"], \"PreciousOutputs\": true},"
+    "{\"Action\": \"ld -o prog a.o b.o\", \"Annotation\": \"Link\", \"Deps\": [0, 1], \"Inputs\": [\"a.o\", \"b.o\"], \"Outputs\": [\"prog\"],"
+    " \"AllowedOutputSubstrings\": [\"warning\"]}"
+    "], \"NamedNodes\": {\"prog\": 2}, \"DefaultNodes\": [2]}");
+
+  const char* a_inputs[] = { "a.c" };
+  const char* a_outputs[] = { "a.o" };
+  const DagInputEnvVar a_env[] = { { "CC", "gcc" } };
+  const char* b_inputs[] = { "./b.c" };
+  const char* b_outputs[] = { "b.o" };
+  const int32_t link_deps[] = { 0, 1 };
+  const char* link_inputs[] = { "a.o", "b.o" };
+  const char* link_outputs[] = { "prog" };
+  const char* link_substrings[] = { "warning" };
+
+  DagInputNode node;
+  memset(&node, 0, sizeof node);
+  node.m_ScannerIndex = -1;
+  node.m_Flags = Frozen::DagNode::kFlagOverwriteOutputs;
+
+  DagInputNode a = node;
+  a.m_Action = "cc -c a.c";
+  a.m_Annotation = "Compile a";
+  a.m_Inputs = { a_inputs, 1 };
+  a.m_Outputs = { a_outputs, 1 };
+  a.m_Env = { a_env, 1 };
+  ASSERT_EQ(0, DagInputWriterAddNode(&writer, a));
+
+  DagInputNode b = node;
+  b.m_Action = "cc -c b.c";
+  b.m_Annotation = "Compile b";
+  b.m_Inputs = { b_inputs, 1 };
+  b.m_Outputs = { b_outputs, 1 };
+  b.m_Flags |= Frozen::DagNode::kFlagPreciousOutputs;
+  ASSERT_EQ(1, DagInputWriterAddNode(&writer, b));
+
+  DagInputNode link = node;
+  link.m_Action = "ld -o prog a.o b.o";
+  link.m_Annotation = "Link";
+  link.m_Deps = { link_deps, 2 };
+  link.m_Inputs = { link_inputs, 2 };
+  link.m_Outputs = { link_outputs, 1 };
+  link.m_AllowedOutputSubstrings = { link_substrings, 1 };
+  ASSERT_EQ(2, DagInputWriterAddNode(&writer, link));
+
+  DagInputWriterSetRoot(&writer, "{\"Identifier\": \"test\", \"NamedNodes\": {\"prog\": 2}, \"DefaultNodes\": [2]}");
+  ASSERT_TRUE(DagInputWriterFlush(&writer, BinaryFileName()));
+
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), JsonDagFileName(), 1, false));
+  ASSERT_TRUE(FreezeDagBinary(BinaryFileName(), BinaryDagFileName(), 2, false));
+
+  const Frozen::Dag* expected = MapDag(&json_dag, JsonDagFileName());
+  const Frozen::Dag* actual = MapDag(&binary_dag, BinaryDagFileName());
+
+  ExpectSameDag(expected, actual);
+  ASSERT_EQ(3, actual->m_NodeCount);
+}
+
+TEST_F(DagInputTest, RejectsBadInput)
+{
+  const int32_t bad_deps[] = { 7 };
+
+  DagInputNode node;
+  memset(&node, 0, sizeof node);
+  node.m_Action = "touch out";
+  node.m_ScannerIndex = -1;
+  node.m_Deps = { bad_deps, 1 };
+  DagInputWriterAddNode(&writer, node);
+  ASSERT_TRUE(DagInputWriterFlush(&writer, BinaryFileName()));
+
+  ASSERT_FALSE(FreezeDagBinary(BinaryFileName(), BinaryDagFileName(), 1, false));
+
+  // The root can't carry nodes of its own.
+  DagInputWriterSetRoot(&writer, "{\"Nodes\": []}");
+  writer.m_Nodes[0].m_Deps.m_Count = 0;
+  ASSERT_TRUE(DagInputWriterFlush(&writer, BinaryFileName()));
+  ASSERT_FALSE(FreezeDagBinary(BinaryFileName(), BinaryDagFileName(), 1, false));
+
+  WriteTextFile(BinaryFileName(), "not a binary DAG input file at all, just text that is long enough to hold a header");
+  ASSERT_FALSE(FreezeDagBinary(BinaryFileName(), BinaryDagFileName(), 1, false));
+}
+
+TEST_F(DagInputTest, WriteTextFileFlagFollowsPayload)
+{
+  const char* outputs[] = { "out.txt" };
+
+  DagInputNode node;
+  memset(&node, 0, sizeof node);
+  node.m_Action = "touch out.txt";
+  node.m_ScannerIndex = -1;
+  node.m_Outputs = { outputs, 1 };
+  node.m_Flags = Frozen::DagNode::kFlagPreciousOutputs | Frozen::DagNode::kFlagIsWriteTextFileAction;
+  DagInputWriterAddNode(&writer, node);
+  DagInputWriterSetRoot(&writer, "{\"Identifier\": \"test\", \"DefaultNodes\": [0]}");
+  ASSERT_TRUE(DagInputWriterFlush(&writer, BinaryFileName()));
+
+  // Without a payload, the node stays a regular action.
+  ASSERT_TRUE(FreezeDagBinary(BinaryFileName(), BinaryDagFileName(), 1, false));
+  const Frozen::Dag* dag = MapDag(&binary_dag, BinaryDagFileName());
+  ASSERT_EQ(uint32_t(Frozen::DagNode::kFlagPreciousOutputs), dag->m_DagNodes[0].m_Flags);
+
+  // A payload needs an output to be written to.
+  writer.m_Nodes[0].m_WriteTextFilePayload = writer.m_Nodes[0].m_Action;
+  writer.m_Nodes[0].m_Outputs.m_Count = 0;
+  ASSERT_TRUE(DagInputWriterFlush(&writer, BinaryFileName()));
+  ASSERT_FALSE(FreezeDagBinary(BinaryFileName(), JsonDagFileName(), 1, false));
+}
+
+// A chain of compile nodes; when changed, node 10 gets a new action and depends on node 3 rather than node 9.
+static std::string ChainJson(int node_count, bool changed)
+{
+  std::string json = "{\"Identifier\": \"test\", \"Nodes\": [";
+  for (int i = 0; i < node_count; ++i)
+  {
+    char deps[32] = "";
+    if (i > 0)
+      snprintf(deps, sizeof deps, ", \"Deps\": [%d]", changed && 10 == i ? 3 : i - 1);
+
+    char node[256];
+    snprintf(node, sizeof node,
+      "%s{\"Action\": \"cc -c f%d.c%s\", \"Annotation\": \"Compile %d\", \"Inputs\": [\"f%d.c\"], \"Outputs\": [\"f%d.o\"]%s}",
+      i ? ", " : "", i, changed && 10 == i ? " -O2" : "", i, i, i, deps);
+    json += node;
+  }
+
+  char tail[128];
+  snprintf(tail, sizeof tail, "], \"NamedNodes\": {\"last\": %d}, \"DefaultNodes\": [%d]}", node_count - 1, node_count - 1);
+  return json + tail;
+}
+
+TEST_F(DagInputTest, IncrementalRecompileMatchesFull)
+{
+  WriteTextFile(JsonFileName(), ChainJson(32, false).c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 1, true));
+
+  // One node changed: only that node is written again.
+  WriteTextFile(JsonFileName(), ChainJson(32, true).c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 2, true));
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), JsonDagFileName(), 1, false));
+
+  const Frozen::Dag* expected = MapDag(&json_dag, JsonDagFileName());
+  const Frozen::Dag* actual = MapDag(&binary_dag, BinaryDagFileName());
+  ASSERT_EQ(0, expected->m_IncrementalCompileCount);
+  ASSERT_EQ(1, actual->m_IncrementalCompileCount);
+  ExpectSameDag(expected, actual);
+  MmapFileUnmap(&binary_dag);
+  MmapFileUnmap(&json_dag);
+
+  // A new node means a full compile.
+  WriteTextFile(JsonFileName(), ChainJson(33, true).c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 1, true));
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), JsonDagFileName(), 1, false));
+
+  expected = MapDag(&json_dag, JsonDagFileName());
+  actual = MapDag(&binary_dag, BinaryDagFileName());
+  ASSERT_EQ(0, actual->m_IncrementalCompileCount);
+  ExpectSameDag(expected, actual);
+}
+
+TEST_F(DagInputTest, RecompilesKeepUnreferencedDataBounded)
+{
+  WriteTextFile(JsonFileName(), ChainJson(200, false).c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 1, true));
+
+  const Frozen::Dag* dag = MapDag(&binary_dag, BinaryDagFileName());
+  ASSERT_EQ(0, dag->m_IncrementalCompileCount);
+  ASSERT_EQ(binary_dag.m_Size, dag->m_CompactSize);
+  const uint32_t compact_size = dag->m_CompactSize;
+  MmapFileUnmap(&binary_dag);
+
+  // Every recompile leaves data behind, so the DAG is written in full again long before the compile count limit.
+  bool compacted = false;
+  for (int i = 1; i <= 4; ++i)
+  {
+    WriteTextFile(JsonFileName(), ChainJson(200, i & 1).c_str());
+    ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 1, true));
+
+    dag = MapDag(&binary_dag, BinaryDagFileName());
+    EXPECT_LE(binary_dag.m_Size, compact_size + compact_size / 3);
+    compacted = compacted || 0 == dag->m_IncrementalCompileCount;
+    MmapFileUnmap(&binary_dag);
+  }
+  EXPECT_TRUE(compacted);
+}
+
+TEST_F(DagInputTest, CompressedDagMatchesPlain)
+{
+  std::string json = ChainJson(2000, false);
+  json.insert(1, "\"CompressFilesAboveKb\": 1, ");
+  WriteTextFile(JsonFileName(), json.c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 1, false));
+
+  // The previous DAG is read back to be patched.
+  json = ChainJson(2000, true);
+  json.insert(1, "\"CompressFilesAboveKb\": 1, ");
+  WriteTextFile(JsonFileName(), json.c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), BinaryDagFileName(), 1, true));
+
+  WriteTextFile(JsonFileName(), ChainJson(2000, true).c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), JsonDagFileName(), 1, false));
+
+  MemoryMappedFile raw;
+  MmapFileInit(&raw);
+  MmapFileMap(&raw, BinaryDagFileName());
+  ASSERT_TRUE(MmapFileValid(&raw));
+  EXPECT_TRUE(Frozen::CompressedFileHeader::MagicNumber == *(const uint32_t*)raw.m_Address);
+  const size_t compressed_size = raw.m_Size;
+  MmapFileDestroy(&raw);
+
+  const Frozen::Dag* expected = MapDag(&json_dag, JsonDagFileName());
+  const Frozen::Dag* actual = MapDag(&binary_dag, BinaryDagFileName());
+  EXPECT_GT(json_dag.m_Size, compressed_size);
+  EXPECT_EQ(0, expected->m_CompressFilesAboveKb);
+  EXPECT_EQ(1, actual->m_CompressFilesAboveKb);
+  EXPECT_EQ(1, actual->m_IncrementalCompileCount);
+  ExpectSameDag(expected, actual);
+}
+
+TEST_F(DagInputTest, NodeLinksAndPriorities)
+{
+  WriteTextFile(JsonFileName(), ChainJson(8, false).c_str());
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), JsonDagFileName(), 1, false));
+
+  const Frozen::Dag* dag = MapDag(&json_dag, JsonDagFileName());
+  ASSERT_EQ(8, dag->m_NodeCount);
+  ASSERT_EQ(7, dag->m_Dependencies.GetCount());
+  ASSERT_EQ(7, dag->m_BackLinks.GetCount());
+  EXPECT_EQ(0, dag->m_DependencyOffsets[0]);
+  EXPECT_EQ(7, dag->m_DependencyOffsets[8]);
+  EXPECT_EQ(7, dag->m_BackLinkOffsets[8]);
+
+  for (int32_t i = 0; i < dag->m_NodeCount; ++i)
+  {
+    // Compile k depends on compile k - 1, so it is the k-th node from the start of the chain.
+    const uint32_t k = dag->m_DagNodes[i].m_OriginalIndex;
+    EXPECT_EQ(int32_t(8 - k), dag->m_NodePriorities[i]);
+
+    const DagNodeIndices deps = DagNodeDependencies(dag, i);
+    ASSERT_EQ(k ? 1 : 0, deps.GetCount());
+    for (int32_t dep : deps)
+    {
+      EXPECT_EQ(k - 1, dag->m_DagNodes[dep].m_OriginalIndex);
+
+      const DagNodeIndices links = DagNodeBackLinks(dag, dep);
+      ASSERT_EQ(1, links.GetCount());
+      EXPECT_EQ(i, links.m_Begin[0]);
+    }
+  }
+}
+
+TEST_F(DagInputTest, PathsAreStoredOnce)
+{
+  WriteTextFile(JsonFileName(),
+    "{\"Identifier\": \"test\", \"Nodes\": ["
+    "{\"Action\": \"cc -c src/a.c\", \"Annotation\": \"Compile a\", \"Inputs\": [\"src/a.c\"], \"Outputs\": [\"obj/a.o\"]},"
+    "{\"Action\": \"cc -c src/b.c\", \"Annotation\": \"Compile b\", \"Inputs\": [\"src//b.c\"], \"Outputs\": [\"obj/b.o\"]},"
+    "{\"Action\": \"ld -o prog\", \"Annotation\": \"Link\", \"Deps\": [0, 1], \"Inputs\": [\"obj/a.o\", \"./obj/b.o\"], \"Outputs\": [\"prog\"]}"
+    "], \"NamedNodes\": {\"prog\": 2}, \"DefaultNodes\": [2]}");
+
+  ASSERT_TRUE(FreezeDagJson(JsonFileName(), JsonDagFileName(), 2, false));
+  const Frozen::Dag* dag = MapDag(&json_dag, JsonDagFileName());
+
+  // Five files and the two directories holding them.
+  ASSERT_EQ(7, dag->m_Paths.GetCount());
+
+  for (int32_t i = 0; i < dag->m_NodeCount; ++i)
+  {
+    const Frozen::DagNode& node = dag->m_DagNodes[i];
+    for (const Frozen::DagFile& file : node.m_InputFiles)
+    {
+      const Frozen::DagPath& path = dag->m_Paths[file.m_PathIndex];
+      EXPECT_EQ(file.m_Filename.Get(), path.m_Path.Get());
+      EXPECT_EQ(file.m_FilenameHash, path.m_PathHash);
+      EXPECT_EQ(file.m_PathIndex, DagFindPath(dag, file.m_Filename, file.m_FilenameHash));
+    }
+  }
+
+  const Frozen::DagNode& link = dag->m_DagNodes[dag->m_DefaultNodes[0]];
+  ASSERT_EQ(2, link.m_InputFiles.GetCount());
+  for (const Frozen::DagFile& input : link.m_InputFiles)
+  {
+    const Frozen::DagNode& compile = dag->m_DagNodes[DagNodeDependencies(dag, dag->m_DefaultNodes[0]).m_Begin[&input - link.m_InputFiles.begin()]];
+    ASSERT_EQ(1, compile.m_OutputFiles.GetCount());
+    EXPECT_EQ(compile.m_OutputFiles[0].m_PathIndex, input.m_PathIndex);
+
+    const Frozen::DagPath& path = dag->m_Paths[input.m_PathIndex];
+    ASSERT_NE(-1, path.m_Directory);
+    EXPECT_STREQ("obj", dag->m_Paths[path.m_Directory].m_Path);
+    EXPECT_EQ(-1, dag->m_Paths[path.m_Directory].m_Directory);
+  }
+
+  EXPECT_EQ(-1, DagFindPath(dag, "obj/c.o", Djb2HashPath("obj/c.o")));
+}
@@ -0,0 +1,190 @@
+#include "DigestCache.hpp"
+#include "Hash.hpp"
+#include "Stats.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+
+
+
+class DigestCacheTest : public ::testing::Test
+{
+protected:
+  MemAllocHeap heap;
+  DigestCache cache;
+
+  static const char* CacheFileName() { return "test_digestcache.tmp"; }
+  static const char* TempFileName() { return "test_digestcache.tmp.tmp"; }
+
+protected:
+  void SetUp() override
+  {
+    HeapInit(&heap);
+    remove(CacheFileName());
+    DigestCacheInit(&cache, MB(4), CacheFileName());
+  }
+
+  void TearDown() override
+  {
+    DigestCacheDestroy(&cache);
+    remove(CacheFileName());
+    HeapDestroy(&heap);
+  }
+
+  static void DigestFor(HashDigest* out, int i)
+  {
+    char contents[64];
+    snprintf(contents, sizeof contents, "contents of %d", i);
+    HashSingleString(out, contents);
+  }
+
+  void SetFile(int i, int generation)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "dir/file%d.cpp", i);
+    HashDigest digest;
+    DigestFor(&digest, i + generation);
+    DigestCacheSet(&cache, name, Djb2HashPath(name), 1000 + generation, digest);
+  }
+
+  void SaveAndReload()
+  {
+    ASSERT_TRUE(DigestCacheSave(&cache, &heap, CacheFileName(), TempFileName()));
+    DigestCacheDestroy(&cache);
+    DigestCacheInit(&cache, MB(4), CacheFileName());
+    ASSERT_NE(nullptr, cache.m_State);
+  }
+};
+
+TEST_F(DigestCacheTest, FrozenIndexFindsAllRecords)
+{
+  const int count = 1000;
+  for (int i = 0; i < count; ++i)
+    SetFile(i, 0);
+
+  SaveAndReload();
+
+  const Frozen::DigestCacheState* state = cache.m_State;
+  ASSERT_EQ(count, state->m_Records.GetCount());
+  ASSERT_GE(state->m_IndexSize, uint32_t(count));
+  ASSERT_EQ(0u, state->m_IndexSize & (state->m_IndexSize - 1));
+
+  for (int i = 0; i < count; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "dir/file%d.cpp", i);
+    const Frozen::DigestRecord* r = DigestCacheFindFrozen(state, name, Djb2HashPath(name));
+    ASSERT_NE(nullptr, r);
+    ASSERT_STREQ(name, r->m_Filename.Get());
+
+    HashDigest expected;
+    DigestFor(&expected, i);
+    ASSERT_TRUE(expected == r->m_ContentDigest);
+  }
+
+  ASSERT_EQ(nullptr, DigestCacheFindFrozen(state, "not-there.cpp", Djb2HashPath("not-there.cpp")));
+}
+
+TEST_F(DigestCacheTest, HasChangedComparesAgainstFrozenState)
+{
+  SetFile(1, 0);
+  SetFile(2, 0);
+  SaveAndReload();
+
+  ASSERT_FALSE(DigestCacheHasChanged(&cache, "dir/file1.cpp", Djb2HashPath("dir/file1.cpp")));
+
+  SetFile(1, 1);
+  ASSERT_TRUE(DigestCacheHasChanged(&cache, "dir/file1.cpp", Djb2HashPath("dir/file1.cpp")));
+  ASSERT_FALSE(DigestCacheHasChanged(&cache, "dir/file2.cpp", Djb2HashPath("dir/file2.cpp")));
+
+  SetFile(3, 0);
+  ASSERT_TRUE(DigestCacheHasChanged(&cache, "dir/file3.cpp", Djb2HashPath("dir/file3.cpp")));
+  ASSERT_FALSE(DigestCacheHasChanged(&cache, "dir/file4.cpp", Djb2HashPath("dir/file4.cpp")));
+}
+
+TEST_F(DigestCacheTest, LookupsProbeFrozenStateWithOverlay)
+{
+  const int count = 100;
+  for (int i = 0; i < count; ++i)
+    SetFile(i, 0);
+
+  SaveAndReload();
+
+  // Nothing is copied out of the mapped file at startup.
+  ASSERT_EQ(0u, cache.m_Table.m_RecordCount);
+
+  HashDigest digest, expected;
+  ASSERT_TRUE(DigestCacheGet(&cache, "dir/file5.cpp", Djb2HashPath("dir/file5.cpp"), 1000, &digest));
+  DigestFor(&expected, 5);
+  ASSERT_TRUE(expected == digest);
+  ASSERT_FALSE(DigestCacheGet(&cache, "dir/file5.cpp", Djb2HashPath("dir/file5.cpp"), 1001, &digest));
+
+  // Updates go to the overlay and shadow the frozen record.
+  SetFile(5, 1);
+  ASSERT_EQ(1u, cache.m_Table.m_RecordCount);
+  ASSERT_FALSE(DigestCacheGet(&cache, "dir/file5.cpp", Djb2HashPath("dir/file5.cpp"), 1000, &digest));
+  ASSERT_TRUE(DigestCacheGet(&cache, "dir/file5.cpp", Djb2HashPath("dir/file5.cpp"), 1001, &digest));
+  DigestFor(&expected, 6);
+  ASSERT_TRUE(expected == digest);
+
+  SetFile(count, 0);
+
+  // Saving merges the overlay with the untouched frozen records.
+  SaveAndReload();
+  ASSERT_EQ(count + 1, cache.m_State->m_Records.GetCount());
+  ASSERT_TRUE(DigestCacheGet(&cache, "dir/file5.cpp", Djb2HashPath("dir/file5.cpp"), 1001, &digest));
+  ASSERT_TRUE(expected == digest);
+  ASSERT_TRUE(DigestCacheGet(&cache, "dir/file42.cpp", Djb2HashPath("dir/file42.cpp"), 1000, &digest));
+  ASSERT_TRUE(DigestCacheGet(&cache, "dir/file100.cpp", Djb2HashPath("dir/file100.cpp"), 1000, &digest));
+}
+
+TEST_F(DigestCacheTest, SaveEvictsLeastRecentlyUsedRecords)
+{
+  const uint64_t now = cache.m_AccessTime;
+
+  cache.m_AccessTime = now - 100;
+  for (int i = 0; i < 5; ++i)
+    SetFile(i, 0);
+
+  cache.m_AccessTime = now;
+  for (int i = 5; i < 10; ++i)
+    SetFile(i, 0);
+
+  const uint32_t dropped_before = g_Stats.m_DigestCacheEntriesDropped;
+  DigestCacheSetRetention(&cache, 7, 6);
+  SaveAndReload();
+
+  ASSERT_EQ(6, cache.m_State->m_Records.GetCount());
+  ASSERT_EQ(4u, g_Stats.m_DigestCacheEntriesDropped - dropped_before);
+
+  HashDigest digest;
+  for (int i = 5; i < 10; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "dir/file%d.cpp", i);
+    ASSERT_TRUE(DigestCacheGet(&cache, name, Djb2HashPath(name), 1000, &digest));
+  }
+}
+
+TEST_F(DigestCacheTest, CompressedCacheReadsBack)
+{
+  const int count = 5000;
+  for (int i = 0; i < count; ++i)
+    SetFile(i, 0);
+
+  DigestCacheSetCompressThreshold(&cache, 1);
+  const uint32_t decompress_calls = g_Stats.m_DecompressCalls;
+  SaveAndReload();
+  EXPECT_EQ(decompress_calls + 1, g_Stats.m_DecompressCalls);
+
+  ASSERT_EQ(count, cache.m_State->m_Records.GetCount());
+  for (int i = 0; i < count; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "dir/file%d.cpp", i);
+    HashDigest expected, actual;
+    DigestFor(&expected, i);
+    ASSERT_TRUE(DigestCacheGet(&cache, name, Djb2HashPath(name), 1000, &actual));
+    ASSERT_TRUE(expected == actual);
+  }
+}
@@ -0,0 +1,133 @@
+#include "Driver.hpp"
+#include "DagGenerator.hpp"
+#include "DagData.hpp"
+#include "AllBuiltNodes.hpp"
+#include "RunAction.hpp"
+#include "FileInfo.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+
+
+class EarlyCutoffTest : public ::testing::Test
+{
+protected:
+  Driver driver;
+
+  static const char* JsonFileName() { return "test_earlycutoff.json.tmp"; }
+  static const char* DagFileName() { return "test_earlycutoff.dag.tmp"; }
+  static const char* StateFileName() { return "test_earlycutoff.state.tmp"; }
+  static const char* OutputName() { return "test_earlycutoff_out.tmp"; }
+
+protected:
+  void SetUp() override
+  {
+    WriteFile(JsonFileName(),
+      "{\"Identifier\": \"test\", \"StateFileName\": \"test_earlycutoff.state.tmp\","
+      " \"StateFileNameTmp\": \"test_earlycutoff.state.tmp.tmp\", \"Nodes\": ["
+      "{\"Action\": \"gen\", \"Annotation\": \"Gen\", \"Outputs\": [\"test_earlycutoff_out.tmp\"], \"EarlyCutoff\": true}"
+      "], \"DefaultNodes\": [0]}");
+
+    memset(&driver, 0, sizeof driver);
+    HeapInit(&driver.m_Heap);
+    LinearAllocInit(&driver.m_Allocator, &driver.m_Heap, MB(1), "early cutoff test alloc");
+    BufferInit(&driver.m_RuntimeNodes);
+    MmapFileInit(&driver.m_DagFile);
+    MmapFileInit(&driver.m_StateFile);
+
+    ASSERT_TRUE(FreezeDagJson(JsonFileName(), DagFileName(), 1, false));
+    MmapFileMapFrozen(&driver.m_DagFile, DagFileName());
+    ASSERT_TRUE(MmapFileValid(&driver.m_DagFile));
+    driver.m_DagData = (const Frozen::Dag*)driver.m_DagFile.m_Address;
+  }
+
+  void TearDown() override
+  {
+    MmapFileDestroy(&driver.m_StateFile);
+    MmapFileDestroy(&driver.m_DagFile);
+    BufferDestroy(&driver.m_RuntimeNodes, &driver.m_Heap);
+    LinearAllocDestroy(&driver.m_Allocator);
+    HeapDestroy(&driver.m_Heap);
+    remove(JsonFileName());
+    remove(DagFileName());
+    remove(StateFileName());
+    remove(OutputName());
+  }
+
+  static void WriteFile(const char* fn, const char* contents)
+  {
+    FILE* f = fopen(fn, "wb");
+    ASSERT_NE(nullptr, f);
+    fputs(contents, f);
+    fclose(f);
+  }
+
+  static void WriteOutput(const char* contents, uint64_t timestamp)
+  {
+    WriteFile(OutputName(), contents);
+    ASSERT_TRUE(SetFileTimestamp(OutputName(), timestamp));
+  }
+
+  // Pretend the node ran, save the build state and load it back the way the next build would.
+  const Frozen::BuiltNode* Run(bool early_cutoff)
+  {
+    const Frozen::BuiltNode* previous = driver.m_AllBuiltNodes ? &driver.m_AllBuiltNodes->m_BuiltNodes[0] : nullptr;
+
+    RuntimeNode node;
+    memset(&node, 0, sizeof node);
+    node.m_DagNode = &driver.m_DagData->m_DagNodes[0];
+    node.m_BuiltNode = previous;
+    node.m_BuildResult = NodeBuildResult::kRanSuccesfully;
+
+    if (early_cutoff)
+    {
+      node.m_OutputDigests = HeapAllocateArray<Frozen::NodeOutputDigest>(&driver.m_Heap, 1);
+      ComputeEarlyCutoffDigests(node.m_DagNode, previous, node.m_OutputDigests);
+    }
+
+    BufferClear(&driver.m_RuntimeNodes);
+    BufferAppendOne(&driver.m_RuntimeNodes, &driver.m_Heap, node);
+    EXPECT_TRUE(DriverSaveAllBuiltNodes(&driver));
+    HeapFree(&driver.m_Heap, node.m_OutputDigests);
+
+    MmapFileMapFrozen(&driver.m_StateFile, StateFileName());
+    EXPECT_TRUE(MmapFileValid(&driver.m_StateFile));
+    driver.m_AllBuiltNodes = (const Frozen::AllBuiltNodes*)driver.m_StateFile.m_Address;
+    EXPECT_EQ(1, driver.m_AllBuiltNodes->m_NodeCount);
+    return &driver.m_AllBuiltNodes->m_BuiltNodes[0];
+  }
+};
+
+TEST_F(EarlyCutoffTest, IdenticalOutputGetsItsTimestampBack)
+{
+  WriteOutput("v1", 1000000);
+  const Frozen::BuiltNode* built = Run(true);
+  ASSERT_EQ(1, built->m_OutputDigests.GetCount());
+  ASSERT_EQ(1000000u, built->m_OutputDigests[0].m_Timestamp);
+
+  WriteOutput("v1", 2000000);
+  built = Run(true);
+  ASSERT_EQ(1000000u, GetFileInfo(OutputName()).m_Timestamp);
+  ASSERT_EQ(1000000u, built->m_OutputDigests[0].m_Timestamp);
+
+  WriteOutput("v2", 3000000);
+  built = Run(true);
+  ASSERT_EQ(3000000u, GetFileInfo(OutputName()).m_Timestamp);
+  ASSERT_EQ(3000000u, built->m_OutputDigests[0].m_Timestamp);
+}
+
+TEST_F(EarlyCutoffTest, RunWithoutCutoffDropsDigests)
+{
+  WriteOutput("v1", 1000000);
+  ASSERT_EQ(1, Run(true)->m_OutputDigests.GetCount());
+
+  // The digests described the outputs of the earlier run, not the ones just written.
+  WriteOutput("v2", 2000000);
+  ASSERT_EQ(0, Run(false)->m_OutputDigests.GetCount());
+
+  WriteOutput("v2", 3000000);
+  Run(true);
+  ASSERT_EQ(3000000u, GetFileInfo(OutputName()).m_Timestamp);
+}
@@ -0,0 +1,72 @@
+#include "FileSign.hpp"
+#include "FileInfo.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#if defined(TUNDRA_WIN32)
+#include <sys/utime.h>
+#else
+#include <utime.h>
+#endif
+
+
+
+class ExtendedTimestampTest : public ::testing::Test
+{
+protected:
+  static const char* FileName() { return "test_filesign.tmp"; }
+  static const char* TempFileName() { return "test_filesign.tmp.new"; }
+
+  void TearDown() override
+  {
+    FileSignSetExtendedTimestamps(false);
+    remove(FileName());
+    remove(TempFileName());
+  }
+
+  static void WriteFile(const char* fn, const char* contents, uint64_t mtime)
+  {
+    FILE* f = fopen(fn, "wb");
+    ASSERT_NE(nullptr, f);
+    fputs(contents, f);
+    fclose(f);
+
+    struct utimbuf times;
+    times.actime = (time_t)mtime;
+    times.modtime = (time_t)mtime;
+    ASSERT_EQ(0, utime(fn, &times));
+  }
+};
+
+TEST_F(ExtendedTimestampTest, NoticesRewriteWithPreservedMtime)
+{
+  WriteFile(FileName(), "hello", 1000000);
+  FileInfo before = GetFileInfo(FileName());
+
+  WriteFile(FileName(), "hello world", 1000000);
+  FileInfo after = GetFileInfo(FileName());
+
+  ASSERT_EQ(before.m_Timestamp, after.m_Timestamp);
+  ASSERT_EQ(FileSignatureTimestamp(before), FileSignatureTimestamp(after));
+
+  FileSignSetExtendedTimestamps(true);
+  ASSERT_NE(FileSignatureTimestamp(before), FileSignatureTimestamp(after));
+  ASSERT_EQ(FileSignatureTimestamp(after), FileSignatureTimestamp(GetFileInfo(FileName())));
+}
+
+TEST_F(ExtendedTimestampTest, NoticesReplacementWithSameSizeAndMtime)
+{
+  WriteFile(FileName(), "aaaa", 1000000);
+  FileInfo before = GetFileInfo(FileName());
+
+  WriteFile(TempFileName(), "bbbb", 1000000);
+  ASSERT_TRUE(RenameFile(TempFileName(), FileName()));
+  FileInfo after = GetFileInfo(FileName());
+
+  ASSERT_EQ(before.m_Timestamp, after.m_Timestamp);
+  ASSERT_EQ(before.m_Size, after.m_Size);
+
+  FileSignSetExtendedTimestamps(true);
+  ASSERT_NE(FileSignatureTimestamp(before), FileSignatureTimestamp(after));
+}
@@ -0,0 +1,151 @@
+#include "GlobCache.hpp"
+#include "FileSign.hpp"
+#include "FileInfo.hpp"
+#include "Hash.hpp"
+#include "Stats.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+#include <sys/stat.h>
+#if defined(TUNDRA_WIN32)
+#include <direct.h>
+#endif
+
+
+
+class GlobCacheTest : public ::testing::Test
+{
+protected:
+  MemAllocHeap heap;
+  MemAllocLinear scratch;
+  GlobCache cache;
+
+  static const char* CacheFileName() { return "test_globcache.tmp"; }
+  static const char* TempFileName() { return "test_globcache.tmp.tmp"; }
+  static const char* TreeName() { return "test_globcache_tree"; }
+
+protected:
+  void SetUp() override
+  {
+    HeapInit(&heap);
+    LinearAllocInit(&scratch, &heap, MB(1), "glob cache test scratch");
+    remove(CacheFileName());
+    DeleteDirectory(TreeName());
+    GlobCacheInit(&cache, MB(4), CacheFileName());
+  }
+
+  void TearDown() override
+  {
+    FileSignSetGlobCache(nullptr);
+    GlobCacheDestroy(&cache);
+    remove(CacheFileName());
+    DeleteDirectory(TreeName());
+    LinearAllocDestroy(&scratch);
+    HeapDestroy(&heap);
+  }
+
+  static void MakeDir(const char* path)
+  {
+#if defined(TUNDRA_WIN32)
+    ASSERT_EQ(0, _mkdir(path));
+#else
+    ASSERT_EQ(0, mkdir(path, 0755));
+#endif
+  }
+
+  static void WriteFile(const char* path)
+  {
+    FILE* f = fopen(path, "wb");
+    ASSERT_NE(nullptr, f);
+    fputs("x", f);
+    fclose(f);
+  }
+
+  HashDigest Glob(const char* filter, bool recurse)
+  {
+    return CalculateGlobSignatureFor(TreeName(), filter, recurse, &heap, &scratch);
+  }
+
+  static GlobCacheRecord Record(uint64_t time, const char* subdirs, uint32_t subdirs_size)
+  {
+    GlobCacheRecord r;
+    r.m_ModifiedTime = time;
+    r.m_ChangeTime = time + 1;
+    r.m_AccessTime = 0;
+    HashSingleString(&r.m_Digest, subdirs);
+    r.m_Subdirectories = subdirs;
+    r.m_SubdirectoriesSize = subdirs_size;
+    return r;
+  }
+};
+
+TEST_F(GlobCacheTest, RecordsSurviveSaveAndReload)
+{
+  const char* key = GlobCacheMakeKey(&scratch, "src/lib", "*.c");
+  GlobCacheSet(&cache, key, Djb2HashPath(key), Record(1000, "a\0bb\0", 5));
+
+  ASSERT_TRUE(GlobCacheSave(&cache, &heap, CacheFileName(), TempFileName()));
+  GlobCacheDestroy(&cache);
+  GlobCacheInit(&cache, MB(4), CacheFileName());
+
+  GlobCacheRecord r;
+  ASSERT_TRUE(GlobCacheGet(&cache, key, Djb2HashPath(key), 1000, 1001, &r));
+  ASSERT_EQ(5u, r.m_SubdirectoriesSize);
+  ASSERT_EQ(0, memcmp("a\0bb\0", r.m_Subdirectories, 5));
+  ASSERT_TRUE(r.m_Digest == Record(1000, "a\0bb\0", 5).m_Digest);
+
+  // The times must match, and the filter is part of the key.
+  ASSERT_FALSE(GlobCacheGet(&cache, key, Djb2HashPath(key), 1002, 1001, &r));
+  const char* other_key = GlobCacheMakeKey(&scratch, "src/lib", nullptr);
+  ASSERT_FALSE(GlobCacheGet(&cache, other_key, Djb2HashPath(other_key), 1000, 1001, &r));
+}
+
+TEST_F(GlobCacheTest, SignatureOnlyDependsOnMatchingPaths)
+{
+  MakeDir(TreeName());
+  MakeDir("test_globcache_tree/sub");
+  WriteFile("test_globcache_tree/sub/a.c");
+
+  HashDigest before = Glob("*.c", true);
+
+  // A directory without matches below it doesn't change a filtered glob.
+  MakeDir("test_globcache_tree/empty");
+  ASSERT_TRUE(before == Glob("*.c", true));
+  ASSERT_TRUE(before != Glob(nullptr, true));
+
+  WriteFile("test_globcache_tree/empty/b.c");
+  ASSERT_TRUE(before != Glob("*.c", true));
+}
+
+TEST_F(GlobCacheTest, UnchangedDirectoriesReuseListings)
+{
+  MakeDir(TreeName());
+  MakeDir("test_globcache_tree/sub");
+  WriteFile("test_globcache_tree/sub/a.c");
+
+  HashDigest uncached = Glob("*.c", true);
+
+  FileSignSetGlobCache(&cache);
+  ASSERT_TRUE(uncached == Glob("*.c", true));
+
+  // Plant a listing for the current times of the root; it is used instead of listing the directory.
+  FileIdentity identity;
+  ASSERT_TRUE(GetFileIdentity(TreeName(), &identity));
+  GlobCacheRecord planted = Record(identity.m_ModifiedTime, "", 0);
+  planted.m_ChangeTime = identity.m_ChangeTime;
+  const char* key = GlobCacheMakeKey(&scratch, TreeName(), "*.c");
+  GlobCacheSet(&cache, key, Djb2HashPath(key), planted);
+
+  uint32_t hits = g_Stats.m_GlobCacheHits;
+  ASSERT_TRUE(uncached != Glob("*.c", true));
+  ASSERT_EQ(hits + 1, g_Stats.m_GlobCacheHits);
+
+  // Adding an entry moves the times of the directory, so it is listed again. They
+  // may not move within the same second, so move them explicitly.
+  WriteFile("test_globcache_tree/b.c");
+  ASSERT_TRUE(SetFileTimestamp(TreeName(), 1000000));
+  FileSignSetGlobCache(nullptr);
+  HashDigest relisted = Glob("*.c", true);
+  FileSignSetGlobCache(&cache);
+  ASSERT_TRUE(relisted == Glob("*.c", true));
+}
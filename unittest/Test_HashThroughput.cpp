@@ -0,0 +1,190 @@
+#include "Hash.hpp"
+#include "FileSign.hpp"
+#include "MemAllocHeap.hpp"
+#include "Thread.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+#include <string.h>
+
+// Provided by the hash backends; not part of the public hashing API.
+void HashBlocks(const uint8_t *data, size_t block_count, HashStateImpl *state);
+void HashBlocksScalar(const uint8_t *data, size_t block_count, HashStateImpl *state);
+
+
+
+class HashThroughputTest : public ::testing::Test
+{
+protected:
+  MemAllocHeap heap;
+  uint8_t* data;
+  size_t size;
+
+protected:
+  void SetUp() override
+  {
+    HeapInit(&heap);
+    data = nullptr;
+    Fill(256 * 1024);
+  }
+
+  void TearDown() override
+  {
+    HeapFree(&heap, data);
+    HeapDestroy(&heap);
+  }
+
+  void Fill(size_t bytes)
+  {
+    HeapFree(&heap, data);
+    size = bytes;
+    data = (uint8_t*)HeapAllocate(&heap, size);
+    uint32_t x = 0x12345678;
+    for (size_t i = 0; i < size; ++i)
+    {
+      x = x * 1664525 + 1013904223;
+      data[i] = uint8_t(x >> 24);
+    }
+  }
+};
+
+TEST_F(HashThroughputTest, PiecewiseUpdateMatchesSingleUpdate)
+{
+  HashDigest whole, pieces;
+  HashState h;
+
+  HashInit(&h);
+  HashUpdate(&h, data, 100000);
+  HashFinalize(&h, &whole);
+
+  // Odd chunk sizes exercise the buffered path between direct block runs.
+  HashInit(&h);
+  size_t offset = 0, chunk = 1;
+  while (offset < 100000)
+  {
+    size_t n = chunk < 100000 - offset ? chunk : 100000 - offset;
+    HashUpdate(&h, data + offset, n);
+    offset += n;
+    chunk = chunk * 3 + 7;
+  }
+  HashFinalize(&h, &pieces);
+
+  ASSERT_TRUE(whole == pieces);
+}
+
+#if ENABLED(USE_FAST_HASH)
+TEST_F(HashThroughputTest, BlockBackends)
+{
+  const size_t block_count = size / 64;
+
+  HashState scalar, simd;
+  HashInit(&scalar);
+  HashInit(&simd);
+
+  HashBlocksScalar(data, block_count, &scalar.m_StateImpl);
+  HashBlocks(data, block_count, &simd.m_StateImpl);
+
+  ASSERT_EQ(0, memcmp(&scalar.m_StateImpl, &simd.m_StateImpl, sizeof scalar.m_StateImpl));
+}
+#endif
+
+static volatile bool s_StopHelpers;
+static const int kHelperCount = 3;
+static ThreadId s_Helpers[kHelperCount];
+
+static void NoWakeup(void*)
+{
+}
+
+static ThreadRoutineReturnType TUNDRA_STDCALL DigestHelperRoutine(void*)
+{
+  while (!s_StopHelpers)
+    FileSignHelpWithDigests();
+  return 0;
+}
+
+static void StartDigestHelpers()
+{
+  s_StopHelpers = false;
+  FileSignInitHelpers(NoWakeup, nullptr);
+  for (int i = 0; i < kHelperCount; ++i)
+    s_Helpers[i] = ThreadStart(DigestHelperRoutine, nullptr, "digest helper");
+}
+
+static void StopDigestHelpers()
+{
+  s_StopHelpers = true;
+  for (int i = 0; i < kHelperCount; ++i)
+    ThreadJoin(s_Helpers[i]);
+  FileSignDestroyHelpers();
+}
+
+static double MegabytesPerSecond(size_t bytes, uint64_t start_time)
+{
+  return bytes / (1024.0 * 1024.0) / TimerToSeconds(TimerGet() - start_time);
+}
+
+TEST_F(HashThroughputTest, TreeDigestWithHelpers)
+{
+  // Large inputs use the tree digest, which must not depend on who hashed the chunks.
+  Fill(32 * 1024 * 1024);
+
+  HashDigest flat, serial, parallel;
+
+  HashState h;
+  HashInit(&h);
+  HashUpdate(&h, data, size);
+  HashFinalize(&h, &flat);
+
+  ComputeContentDigest(&serial, data, size);
+
+  StartDigestHelpers();
+  ComputeContentDigest(&parallel, data, size);
+  StopDigestHelpers();
+
+  ASSERT_TRUE(flat != serial);
+  ASSERT_TRUE(serial == parallel);
+}
+
+// Times the block backends, HashUpdate and the tree digest. Run it with --gtest_also_run_disabled_tests.
+TEST_F(HashThroughputTest, DISABLED_Benchmark)
+{
+  Fill(64 * 1024 * 1024);
+  uint64_t t0;
+
+#if ENABLED(USE_FAST_HASH)
+  HashState scalar, simd;
+  HashInit(&scalar);
+  HashInit(&simd);
+
+  t0 = TimerGet();
+  HashBlocksScalar(data, size / 64, &scalar.m_StateImpl);
+  double scalar_mbs = MegabytesPerSecond(size, t0);
+
+  t0 = TimerGet();
+  HashBlocks(data, size / 64, &simd.m_StateImpl);
+  double simd_mbs = MegabytesPerSecond(size, t0);
+
+  printf("hash block throughput: scalar %.0f MB/s, %s %.0f MB/s\n", scalar_mbs, HashBackendName(), simd_mbs);
+#endif
+
+  HashDigest digest;
+  HashState h;
+  t0 = TimerGet();
+  HashInit(&h);
+  HashUpdate(&h, data, size);
+  HashFinalize(&h, &digest);
+  printf("HashUpdate throughput: %.0f MB/s\n", MegabytesPerSecond(size, t0));
+
+  t0 = TimerGet();
+  ComputeContentDigest(&digest, data, size);
+  double serial_mbs = MegabytesPerSecond(size, t0);
+
+  StartDigestHelpers();
+  t0 = TimerGet();
+  ComputeContentDigest(&digest, data, size);
+  double parallel_mbs = MegabytesPerSecond(size, t0);
+  StopDigestHelpers();
+
+  printf("tree digest throughput: serial %.0f MB/s, %d helpers %.0f MB/s\n", serial_mbs, kHelperCount, parallel_mbs);
+}
@@ -1,8 +1,14 @@
 #include "IncludeScanner.hpp"
 #include "MemAllocLinear.hpp"
 #include "MemAllocHeap.hpp"
+#include "MemoryMappedFile.hpp"
+#include "BinaryWriter.hpp"
+#include "DagGenerator.hpp"
+#include "DagData.hpp"
 #include "TestHarness.hpp"
 
+#include <stdio.h>
+
 
 
 class IncludeScannerTest : public ::testing::Test
@@ -114,3 +120,107 @@ TEST_F(IncludeScannerTest, MultiIncludes)
   ASSERT_EQ(true, incs->m_ShouldFollow);
   ASSERT_EQ(nullptr, incs->m_Next);
 }
+
+TEST_F(IncludeScannerTest, GenericKeywordTrie)
+{
+  // "inc" is a prefix of "include"; the earlier keyword in the list wins.
+  const char* keywords[] = { "include", "inc", "import" };
+  const int keyword_count = 3;
+  const char* fn = "test_keywordtrie.tmp";
+
+  BinaryWriter writer;
+  BinaryWriterInit(&writer, &heap);
+  BinarySegment* main_seg = BinaryWriterAddSegment(&writer);
+  BinarySegment* array_seg = BinaryWriterAddSegment(&writer);
+  BinarySegment* str_seg = BinaryWriterAddSegment(&writer);
+
+  BinarySegmentWriteInt32(main_seg, Frozen::ScannerType::kGeneric);
+  BinarySegmentWriteInt32(main_seg, 0);
+  BinarySegmentWriteNullPointer(main_seg);
+  memset(BinarySegmentAlloc(main_seg, sizeof(HashDigest)), 0, sizeof(HashDigest));
+  BinarySegmentWriteUint32(main_seg, Frozen::GenericScannerData::kFlagUseSeparators);
+  BinarySegmentWriteInt32(main_seg, keyword_count);
+  BinarySegmentWritePointer(main_seg, BinarySegmentPosition(array_seg));
+  for (int i = 0; i < keyword_count; ++i)
+  {
+    BinarySegmentWritePointer(array_seg, BinarySegmentPosition(str_seg));
+    BinarySegmentWriteStringData(str_seg, keywords[i]);
+    BinarySegmentWriteInt16(array_seg, (int16_t)strlen(keywords[i]));
+    BinarySegmentWriteUint8(array_seg, i == 1 ? 0 : 1);
+    BinarySegmentWriteUint8(array_seg, 0);
+  }
+  WriteKeywordTrie(main_seg, array_seg, keywords, keyword_count, &alloc);
+
+  ASSERT_TRUE(BinaryWriterFlush(&writer, fn));
+  BinaryWriterDestroy(&writer);
+
+  MemoryMappedFile mapping;
+  MmapFileInit(&mapping);
+  MmapFileMap(&mapping, fn);
+  ASSERT_TRUE(MmapFileValid(&mapping));
+  const Frozen::GenericScannerData* config = (const Frozen::GenericScannerData*)mapping.m_Address;
+
+  // Root plus "inc", "lude", "mport".
+  ASSERT_EQ(13, config->m_KeywordTrie.GetCount());
+
+  char data[] = "include \"a.h\"\n  inc <b.h>\nimport \"c.h\"\nimp \"d.h\"\nincludex \"e.h\"\n";
+  IncludeData* incs = ScanIncludesGeneric(data, &alloc, *config);
+
+  ASSERT_NE(nullptr, incs);
+  ASSERT_STREQ("a.h", incs->m_String);
+  ASSERT_EQ(false, incs->m_IsSystemInclude);
+  ASSERT_EQ(true, incs->m_ShouldFollow);
+
+  incs = incs->m_Next;
+  ASSERT_NE(nullptr, incs);
+  ASSERT_STREQ("b.h", incs->m_String);
+  ASSERT_EQ(true, incs->m_IsSystemInclude);
+  ASSERT_EQ(false, incs->m_ShouldFollow);
+
+  incs = incs->m_Next;
+  ASSERT_NE(nullptr, incs);
+  ASSERT_STREQ("c.h", incs->m_String);
+  ASSERT_EQ(nullptr, incs->m_Next);
+
+  MmapFileDestroy(&mapping);
+  remove(fn);
+}
+
+TEST_F(IncludeScannerTest, KeywordTrieWithEveryByte)
+{
+  // The widest a node can get: one child for every byte but NUL.
+  char storage[255][2];
+  const char* keywords[255];
+  for (int i = 0; i < 255; ++i)
+  {
+    storage[i][0] = char(i + 1);
+    storage[i][1] = '\0';
+    keywords[i] = storage[i];
+  }
+  const char* fn = "test_keywordtrie.tmp";
+
+  BinaryWriter writer;
+  BinaryWriterInit(&writer, &heap);
+  BinarySegment* main_seg = BinaryWriterAddSegment(&writer);
+  BinarySegment* array_seg = BinaryWriterAddSegment(&writer);
+  WriteKeywordTrie(main_seg, array_seg, keywords, 255, &alloc);
+  ASSERT_TRUE(BinaryWriterFlush(&writer, fn));
+  BinaryWriterDestroy(&writer);
+
+  MemoryMappedFile mapping;
+  MmapFileInit(&mapping);
+  MmapFileMap(&mapping, fn);
+  ASSERT_TRUE(MmapFileValid(&mapping));
+  const FrozenArray<Frozen::KeywordTrieNode>* trie = (const FrozenArray<Frozen::KeywordTrieNode>*)mapping.m_Address;
+
+  ASSERT_EQ(256, trie->GetCount());
+  ASSERT_EQ(255, (*trie)[0].m_ChildCount);
+  for (int i = 1; i < 256; ++i)
+  {
+    ASSERT_EQ(char(i), (*trie)[i].m_Char);
+    ASSERT_EQ(i - 1, (*trie)[i].m_KeywordIndex);
+  }
+
+  MmapFileDestroy(&mapping);
+  remove(fn);
+}
@@ -1,8 +1,13 @@
 #include "TestHarness.hpp"
 #include "JsonParse.hpp"
+#include "JsonStructuralIndex.hpp"
 #include "MemAllocLinear.hpp"
 #include "MemAllocHeap.hpp"
 
+#include <stdio.h>
+#include <string>
+#include <vector>
+
 
 
 class JsonTest : public ::testing::Test
@@ -150,3 +155,289 @@ TEST_F(JsonTest, Doubles)
   ASSERT_DOUBLE_EQ(array->m_Values[2]->AsNumber()->m_Number, -1.0e10);
   ASSERT_DOUBLE_EQ(array->m_Values[3]->AsNumber()->m_Number, 5e7);
 }
+
+TEST_F(JsonTest, Errors)
+{
+  const char* bad_inputs[] = { "[\"foo]", "[12abc]", "[true1]", "{\"a\" 1}", "[1 2]", "[1,]x" };
+
+  for (const char* bad : bad_inputs)
+  {
+    std::string indexed(bad), unindexed(bad);
+    ASSERT_EQ(nullptr, JsonParse(&indexed[0], &alloc, &scratch, error_msg)) << bad;
+    ASSERT_STRNE("", error_msg);
+    ASSERT_EQ(nullptr, JsonParseUnindexed(&unindexed[0], &alloc, &scratch, error_msg)) << bad;
+    ASSERT_STRNE("", error_msg);
+  }
+
+  char input[] = "{\n  \"a\": 1,\n  \"b\": nope\n}";
+  ASSERT_EQ(nullptr, JsonParse(input, &alloc, &scratch, error_msg));
+  ASSERT_NE(nullptr, strstr(error_msg, "3:"));
+}
+
+// Straightforward one byte at a time version of what the structural index computes.
+static std::vector<size_t> ReferenceStructuralOffsets(const std::string& doc)
+{
+  std::vector<size_t> result;
+  bool in_string = false, escape = false, prev_scalar = false;
+
+  for (size_t i = 0; i < doc.size(); ++i)
+  {
+    const char ch = doc[i];
+    const bool escaped = escape;
+    escape = !escaped && '\\' == ch;
+
+    if (in_string)
+    {
+      if ('"' == ch && !escaped)
+      {
+        result.push_back(i);
+        in_string = false;
+      }
+      continue;
+    }
+
+    bool scalar = false;
+    if ('"' == ch && !escaped)
+    {
+      result.push_back(i);
+      in_string = true;
+    }
+    else if (strchr("{}[]:,", ch))
+      result.push_back(i);
+    else if (!strchr(" \t\n\r", ch))
+    {
+      if (!prev_scalar)
+        result.push_back(i);
+      scalar = true;
+    }
+    prev_scalar = scalar;
+  }
+
+  return result;
+}
+
+TEST_F(JsonTest, StructuralIndexMatchesReference)
+{
+  const char alphabet[] = "\"\"\\\\{}[]:,  \n\tab1-";
+  uint32_t x = 0x2545f491;
+
+  for (int iteration = 0; iteration < 2000; ++iteration)
+  {
+    // Some documents span several refill batches.
+    x = x * 1664525 + 1013904223;
+    size_t length = (x >> 8) % (iteration % 10 ? 300 : 5000);
+
+    std::string doc;
+    for (size_t i = 0; i < length; ++i)
+    {
+      x = x * 1664525 + 1013904223;
+      doc += alphabet[(x >> 16) % (sizeof alphabet - 1)];
+    }
+
+    JsonStructuralIndex index;
+    JsonStructuralIndexInit(&index, doc.c_str(), doc.size());
+
+    std::vector<size_t> offsets;
+    for (size_t offset; (offset = JsonStructuralIndexNext(&index)) != doc.size();)
+      offsets.push_back(offset);
+
+    ASSERT_TRUE(ReferenceStructuralOffsets(doc) == offsets) << doc;
+  }
+}
+
+static bool JsonEqual(const JsonValue* a, const JsonValue* b)
+{
+  if (a->m_Type != b->m_Type)
+    return false;
+
+  switch (a->m_Type)
+  {
+  case JsonValue::kNull:
+    return true;
+  case JsonValue::kBoolean:
+    return a->GetBoolean() == b->GetBoolean();
+  case JsonValue::kNumber:
+    return a->GetNumber() == b->GetNumber();
+  case JsonValue::kString:
+    return 0 == strcmp(a->GetString(), b->GetString());
+  case JsonValue::kArray:
+    if (a->AsArray()->m_Count != b->AsArray()->m_Count)
+      return false;
+    for (size_t i = 0; i < a->AsArray()->m_Count; ++i)
+      if (!JsonEqual(a->Elem(i), b->Elem(i)))
+        return false;
+    return true;
+  case JsonValue::kObject:
+    if (a->AsObject()->m_Count != b->AsObject()->m_Count)
+      return false;
+    for (size_t i = 0; i < a->AsObject()->m_Count; ++i)
+      if (0 != strcmp(a->AsObject()->m_Names[i], b->AsObject()->m_Names[i]) || !JsonEqual(a->AsObject()->m_Values[i], b->AsObject()->m_Values[i]))
+        return false;
+    return true;
+  }
+
+  return false;
+}
+
+TEST_F(JsonTest, LongNumbersAndControlWhitespace)
+{
+  // Numbers have no length limit, and \v and \f separate values like other whitespace.
+  std::string number = "1." + std::string(100, '0') + "1";
+  std::string doc = "[\f" + number + ",\v-" + number + "e-2\f]";
+
+  std::string unindexed_doc(doc);
+  const JsonValue* reference = JsonParseUnindexed(&unindexed_doc[0], &alloc, &scratch, error_msg);
+  ASSERT_STREQ("", error_msg);
+
+  const JsonValue* v = JsonParse(&doc[0], &alloc, &scratch, error_msg);
+  ASSERT_STREQ("", error_msg);
+  ASSERT_NE(nullptr, v);
+
+  const JsonArrayValue* array = v->AsArray();
+  ASSERT_NE(nullptr, array);
+  ASSERT_EQ(2, array->m_Count);
+  ASSERT_DOUBLE_EQ(1.0, array->m_Values[0]->AsNumber()->m_Number);
+  ASSERT_DOUBLE_EQ(-0.01, array->m_Values[1]->AsNumber()->m_Number);
+  ASSERT_TRUE(JsonEqual(reference, v));
+}
+
+// Builds a DAG shaped document, then times the indexed parser against the byte-at-a-time one.
+TEST_F(JsonTest, StructuralIndexBenchmark)
+{
+  std::string doc = "{\"Nodes\": [\n";
+  char node[512];
+  for (int i = 0; doc.size() < 32 * 1024 * 1024; ++i)
+  {
+    snprintf(node, sizeof node,
+      "  {\"Action\": \"cc -c src/module%d/file%d.c -o \\\"artifacts/obj/file%d.o\\\"\", \"Annotation\": \"Compile file%d.c\",\n"
+      "   \"Inputs\": [\"src/module%d/file%d.c\", \"src/include/common.h\"], \"Outputs\": [\"artifacts/obj/file%d.o\"],\n"
+      "   \"Deps\": [%d, %d, %d], \"OverwriteOutputs\": true, \"Scanner\": null, \"Weight\": -1.5e3},\n",
+      i % 97, i, i, i, i % 97, i, i, i / 2, i / 3, i / 5);
+    doc += node;
+  }
+  doc += "  {}\n]}\n";
+
+  MemAllocLinear big_alloc, big_scratch;
+  LinearAllocInit(&big_alloc, &heap, MB(256), "json benchmark alloc");
+  LinearAllocInit(&big_scratch, &heap, MB(64), "json benchmark scratch");
+
+  std::string unindexed_doc(doc);
+  uint64_t t0 = TimerGet();
+  const JsonValue* reference = JsonParseUnindexed(&unindexed_doc[0], &big_alloc, &big_scratch, error_msg);
+  double unindexed_mbs = doc.size() / (1024.0 * 1024.0) / TimerToSeconds(TimerGet() - t0);
+  ASSERT_STREQ("", error_msg);
+
+  std::string indexed_doc(doc);
+  t0 = TimerGet();
+  const JsonValue* indexed = JsonParse(&indexed_doc[0], &big_alloc, &big_scratch, error_msg);
+  double indexed_mbs = doc.size() / (1024.0 * 1024.0) / TimerToSeconds(TimerGet() - t0);
+  ASSERT_STREQ("", error_msg);
+
+  printf("json parse throughput: byte-at-a-time %.0f MB/s, %s index %.0f MB/s\n", unindexed_mbs, JsonStructuralBackendName(), indexed_mbs);
+
+  ASSERT_TRUE(JsonEqual(reference, indexed));
+
+  LinearAllocDestroy(&big_scratch);
+  LinearAllocDestroy(&big_alloc);
+}
+
+TEST_F(JsonTest, ReaderStreamsMembers)
+{
+  const std::string doc =
+    "{ \"Nodes\" : [ { \"Action\" : \"cc \\\"a b\\\"\", \"Deps\" : [1, 2] }, 17, \"x\", [] ],"
+    "  \"Name\" : \"tail\", \"Flag\" : true }";
+
+  // No terminator, and the buffer must come back untouched.
+  std::vector<char> buffer(doc.begin(), doc.end());
+  const std::vector<char> original = buffer;
+
+  std::string copy = doc;
+  const JsonValue* reference = JsonParse(&copy[0], &alloc, &scratch, error_msg);
+  ASSERT_NE(nullptr, reference);
+  const JsonArrayValue* reference_nodes = reference->Find("Nodes")->AsArray();
+
+  MemAllocLinear node_alloc;
+  LinearAllocInit(&node_alloc, &heap, MB(1), "json node alloc");
+
+  JsonReader* reader = JsonReaderCreate(&heap, &buffer[0], buffer.size(), &alloc);
+  ASSERT_TRUE(JsonReaderBeginObject(reader));
+
+  const char* key;
+  ASSERT_TRUE(JsonReaderNextKey(reader, &key));
+  ASSERT_STREQ("Nodes", key);
+  ASSERT_TRUE(JsonReaderBeginArray(reader));
+
+  size_t count = 0;
+  while (JsonReaderNextElement(reader))
+  {
+    MemAllocLinearScope scope(&node_alloc);
+    const JsonValue* node = JsonReaderParseValue(reader, &node_alloc, &scratch);
+    ASSERT_NE(nullptr, node);
+    ASSERT_LT(count, reference_nodes->m_Count);
+    ASSERT_TRUE(JsonEqual(reference_nodes->m_Values[count], node));
+    ++count;
+  }
+  ASSERT_EQ(reference_nodes->m_Count, count);
+
+  ASSERT_TRUE(JsonReaderNextKey(reader, &key));
+  ASSERT_STREQ("Name", key);
+  const JsonValue* name = JsonReaderParseValue(reader, &alloc, &scratch);
+  ASSERT_STREQ("tail", name->GetString());
+
+  ASSERT_TRUE(JsonReaderNextKey(reader, &key));
+  ASSERT_STREQ("Flag", key);
+  ASSERT_TRUE(JsonReaderParseValue(reader, &alloc, &scratch)->GetBoolean());
+
+  ASSERT_FALSE(JsonReaderNextKey(reader, &key));
+  ASSERT_STREQ("", JsonReaderError(reader));
+  ASSERT_TRUE(JsonReaderFinish(reader));
+  ASSERT_EQ(buffer.size(), JsonReaderOffset(reader));
+
+  JsonReaderDestroy(reader);
+  LinearAllocDestroy(&node_alloc);
+
+  ASSERT_TRUE(original == buffer);
+}
+
+TEST_F(JsonTest, ReaderErrors)
+{
+  const char* const bad[] = {
+    "[ 1 ]",
+    "{ \"a\" : 1 \"b\" : 2 }",
+    "{ \"a\" : [ 1 2 ] }",
+    "{ \"a\" : [ 1, ] }",
+    "{ 1 : 2 }",
+    "{ \"a\" : 1 } x",
+  };
+
+  for (const char* text : bad)
+  {
+    JsonReader* reader = JsonReaderCreate(&heap, text, strlen(text), &alloc);
+
+    bool ok = JsonReaderBeginObject(reader);
+    const char* key;
+    while (ok && JsonReaderNextKey(reader, &key))
+    {
+      const JsonValue* value = nullptr;
+      if (JsonReaderBeginArray(reader))
+      {
+        while (JsonReaderNextElement(reader))
+        {
+          if (!(value = JsonReaderParseValue(reader, &alloc, &scratch)))
+            break;
+        }
+      }
+      else
+      {
+        value = JsonReaderParseValue(reader, &alloc, &scratch);
+      }
+      ok = value != nullptr && !JsonReaderError(reader)[0];
+    }
+    ok = ok && !JsonReaderError(reader)[0] && JsonReaderFinish(reader);
+
+    EXPECT_FALSE(ok) << text;
+    EXPECT_STRNE("", JsonReaderError(reader)) << text;
+
+    JsonReaderDestroy(reader);
+  }
+}
@@ -0,0 +1,91 @@
+#include "Lz4.hpp"
+#include "TestHarness.hpp"
+
+#include <string.h>
+#include <vector>
+
+
+
+static void ExpectRoundTrip(const std::vector<uint8_t>& data)
+{
+  std::vector<uint8_t> packed(Lz4CompressBound(data.size()));
+  const size_t packed_size = Lz4Compress(data.data(), data.size(), packed.data(), packed.size());
+  ASSERT_NE(0u, packed_size);
+
+  std::vector<uint8_t> unpacked(data.size() + 1);
+  ASSERT_TRUE(Lz4Decompress(packed.data(), packed_size, unpacked.data(), data.size()));
+  EXPECT_TRUE(0 == memcmp(data.data(), unpacked.data(), data.size()));
+
+  // The decompressed size has to be given exactly.
+  EXPECT_FALSE(Lz4Decompress(packed.data(), packed_size, unpacked.data(), data.size() + 1));
+}
+
+TEST(Lz4, RoundTripsShortInput)
+{
+  ExpectRoundTrip(std::vector<uint8_t>());
+  ExpectRoundTrip(std::vector<uint8_t>(1, 'a'));
+  ExpectRoundTrip(std::vector<uint8_t>(13, 'a'));
+}
+
+TEST(Lz4, RoundTripsRepetitiveInput)
+{
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 100000; ++i)
+    data.push_back(uint8_t("frozen dag node "[i % 16]));
+
+  std::vector<uint8_t> packed(Lz4CompressBound(data.size()));
+  EXPECT_GT(data.size() / 50, Lz4Compress(data.data(), data.size(), packed.data(), packed.size()));
+
+  ExpectRoundTrip(data);
+}
+
+TEST(Lz4, RoundTripsMixedInput)
+{
+  // Runs of noise between repeats near and far, with long literal and match lengths.
+  std::vector<uint8_t> data;
+  uint32_t state = 12345;
+  for (int run = 0; run < 200; ++run)
+  {
+    for (int i = 0; i < run * 7; ++i)
+    {
+      state = state * 1103515245 + 12345;
+      data.push_back(uint8_t(state >> 16));
+    }
+
+    const size_t distance = 1 + (state >> 8) % 70000;
+    const size_t length = 4 + (state >> 4) % 600;
+    for (size_t i = 0; i < length; ++i)
+      data.push_back(data.size() >= distance ? data[data.size() - distance] : uint8_t(i));
+  }
+
+  ExpectRoundTrip(data);
+}
+
+TEST(Lz4, CompressFailsWhenOutputDoesNotFit)
+{
+  std::vector<uint8_t> data(1000);
+  uint32_t state = 1;
+  for (uint8_t& b : data)
+  {
+    state = state * 1103515245 + 12345;
+    b = uint8_t(state >> 16);
+  }
+
+  std::vector<uint8_t> packed(data.size());
+  EXPECT_EQ(0u, Lz4Compress(data.data(), data.size(), packed.data(), packed.size() - 1));
+}
+
+TEST(Lz4, RejectsDamagedInput)
+{
+  std::vector<uint8_t> data(4096, 'x');
+  std::vector<uint8_t> packed(Lz4CompressBound(data.size()));
+  const size_t packed_size = Lz4Compress(data.data(), data.size(), packed.data(), packed.size());
+  ASSERT_NE(0u, packed_size);
+
+  std::vector<uint8_t> unpacked(data.size());
+  EXPECT_FALSE(Lz4Decompress(packed.data(), packed_size - 1, unpacked.data(), unpacked.size()));
+
+  // A match reaching back before the start of the output.
+  const uint8_t bad[] = {0x10, 'a', 0x05, 0x00};
+  EXPECT_FALSE(Lz4Decompress(bad, sizeof bad, unpacked.data(), 5));
+}
@@ -0,0 +1,289 @@
+#include "ScanCache.hpp"
+#include "ScanData.hpp"
+#include "MemAllocLinear.hpp"
+#include "MemAllocHeap.hpp"
+#include "MemoryMappedFile.hpp"
+#include "Thread.hpp"
+#include "Stats.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+
+
+
+class ScanCacheTest : public ::testing::Test
+{
+protected:
+  MemAllocHeap heap;
+  MemAllocLinear alloc;
+  MemAllocLinear scratch;
+  ScanCache cache;
+  MemoryMappedFile mapping;
+  HashDigest scanner_guid;
+
+  static const char* CacheFileName() { return "test_scancache.tmp"; }
+  static const char* JournalFileName() { return "test_scancache.tmp.log"; }
+
+protected:
+  void SetUp() override
+  {
+    HeapInit(&heap);
+    LinearAllocInit(&alloc, &heap, MB(4), "scan cache alloc");
+    LinearAllocInit(&scratch, &heap, MB(1), "scan cache scratch");
+    ScanCacheInit(&cache, &heap, &alloc);
+    MmapFileInit(&mapping);
+    HashSingleString(&scanner_guid, "test scanner");
+  }
+
+  void TearDown() override
+  {
+    MmapFileDestroy(&mapping);
+    ScanCacheDestroy(&cache);
+    remove(CacheFileName());
+    remove(JournalFileName());
+    LinearAllocDestroy(&scratch);
+    LinearAllocDestroy(&alloc);
+    HeapDestroy(&heap);
+  }
+
+  HashDigest KeyFor(const char* filename)
+  {
+    HashDigest key;
+    ComputeScanCacheKey(&key, filename, scanner_guid);
+    return key;
+  }
+
+  void InsertFile(int i)
+  {
+    char name[64], include[64];
+    snprintf(name, sizeof name, "file%d.h", i);
+    snprintf(include, sizeof include, "include%d.h", i);
+    const char* includes[] = { include };
+    ScanCacheInsert(&cache, KeyFor(name), 1000 + i, includes, 1);
+  }
+
+  // Save the cache, then reopen it from the frozen file.
+  const Frozen::ScanData* SaveAndReload()
+  {
+    EXPECT_TRUE(ScanCacheSave(&cache, CacheFileName(), &heap));
+    ScanCacheDestroy(&cache);
+
+    MmapFileMap(&mapping, CacheFileName());
+    EXPECT_TRUE(MmapFileValid(&mapping));
+    const Frozen::ScanData* data = (const Frozen::ScanData*)mapping.m_Address;
+    EXPECT_TRUE(Frozen::ScanData::MagicNumber == data->m_MagicNumber);
+
+    LinearAllocReset(&alloc);
+    ScanCacheInit(&cache, &heap, &alloc);
+    ScanCacheSetCache(&cache, data);
+    return data;
+  }
+};
+
+TEST_F(ScanCacheTest, FrozenIndexFindsAllKeys)
+{
+  const int count = 1000;
+  for (int i = 0; i < count; ++i)
+    InsertFile(i);
+
+  const Frozen::ScanData* data = SaveAndReload();
+
+  ASSERT_EQ(count, data->m_EntryCount);
+  ASSERT_GE(data->m_IndexSize, uint32_t(count));
+  ASSERT_EQ(0u, data->m_IndexSize & (data->m_IndexSize - 1));
+
+  for (int i = 0; i < count; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "file%d.h", i);
+    int index = ScanCacheFindFrozen(data, KeyFor(name));
+    ASSERT_GE(index, 0);
+    ASSERT_TRUE(data->m_Keys[index] == KeyFor(name));
+  }
+
+  ASSERT_EQ(-1, ScanCacheFindFrozen(data, KeyFor("not-there.h")));
+}
+
+TEST_F(ScanCacheTest, LookupFromFrozenData)
+{
+  InsertFile(7);
+  SaveAndReload();
+
+  ScanCacheLookupResult result;
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file7.h"), 1007, &result, &scratch));
+  ASSERT_EQ(1, result.m_IncludedFileCount);
+  ASSERT_STREQ("include7.h", result.m_IncludedFiles[0].m_Filename);
+
+  // Stale timestamp must miss.
+  ASSERT_FALSE(ScanCacheLookup(&cache, KeyFor("file7.h"), 1008, &result, &scratch));
+}
+
+TEST_F(ScanCacheTest, JournalRoundTrip)
+{
+  InsertFile(1);
+  SaveAndReload();
+
+  ASSERT_FALSE(ScanCacheDirty(&cache));
+
+  InsertFile(2);
+  ASSERT_TRUE(ScanCacheDirty(&cache));
+  ASSERT_FALSE(ScanCacheShouldCompact(&cache));
+  ASSERT_TRUE(ScanCacheAppendJournal(&cache, JournalFileName()));
+  ASSERT_FALSE(ScanCacheDirty(&cache));
+
+  // Reopen: frozen file plus journal.
+  const Frozen::ScanData* data = (const Frozen::ScanData*)mapping.m_Address;
+  ScanCacheDestroy(&cache);
+  ScanCacheInit(&cache, &heap, &alloc);
+  ScanCacheSetCache(&cache, data);
+  ScanCacheLoadJournal(&cache, JournalFileName());
+
+  ASSERT_EQ(1u, cache.m_JournalRecordCount);
+  ASSERT_FALSE(ScanCacheDirty(&cache));
+
+  ScanCacheLookupResult result;
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file1.h"), 1001, &result, &scratch));
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file2.h"), 1002, &result, &scratch));
+  ASSERT_EQ(1, result.m_IncludedFileCount);
+  ASSERT_STREQ("include2.h", result.m_IncludedFiles[0].m_Filename);
+
+  // Appending more records keeps the existing ones.
+  InsertFile(3);
+  ASSERT_TRUE(ScanCacheAppendJournal(&cache, JournalFileName()));
+  ScanCacheDestroy(&cache);
+  ScanCacheInit(&cache, &heap, &alloc);
+  ScanCacheLoadJournal(&cache, JournalFileName());
+  ASSERT_EQ(2u, cache.m_JournalRecordCount);
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file2.h"), 1002, &result, &scratch));
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file3.h"), 1003, &result, &scratch));
+}
+
+TEST_F(ScanCacheTest, JournalWithDamagedTailIsRewritten)
+{
+  InsertFile(1);
+  ASSERT_TRUE(ScanCacheAppendJournal(&cache, JournalFileName()));
+
+  // Simulate a partially written record.
+  FILE* f = fopen(JournalFileName(), "ab");
+  ASSERT_NE(nullptr, f);
+  const char partial[] = "\x40\0\0\0garbage";
+  fwrite(partial, sizeof partial, 1, f);
+  fclose(f);
+
+  ScanCacheDestroy(&cache);
+  ScanCacheInit(&cache, &heap, &alloc);
+  ScanCacheLoadJournal(&cache, JournalFileName());
+
+  // The recovered record must be written again, to a fresh journal.
+  ASSERT_EQ(0u, cache.m_JournalRecordCount);
+  ASSERT_TRUE(ScanCacheDirty(&cache));
+
+  InsertFile(2);
+  ASSERT_TRUE(ScanCacheAppendJournal(&cache, JournalFileName()));
+  ScanCacheDestroy(&cache);
+  ScanCacheInit(&cache, &heap, &alloc);
+  ScanCacheLoadJournal(&cache, JournalFileName());
+
+  ScanCacheLookupResult result;
+  ASSERT_EQ(2u, cache.m_JournalRecordCount);
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file1.h"), 1001, &result, &scratch));
+  ASSERT_TRUE(ScanCacheLookup(&cache, KeyFor("file2.h"), 1002, &result, &scratch));
+}
+
+TEST_F(ScanCacheTest, ContentKeySurvivesTimestampChange)
+{
+  HashDigest digest_a, digest_b;
+  HashSingleString(&digest_a, "#include \"a.h\"\n");
+  HashSingleString(&digest_b, "#include \"b.h\"\n");
+
+  HashDigest content_key, other_key;
+  ComputeScanCacheContentKey(&content_key, KeyFor("file.h"), digest_a);
+  ComputeScanCacheContentKey(&other_key, KeyFor("file.h"), digest_b);
+  ASSERT_TRUE(content_key != other_key);
+  ASSERT_TRUE(content_key != KeyFor("file.h"));
+
+  const char* includes[] = { "a.h" };
+  ScanCacheInsert(&cache, KeyFor("file.h"), 1000, includes, 1);
+  ScanCacheInsert(&cache, content_key, kScanCacheContentTimestamp, includes, 1);
+  SaveAndReload();
+
+  // A new timestamp misses the path key, but the content key still hits.
+  ScanCacheLookupResult result;
+  ASSERT_FALSE(ScanCacheLookup(&cache, KeyFor("file.h"), 2000, &result, &scratch));
+  ASSERT_TRUE(ScanCacheLookup(&cache, content_key, kScanCacheContentTimestamp, &result, &scratch));
+  ASSERT_EQ(1, result.m_IncludedFileCount);
+  ASSERT_STREQ("a.h", result.m_IncludedFiles[0].m_Filename);
+  ASSERT_FALSE(ScanCacheLookup(&cache, other_key, kScanCacheContentTimestamp, &result, &scratch));
+}
+
+TEST_F(ScanCacheTest, SaveEvictsRecordsOverBudget)
+{
+  for (int i = 0; i < 5; ++i)
+    InsertFile(i);
+
+  const uint32_t dropped_before = g_Stats.m_ScanCacheEntriesDropped;
+  ScanCacheSetRetention(&cache, 7, 3);
+  const Frozen::ScanData* data = SaveAndReload();
+
+  ASSERT_EQ(3, data->m_EntryCount);
+  ASSERT_EQ(2u, g_Stats.m_ScanCacheEntriesDropped - dropped_before);
+}
+
+struct ScanCacheInsertJob
+{
+  ScanCache* m_Cache;
+  const HashDigest* m_Keys;
+  int m_Begin;
+  int m_End;
+};
+
+static ThreadRoutineReturnType TUNDRA_STDCALL InsertJobRoutine(void* param)
+{
+  ScanCacheInsertJob* job = (ScanCacheInsertJob*)param;
+  const char* includes[] = { "a.h", "b.h" };
+  for (int i = job->m_Begin; i < job->m_End; ++i)
+    ScanCacheInsert(job->m_Cache, job->m_Keys[i], i, includes, 2);
+  return 0;
+}
+
+TEST_F(ScanCacheTest, ConcurrentInserts)
+{
+  const int thread_count = 8;
+  const int per_thread = 2000;
+  const int count = thread_count * per_thread;
+
+  HashDigest* keys = HeapAllocateArray<HashDigest>(&heap, count);
+  for (int i = 0; i < count; ++i)
+  {
+    char name[64];
+    snprintf(name, sizeof name, "dir/file%d.h", i);
+    keys[i] = KeyFor(name);
+  }
+
+  ScanCacheInsertJob jobs[thread_count];
+  ThreadId threads[thread_count];
+  for (int t = 0; t < thread_count; ++t)
+  {
+    jobs[t].m_Cache = &cache;
+    jobs[t].m_Keys = keys;
+    jobs[t].m_Begin = t * per_thread;
+    jobs[t].m_End = (t + 1) * per_thread;
+    threads[t] = ThreadStart(InsertJobRoutine, &jobs[t], "scan cache test");
+  }
+
+  for (int t = 0; t < thread_count; ++t)
+    ThreadJoin(threads[t]);
+
+  for (int i = 0; i < count; ++i)
+  {
+    ScanCacheLookupResult result;
+    ASSERT_TRUE(ScanCacheLookup(&cache, keys[i], i, &result, &scratch));
+    ASSERT_EQ(2, result.m_IncludedFileCount);
+    ASSERT_STREQ("b.h", result.m_IncludedFiles[1].m_Filename);
+  }
+
+  const Frozen::ScanData* data = SaveAndReload();
+  ASSERT_EQ(count, data->m_EntryCount);
+
+  HeapFree(&heap, keys);
+}
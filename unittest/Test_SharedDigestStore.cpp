@@ -0,0 +1,110 @@
+#include "SharedDigestStore.hpp"
+#include "FileInfo.hpp"
+#include "TestHarness.hpp"
+
+#include <stdio.h>
+
+
+
+class SharedDigestStoreTest : public ::testing::Test
+{
+protected:
+  SharedDigestStore store;
+  SharedDigestStore other;
+
+  static const char* StoreFileName() { return "test_shareddigests.tmp"; }
+
+protected:
+  void SetUp() override
+  {
+    remove(StoreFileName());
+    SharedDigestStoreInit(&store);
+    SharedDigestStoreInit(&other);
+  }
+
+  void TearDown() override
+  {
+    SharedDigestStoreDestroy(&other);
+    SharedDigestStoreDestroy(&store);
+    remove(StoreFileName());
+  }
+
+  static FileIdentity IdentityFor(uint64_t inode)
+  {
+    FileIdentity identity;
+    identity.m_Device = 42;
+    identity.m_Inode = inode;
+    identity.m_Size = 1000 + inode;
+    identity.m_ModifiedTime = 123456;
+    identity.m_ChangeTime = 123457;
+    return identity;
+  }
+};
+
+TEST_F(SharedDigestStoreTest, RecordsAreVisibleThroughOtherMappings)
+{
+  ASSERT_TRUE(SharedDigestStoreOpen(&store, StoreFileName(), 1024));
+  ASSERT_TRUE(SharedDigestStoreOpen(&other, StoreFileName(), 1024));
+
+  HashDigest digest, result;
+  HashSingleString(&digest, "contents");
+
+  ASSERT_FALSE(SharedDigestStoreGet(&other, IdentityFor(1), &result));
+  SharedDigestStoreSet(&store, IdentityFor(1), digest);
+  ASSERT_TRUE(SharedDigestStoreGet(&other, IdentityFor(1), &result));
+  ASSERT_TRUE(digest == result);
+
+  // Any change to the identity is a miss.
+  FileIdentity touched = IdentityFor(1);
+  touched.m_ChangeTime++;
+  ASSERT_FALSE(SharedDigestStoreGet(&other, touched, &result));
+
+  // Records survive reopening.
+  SharedDigestStoreDestroy(&store);
+  ASSERT_TRUE(SharedDigestStoreOpen(&store, StoreFileName(), 1024));
+  ASSERT_TRUE(SharedDigestStoreGet(&store, IdentityFor(1), &result));
+  ASSERT_TRUE(digest == result);
+}
+
+TEST_F(SharedDigestStoreTest, FullTableReplacesRecords)
+{
+  ASSERT_TRUE(SharedDigestStoreOpen(&store, StoreFileName(), 16));
+
+  HashDigest digest, result;
+  HashSingleString(&digest, "contents");
+
+  for (uint64_t i = 0; i < 100; ++i)
+    SharedDigestStoreSet(&store, IdentityFor(i), digest);
+
+  int found = 0;
+  for (uint64_t i = 0; i < 100; ++i)
+    found += SharedDigestStoreGet(&store, IdentityFor(i), &result) ? 1 : 0;
+
+  ASSERT_GT(found, 0);
+  ASSERT_LE(found, 16);
+  ASSERT_TRUE(SharedDigestStoreGet(&store, IdentityFor(99), &result));
+}
+
+TEST_F(SharedDigestStoreTest, FileIdentityTracksChanges)
+{
+  const char* fn = "test_shareddigests_file.tmp";
+  FILE* f = fopen(fn, "wb");
+  ASSERT_NE(nullptr, f);
+  fputs("hello", f);
+  fclose(f);
+
+  FileIdentity a, b;
+  ASSERT_TRUE(GetFileIdentity(fn, &a));
+  ASSERT_EQ(5u, a.m_Size);
+
+  f = fopen(fn, "ab");
+  fputs(" world", f);
+  fclose(f);
+
+  ASSERT_TRUE(GetFileIdentity(fn, &b));
+  ASSERT_EQ(a.m_Inode, b.m_Inode);
+  ASSERT_EQ(11u, b.m_Size);
+
+  remove(fn);
+  ASSERT_FALSE(GetFileIdentity(fn, &b));
+}